@@ -27,3 +27,21 @@ def get_undistort_map(balance=0.0, scale_factor=1.0, new_dim=(320, 240)):
 def undistort(img, map1, map2):
     undistorted_img = cv2.remap(img, map1, map2, interpolation=cv2.INTER_LINEAR, borderMode=cv2.BORDER_CONSTANT)
     return undistorted_img
+
+def get_roi_map(map1, map2, roi, rotation=None, dim=(320, 240)):
+    """
+    Remap tables that undistort, rotate (cv2.ROTATE_90_CLOCKWISE / cv2.ROTATE_90_COUNTERCLOCKWISE or None) and crop in one cv2.remap call
+    roi = (y_start, y_end, x_start, x_end) in the rotated image
+    """
+    map_x, map_y = cv2.convertMaps(map1, map2, cv2.CV_32FC1)
+    rows, cols = np.mgrid[roi[0]:roi[1], roi[2]:roi[3]]
+
+    # Pixel of the undistorted image that ends up at (rows, cols) after the rotation
+    if rotation == cv2.ROTATE_90_CLOCKWISE:
+        src_y, src_x = dim[1] - 1 - cols, rows
+    elif rotation == cv2.ROTATE_90_COUNTERCLOCKWISE:
+        src_y, src_x = cols, dim[0] - 1 - rows
+    else:
+        src_y, src_x = rows, cols
+
+    return cv2.convertMaps(map_x[src_y, src_x], map_y[src_y, src_x], cv2.CV_16SC2)
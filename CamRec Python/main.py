@@ -1,28 +1,149 @@
-from ast import Pass
-from FisheyeCorrection.undistort import undistort, get_undistort_map
+from FisheyeCorrection.undistort import get_undistort_map, get_roi_map
+from collections import deque
+from concurrent.futures import ThreadPoolExecutor
 import cv2 as cv
 import pytesseract
 import re
 import subprocess 
 import numpy as np
 import serial
+import struct
+import threading
+import time
 
-def detect_letter(img):
-    pass
+try:
+    import tflite_runtime.interpreter as tflite
+except ImportError:
+    from tensorflow import lite as tflite
 
-def get_undist_roi(img, map1, map2, is_right=False):
-    img = undistort(img, map1, map2)
-    if is_right:
-        pass
-        img = cv.rotate(img, cv.ROTATE_90_COUNTERCLOCKWISE)
-    else:
-        pass
-        img = cv.rotate(img, cv.ROTATE_90_CLOCKWISE)
+# Must match CamRec.h
+SYNC_BYTE = 0x5A
+VERSION = 1
+FRAME_READY = 0
+FRAME_VICTIMS = 1
+BAUD_RATE = 1050000
 
-    #[y:y+h, x:x+w] the ":" means from to 
-    img = img[100:300, 50:190]
+# Region of interest in the rotated image (y start, y end, x start, x end)
+ROI = (100, 300, 50, 190)
+# Frame pairs in the worker pool before results are sent
+PIPELINE_DEPTH = 2
+# Letter classifier (see train.py)
+MODEL_PATH = 'converted_model.tflite'
+LETTER_SIZE = 100
 
-    return img
+# VictimCode
+NONE, HARMED, STABLE, UNHARMED, RED, GREEN, YELLOW = range(7)
+
+class LetterClassifier:
+    """
+    Int8 TfLite model for H, S, U - one interpreter per batch size, so both cameras go through a single invocation
+    and no tensor has to be reallocated between frames. Only used by one thread at a time.
+    """
+    # Output of the model: H, S, U, None
+    LOOKUP = (HARMED, STABLE, UNHARMED, NONE)
+
+    def __init__(self, model_path=MODEL_PATH):
+        self.interpreters = [self.make_interpreter(model_path, batch) for batch in (1, 2)]
+
+    @staticmethod
+    def make_interpreter(model_path, batch):
+        # The tflite runtime uses XNNPACK by default - one thread, the color workers need the other cores
+        interpreter = tflite.Interpreter(model_path=model_path, num_threads=1)
+        input_index = interpreter.get_input_details()[0]["index"]
+        interpreter.resize_tensor_input(input_index, [batch, LETTER_SIZE, LETTER_SIZE, 1])
+        interpreter.allocate_tensors()
+        return interpreter
+
+    @staticmethod
+    def prepare(img):
+        """
+        Grayscale and per image standardization like in training - can run in the color workers
+        """
+        img = cv.resize(cv.cvtColor(img, cv.COLOR_BGR2GRAY), (LETTER_SIZE, LETTER_SIZE), interpolation=cv.INTER_AREA)
+        img = np.float32(img) / 255.0
+        std = max(float(img.std()), 1.0 / LETTER_SIZE)
+        return np.reshape((img - img.mean()) / std, (LETTER_SIZE, LETTER_SIZE, 1))
+
+    def classify(self, images):
+        """
+        images are 1 or 2 prepared images, returns a list of (VictimCode, confidence)
+        """
+        interpreter = self.interpreters[len(images) - 1]
+        input_details = interpreter.get_input_details()[0]
+        output_details = interpreter.get_output_details()[0]
+        batch = np.stack(images)
+
+        # Quantize the input if the model doesn't do it itself
+        if input_details["dtype"] != np.float32:
+            scale, zero_point = input_details["quantization"]
+            info = np.iinfo(input_details["dtype"])
+            batch = np.clip(np.round(batch / scale + zero_point), info.min, info.max)
+
+        interpreter.set_tensor(input_details["index"], batch.astype(input_details["dtype"]))
+        interpreter.invoke()
+        output = np.float32(interpreter.get_tensor(output_details["index"]))
+
+        if output_details["dtype"] != np.float32:
+            scale, zero_point = output_details["quantization"]
+            output = (output - zero_point) * scale
+
+        results = []
+        for probs in output:
+            letter = int(np.argmax(probs))
+            results.append((self.LOOKUP[letter], float(np.clip(probs[letter], 0.0, 1.0))))
+        return results
+
+def get_roi_maps():
+    """
+    Remap tables for both cameras - undistort, rotate and crop only the region of interest
+    """
+    map1, map2 = get_undistort_map(0.8, 1.0)
+    left_maps = get_roi_map(map1, map2, ROI, cv.ROTATE_90_CLOCKWISE)
+    right_maps = get_roi_map(map1, map2, ROI, cv.ROTATE_90_COUNTERCLOCKWISE)
+    return left_maps, right_maps
+
+def open_camera(cam_id):
+    cam = cv.VideoCapture(int(cam_id))
+    if not cam.isOpened():   
+        raise IOError("Cannot open webcam")
+    cam.set(cv.CAP_PROP_FOURCC, cv.VideoWriter_fourcc('M','J','P','G'))
+    cam.set(cv.CAP_PROP_FRAME_WIDTH, 320)
+    cam.set(cv.CAP_PROP_FRAME_HEIGHT, 240)
+    cam.set(cv.CAP_PROP_BUFFERSIZE, 1)
+    return cam
+
+class CameraThread(threading.Thread):
+    """
+    Grabs frames continuously and keeps only the newest one with its capture time (ms)
+    """
+    def __init__(self, cam_id):
+        super().__init__(daemon=True)
+        self.cam = open_camera(cam_id)
+        self.condition = threading.Condition()
+        self.frame = None
+        self.capture_ms = 0
+        self.count = 0
+
+    def run(self):
+        while True:
+            ok, frame = self.cam.read()
+            capture_ms = int(time.monotonic() * 1000)
+            if not ok:
+                continue
+            with self.condition:
+                self.frame = frame
+                self.capture_ms = capture_ms
+                self.count += 1
+                self.condition.notify_all()
+
+    def get_newer(self, last_count, timeout=1.0):
+        """
+        Wait for a frame newer than last_count, returns (frame, capture time, count) - frame is None after the timeout
+        """
+        with self.condition:
+            if not self.condition.wait_for(lambda: self.count != last_count, timeout):
+                return None, 0, last_count
+            return self.frame, self.capture_ms, self.count
 
 def get_cam_serial():
     # Prepare the external command to extract serial number. 
@@ -40,23 +161,60 @@ def get_cam_serial():
     # LeftId is left rightId is right 
     return lcamId, rcamId
 
+def make_hue_classes():
+    """
+    Lookup table OpenCV hue (0 - 179) -> one hot row for red, yellow, green (nearest hue on the color circle)
+    """
+    classes = np.zeros((180, 3), np.float32)
+    for hue in range(180):
+        distances = [min(abs(hue - center), 180 - abs(hue - center)) for center in HUE_CENTERS]
+        classes[hue, int(np.argmin(distances))] = 1.0
+    return classes
+
+# Hue of red, yellow, green in OpenCV units (degree / 2)
+HUE_CENTERS = (0.0, 25.0, 37.25)
+HUE_CLASSES = make_hue_classes()
+# Minimum share of saturated pixels for a color victim
+MIN_COLORED_SHARE = 0.06
+
 def detect_Color(img):
     """
-    Returrns the detected color in the format: r = 1, y = 2, g = 3, None = 0
+    Returns the detected color in the format: r = 1, y = 2, g = 3, None = 0 and the confidence (0 to 1)
     """
     pixels = cv.cvtColor(img, cv.COLOR_BGR2HSV)
-    sat = pixels[:, :, 1]
-    mask = np.where(np.logical_and(sat > 100, pixels[:, :, 2] > 30), 255, 0)
-    if(np.count_nonzero(mask > 80) / 200.0 / 140.0 > 0.06):
-        hues = np.float32(pixels[np.where(mask > 127)][:, 0])
-        hues *= 2.0
-        hue_mean = np.arctan2(np.mean(np.sin(hues / 180 * np.pi)), np.mean(np.cos(hues / 180 * np.pi)))
-        r_sim = abs(np.arctan2(np.sin(hue_mean - np.pi * 2.0), np.cos(hue_mean - np.pi * 2.0)))
-        y_sim = abs(np.arctan2(np.sin(hue_mean - 0.873), np.cos(hue_mean - 0.873)))
-        g_sim = abs(np.arctan2(np.sin(hue_mean - 1.3), np.cos(hue_mean - 1.3))) 
-        return np.argmin([r_sim, y_sim, g_sim]) + 1
+    # Saturation > 100 and value > 30
+    mask = cv.inRange(pixels, (0, 101, 31), (179, 255, 255))
+    hist = cv.calcHist([pixels], [0], mask, [180], [0, 180])[:, 0]
+    colored = float(hist.sum())
+    share = colored / mask.size
+    if share > MIN_COLORED_SHARE:
+        # Votes of all saturated pixels - the confidence is the share of the winning color
+        votes = hist @ HUE_CLASSES
+        color = int(np.argmax(votes))
+        return color + 1, float(votes[color] / colored)
     
-    return 0
+    return 0, float(np.clip(1.0 - share / MIN_COLORED_SHARE, 0.0, 1.0))
+
+def crc8(data):
+    crc = 0
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xff if crc & 0x80 else (crc << 1) & 0xff
+    return crc
+
+def build_frame(frame_type, payload=b''):
+    body = struct.pack("<BBB", VERSION, frame_type, len(payload)) + payload
+    return bytes([SYNC_BYTE]) + body + bytes([crc8(body)])
+
+def build_victims_frame(sequence, capture_ms, left, right):
+    """
+    left and right are (VictimCode, confidence 0 to 1)
+    """
+    age = min(int(time.monotonic() * 1000) - capture_ms, 0xffff)
+    payload = struct.pack("<HIHBBBB", sequence & 0xffff, capture_ms & 0xffffffff, age,
+                          left[0], int(left[1] * 255), right[0], int(right[1] * 255))
+    return build_frame(FRAME_VICTIMS, payload)
 
 def read_all_serial(port):
     if port.in_waiting <= 0:
@@ -64,57 +222,77 @@ def read_all_serial(port):
     return port.read(port.in_waiting)
         
 
+def process(img, maps, color_lookup):
+    """
+    Detection of one camera in the worker pool - returns ((VictimCode, confidence), prepared letter image or None)
+    """
+    roi = cv.remap(img, maps[0], maps[1], interpolation=cv.INTER_LINEAR, borderMode=cv.BORDER_CONSTANT)
+    color, confidence = detect_Color(roi)
+    
+    # Letters only if there is no color victim
+    if color == 0:
+        return (NONE, confidence), LetterClassifier.prepare(roi)
+
+    return (color_lookup[color], confidence), None
+
+def finish_pair(classifier, left, right):
+    """
+    Letter stage - waits for the color results of both cameras and classifies the remaining letter images in one batch
+    """
+    results = [left.result(), right.result()]
+    images = [image for _, image in results if image is not None]
+    letters = iter(classifier.classify(images)) if images else None
+    return tuple(next(letters) if image is not None else out for out, image in results)
+
 def main():
-    port = serial.Serial('/dev/serial0', baudrate=9600, timeout=0)
-    letterLookup = [b'N',  b'H', b'S', b'U']
-    colorLookup = [b'N',  b'R', b'Y', b'G']
+    port = serial.Serial('/dev/serial0', baudrate=BAUD_RATE, timeout=0)
+    colorLookup = [NONE, RED, YELLOW, GREEN]
+    sequence = 0
 
-    map1, map2 = get_undistort_map(0.8, 1.0)
+    # The stages run in parallel threads - OpenCV must not start its own threads in each of them
+    cv.setNumThreads(1)
+
+    left_maps, right_maps = get_roi_maps()
+    classifier = LetterClassifier()
     
-    lcamId, rcamId=get_cam_serial()
-    caml = cv.VideoCapture(int(lcamId)) # left
-    if not caml.isOpened():   
-        raise IOError("Cannot open webcam")
-    caml.set(cv.CAP_PROP_FOURCC, cv.VideoWriter_fourcc('M','J','P','G'))
-    caml.set(cv.CAP_PROP_FRAME_WIDTH, 320)
-    caml.set(cv.CAP_PROP_FRAME_HEIGHT, 240)
+    lcamId, rcamId = get_cam_serial()
+    caml = CameraThread(lcamId) # left
+    camr = CameraThread(rcamId) # right
+    caml.start()
+    camr.start()
 
-    camr = cv.VideoCapture(int(rcamId)) # right
-    if not camr.isOpened():   
-        raise IOError("Cannot open webcam")
-    camr.set(cv.CAP_PROP_FOURCC, cv.VideoWriter_fourcc('M','J','P','G'))
-    camr.set(cv.CAP_PROP_FRAME_WIDTH, 320)
-    camr.set(cv.CAP_PROP_FRAME_HEIGHT, 240)
+    pool = ThreadPoolExecutor(max_workers=2)
+    # Own thread for the interpreter - the color workers already go on with the next frames
+    letter_pool = ThreadPoolExecutor(max_workers=1)
+    pending = deque()
+    lcount = rcount = 0
 
     while True:
         try:
             if b'B' in read_all_serial(port):
-                port.write(b'OK\n')
-            #get picture
-            _, imgl = caml.read()
-            _, imgr = camr.read()
-            #undistort and crop
+                port.write(build_frame(FRAME_READY))
 
-            imgr = get_undist_roi(imgr, map1, map2, True)
-            imgl = get_undist_roi(imgl, map1, map2, False)
+            # Newest pictures of both cameras - the capture threads already grab the next ones
+            imgl, lcapture_ms, lcount = caml.get_newer(lcount)
+            imgr, rcapture_ms, rcount = camr.get_newer(rcount)
 
-            rightOut = colorLookup[detect_Color(imgr)]
-            leftOut = colorLookup[detect_Color(imgl)]
-        
-        #if rightOut == colorLookup[0]:
-        #    rightOut = letterLookup[detect_letter(imgr)]
+            if imgl is None or imgr is None:
+                continue
+
+            left = pool.submit(process, imgl, left_maps, colorLookup)
+            right = pool.submit(process, imgr, right_maps, colorLookup)
+            pending.append((min(lcapture_ms, rcapture_ms), letter_pool.submit(finish_pair, classifier, left, right)))
 
-        #if leftOut == colorLookup[0]:
-        #    leftOut = letterLookup[detect_letter(imgl)]
-            port.write(b'l' + leftOut + b'r' + rightOut + b'\n')
-            print("l: " + str(leftOut), "r: " + str(rightOut))
+            # Send finished results in order
+            while pending and (len(pending) > PIPELINE_DEPTH or pending[0][1].done()):
+                capture_ms, result = pending.popleft()
+                leftOut, rightOut = result.result()
+                port.write(build_victims_frame(sequence, capture_ms, leftOut, rightOut))
+                sequence += 1
+                print("l: " + str(leftOut), "r: " + str(rightOut))
         except Exception as e:
             print(e)
             continue
 
-        
-    #cv.imwrite("testL.jpg", imgl)
-    #cv.imwrite("testR.jpg", imgr)
-
 if __name__ == "__main__":
     main()
@@ -0,0 +1,25 @@
+/*
+This part of the host build replaces the library header - JAFDSettings.h only uses its settings types
+*/
+
+#pragma once
+
+#include "arduino.h"
+
+typedef enum
+{
+	TCS34725_INTEGRATIONTIME_2_4MS = 0xFF,
+	TCS34725_INTEGRATIONTIME_24MS = 0xF6,
+	TCS34725_INTEGRATIONTIME_50MS = 0xEB,
+	TCS34725_INTEGRATIONTIME_101MS = 0xD5,
+	TCS34725_INTEGRATIONTIME_154MS = 0xC0,
+	TCS34725_INTEGRATIONTIME_700MS = 0x00
+} tcs34725IntegrationTime_t;
+
+typedef enum
+{
+	TCS34725_GAIN_1X = 0x00,
+	TCS34725_GAIN_4X = 0x01,
+	TCS34725_GAIN_16X = 0x02,
+	TCS34725_GAIN_60X = 0x03
+} tcs34725Gain_t;
\ No newline at end of file
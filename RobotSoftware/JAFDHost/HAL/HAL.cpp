@@ -0,0 +1,161 @@
+/*
+This part of the host build replaces the Arduino core of the Due - only what the sources of the host build use
+*/
+
+#include "arduino.h"
+
+#include <chrono>
+
+HostSerial Serial;
+HostSerialUSB SerialUSB;
+
+HostDWT hostDWT;
+HostCoreDebug hostCoreDebug;
+
+namespace
+{
+	uint64_t _time = 0;				// Simulated time (us)
+	uint32_t _cycleOffset = 0;		// Value of the cycle counter at host time 0
+	uint32_t _random = 1;			// State of the random generator
+
+	uint32_t hostCycles()
+	{
+		const auto now = std::chrono::steady_clock::now().time_since_epoch();
+
+		return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count() * (VARIANT_MCK / 1000000UL) / 1000UL);
+	}
+}
+
+uint32_t millis()
+{
+	return static_cast<uint32_t>(_time / 1000);
+}
+
+uint32_t micros()
+{
+	return static_cast<uint32_t>(_time);
+}
+
+void delay(const uint32_t ms)
+{
+	_time += ms * 1000ULL;
+}
+
+void delayMicroseconds(const uint32_t us)
+{
+	_time += us;
+}
+
+// Xorshift like MazeSim
+long random(const long max)
+{
+	_random ^= _random << 13;
+	_random ^= _random >> 17;
+	_random ^= _random << 5;
+
+	return (max > 0) ? static_cast<long>(_random % static_cast<uint32_t>(max)) : 0;
+}
+
+long random(const long min, const long max)
+{
+	return (max > min) ? min + random(max - min) : min;
+}
+
+void randomSeed(const unsigned long seed)
+{
+	_random = (seed != 0) ? static_cast<uint32_t>(seed) : 1;
+}
+
+namespace HAL
+{
+	void setTime(const uint32_t ms)
+	{
+		_time = ms * 1000ULL;
+	}
+
+	void advanceTime(const uint32_t ms)
+	{
+		_time += ms * 1000ULL;
+	}
+}
+
+HostCycleCounter::operator uint32_t() const
+{
+	return hostCycles() - _cycleOffset;
+}
+
+HostCycleCounter& HostCycleCounter::operator=(const uint32_t value)
+{
+	_cycleOffset = hostCycles() - value;
+
+	return *this;
+}
+
+size_t Print::write(const uint8_t* buffer, const size_t length)
+{
+	for (size_t i = 0; i < length; i++) write(buffer[i]);
+
+	return length;
+}
+
+size_t Print::print(const char* str)
+{
+	return write(reinterpret_cast<const uint8_t*>(str), strlen(str));
+}
+
+size_t Print::print(const char c)
+{
+	return write(static_cast<uint8_t>(c));
+}
+
+size_t Print::print(const long value, const int base)
+{
+	char buffer[32];
+
+	if (base == HEX) snprintf(buffer, sizeof(buffer), "%lX", static_cast<unsigned long>(value));
+	else snprintf(buffer, sizeof(buffer), "%ld", value);
+
+	return print(buffer);
+}
+
+size_t Print::print(const unsigned long value, const int base)
+{
+	char buffer[32];
+
+	snprintf(buffer, sizeof(buffer), (base == HEX) ? "%lX" : "%lu", value);
+
+	return print(buffer);
+}
+
+size_t Print::print(const double value, const int digits)
+{
+	char buffer[64];
+
+	snprintf(buffer, sizeof(buffer), "%.*f", digits, value);
+
+	return print(buffer);
+}
+
+size_t Print::println()
+{
+	return print("\n");
+}
+
+size_t HostSerial::write(const uint8_t byte)
+{
+	return fputc(byte, stdout) == EOF ? 0 : 1;
+}
+
+size_t HostSerialUSB::write(const uint8_t byte)
+{
+	output.push_back(byte);
+
+	return 1;
+}
+
+size_t HostSerialUSB::write(const uint8_t* buffer, const size_t length)
+{
+	output.insert(output.end(), buffer, buffer + length);
+
+	return length;
+}
\ No newline at end of file
@@ -0,0 +1,7 @@
+/*
+This part of the host build replaces the library header - the headers of JAFD only include it
+*/
+
+#pragma once
+
+#include "arduino.h"
\ No newline at end of file
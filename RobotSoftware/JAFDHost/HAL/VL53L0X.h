@@ -0,0 +1,9 @@
+/*
+This part of the host build replaces the library header - the headers of JAFD only declare objects of it
+*/
+
+#pragma once
+
+#include "arduino.h"
+
+class VL53L0X {};
\ No newline at end of file
@@ -0,0 +1,183 @@
+/*
+This part of the host build replaces the Arduino core of the Due - only what the sources of the host build use
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <stdlib.h>
+#include <vector>
+
+#define VARIANT_MCK 84000000UL		// MCK of the Due - the host cycle counter counts in these cycles
+
+#define PI 3.1415926535897932384626433832795
+#define DEG_TO_RAD 0.017453292519943295769236907684886
+#define RAD_TO_DEG 57.295779513082320876798154814105
+
+#define M_TWOPI (M_PI * 2.0)		// From the math.h of the ARM toolchain
+
+// Peripheral IDs of the SAM3X - only for the enums of Interrupts.h
+#define ID_PIOA 11
+#define ID_PIOB 12
+#define ID_PIOC 13
+#define ID_PIOD 14
+
+#define DEC 10
+#define HEX 16
+
+// Analog pins of the Due
+#define A0 54
+#define A1 55
+#define A2 56
+#define A3 57
+#define A4 58
+#define A5 59
+#define A6 60
+#define A7 61
+#define A8 62
+#define A9 63
+#define A10 64
+#define A11 65
+
+template<typename T>
+T constrain(const T value, const T low, const T high)
+{
+	return (value < low) ? low : ((value > high) ? high : value);
+}
+
+// Same sequence on every run - the seed is fixed
+long random(const long max);
+long random(const long min, const long max);
+void randomSeed(const unsigned long seed);
+
+// Simulated time - only advances by delay() or HAL::advanceTime(), so host runs are deterministic
+uint32_t millis();
+uint32_t micros();
+void delay(const uint32_t ms);
+void delayMicroseconds(const uint32_t us);
+
+class Print
+{
+public:
+	virtual size_t write(const uint8_t byte) = 0;
+	virtual size_t write(const uint8_t* buffer, const size_t length);
+
+	size_t print(const char* str);
+	size_t print(const char c);
+	size_t print(const long value, const int base = DEC);
+	size_t print(const unsigned long value, const int base = DEC);
+	size_t print(const int value, const int base = DEC) { return print(static_cast<long>(value), base); }
+	size_t print(const unsigned int value, const int base = DEC) { return print(static_cast<unsigned long>(value), base); }
+	size_t print(const unsigned char value, const int base = DEC) { return print(static_cast<unsigned long>(value), base); }
+	size_t print(const double value, const int digits = 2);
+
+	size_t println();
+
+	template<typename T>
+	size_t println(const T value)
+	{
+		return print(value) + println();
+	}
+
+	template<typename T>
+	size_t println(const T value, const int format)
+	{
+		return print(value, format) + println();
+	}
+
+	virtual ~Print() = default;
+};
+
+class Stream : public Print
+{
+public:
+	virtual int available() = 0;
+	virtual int read() = 0;
+	virtual int peek() = 0;
+};
+
+// Serial prints to stdout and never receives anything
+class HostSerial : public Stream
+{
+public:
+	void begin(const unsigned long baudrate) {}
+	size_t write(const uint8_t byte);
+	int available() { return 0; }
+	int read() { return -1; }
+	int peek() { return -1; }
+	operator bool() { return true; }
+};
+
+// SerialUSB collects the written bytes (telemetry records) in a buffer
+class HostSerialUSB : public Stream
+{
+public:
+	std::vector<uint8_t> output;
+
+	void begin(const unsigned long baudrate) {}
+	size_t write(const uint8_t byte);
+	size_t write(const uint8_t* buffer, const size_t length);
+	int available() { return 0; }
+	int read() { return -1; }
+	int peek() { return -1; }
+	operator bool() { return true; }
+};
+
+extern HostSerial Serial;
+extern HostSerialUSB SerialUSB;
+
+// Interrupts don't exist on the host - all code runs in one thread
+inline void __disable_irq() {}
+inline void __enable_irq() {}
+inline void __DMB() {}
+
+inline uint32_t __LDREXW(volatile uint32_t* address)
+{
+	return *address;
+}
+
+inline uint32_t __STREXW(const uint32_t value, volatile uint32_t* address)
+{
+	*address = value;
+	return 0;
+}
+
+inline void __CLREX() {}
+
+// DWT cycle counter - real host time in MCK cycles, so the Profiler shows the run time on the host
+class HostCycleCounter
+{
+public:
+	operator uint32_t() const;
+	HostCycleCounter& operator=(const uint32_t value);
+};
+
+struct HostDWT
+{
+	uint32_t CTRL;
+	HostCycleCounter CYCCNT;
+};
+
+struct HostCoreDebug
+{
+	uint32_t DEMCR;
+};
+
+#define DWT_CTRL_CYCCNTENA_Msk (1UL << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
+
+extern HostDWT hostDWT;
+extern HostCoreDebug hostCoreDebug;
+
+#define DWT (&hostDWT)
+#define CoreDebug (&hostCoreDebug)
+
+namespace HAL
+{
+	void setTime(const uint32_t ms);			// Set the simulated time
+	void advanceTime(const uint32_t ms);		// Let the simulated time pass
+}
\ No newline at end of file
@@ -0,0 +1,30 @@
+/*
+This part of the host build is responsible for the simulated robot behind the replaced hardware modules (see Backends.cpp)
+*/
+
+#pragma once
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include "../../JAFDProgram/JAFD/header/AllDatatypes.h"
+#include "../../JAFDProgram/JAFD/header/DistanceSensors.h"
+
+namespace JAFD
+{
+	// Ideal robot on a level floor: the wheels follow MotorControl::setSpeeds() at once, the Bno055 integrates the heading of the wheels
+	// The distance sensors only deliver the queued samples; colour, heat and checkpoint do nothing
+	namespace Backends
+	{
+		void reset(const Vec2f position, const float heading);	// Robot stands at the position (cm) with the global heading (rad)
+		void step(const uint8_t freq);			// Let one period of a job with the frequency pass (wheels, pose and Bno055)
+
+		ReturnCode queueDistSample(const DistanceSensors::DistSample& sample);	// Returned by DistanceSensors::getSample() - error if the queue is full
+
+		Vec2f getPosition();					// True position of the simulated robot (cm)
+		float getHeading();						// True global heading of the simulated robot (rad)
+	}
+}
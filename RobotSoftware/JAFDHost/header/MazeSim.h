@@ -0,0 +1,43 @@
+/*
+This part of the host build is responsible for the maze simulator and the benchmark of the path planning
+*/
+
+#pragma once
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include "../../JAFDProgram/JAFD/header/AllDatatypes.h"
+
+namespace JAFD
+{
+	// Deterministic mazes (same seed = same maze) explored with the real planners of MazeMapping
+	// The simulated robot senses the true cell it stands on and drives the planned paths; the run time uses the costs of the PathPlanner (0.1 s)
+	// Only runs on the host - MazeMapping stores the maze in the RAM backend of the SpiNVSRAM there
+	namespace MazeSim
+	{
+		// Result of one simulated run
+		struct RunResult
+		{
+			uint16_t reachableCells;	// Cells that can be reached from the start
+			uint16_t visitedCells;		// Cells visited by the exploration
+			uint16_t planCalls;			// Calls of the planners while the robot stands
+			uint32_t planCycles;		// Cycles of all planner calls (MCK)
+			uint32_t maxPlanCycles;		// Cycles of the slowest call
+			uint32_t runTime;			// Simulated time of exploration and return to the start (0.1 s)
+		};
+
+		// Generate a maze with the start in the corner (0, 0)
+		ReturnCode generate(const uint32_t seed, const uint8_t width, const uint8_t height);
+
+		// Explore the generated maze and drive back to the start
+		ReturnCode run(RunResult& result);
+
+		// Generate and run the corpus of JAFDSettings::MazeSim and print the results and the profiler over Serial
+		// Error if a run didn't get back to the start
+		ReturnCode benchmark();
+	}
+}
\ No newline at end of file
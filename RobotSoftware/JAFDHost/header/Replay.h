@@ -0,0 +1,26 @@
+/*
+This part of the host build is responsible for replaying recorded telemetry through the sensor fusion
+*/
+
+#pragma once
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include "../../JAFDProgram/JAFD/header/AllDatatypes.h"
+
+namespace JAFD
+{
+	// Reads a recorded telemetry stream (same framing as Telemetry) and feeds filterInputs, distances and fusionTime records through SensorFusion in the recorded order
+	// The last robotState record before the first filterInputs record sets the start pose, the robotState records after every step are the reference
+	// Only runs on the host - the map is filled from scratch, the robot and its checkpoint aren't touched
+	namespace Replay
+	{
+		// Replay the file and print the replayed steps and the maximum differences to the recorded robot states over Serial
+		// Error if the file can't be read, has bad records or a replayed state differs more than JAFDSettings::Replay::maxStateDifference
+		ReturnCode run(const char* fileName);
+	}
+}
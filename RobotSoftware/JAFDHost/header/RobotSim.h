@@ -0,0 +1,30 @@
+/*
+This part of the host build is responsible for the benchmarks of the sensor fusion and the driving tasks
+*/
+
+#pragma once
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include "../../JAFDProgram/JAFD/header/AllDatatypes.h"
+
+namespace JAFD
+{
+	// SmoothDriving and SensorFusion in a closed loop with the simulated robot of Backends
+	// The jobs run like the scheduler of the robot calls them (JAFDSettings::RobotSim::jobFreq), the main loop plans ahead after every period
+	namespace RobotSim
+	{
+		// Drive the task corpus and print the end pose errors and the cycles of planning and updateSpeeds() over Serial
+		// Error if a task can't be started, doesn't finish or ends too far off
+		ReturnCode benchmarkDriving();
+
+		// Drive through a corridor with samples of the short distance sensors and print the cycles of the fusion over Serial
+		// Error if the fused pose drifts away from the simulated one
+		// The telemetry records of the run stay in SerialUSB, so they can be written to a file and replayed
+		ReturnCode benchmarkFusion();
+	}
+}
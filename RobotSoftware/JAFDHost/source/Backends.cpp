@@ -0,0 +1,199 @@
+/*
+This part of the host build replaces the modules of JAFD that need the hardware of the robot
+*/
+
+#include "../../JAFDProgram/JAFDSettings.h"
+#include "../../JAFDProgram/JAFD/header/SmallThings.h"
+#include "../../JAFDProgram/JAFD/header/MotorControl.h"
+#include "../../JAFDProgram/JAFD/header/Bno055.h"
+#include "../../JAFDProgram/JAFD/header/DistanceSensors.h"
+#include "../../JAFDProgram/JAFD/header/TCS34725.h"
+#include "../../JAFDProgram/JAFD/header/HeatSensor.h"
+#include "../../JAFDProgram/JAFD/header/Checkpoint.h"
+#include "../../JAFDProgram/JAFD/header/RobotLogic.h"
+#include "../../JAFDProgram/JAFD/header/Math.h"
+#include "../header/Backends.h"
+
+namespace JAFD
+{
+	// Only the accounted buffers - the host has no painted stack
+	namespace MemWatcher
+	{
+		namespace
+		{
+			uint32_t _bufferRam = 0;
+			uint8_t _numBuffers = 0;
+		}
+
+		ReturnCode addBuffer(const char* name, const uint32_t size)
+		{
+			if (_numBuffers >= JAFDSettings::MemWatcher::maxBuffers) return ReturnCode::error;
+
+			_numBuffers++;
+			_bufferRam += size;
+
+			return ReturnCode::ok;
+		}
+
+		uint32_t getBufferRam()
+		{
+			return _bufferRam;
+		}
+	}
+	namespace Backends
+	{
+		namespace
+		{
+			constexpr uint8_t maxQueuedSamples = 32;
+
+			WheelSpeeds _setSpeeds;			// Last speeds of MotorControl::setSpeeds()
+			Vec2f _position;				// True position (cm)
+			float _heading = 0.0f;			// True global heading (rad)
+			float _rotSpeed = 0.0f;			// Rotation speed (deg/s)
+			float _bnoTare = 0.0f;			// Global heading of the Bno055 at heading 0
+
+			DistanceSensors::DistSample _samples[maxQueuedSamples];
+			uint8_t _firstSample = 0;
+			uint8_t _numSamples = 0;
+		}
+
+		void reset(const Vec2f position, const float heading)
+		{
+			_setSpeeds = WheelSpeeds();
+			_position = position;
+			_heading = heading;
+			_rotSpeed = 0.0f;
+			_bnoTare = 0.0f;
+			_firstSample = 0;
+			_numSamples = 0;
+		}
+
+		void step(const uint8_t freq)
+		{
+			const float angularVel = (_setSpeeds.right - _setSpeeds.left) / JAFDSettings::Mechanics::wheelDistance;
+			const float forwardVel = (_setSpeeds.left + _setSpeeds.right) / 2.0f;
+
+			// Middle of the heading over the period
+			float sinHeading, cosHeading;
+			fastSinCos(_heading + angularVel / freq / 2.0f, sinHeading, cosHeading);
+
+			_position += Vec2f(cosHeading, sinHeading) * (forwardVel / freq);
+			_heading += angularVel / freq;
+			_rotSpeed = angularVel * RAD_TO_DEG;
+		}
+
+		ReturnCode queueDistSample(const DistanceSensors::DistSample& sample)
+		{
+			if (_numSamples >= maxQueuedSamples) return ReturnCode::error;
+
+			_samples[(_firstSample + _numSamples++) % maxQueuedSamples] = sample;
+
+			return ReturnCode::ok;
+		}
+
+		Vec2f getPosition()
+		{
+			return _position;
+		}
+
+		float getHeading()
+		{
+			return _heading;
+		}
+	}
+
+	namespace MotorControl
+	{
+		void setSpeeds(const WheelSpeeds wheelSpeeds)
+		{
+			Backends::_setSpeeds = wheelSpeeds;
+		}
+
+		FloatWheelSpeeds getFloatSpeeds()
+		{
+			return FloatWheelSpeeds(Backends::_setSpeeds.left, Backends::_setSpeeds.right);
+		}
+	}
+
+	namespace Bno055
+	{
+		ReturnCode startUpdate()
+		{
+			return ReturnCode::ok;
+		}
+
+		ReturnCode finishUpdate()
+		{
+			return ReturnCode::ok;
+		}
+
+		void tare(float globalHeading)
+		{
+			Backends::_bnoTare = Backends::_heading - globalHeading;
+		}
+
+		Vec3f getForwardVec()
+		{
+			float sinHeading, cosHeading;
+			fastSinCos(Backends::_heading - Backends::_bnoTare, sinHeading, cosHeading);
+
+			return Vec3f(cosHeading, sinHeading, 0.0f);
+		}
+
+		float getRotSpeed()
+		{
+			return Backends::_rotSpeed;
+		}
+	}
+
+	namespace DistanceSensors
+	{
+		void updateDistSensors() {}
+
+		ReturnCode getSample(DistSample* sample)
+		{
+			if (Backends::_numSamples == 0) return ReturnCode::error;
+
+			*sample = Backends::_samples[Backends::_firstSample];
+
+			Backends::_firstSample = (Backends::_firstSample + 1) % Backends::maxQueuedSamples;
+			Backends::_numSamples--;
+
+			return ReturnCode::ok;
+		}
+	}
+
+	namespace ColorSensor
+	{
+		bool dataIsReady()
+		{
+			return false;
+		}
+
+		void getData(uint16_t* colorTemp, uint16_t* lux) {}
+	}
+
+	namespace HeatSensor
+	{
+		void queueUpdate() {}
+
+		bool finishUpdate(HeatSensData& data)
+		{
+			return false;
+		}
+	}
+
+	// The host keeps no snapshot - a run always starts from scratch
+	namespace Checkpoint
+	{
+		ReturnCode store(const MapCoordinate coor, const AbsoluteDir heading)
+		{
+			return ReturnCode::ok;
+		}
+	}
+
+	namespace RobotLogic
+	{
+		void timeBetweenUpdate() {}
+	}
+}
@@ -0,0 +1,70 @@
+/*
+This part of the host build is responsible for running the benchmarks - the name of the benchmark is the first argument
+*/
+
+#include "../../JAFDProgram/JAFD/header/Profiler.h"
+#include "../../JAFDProgram/JAFD/header/Math.h"
+#include "../header/MazeSim.h"
+#include "../header/RobotSim.h"
+#include "../header/Replay.h"
+
+#include <stdio.h>
+
+using namespace JAFD;
+
+namespace
+{
+	// Telemetry records of the benchmark, so the run can be replayed
+	bool writeRecording(const char* fileName)
+	{
+		FILE* file = fopen(fileName, "wb");
+
+		if (file == nullptr) return false;
+
+		const bool ok = fwrite(SerialUSB.output.data(), 1, SerialUSB.output.size(), file) == SerialUSB.output.size();
+
+		return fclose(file) == 0 && ok;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Profiler::setup();
+
+	if (argc >= 2 && strcmp(argv[1], "mazesim") == 0)
+	{
+		return (MazeSim::benchmark() == ReturnCode::ok) ? 0 : 1;
+	}
+
+	if (argc >= 2 && strcmp(argv[1], "driving") == 0)
+	{
+		return (RobotSim::benchmarkDriving() == ReturnCode::ok) ? 0 : 1;
+	}
+
+	if (argc >= 2 && strcmp(argv[1], "fusion") == 0)
+	{
+		if (RobotSim::benchmarkFusion() != ReturnCode::ok) return 1;
+
+		if (argc >= 3 && !writeRecording(argv[2]))
+		{
+			Serial.println("Can't write the recording");
+			return 1;
+		}
+
+		return 0;
+	}
+
+	if (argc >= 3 && strcmp(argv[1], "replay") == 0)
+	{
+		return (Replay::run(argv[2]) == ReturnCode::ok) ? 0 : 1;
+	}
+
+	if (argc >= 2 && strcmp(argv[1], "math") == 0)
+	{
+		return (benchmarkFastMath() == ReturnCode::ok) ? 0 : 1;
+	}
+
+	Serial.println("Usage: JAFDBench mazesim | driving | fusion [recording] | math | replay <recording>");
+
+	return 2;
+}
\ No newline at end of file
@@ -0,0 +1,390 @@
+/*
+This part of the host build is responsible for the maze simulator and the benchmark of the path planning
+*/
+
+#include "../../JAFDProgram/JAFDSettings.h"
+#include "../../JAFDProgram/JAFD/header/MazeMapping.h"
+#include "../../JAFDProgram/JAFD/header/Profiler.h"
+#include "../header/MazeSim.h"
+
+#include <string.h>
+
+namespace JAFD
+{
+	namespace MazeSim
+	{
+		namespace
+		{
+			// True maze
+			uint8_t _connections[JAFDSettings::MazeSim::maxSize][JAFDSettings::MazeSim::maxSize];	// EntranceDirections
+			uint8_t _states[JAFDSettings::MazeSim::maxSize][JAFDSettings::MazeSim::maxSize];		// CellState (only blackTile and bump)
+			uint8_t _width = 0;
+			uint8_t _height = 0;
+
+			uint32_t _random = 1;		// State of the random generator
+
+			Profiler::SectionID explorePlanSection = Profiler::invalidSection;	// Planning of the exploration when the robot stands (Exploration)
+			Profiler::SectionID aheadPlanSection = Profiler::invalidSection;	// Planning of the next decision while driving (not in the results)
+			Profiler::SectionID homePlanSection = Profiler::invalidSection;		// Planning of the way back (PathPlanner)
+
+			// Xorshift - same mazes on every platform and independent of random()
+			uint32_t nextRandom()
+			{
+				_random ^= _random << 13;
+				_random ^= _random >> 17;
+				_random ^= _random << 5;
+
+				return _random;
+			}
+
+			bool chance(const uint8_t percent)
+			{
+				return nextRandom() % 100 < percent;
+			}
+
+			// Same axes as MazeMapping (north = +y, east = +x)
+			MapCoordinate neighbour(const MapCoordinate coor, const AbsoluteDir dir)
+			{
+				switch (dir)
+				{
+				case AbsoluteDir::north:
+					return MapCoordinate{ coor.x, static_cast<int8_t>(coor.y + 1) };
+				case AbsoluteDir::east:
+					return MapCoordinate{ static_cast<int8_t>(coor.x + 1), coor.y };
+				case AbsoluteDir::south:
+					return MapCoordinate{ coor.x, static_cast<int8_t>(coor.y - 1) };
+				default:
+					return MapCoordinate{ static_cast<int8_t>(coor.x - 1), coor.y };
+				}
+			}
+
+			inline uint8_t toEntrance(const AbsoluteDir dir)
+			{
+				return 1 << static_cast<uint8_t>(dir);
+			}
+
+			inline AbsoluteDir opposite(const AbsoluteDir dir)
+			{
+				return static_cast<AbsoluteDir>((static_cast<uint8_t>(dir) + 2) & 0b11);
+			}
+
+			AbsoluteDir fromEntrance(const uint8_t entrance)
+			{
+				if (entrance & EntranceDirections::north) return AbsoluteDir::north;
+				else if (entrance & EntranceDirections::east) return AbsoluteDir::east;
+				else if (entrance & EntranceDirections::south) return AbsoluteDir::south;
+				else return AbsoluteDir::west;
+			}
+
+			inline bool inMaze(const MapCoordinate coor)
+			{
+				return coor.x >= 0 && coor.x < _width && coor.y >= 0 && coor.y < _height;
+			}
+
+			// Remove the wall between a cell and its neighbour
+			void connect(const MapCoordinate coor, const AbsoluteDir dir)
+			{
+				const MapCoordinate other = neighbour(coor, dir);
+
+				_connections[coor.x][coor.y] |= toEntrance(dir);
+				_connections[other.x][other.y] |= toEntrance(opposite(dir));
+			}
+
+			// Same as in RobotLogic
+			bool isPassable(GridCell cell)
+			{
+				return !(cell.cellState & CellState::blackTile);
+			}
+
+			// Time to drive to the next cell (0.1 s) - costs of the PathPlanner
+			uint16_t stepTime(const AbsoluteDir heading, const AbsoluteDir dir, const uint8_t state)
+			{
+				uint16_t time = JAFDSettings::MazeMapping::PathPlanner::straightCost;
+
+				const uint8_t turn = (static_cast<uint8_t>(dir) - static_cast<uint8_t>(heading)) & 0b11;
+
+				if (turn == 2) time += JAFDSettings::MazeMapping::PathPlanner::turn180Cost;
+				else if (turn != 0) time += JAFDSettings::MazeMapping::PathPlanner::turn90Cost;
+
+				if (state & CellState::bump) time += JAFDSettings::MazeMapping::PathPlanner::bumpCost;
+
+				return time;
+			}
+
+			// The robot senses the cell it stands on
+			void sense(const MapCoordinate coor)
+			{
+				MazeMapping::setGridCell(GridCell(_connections[coor.x][coor.y], CellState::visited | _states[coor.x][coor.y]), coor);
+			}
+
+			// Cells that can be reached from the start without black tiles
+			uint16_t countReachable()
+			{
+				bool reached[JAFDSettings::MazeSim::maxSize][JAFDSettings::MazeSim::maxSize] = { { false } };
+				MapCoordinate stack[JAFDSettings::MazeSim::maxSize * JAFDSettings::MazeSim::maxSize];
+				uint16_t size = 0;
+				uint16_t count = 1;
+
+				reached[0][0] = true;
+				stack[size++] = homePosition;
+
+				while (size > 0)
+				{
+					const MapCoordinate coor = stack[--size];
+
+					for (uint8_t i = 0; i < 4; i++)
+					{
+						const AbsoluteDir dir = static_cast<AbsoluteDir>(i);
+						const MapCoordinate next = neighbour(coor, dir);
+
+						if (!(_connections[coor.x][coor.y] & toEntrance(dir)) || reached[next.x][next.y] || (_states[next.x][next.y] & CellState::blackTile)) continue;
+
+						reached[next.x][next.y] = true;
+						stack[size++] = next;
+						count++;
+					}
+				}
+
+				return count;
+			}
+
+			void addPlanCycles(RunResult& result, const Profiler::SectionID section, const uint32_t cycles)
+			{
+				Profiler::record(section, cycles);
+
+				result.planCalls++;
+				result.planCycles += cycles;
+
+				if (cycles > result.maxPlanCycles) result.maxPlanCycles = cycles;
+			}
+
+			// Drive along a planned path like FollowPath (only the first JAFDSettings::SmoothDriving::maxPathLength steps) - false if the robot had to turn back at a black tile
+			bool drive(const uint8_t* directions, MapCoordinate& position, AbsoluteDir& heading, RunResult& result)
+			{
+				for (uint8_t i = 0; i < JAFDSettings::SmoothDriving::maxPathLength && directions[i] != EntranceDirections::nowhere; i++)
+				{
+					const AbsoluteDir dir = fromEntrance(directions[i]);
+					const MapCoordinate next = neighbour(position, dir);
+					const uint8_t state = _states[next.x][next.y];
+
+					result.runTime += stepTime(heading, dir, state);
+					heading = dir;
+
+					// Detected on the tile - back to the last cell
+					if (state & CellState::blackTile)
+					{
+						MazeMapping::setGridCell(GridCell(EntranceDirections::nowhere, CellState::visited | CellState::blackTile), next);
+
+						result.runTime += JAFDSettings::MazeMapping::PathPlanner::straightCost;
+						return false;
+					}
+
+					GridCell cell;
+					MazeMapping::getGridCell(&cell, next);
+
+					if (!(cell.cellState & CellState::visited)) result.visitedCells++;
+
+					position = next;
+					sense(position);
+				}
+
+				return true;
+			}
+		}
+
+		ReturnCode generate(const uint32_t seed, const uint8_t width, const uint8_t height)
+		{
+			if (width == 0 || height == 0 || width > JAFDSettings::MazeSim::maxSize || height > JAFDSettings::MazeSim::maxSize) return ReturnCode::error;
+
+			bool visited[JAFDSettings::MazeSim::maxSize][JAFDSettings::MazeSim::maxSize] = { { false } };
+			MapCoordinate stack[JAFDSettings::MazeSim::maxSize * JAFDSettings::MazeSim::maxSize];
+			uint16_t size = 0;
+
+			_width = width;
+			_height = height;
+			_random = (seed != 0) ? seed : 1;
+
+			memset(_connections, 0, sizeof(_connections));
+			memset(_states, 0, sizeof(_states));
+
+			// Depth first search - every cell can be reached on exactly one way
+			visited[0][0] = true;
+			stack[size++] = homePosition;
+
+			while (size > 0)
+			{
+				const MapCoordinate coor = stack[size - 1];
+				AbsoluteDir options[4];
+				uint8_t numOptions = 0;
+
+				for (uint8_t i = 0; i < 4; i++)
+				{
+					const MapCoordinate next = neighbour(coor, static_cast<AbsoluteDir>(i));
+
+					if (inMaze(next) && !visited[next.x][next.y]) options[numOptions++] = static_cast<AbsoluteDir>(i);
+				}
+
+				if (numOptions == 0)
+				{
+					size--;
+					continue;
+				}
+
+				const AbsoluteDir dir = options[nextRandom() % numOptions];
+				const MapCoordinate next = neighbour(coor, dir);
+
+				connect(coor, dir);
+
+				visited[next.x][next.y] = true;
+				stack[size++] = next;
+			}
+
+			// Loops, black tiles and speed bumps (never on the start)
+			for (int8_t x = 0; x < width; x++)
+			{
+				for (int8_t y = 0; y < height; y++)
+				{
+					const MapCoordinate coor{ x, y };
+
+					if (x + 1 < width && !(_connections[x][y] & EntranceDirections::east) && chance(JAFDSettings::MazeSim::loopShare)) connect(coor, AbsoluteDir::east);
+					if (y + 1 < height && !(_connections[x][y] & EntranceDirections::north) && chance(JAFDSettings::MazeSim::loopShare)) connect(coor, AbsoluteDir::north);
+
+					if (coor == homePosition) continue;
+
+					if (chance(JAFDSettings::MazeSim::blackTileShare)) _states[x][y] |= CellState::blackTile;
+					else if (chance(JAFDSettings::MazeSim::bumpShare)) _states[x][y] |= CellState::bump;
+				}
+			}
+
+			return ReturnCode::ok;
+		}
+
+		ReturnCode run(RunResult& result)
+		{
+			if (_width == 0 || _height == 0) return ReturnCode::error;
+
+			uint8_t directions[JAFDSettings::MazeMapping::Exploration::maxPathLength];
+			MapCoordinate position = homePosition;
+			AbsoluteDir heading = AbsoluteDir::north;
+
+			result = RunResult();
+			result.reachableCells = countReachable();
+
+			MazeMapping::resetAllCells();
+
+			sense(position);
+			result.visitedCells = 1;
+
+			// Exploration like RobotLogic - fastest frontier cell, the decision after it is planned while driving
+			while (result.planCalls < UINT16_MAX)
+			{
+				uint32_t start = Profiler::getCycles();
+				const ReturnCode code = MazeMapping::Exploration::findNextPath(position, heading, directions, JAFDSettings::MazeMapping::Exploration::maxPathLength, isPassable);
+
+				addPlanCycles(result, explorePlanSection, Profiler::getCycles() - start);
+
+				if (code != ReturnCode::ok) break;
+
+				start = Profiler::getCycles();
+				MazeMapping::Exploration::planAhead(isPassable);
+				Profiler::record(aheadPlanSection, Profiler::getCycles() - start);
+
+				drive(directions, position, heading, result);
+			}
+
+			// Fastest way back to the start - planned again after every part like the exploration
+			while (position != homePosition && result.planCalls < UINT16_MAX)
+			{
+				const uint32_t start = Profiler::getCycles();
+				const ReturnCode code = MazeMapping::PathPlanner::findFastestPath(position, heading, homePosition, directions, JAFDSettings::MazeMapping::Exploration::maxPathLength, isPassable);
+
+				addPlanCycles(result, homePlanSection, Profiler::getCycles() - start);
+
+				if (code != ReturnCode::ok) break;
+
+				drive(directions, position, heading, result);
+			}
+
+			MazeMapping::resetAllCells();
+
+			return (position == homePosition) ? ReturnCode::ok : ReturnCode::error;
+		}
+
+		ReturnCode benchmark()
+		{
+			static bool sectionsAdded = false;
+
+			constexpr uint8_t sizeRange = JAFDSettings::MazeSim::maxSize - JAFDSettings::MazeSim::minSize + 1;
+			constexpr float cyclesPerMicros = VARIANT_MCK / 1000000.0f;
+
+			uint32_t totalCycles = 0;
+			uint32_t totalCalls = 0;
+			uint32_t totalTime = 0;
+			ReturnCode totalCode = ReturnCode::ok;
+
+			if (!sectionsAdded)
+			{
+				explorePlanSection = Profiler::addSection("simExplorePlan");
+				aheadPlanSection = Profiler::addSection("simAheadPlan");
+				homePlanSection = Profiler::addSection("simHomePlan");
+				sectionsAdded = true;
+			}
+
+			Serial.println("MazeSim: maze / size / reachable / visited / plans / avg plan (us) / max plan (us) / run time (s)");
+
+			for (uint8_t i = 0; i < JAFDSettings::MazeSim::corpusSize; i++)
+			{
+				// Sizes spread over the range
+				const uint8_t width = JAFDSettings::MazeSim::minSize + (i * 5) % sizeRange;
+				const uint8_t height = JAFDSettings::MazeSim::minSize + (i * 3) % sizeRange;
+
+				RunResult result;
+
+				generate(JAFDSettings::MazeSim::corpusSeed + i, width, height);
+
+				const ReturnCode code = run(result);
+
+				Serial.print(i);
+				Serial.print(" / ");
+				Serial.print(width);
+				Serial.print("x");
+				Serial.print(height);
+				Serial.print(" / ");
+				Serial.print(result.reachableCells);
+				Serial.print(" / ");
+				Serial.print(result.visitedCells);
+				Serial.print(" / ");
+				Serial.print(result.planCalls);
+				Serial.print(" / ");
+				Serial.print(result.planCycles / cyclesPerMicros / result.planCalls, 1);
+				Serial.print(" / ");
+				Serial.print(result.maxPlanCycles / cyclesPerMicros, 1);
+				Serial.print(" / ");
+				Serial.print(result.runTime / 10.0f, 1);
+
+				if (code != ReturnCode::ok)
+				{
+					Serial.print(" (not back at the start)");
+					totalCode = ReturnCode::error;
+				}
+
+				Serial.println();
+
+				totalCycles += result.planCycles;
+				totalCalls += result.planCalls;
+				totalTime += result.runTime;
+			}
+
+			Serial.print("MazeSim total: plans ");
+			Serial.print(totalCalls);
+			Serial.print(", plan time (ms) ");
+			Serial.print(totalCycles / cyclesPerMicros / 1000.0f, 1);
+			Serial.print(", run time (s) ");
+			Serial.println(totalTime / 10.0f, 1);
+
+			Profiler::dump();
+
+			return totalCode;
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,267 @@
+/*
+This part of the host build is responsible for replaying recorded telemetry through the sensor fusion
+*/
+
+#include "../../JAFDProgram/JAFDSettings.h"
+#include "../../JAFDProgram/JAFD/header/Telemetry.h"
+#include "../../JAFDProgram/JAFD/header/SensorFusion.h"
+#include "../../JAFDProgram/JAFD/header/MazeMapping.h"
+#include "../header/Replay.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+namespace JAFD
+{
+	namespace Replay
+	{
+		namespace
+		{
+			constexpr uint8_t headerSize = 8;		// Sync, version, type, length, timestamp
+
+			// Payload sizes of the replayed records (see Telemetry::RecordType)
+			constexpr uint8_t robotStateFields = 9;
+			constexpr uint8_t robotStateSize = robotStateFields * sizeof(float);
+			constexpr uint8_t distancesSize = 7 * sizeof(uint16_t) + 7;
+			constexpr uint8_t filterInputsSize = sizeof(uint32_t) + 6 * sizeof(float) + 1;
+			constexpr uint8_t fusionTimeSize = sizeof(uint32_t);
+
+			// Names of the robotState fields in the order of the record
+			const char* const robotStateNames[robotStateFields] = { "left", "right", "forwardVel", "x", "y", "z", "angularVel", "heading", "pitch" };
+
+			bool _started = false;				// Has the first step been replayed?
+			bool _awaitingReference = false;	// Is the recorded state of the last step still missing?
+			float _replayedState[robotStateFields];		// State after the last replayed step
+			float _maxDifference[robotStateFields];		// Maximum differences to the recorded states
+
+			uint32_t _replayedSteps = 0;
+			uint32_t _comparedSteps = 0;
+			uint32_t _exactSteps = 0;			// Steps with the same state as recorded
+			uint32_t _badRecords = 0;
+
+			// Little endian like the Due - a copy, because the fields aren't aligned
+			template<typename T>
+			T readValue(const uint8_t* bytes)
+			{
+				T value;
+				memcpy(&value, bytes, sizeof(T));
+
+				return value;
+			}
+
+			void replayRobotState(const uint8_t* payload)
+			{
+				// State before the first replayed step - start pose of the recording (x, y, z, global heading)
+				if (!_started)
+				{
+					SensorFusion::setCertainRobotPosition(Vec3f(readValue<float>(payload + 12), readValue<float>(payload + 16), readValue<float>(payload + 20)), readValue<float>(payload + 28));
+					return;
+				}
+
+				if (!_awaitingReference) return;
+
+				bool exact = true;
+
+				for (uint8_t i = 0; i < robotStateFields; i++)
+				{
+					const float recorded = readValue<float>(payload + i * sizeof(float));
+
+					if (memcmp(&recorded, &_replayedState[i], sizeof(float)) != 0) exact = false;
+
+					_maxDifference[i] = fmaxf(_maxDifference[i], fabsf(recorded - _replayedState[i]));
+				}
+
+				if (exact) _exactSteps++;
+
+				_comparedSteps++;
+				_awaitingReference = false;
+			}
+
+			void replayDistances(const uint8_t* payload)
+			{
+				Distances distances;
+				DistSensorStates states;
+
+				distances.frontLeft = readValue<uint16_t>(payload);
+				distances.frontRight = readValue<uint16_t>(payload + 2);
+				distances.frontLong = readValue<uint16_t>(payload + 4);
+				distances.leftFront = readValue<uint16_t>(payload + 6);
+				distances.leftBack = readValue<uint16_t>(payload + 8);
+				distances.rightFront = readValue<uint16_t>(payload + 10);
+				distances.rightBack = readValue<uint16_t>(payload + 12);
+
+				states.frontLeft = static_cast<DistSensorStatus>(payload[14]);
+				states.frontRight = static_cast<DistSensorStatus>(payload[15]);
+				states.frontLong = static_cast<DistSensorStatus>(payload[16]);
+				states.leftFront = static_cast<DistSensorStatus>(payload[17]);
+				states.leftBack = static_cast<DistSensorStatus>(payload[18]);
+				states.rightFront = static_cast<DistSensorStatus>(payload[19]);
+				states.rightBack = static_cast<DistSensorStatus>(payload[20]);
+
+				SensorFusion::setDistances(distances);
+				SensorFusion::setDistSensStates(states);
+			}
+
+			void replayFilterInputs(const uint8_t* payload)
+			{
+				SensorFusion::FilterInputs inputs;
+
+				inputs.time = readValue<uint32_t>(payload);
+				inputs.wheelSpeeds = FloatWheelSpeeds(readValue<float>(payload + 4), readValue<float>(payload + 8));
+				inputs.bnoForwardVec = Vec3f(readValue<float>(payload + 12), readValue<float>(payload + 16), readValue<float>(payload + 20));
+				inputs.bnoRotSpeed = readValue<float>(payload + 24);
+
+				// A recording without robotState starts at the current pose
+				_started = true;
+
+				SensorFusion::filterInputs(inputs, payload[28]);
+
+				// Same order as Telemetry::logRobotState()
+				const RobotState state = SensorFusion::getRobotState();
+				const float values[robotStateFields] = { state.wheelSpeeds.left, state.wheelSpeeds.right, state.forwardVel, state.position.x, state.position.y, state.position.z, state.angularVel.x, state.globalHeading, state.pitch };
+
+				memcpy(_replayedState, values, sizeof(values));
+
+				_awaitingReference = true;
+				_replayedSteps++;
+			}
+
+			// Handle a record with valid checksum - other types are ignored
+			void handleRecord(const Telemetry::RecordType type, const uint8_t* payload, const uint8_t length)
+			{
+				switch (type)
+				{
+				case Telemetry::RecordType::robotState:
+					if (length == robotStateSize) replayRobotState(payload);
+					else _badRecords++;
+					break;
+
+				case Telemetry::RecordType::distances:
+					if (length == distancesSize) replayDistances(payload);
+					else _badRecords++;
+					break;
+
+				case Telemetry::RecordType::filterInputs:
+					if (length == filterInputsSize) replayFilterInputs(payload);
+					else _badRecords++;
+					break;
+
+				case Telemetry::RecordType::fusionTime:
+					if (length == fusionTimeSize) SensorFusion::untimedFusion(readValue<uint32_t>(payload));
+					else _badRecords++;
+					break;
+
+				default:
+					break;
+				}
+			}
+
+			// Decode all records of the recording - garbage between records is skipped
+			void decode(const std::vector<uint8_t>& data)
+			{
+				size_t pos = 0;
+
+				while (pos + headerSize < data.size())
+				{
+					if (data[pos] != Telemetry::syncByte)
+					{
+						pos++;
+						continue;
+					}
+
+					// Resynchronize at the next sync byte - this one was noise
+					if (data[pos + 1] != Telemetry::version)
+					{
+						_badRecords++;
+						pos++;
+						continue;
+					}
+
+					const uint8_t length = data[pos + 3];
+
+					if (pos + headerSize + length >= data.size()) break;
+
+					uint8_t checksum = 0;
+
+					for (size_t i = pos + 1; i < pos + headerSize + length; i++) checksum ^= data[i];
+
+					if (checksum != data[pos + headerSize + length])
+					{
+						_badRecords++;
+						pos++;
+						continue;
+					}
+
+					handleRecord(static_cast<Telemetry::RecordType>(data[pos + 2]), &data[pos + headerSize], length);
+
+					pos += headerSize + length + 1;
+				}
+			}
+		}
+
+		ReturnCode run(const char* fileName)
+		{
+			FILE* file = fopen(fileName, "rb");
+
+			if (file == nullptr)
+			{
+				Serial.print("Replay: can't open ");
+				Serial.println(fileName);
+
+				return ReturnCode::error;
+			}
+
+			std::vector<uint8_t> data;
+			uint8_t buffer[4096];
+			size_t read;
+
+			while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) data.insert(data.end(), buffer, buffer + read);
+
+			fclose(file);
+
+			_started = false;
+			_awaitingReference = false;
+			_replayedSteps = 0;
+			_comparedSteps = 0;
+			_exactSteps = 0;
+			_badRecords = 0;
+
+			for (uint8_t i = 0; i < robotStateFields; i++) _maxDifference[i] = 0.0f;
+
+			// The replayed run maps from scratch
+			MazeMapping::resetAllCells();
+
+			decode(data);
+
+			Serial.print("Replay: steps ");
+			Serial.print(_replayedSteps);
+			Serial.print(", compared ");
+			Serial.print(_comparedSteps);
+			Serial.print(", bit-exact ");
+			Serial.print(_exactSteps);
+			Serial.print(", bad records ");
+			Serial.println(_badRecords);
+
+			Serial.print("Max difference:");
+
+			bool withinBound = true;
+
+			for (uint8_t i = 0; i < robotStateFields; i++)
+			{
+				Serial.print(" ");
+				Serial.print(robotStateNames[i]);
+				Serial.print("=");
+				Serial.print(_maxDifference[i], 5);
+
+				if (!(_maxDifference[i] <= JAFDSettings::Replay::maxStateDifference)) withinBound = false;
+			}
+
+			Serial.println();
+
+			if (_replayedSteps == 0 || _badRecords > 0 || !withinBound) return ReturnCode::error;
+
+			return ReturnCode::ok;
+		}
+	}
+}
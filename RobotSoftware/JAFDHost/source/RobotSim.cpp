@@ -0,0 +1,374 @@
+/*
+This part of the host build is responsible for the benchmarks of the sensor fusion and the driving tasks
+*/
+
+#include "../../JAFDProgram/JAFDSettings.h"
+#include "../../JAFDProgram/JAFD/header/SmoothDriving.h"
+#include "../../JAFDProgram/JAFD/header/SensorFusion.h"
+#include "../../JAFDProgram/JAFD/header/MazeMapping.h"
+#include "../../JAFDProgram/JAFD/header/Profiler.h"
+#include "../../JAFDProgram/JAFD/header/Math.h"
+#include "../../JAFDProgram/JAFD/header/Telemetry.h"
+#include "../header/Backends.h"
+#include "../header/RobotSim.h"
+
+namespace JAFD
+{
+	namespace RobotSim
+	{
+		namespace
+		{
+			constexpr uint8_t jobFreq = JAFDSettings::RobotSim::jobFreq;
+			constexpr uint32_t period = 1000 / jobFreq;		// Time between two calls of the jobs (ms)
+			constexpr float cyclesPerMicros = VARIANT_MCK / 1000000.0f;
+
+			constexpr float corridorHalfWidth = JAFDSettings::Field::cellWidth / 2.0f;
+			constexpr float corridorEnd = (JAFDSettings::RobotSim::corridorCells - 0.5f) * JAFDSettings::Field::cellWidth;	// Wall at the end of the corridor (cm)
+
+			// Result of one driven task
+			struct TaskResult
+			{
+				uint32_t time;				// Simulated time until the task was finished (ms)
+				uint32_t startCycles;		// Cycles of setNewTask() (MCK)
+				uint32_t maxUpdateCycles;	// Cycles of the slowest updateSpeeds() (MCK)
+				float maxPoseError;			// Largest distance between the fused and the simulated position (cm)
+			};
+
+			Profiler::SectionID setNewTaskSection = Profiler::invalidSection;		// Planning of a new task
+			Profiler::SectionID updateSpeedsSection = Profiler::invalidSection;		// SmoothDriving::updateSpeeds()
+			Profiler::SectionID planAheadSection = Profiler::invalidSection;		// SmoothDriving::planAhead()
+			Profiler::SectionID sensorFilteringSection = Profiler::invalidSection;	// SensorFusion::sensorFiltering()
+			Profiler::SectionID updateSensorsSection = Profiler::invalidSection;	// SensorFusion::updateSensors()
+			Profiler::SectionID untimedFusionSection = Profiler::invalidSection;	// SensorFusion::untimedFusion()
+
+			void addSections()
+			{
+				static bool sectionsAdded = false;
+
+				if (sectionsAdded) return;
+
+				setNewTaskSection = Profiler::addSection("simSetNewTask");
+				updateSpeedsSection = Profiler::addSection("simUpdateSpeeds");
+				planAheadSection = Profiler::addSection("simPlanAhead");
+				sensorFilteringSection = Profiler::addSection("simSensorFiltering");
+				updateSensorsSection = Profiler::addSection("simUpdateSensors");
+				untimedFusionSection = Profiler::addSection("simUntimedFusion");
+				sectionsAdded = true;
+			}
+
+			// Simulation and fusion agree on the pose of the standing robot
+			void placeRobot(const Vec2f position, const float heading)
+			{
+				Backends::reset(position, heading);
+				SensorFusion::setCertainRobotPosition(Vec3f(position.x, position.y, 0.0f), heading);
+
+				// Start pose of a replay of the recording
+				Telemetry::logRobotState(SensorFusion::getRobotState());
+			}
+
+			// Global heading of an EntranceDirection like SmoothDriving (north = 0, west = pi/2)
+			float directionToHeading(const uint8_t direction)
+			{
+				switch (direction)
+				{
+				case EntranceDirections::east:
+					return -M_PI_2;
+				case EntranceDirections::south:
+					return M_PI;
+				case EntranceDirections::west:
+					return M_PI_2;
+				default:
+					return 0.0f;
+				}
+			}
+
+			// Distance from a point in a direction to the walls of the corridor (cm) - it starts behind (0, 0) and leads along x
+			float corridorDistance(const Vec2f point, const Vec2f direction)
+			{
+				float distance = INFINITY;
+
+				if (direction.y > 0.0f) distance = fminf(distance, (corridorHalfWidth - point.y) / direction.y);
+				else if (direction.y < 0.0f) distance = fminf(distance, (-corridorHalfWidth - point.y) / direction.y);
+
+				if (direction.x > 0.0f) distance = fminf(distance, (corridorEnd - point.x) / direction.x);
+				else if (direction.x < 0.0f) distance = fminf(distance, (-corridorHalfWidth - point.x) / direction.x);
+
+				return distance;
+			}
+
+			// Samples of all short distance sensors at the simulated pose
+			void queueCorridorSamples()
+			{
+				const Vec2f position = Backends::getPosition();
+
+				float sinHeading, cosHeading;
+				fastSinCos(Backends::getHeading(), sinHeading, cosHeading);
+
+				for (uint8_t i = 0; i < static_cast<uint8_t>(DistanceSensors::SensorID::numSensors); i++)
+				{
+					const DistanceSensors::SensorID sensor = static_cast<DistanceSensors::SensorID>(i);
+					Vec2f mountPosition;
+					Vec2f mountDirection;
+
+					if (SensorFusion::getDistSensMounting(sensor, mountPosition, mountDirection) != ReturnCode::ok) continue;
+
+					const Vec2f point = position + Vec2f(cosHeading * mountPosition.x - sinHeading * mountPosition.y, sinHeading * mountPosition.x + cosHeading * mountPosition.y);
+					const Vec2f direction(cosHeading * mountDirection.x - sinHeading * mountDirection.y, sinHeading * mountDirection.x + cosHeading * mountDirection.y);
+					const float distance = corridorDistance(point, direction) * 10.0f;
+
+					DistanceSensors::DistSample sample;
+					sample.timestamp = millis();
+					sample.sensor = sensor;
+
+					if (distance > JAFDSettings::RobotSim::maxSensorRange)
+					{
+						sample.distance = 0;
+						sample.status = DistSensorStatus::overflow;
+					}
+					else
+					{
+						sample.distance = static_cast<uint16_t>(distance + 0.5f);
+						sample.status = DistSensorStatus::ok;
+					}
+
+					Backends::queueDistSample(sample);
+				}
+			}
+
+			// One period: the jobs of the scheduler, then the main loop
+			void tick(TaskResult& result, const bool withDistSensors)
+			{
+				Backends::step(jobFreq);
+				HAL::advanceTime(period);
+
+				Profiler::start(sensorFilteringSection);
+				SensorFusion::sensorFiltering(jobFreq);
+				Profiler::stop(sensorFilteringSection);
+
+				const uint32_t start = Profiler::getCycles();
+				SmoothDriving::updateSpeeds(jobFreq);
+				const uint32_t cycles = Profiler::getCycles() - start;
+
+				Profiler::record(updateSpeedsSection, cycles);
+
+				if (cycles > result.maxUpdateCycles) result.maxUpdateCycles = cycles;
+
+				if (withDistSensors)
+				{
+					queueCorridorSamples();
+
+					Profiler::start(updateSensorsSection);
+					SensorFusion::updateSensors();
+					Profiler::stop(updateSensorsSection);
+
+					Profiler::start(untimedFusionSection);
+					SensorFusion::untimedFusion();
+					Profiler::stop(untimedFusionSection);
+				}
+
+				Profiler::start(planAheadSection);
+				SmoothDriving::planAhead();
+				Profiler::stop(planAheadSection);
+
+				Telemetry::drain();
+
+				const RobotState state = SensorFusion::getRobotState();
+				const float poseError = (Vec2f(state.position.x, state.position.y) - Backends::getPosition()).length();
+
+				if (poseError > result.maxPoseError) result.maxPoseError = poseError;
+			}
+
+			// Start the task from the current state and run until it is finished
+			template<typename T>
+			ReturnCode driveTask(const T& task, TaskResult& result, const bool withDistSensors)
+			{
+				result = TaskResult{ 0, 0, 0, 0.0f };
+
+				const uint32_t start = Profiler::getCycles();
+				const ReturnCode code = SmoothDriving::setNewTask<SmoothDriving::NewStateType::currentState>(task, true);
+
+				result.startCycles = Profiler::getCycles() - start;
+				Profiler::record(setNewTaskSection, result.startCycles);
+
+				if (code != ReturnCode::ok) return code;
+
+				while (!SmoothDriving::isTaskFinished())
+				{
+					if (result.time >= JAFDSettings::RobotSim::maxTaskTime) return ReturnCode::aborted;
+
+					tick(result, withDistSensors);
+					result.time += period;
+				}
+
+				return ReturnCode::ok;
+			}
+
+			// Task of the driving corpus with its end pose - every task starts at (0, 0) facing north
+			constexpr uint8_t corpusSize = 5;
+
+			ReturnCode driveCorpusTask(const uint8_t index, TaskResult& result, const char*& name, Vec2f& endPosition, float& endHeading)
+			{
+				using namespace SmoothDriving;
+
+				static const uint8_t path[] = { EntranceDirections::north, EntranceDirections::north, EntranceDirections::west, EntranceDirections::west };
+
+				switch (index)
+				{
+				case 0:
+					name = "forward 60 cm";
+					endPosition = Vec2f(60.0f, 0.0f);
+					endHeading = 0.0f;
+					return driveTask(TaskArray(Accelerate(30, 15.0f), DriveStraight(30.0f), Accelerate(0, 15.0f), Stop()), result, false);
+				case 1:
+					name = "backward 60 cm";
+					endPosition = Vec2f(-60.0f, 0.0f);
+					endHeading = 0.0f;
+					return driveTask(TaskArray(Accelerate(-30, -15.0f), DriveStraight(-30.0f), Accelerate(0, -15.0f), Stop()), result, false);
+				case 2:
+					name = "rotate 90 deg";
+					endPosition = Vec2f(0.0f, 0.0f);
+					endHeading = M_PI_2;
+					return driveTask(TaskArray(Rotate(2.0f, 90.0f), Stop()), result, false);
+				case 3:
+					name = "rotate -180 deg";
+					endPosition = Vec2f(0.0f, 0.0f);
+					endHeading = -M_PI;
+					return driveTask(TaskArray(Rotate(-2.0f, -180.0f), Stop()), result, false);
+				default:
+				{
+					name = "follow path";
+					endPosition = Vec2f(0.0f, 0.0f);
+
+					// Cells like the heading of SensorFusion (north = +x, west = +y)
+					for (const uint8_t direction : path)
+					{
+						float sinHeading, cosHeading;
+						fastSinCos(directionToHeading(direction), sinHeading, cosHeading);
+
+						endPosition += Vec2f(roundf(cosHeading), roundf(sinHeading)) * JAFDSettings::Field::cellWidth;
+					}
+
+					endHeading = directionToHeading(path[sizeof(path) - 1]);
+
+					return driveTask(FollowPath(path, sizeof(path)), result, false);
+				}
+				}
+			}
+
+			void printResult(const TaskResult& result)
+			{
+				Serial.print(result.time / 1000.0f, 2);
+				Serial.print(" / ");
+				Serial.print(result.startCycles / cyclesPerMicros, 1);
+				Serial.print(" / ");
+				Serial.print(result.maxUpdateCycles / cyclesPerMicros, 1);
+			}
+		}
+
+		ReturnCode benchmarkDriving()
+		{
+			ReturnCode totalCode = ReturnCode::ok;
+
+			addSections();
+
+			Serial.println("RobotSim driving: task / time (s) / setNewTask (us) / max updateSpeeds (us) / position error (cm) / heading error (deg)");
+
+			for (uint8_t i = 0; i < corpusSize; i++)
+			{
+				TaskResult result;
+				const char* name = "";
+				Vec2f endPosition;
+				float endHeading = 0.0f;
+
+				placeRobot(Vec2f(0.0f, 0.0f), 0.0f);
+
+				const ReturnCode code = driveCorpusTask(i, result, name, endPosition, endHeading);
+				const RobotState state = SensorFusion::getRobotState();
+				const float posError = (Vec2f(state.position.x, state.position.y) - endPosition).length();
+				const float headingError = fabsf(fitAngleToInterval(state.globalHeading - endHeading));
+
+				Serial.print(name);
+				Serial.print(" / ");
+				printResult(result);
+				Serial.print(" / ");
+				Serial.print(posError, 2);
+				Serial.print(" / ");
+				Serial.print(headingError * RAD_TO_DEG, 2);
+
+				if (code != ReturnCode::ok)
+				{
+					Serial.print((code == ReturnCode::aborted) ? " (not finished)" : " (not started)");
+					totalCode = ReturnCode::error;
+				}
+				else if (posError > JAFDSettings::RobotSim::maxPosError || headingError > JAFDSettings::RobotSim::maxHeadingError)
+				{
+					Serial.print(" (off the planned pose)");
+					totalCode = ReturnCode::error;
+				}
+
+				Serial.println();
+			}
+
+			Profiler::dump();
+
+			return totalCode;
+		}
+
+		ReturnCode benchmarkFusion()
+		{
+			constexpr float length = (JAFDSettings::RobotSim::corridorCells - 1) * JAFDSettings::Field::cellWidth;
+
+			ReturnCode totalCode = ReturnCode::ok;
+
+			addSections();
+
+			// The fusion maps the corridor
+			MazeMapping::resetAllCells();
+
+			placeRobot(Vec2f(0.0f, 0.0f), 0.0f);
+
+			Serial.println("RobotSim fusion: task / time (s) / setNewTask (us) / max updateSpeeds (us) / max pose error (cm)");
+
+			for (uint8_t i = 0; i < 4; i++)
+			{
+				TaskResult result;
+				ReturnCode code;
+
+				// Along the corridor, turn at its end and back to the start
+				if (i % 2 == 0)
+				{
+					Serial.print("straight / ");
+					code = driveTask(SmoothDriving::TaskArray(SmoothDriving::Accelerate(20, 30.0f), SmoothDriving::DriveStraight(length - 60.0f), SmoothDriving::Accelerate(0, 30.0f), SmoothDriving::Stop()), result, true);
+				}
+				else
+				{
+					Serial.print("turn / ");
+					code = driveTask(SmoothDriving::TaskArray(SmoothDriving::Rotate(2.0f, 180.0f), SmoothDriving::Stop()), result, true);
+				}
+
+				printResult(result);
+				Serial.print(" / ");
+				Serial.print(result.maxPoseError, 2);
+
+				if (code != ReturnCode::ok)
+				{
+					Serial.print((code == ReturnCode::aborted) ? " (not finished)" : " (not started)");
+					totalCode = ReturnCode::error;
+				}
+				else if (result.maxPoseError > JAFDSettings::RobotSim::maxFusionError)
+				{
+					Serial.print(" (fused pose drifted off)");
+					totalCode = ReturnCode::error;
+				}
+
+				Serial.println();
+			}
+
+			MazeMapping::resetAllCells();
+
+			Profiler::dump();
+
+			return totalCode;
+		}
+	}
+}
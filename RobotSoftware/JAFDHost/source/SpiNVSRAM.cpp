@@ -0,0 +1,117 @@
+/*
+This part of the host build replaces the SPI NVSRAM by RAM - the stored data of the robot is never touched
+*/
+
+#include "../../JAFDProgram/JAFDSettings.h"
+#include "../../JAFDProgram/JAFD/header/SpiNVSRAM.h"
+
+namespace JAFD
+{
+	namespace SpiNVSRAM
+	{
+		namespace
+		{
+			constexpr uint32_t size = 128 * 1024;		// Like the 23LCV1024
+
+			uint8_t _memory[size];
+
+			// Addresses wrap like in the sequential mode
+			void copyIn(uint32_t address, const uint8_t* buffer, const uint32_t length)
+			{
+				for (uint32_t i = 0; i < length; i++) _memory[(address + i) % size] = buffer[i];
+			}
+
+			void copyOut(uint32_t address, uint8_t* buffer, const uint32_t length)
+			{
+				for (uint32_t i = 0; i < length; i++) buffer[i] = _memory[(address + i) % size];
+			}
+		}
+
+		void enable() {}
+		void disable() {}
+
+		ReturnCode setup()
+		{
+			return ReturnCode::ok;
+		}
+
+		uint8_t readByte(const uint32_t address)
+		{
+			return _memory[address % size];
+		}
+
+		void writeByte(const uint32_t address, const uint8_t byte)
+		{
+			_memory[address % size] = byte;
+		}
+
+		void readStream(const uint32_t address, uint8_t* buffer, const uint32_t length)
+		{
+			copyOut(address, buffer, length);
+		}
+
+		void writeStream(uint32_t address, uint8_t* buffer, const uint32_t length)
+		{
+			copyIn(address, buffer, length);
+		}
+
+		void fill(const uint32_t address, const uint8_t value, const uint32_t length)
+		{
+			for (uint32_t i = 0; i < length; i++) _memory[(address + i) % size] = value;
+		}
+
+		// Transfers finish at once - the callback is called before returning
+		ReturnCode readStreamAsync(const uint32_t address, uint8_t* buffer, const uint32_t length, void(*finishedCallback)())
+		{
+			copyOut(address, buffer, length);
+
+			if (finishedCallback) finishedCallback();
+
+			return ReturnCode::ok;
+		}
+
+		ReturnCode writeStreamAsync(const uint32_t address, uint8_t* buffer, const uint32_t length, void(*finishedCallback)())
+		{
+			copyIn(address, buffer, length);
+
+			if (finishedCallback) finishedCallback();
+
+			return ReturnCode::ok;
+		}
+
+		ReturnCode fillAsync(const uint32_t address, const uint8_t value, const uint32_t length, void(*finishedCallback)())
+		{
+			fill(address, value, length);
+
+			if (finishedCallback) finishedCallback();
+
+			return ReturnCode::ok;
+		}
+
+		bool isBusy()
+		{
+			return false;
+		}
+
+		void waitForTransfer() {}
+
+		void dmaInterrupt() {}
+
+		uint16_t crc16(const uint8_t* bytes, const uint32_t length)
+		{
+			uint16_t crc = 0xffff;
+
+			for (uint32_t i = 0; i < length; i++)
+			{
+				crc ^= static_cast<uint16_t>(bytes[i]) << 8;
+
+				for (uint8_t j = 0; j < 8; j++)
+				{
+					crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+				}
+			}
+
+			return crc;
+		}
+	}
+}
\ No newline at end of file
@@ -6,7 +6,6 @@ In this file are all definitions and includes for datatypes and name aliases, wh
 
 #include <stdint.h>
 #include "Vector.h"
-#include "DuePinMapping.h"
 
 namespace JAFD
 {
@@ -64,6 +63,19 @@ namespace JAFD
 
 			return result;
 		}
+
+		inline const VisVictimProb& operator+=(const VisVictimProb& prob)
+		{
+			harmed += prob.harmed;
+			stable += prob.stable;
+			unharmed += prob.unharmed;
+			red += prob.red;
+			green += prob.green;
+			yellow += prob.yellow;
+			none += prob.none;
+
+			return *this;
+		}
 	};
 
 	enum class SerialType : uint8_t
@@ -89,12 +101,10 @@ namespace JAFD
 		explicit WheelSpeeds(const volatile FloatWheelSpeeds& speeds);
 		explicit constexpr WheelSpeeds(const FloatWheelSpeeds& speeds);
 
-		inline const volatile WheelSpeeds& operator=(const volatile WheelSpeeds speeds) volatile
+		inline void operator=(const volatile WheelSpeeds speeds) volatile
 		{
 			left = speeds.left;
 			right = speeds.right;
-
-			return *this;
 		}
 
 		inline const WheelSpeeds& operator=(const WheelSpeeds& speeds)
@@ -118,12 +128,10 @@ namespace JAFD
 		explicit FloatWheelSpeeds(const volatile WheelSpeeds& speeds) : left(static_cast<float>(speeds.left)), right(static_cast<float>(speeds.right)) {}
 		explicit constexpr FloatWheelSpeeds(const WheelSpeeds& speeds) : left(static_cast<float>(speeds.left)), right(static_cast<float>(speeds.right)) {}
 
-		inline const volatile FloatWheelSpeeds& operator=(const volatile FloatWheelSpeeds speeds) volatile
+		inline void operator=(const volatile FloatWheelSpeeds speeds) volatile
 		{
 			left = speeds.left;
 			right = speeds.right;
-
-			return *this;
 		}
 
 		inline const FloatWheelSpeeds& operator=(const FloatWheelSpeeds& speeds)
@@ -171,12 +179,10 @@ namespace JAFD
 		MapCoordinate(const volatile MapCoordinate& coor) : x(coor.x), y(coor.y) {}
 		constexpr MapCoordinate(const MapCoordinate& coor) : x(coor.x), y(coor.y) {}
 
-		inline const volatile MapCoordinate& operator=(const volatile MapCoordinate coor) volatile
+		inline void operator=(const volatile MapCoordinate coor) volatile
 		{
 			x = coor.x;
 			y = coor.y;
-
-			return *this;
 		}
 
 		inline const MapCoordinate& operator=(const MapCoordinate& coor)
@@ -413,6 +419,9 @@ namespace JAFD
 		default:
 			break;
 		}
+
+		// Invalid direction - keep the heading
+		return heading;
 	}
 
 	// State of robot
@@ -434,7 +443,7 @@ namespace JAFD
 		RobotState(const volatile RobotState& state) : wheelSpeeds(state.wheelSpeeds), forwardVel(state.forwardVel), position(state.position), angularVel(state.angularVel), forwardVec(state.forwardVec), heading(state.heading), globalHeading(state.globalHeading), pitch(state.pitch) {}
 		constexpr RobotState(const RobotState& state) : wheelSpeeds(state.wheelSpeeds), forwardVel(state.forwardVel), position(state.position), angularVel(state.angularVel), forwardVec(state.forwardVec), heading(state.heading), globalHeading(state.globalHeading), pitch(state.pitch) {}
 
-		inline const volatile RobotState& operator=(const volatile RobotState state) volatile
+		inline void operator=(const volatile RobotState state) volatile
 		{
 			wheelSpeeds = state.wheelSpeeds;
 			forwardVel = state.forwardVel;
@@ -444,8 +453,6 @@ namespace JAFD
 			heading = state.heading;
 			globalHeading = state.globalHeading;
 			pitch = state.pitch;
-
-			return *this;
 		}
 
 		inline const RobotState& operator=(const RobotState& state)
@@ -533,12 +540,10 @@ namespace JAFD
 		GridCell(const volatile GridCell& cell) : cellConnections(cell.cellConnections), cellState(cell.cellState) {}
 		constexpr GridCell(const GridCell& cell) : cellConnections(cell.cellConnections), cellState(cell.cellState) {}
 
-		inline const volatile GridCell& operator=(const volatile GridCell cell) volatile
+		inline void operator=(const volatile GridCell cell) volatile
 		{
 			cellConnections = cell.cellConnections;
 			cellState = cell.cellState;
-
-			return *this;
 		}
 
 		inline const GridCell& operator=(const GridCell& cell)
@@ -574,7 +579,7 @@ namespace JAFD
 		DistSensorStates(const volatile DistSensorStates& dist) : frontLeft(dist.frontLeft), frontRight(dist.frontRight), frontLong(dist.frontLong), leftFront(dist.leftFront), leftBack(dist.leftBack), rightFront(dist.rightFront), rightBack(dist.rightBack) {}
 		constexpr DistSensorStates(const DistSensorStates& dist) : frontLeft(dist.frontLeft), frontRight(dist.frontRight), frontLong(dist.frontLong), leftFront(dist.leftFront), leftBack(dist.leftBack), rightFront(dist.rightFront), rightBack(dist.rightBack) {}
 
-		inline const volatile DistSensorStates& operator=(const volatile DistSensorStates dist) volatile
+		inline void operator=(const volatile DistSensorStates dist) volatile
 		{
 			frontLeft = dist.frontLeft;
 			frontRight = dist.frontRight;
@@ -583,8 +588,6 @@ namespace JAFD
 			leftBack = dist.leftBack;
 			rightFront = dist.rightFront;
 			rightBack = dist.rightBack;
-
-			return *this;
 		}
 
 		inline const DistSensorStates& operator=(const DistSensorStates& dist)
@@ -616,7 +619,7 @@ namespace JAFD
 		Distances(const volatile Distances& dist) : frontLeft(dist.frontLeft), frontRight(dist.frontRight), frontLong(dist.frontLong), leftFront(dist.leftFront), leftBack(dist.leftBack), rightFront(dist.rightFront), rightBack(dist.rightBack) {}
 		constexpr Distances(const Distances& dist) : frontLeft(dist.frontLeft), frontRight(dist.frontRight), frontLong(dist.frontLong), leftFront(dist.leftFront), leftBack(dist.leftBack), rightFront(dist.rightFront), rightBack(dist.rightBack) {}
 
-		inline const volatile Distances& operator=(const volatile Distances dist) volatile
+		inline void operator=(const volatile Distances dist) volatile
 		{
 			frontLeft = dist.frontLeft;
 			frontRight = dist.frontRight;
@@ -625,8 +628,6 @@ namespace JAFD
 			leftBack = dist.leftBack;
 			rightFront = dist.rightFront;
 			rightBack = dist.rightBack;
-
-			return *this;
 		}
 
 		inline const Distances& operator=(const Distances& dist)
@@ -653,12 +654,10 @@ namespace JAFD
 		ColorSensData(const volatile ColorSensData& data) : colorTemp(data.colorTemp), lux(data.lux) {}
 		constexpr ColorSensData(const ColorSensData& data) : colorTemp(data.colorTemp), lux(data.lux) {}
 
-		inline const volatile ColorSensData& operator=(const volatile ColorSensData data) volatile
+		inline void operator=(const volatile ColorSensData data) volatile
 		{
 			colorTemp = data.colorTemp;
 			lux = data.lux;
-
-			return *this;
 		}
 
 		inline const ColorSensData& operator=(const ColorSensData& data)
@@ -670,6 +669,37 @@ namespace JAFD
 		}
 	};
 
+	// Results of both heat sensors
+	struct HeatSensData
+	{
+		float leftConfidence;	// Confidence of a heat victim on the left side (0 - 1)
+		float rightConfidence;	// Confidence of a heat victim on the right side (0 - 1)
+		float ambientTemp;		// Rolling estimate of the ambient temperature
+		uint32_t timestamp;		// Time of the readings (ms)
+
+		explicit constexpr HeatSensData(float leftConfidence = 0.0f, float rightConfidence = 0.0f, float ambientTemp = 0.0f, uint32_t timestamp = 0) : leftConfidence(leftConfidence), rightConfidence(rightConfidence), ambientTemp(ambientTemp), timestamp(timestamp) {}
+		HeatSensData(const volatile HeatSensData& data) : leftConfidence(data.leftConfidence), rightConfidence(data.rightConfidence), ambientTemp(data.ambientTemp), timestamp(data.timestamp) {}
+		constexpr HeatSensData(const HeatSensData& data) : leftConfidence(data.leftConfidence), rightConfidence(data.rightConfidence), ambientTemp(data.ambientTemp), timestamp(data.timestamp) {}
+
+		inline void operator=(const volatile HeatSensData data) volatile
+		{
+			leftConfidence = data.leftConfidence;
+			rightConfidence = data.rightConfidence;
+			ambientTemp = data.ambientTemp;
+			timestamp = data.timestamp;
+		}
+
+		inline const HeatSensData& operator=(const HeatSensData& data)
+		{
+			leftConfidence = data.leftConfidence;
+			rightConfidence = data.rightConfidence;
+			ambientTemp = data.ambientTemp;
+			timestamp = data.timestamp;
+
+			return *this;
+		}
+	};
+
 	// Data fused by SensorFusion
 	struct FusedData
 	{
@@ -679,12 +709,13 @@ namespace JAFD
 		Distances distances; 		// Results of distance measurement in mm
 		DistSensorStates distSensorState;	// States of all distance sensors
 		ColorSensData colorSensData;	// Data from color sensor at the bottom (includes color temperature and brightness in lux)
+		HeatSensData heatSensData;		// Victim confidences of both heat sensors
 
-		constexpr FusedData() : robotState(), gridCell(), gridCellCertainty(0.0f), distances(), distSensorState(), colorSensData() {}
-		FusedData(const volatile FusedData& data) : robotState(data.robotState), gridCell(data.gridCell), gridCellCertainty(data.gridCellCertainty), distances(data.distances), distSensorState(data.distSensorState), colorSensData(data.colorSensData) {}
-		constexpr FusedData(const FusedData& data) : robotState(data.robotState), gridCell(data.gridCell), gridCellCertainty(data.gridCellCertainty), distances(data.distances), distSensorState(data.distSensorState), colorSensData(data.colorSensData)  {}
+		constexpr FusedData() : robotState(), gridCell(), gridCellCertainty(0.0f), distances(), distSensorState(), colorSensData(), heatSensData() {}
+		FusedData(const volatile FusedData& data) : robotState(data.robotState), gridCell(data.gridCell), gridCellCertainty(data.gridCellCertainty), distances(data.distances), distSensorState(data.distSensorState), colorSensData(data.colorSensData), heatSensData(data.heatSensData) {}
+		constexpr FusedData(const FusedData& data) : robotState(data.robotState), gridCell(data.gridCell), gridCellCertainty(data.gridCellCertainty), distances(data.distances), distSensorState(data.distSensorState), colorSensData(data.colorSensData), heatSensData(data.heatSensData) {}
 
-		inline const volatile FusedData& operator=(const volatile FusedData data) volatile
+		inline void operator=(const volatile FusedData data) volatile
 		{
 			robotState = data.robotState;
 			gridCell = data.gridCell;
@@ -692,8 +723,7 @@ namespace JAFD
 			distances = data.distances;
 			distSensorState = data.distSensorState;
 			colorSensData = data.colorSensData;
-
-			return *this;
+			heatSensData = data.heatSensData;
 		}
 
 		inline const FusedData& operator=(const FusedData& data)
@@ -704,6 +734,7 @@ namespace JAFD
 			distances = data.distances;
 			distSensorState = data.distSensorState;
 			colorSensData = data.colorSensData;
+			heatSensData = data.heatSensData;
 
 			return *this;
 		}
@@ -0,0 +1,43 @@
+/*
+This private file of the library is responsible for the non-blocking access to both I2C buses
+*/
+
+#pragma once
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include "AllDatatypes.h"
+
+namespace JAFD
+{
+	// Interrupt driven transaction engine for the TWI peripherals (Wire = TWI1, Wire1 = TWI0)
+	// Blocking Wire access to a bus is only allowed while it is idle (see waitForBus())
+	namespace AsyncI2C
+	{
+		enum class Bus : uint8_t
+		{
+			wire,		// Wire (TWI1) - Multiplexer, distance sensors, ...
+			wire1,		// Wire1 (TWI0) - Bno055
+			numBuses
+		};
+
+		// Called from the interrupt when a transaction is finished
+		typedef void(*Callback)(const ReturnCode code);
+
+		// Init (after Wire.begin() / Wire1.begin())
+		ReturnCode setup();
+
+		// Queue transactions - buffer must stay valid until the transaction is finished
+		// regAddrSize is the size of the internal register address in bytes (0 - 3)
+		ReturnCode queueRead(const Bus bus, const uint8_t i2cAddr, const uint32_t regAddr, const uint8_t regAddrSize, uint8_t* buffer, const uint8_t length, Callback callback = nullptr);
+		ReturnCode queueWrite(const Bus bus, const uint8_t i2cAddr, const uint32_t regAddr, const uint8_t regAddrSize, uint8_t* buffer, const uint8_t length, Callback callback = nullptr);
+
+		// Status
+		bool isBusy(const Bus bus);
+		ReturnCode waitForBus(const Bus bus);	// Wait until all queued transactions are finished - error if one failed since the last call
+	}
+}
\ No newline at end of file
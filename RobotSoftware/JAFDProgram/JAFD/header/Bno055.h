@@ -19,7 +19,10 @@ namespace JAFD
 	{
 		ReturnCode setup();
 		ReturnCode calibrate();
+		ReturnCode waitForFusion();		// Wait until the fusion delivers a valid orientation (before tare)
 		void updateValues();
+		ReturnCode startUpdate();		// Start reading all values in the background (Wire1)
+		ReturnCode finishUpdate();		// Wait for the values of startUpdate()
 		void tare();
 		void tare(float globalHeading);		// Pitch and Roll should be 0; Global heading in rad
 
@@ -0,0 +1,63 @@
+/*
+This private file of the library is responsible for the persistent calibration data in the SPI NVSRAM
+*/
+
+#pragma once
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include "AllDatatypes.h"
+
+namespace JAFD
+{
+	// All calibration data is one block with version and CRC - it is read in one stream at setup and always written as a whole
+	// The NVSRAM holds two slots of the block; a store overwrites the older one, so a reset while writing keeps the last block
+	namespace Calibration
+	{
+		constexpr uint16_t version = 2;			// Increase with every change of Data - the stored blocks are discarded then, calibrate again with 'k' and 'c' over Serial
+		constexpr uint8_t maxDistSensors = 8;	// IDs of the distance sensor objects
+		constexpr uint8_t motorLUTSize = 16;	// Points of the feedforward table of a motor
+
+		// Linear correction of a distance sensor (true = k * measured + d)
+		struct DistSensorCalib
+		{
+			float k;
+			int16_t d;
+			bool valid;
+		};
+
+		// Offsets of the Bno055 (like adafruit_bno055_offsets_t)
+		struct Bno055Calib
+		{
+			int16_t accelOffset[3];
+			int16_t accelRadius;
+			int16_t gyroOffset[3];
+			int16_t magOffset[3];
+			int16_t magRadius;
+			bool valid;
+		};
+
+		// Feedforward of a motor (MotorControl::characterize()): drive as share of the motor voltage for the speed i * speedStep (cm/s)
+		struct MotorCalib
+		{
+			float drive[motorLUTSize];
+			float speedStep;
+			bool valid;
+		};
+
+		struct Data
+		{
+			DistSensorCalib distSensors[maxDistSensors];
+			Bno055Calib bno055;
+			MotorCalib motors[2];		// Left, right
+		};
+
+		ReturnCode setup();		// Read the block - error if no slot has the right version and CRC (nothing is valid then)
+		ReturnCode store();		// Write the whole block into the older slot and verify it
+		Data& getData();		// RAM copy - changes are written by store()
+	}
+}
\ No newline at end of file
@@ -14,14 +14,44 @@ This private part of the Library is responsible for the communication with the R
 
 namespace JAFD
 {
+	// Binary frames from the RasPI over Serial1 - received by the PDC into a double buffer and decoded incrementally by loop()
+	// Frame layout (little endian):
+	// [0] sync byte 0x5A | [1] version | [2] frame type | [3] payload length | payload | CRC-8 (poly 0x07) of bytes 1 to end of payload
+	// Writer on the RasPI: "CamRec Python/main.py"
 	namespace CamRec
 	{
-		ReturnCode setup();
+		constexpr uint8_t syncByte = 0x5A;
+		constexpr uint8_t version = 1;
+		constexpr uint8_t handshakeRequest = 'B';	// Sent to the RasPI, answered with a ready frame
 
-		void loop();
+		enum class FrameType : uint8_t
+		{
+			ready,			// No payload
+			victims			// uint16 sequence, uint32 capture time (RasPI ms), uint16 age at sending (ms), uint8 left VictimCode, uint8 left confidence, uint8 right VictimCode, uint8 right confidence
+		};
+
+		enum class VictimCode : uint8_t
+		{
+			none,
+			harmed,
+			stable,
+			unharmed,
+			red,
+			green,
+			yellow
+		};
+
+		ReturnCode setup();			// Start reception and send the handshake request - doesn't wait
+		ReturnCode waitForReady();	// Wait for the ready frame (at most handshakeTimeout after setup)
+
+		void loop();		// Decode all received bytes - doesn't wait
 
 		VisVictimProb getVictims(bool left);
 
-		void newField();
+		void newField();	// Frames captured before this call are ignored
+
+		uint32_t getLastFrameTime();	// Capture time of the last frame (local ms)
+		uint16_t getLostFrames();		// Frames missing in the sequence
+		uint16_t getBadFrames();		// Frames with wrong version or CRC
 	}
 }
\ No newline at end of file
@@ -0,0 +1,43 @@
+/*
+This private file of the library is responsible for the snapshot of the robot state at the last checkpoint
+*/
+
+#pragma once
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include "AllDatatypes.h"
+#include "MazeMapping.h"
+#include "../../JAFDSettings.h"
+
+namespace JAFD
+{
+	// Everything that the maze in the NVSRAM doesn't hold - written in one burst when reaching a checkpoint
+	// Like the calibration block: version, CRC and two slots, so a reset while writing keeps the last snapshot
+	// The exploration continues from the stored maze, the frontier follows from the visited cells
+	namespace Checkpoint
+	{
+		constexpr uint16_t version = 4;		// Increase with every change of Data
+		constexpr uint8_t maxWalls = JAFDSettings::MazeMapping::VictimEvidence::tableSize;
+
+		struct Data
+		{
+			MapCoordinate coor;			// Checkpoint cell
+			uint8_t floor;				// Floor of the checkpoint cell
+			AbsoluteDir heading;		// Heading when reaching it
+			uint8_t leftCubes;			// Dispenser counts
+			uint8_t rightCubes;
+			uint8_t numWalls;
+			MazeMapping::VictimEvidence::StoredWall walls[maxWalls];
+		};
+
+		ReturnCode setup();			// Read the snapshot - error if there is no valid one (the run starts from scratch)
+		ReturnCode store(const MapCoordinate coor, const AbsoluteDir heading);	// Write a snapshot into the older slot (DMA - doesn't wait)
+		ReturnCode resume();		// Restore floor, pose, victim evidence and dispenser counts of the snapshot
+		void clear();				// Invalidate both slots (new run)
+	}
+}
\ No newline at end of file
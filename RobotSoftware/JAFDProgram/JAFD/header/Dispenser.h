@@ -14,12 +14,24 @@ namespace JAFD
 		// Set up the Dispenser System
 		ReturnCode setup();
 
-		// Dispence items
+		// Dispence items - only starts the drop, the servo is stepped by update() in the background
+		// If the side has not enough cubes, the rest is dropped from the other side after a 180 degree turn
+		// Error if the number is invalid or a drop is still running
 		ReturnCode dispenseLeft(uint8_t number); 
 		ReturnCode dispenseRight(uint8_t number);
 
+		bool isFinished();					// Are all cubes of the last call dropped?
+		void update(const uint8_t freq);	// State machine of the drop (scheduler job) - only steps the servos
+
+		// The 180 degree turn is started by the main loop: while needsTurn() is true, nothing else may set a driving task
+		bool needsTurn();
+		ReturnCode startTurn();				// Start the turn - error if none is needed or it couldn't be started (the rest of the drop is cancelled)
+
 		uint16_t getLeftCubeCount();
 		uint16_t getRightCubeCount();
+
+		// Restore the counts of a checkpoint snapshot
+		void setCubeCounts(const uint8_t left, const uint8_t right);
 	}
 
 }
@@ -16,6 +16,7 @@ This file is responsible for all distance sensors
 #include "../../JAFDSettings.h"
 #include "AllDatatypes.h"
 #include "Interrupts.h"
+#include "StaticQueue.h"
 
 namespace JAFD
 {
@@ -46,9 +47,17 @@ namespace JAFD
 
 			VL6180(uint8_t multiplexCh, uint8_t id);
 			ReturnCode setup() const;
-			uint16_t getDistance();		// Get distance in mm
+			uint16_t getDistance();		// Get distance in mm (waits for measurement)
+			bool dataReady() const;		// Check if a new measurement is available (doesn't wait)
+			uint16_t readDistance();	// Read distance in mm of a finished measurement
+			void queueResultRead();			// Queue reading of status and result in the multiplexer batch
+			bool batchedDataReady() const;	// Is a new measurement in the batched result?
+			uint16_t readBatchedDistance();	// Get distance in mm from the batched result and queue clearing of the interrupt
+			void stopRanging() const;
+			void startRanging() const;
 			Status getStatus() const;
 			void calcCalibData(uint16_t firstTrue, uint16_t firstMeasure, uint16_t secondTrue, uint16_t secondMeasure);
+			void setCalibData(float k, int16_t d);
 			void storeCalibData();
 			void restoreCalibData();
 			void resetCalibData();
@@ -78,6 +87,12 @@ namespace JAFD
 			float _k = 1.0f;
 			int16_t _d = 0;
 
+			// Results of the multiplexer batch
+			uint8_t _batchRangeStatus = 0;
+			uint8_t _batchIntStatus = 0;
+			uint8_t _batchRangeResult = 0;
+
+			uint16_t evaluateMeasurement(const uint8_t rawRange, const uint8_t rawStatus);
 			void loadSettings() const;
 			void write8(uint16_t address, uint8_t data) const;
 			void write16(uint16_t address, uint16_t data) const;
@@ -105,6 +120,7 @@ namespace JAFD
 			uint16_t getDistance();	// Get distance in mm
 			Status getStatus() const;
 			void calcCalibData(uint16_t firstTrue, uint16_t firstMeasure, uint16_t secondTrue, uint16_t secondMeasure);
+			void setCalibData(float k, int16_t d);
 			void storeCalibData();
 			void restoreCalibData();
 			void resetCalibData();
@@ -147,9 +163,17 @@ namespace JAFD
 
 			VL53L0(uint8_t multiplexCh, uint8_t id);
 			ReturnCode setup();
-			uint16_t getDistance();		// Get distance in mm
+			uint16_t getDistance();		// Get distance in mm (waits for measurement)
+			bool dataReady();			// Check if a new measurement is available (doesn't wait)
+			uint16_t readDistance();	// Read distance in mm of a finished measurement
+			void queueResultRead();			// Queue reading of status and result in the multiplexer batch
+			bool batchedDataReady() const;	// Is a new measurement in the batched result?
+			uint16_t readBatchedDistance();	// Get distance in mm from the batched result and queue clearing of the interrupt
+			void stopRanging();
+			void startRanging();
 			Status getStatus() const;
 			void calcCalibData(uint16_t firstTrue, uint16_t firstMeasure, uint16_t secondTrue, uint16_t secondMeasure);
+			void setCalibData(float k, int16_t d);
 			void storeCalibData();
 			void restoreCalibData();
 			void resetCalibData();
@@ -165,6 +189,33 @@ namespace JAFD
 
 			VL53L0X _sensor;
 			Status _status;
+
+			// Results of the multiplexer batch
+			uint8_t _batchIntStatus = 0;
+			uint8_t _batchRange[2] = { 0 };
+
+			uint16_t evaluateMeasurement(const uint16_t rawDistance);
+		};
+
+		// Short distance sensors that are read by the acquisition scheduler
+		enum class SensorID : uint8_t
+		{
+			frontLeft,
+			frontRight,
+			leftFront,
+			leftBack,
+			rightFront,
+			rightBack,
+			numSensors
+		};
+
+		// One timestamped measurement of a distance sensor
+		struct DistSample
+		{
+			uint32_t timestamp;			// Time of acquisition (ms)
+			uint16_t distance;			// Measured distance in mm
+			SensorID sensor;			// Which sensor?
+			DistSensorStatus status;	// Status of the measurement
 		};
 
 		extern VL53L0 frontLeft;	// Front-Left short distance sensor
@@ -177,8 +228,9 @@ namespace JAFD
 
 		ReturnCode setup();
 		ReturnCode reset();
-		void updateDistSensors();
+		void updateDistSensors();						// Collect finished measurements without waiting
+		ReturnCode getSample(DistSample* sample);		// Get oldest sample from the buffer
 		void forceNewMeasurement();
-		void averagedCalibration();
+		ReturnCode autoCalibration();					// Calibrate all short sensors at once - start in the middle of a dead end, facing the front wall
 	}
 }
\ No newline at end of file
@@ -0,0 +1,64 @@
+/*
+This file of the library is responsible for a lock-free double buffer
+*/
+
+#pragma once
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include "AllDatatypes.h"
+
+namespace JAFD
+{
+	// Template class to publish data from one producer to any number of consumers without masking interrupts
+	// The producer writes the inactive buffer and switches; a consumer retries if both buffers got written while it was copying (sequence counter)
+	// Only one context (e.g. one interrupt) may publish - or the other producers have to block it while publishing
+	template <typename T>
+	class DoubleBuffer
+	{
+	private:
+		T _buffers[2];					// Published data; the active buffer is _sequence & 1
+		volatile uint32_t _sequence;	// Number of publications
+
+	public:
+		// Constructor
+		DoubleBuffer() : _buffers(), _sequence(0) {}
+
+		// Publish new data (only from the producer)
+		void publish(const T& data)
+		{
+			const uint32_t next = _sequence + 1;
+
+			_buffers[next & 1] = data;
+
+			// Make sure that the data is written before the buffers are switched
+			__DMB();
+
+			_sequence = next;
+		}
+
+		// Get a consistent copy of the latest data
+		T read() const
+		{
+			T result;
+			uint32_t sequence;
+
+			do
+			{
+				sequence = _sequence;
+
+				__DMB();
+
+				result = _buffers[sequence & 1];
+
+				__DMB();
+			} while ((uint32_t)(_sequence - sequence) > 1);		// The buffer got overwritten while copying
+
+			return result;
+		}
+	};
+}
\ No newline at end of file
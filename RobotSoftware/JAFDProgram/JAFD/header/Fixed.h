@@ -0,0 +1,142 @@
+/*
+This private file of the library is responsible for fixed point numbers
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+
+namespace JAFD
+{
+	// Signed fixed point number (value = raw / 2^fracBits) - only integer instructions
+	// The Cortex-M3 has no FPU, but multiplies 32 x 32 -> 64 bit in one instruction
+	// There is no saturation (except division by 0): values have to stay in the range (Q16.16: -32768 to 32767)
+	template<uint8_t fracBits>
+	class FixedPoint
+	{
+	private:
+		struct RawValue {};		// Tag for fromRaw()
+
+		constexpr FixedPoint(const int32_t raw, RawValue) : raw(raw) {}
+	public:
+		static constexpr int32_t one = static_cast<int32_t>(1) << fracBits;
+
+		int32_t raw;
+
+		constexpr FixedPoint() : raw(0) {}
+		explicit constexpr FixedPoint(const int32_t value) : raw(value * one) {}
+		explicit constexpr FixedPoint(const float value) : raw(static_cast<int32_t>(value * one + (value >= 0.0f ? 0.5f : -0.5f))) {}	// Rounded - free for constants
+
+		static constexpr FixedPoint fromRaw(const int32_t raw)
+		{
+			return FixedPoint(raw, RawValue());
+		}
+
+		explicit constexpr operator float() const
+		{
+			return raw / static_cast<float>(one);
+		}
+
+		constexpr FixedPoint operator-() const
+		{
+			return fromRaw(-raw);
+		}
+
+		constexpr FixedPoint operator+(const FixedPoint other) const
+		{
+			return fromRaw(raw + other.raw);
+		}
+
+		constexpr FixedPoint operator-(const FixedPoint other) const
+		{
+			return fromRaw(raw - other.raw);
+		}
+
+		constexpr FixedPoint operator*(const FixedPoint other) const
+		{
+			return fromRaw(static_cast<int32_t>((static_cast<int64_t>(raw) * other.raw) >> fracBits));
+		}
+
+		constexpr FixedPoint operator*(const int32_t value) const
+		{
+			return fromRaw(raw * value);
+		}
+
+		// Division by 0 saturates
+		FixedPoint operator/(const FixedPoint other) const
+		{
+			if (other.raw == 0) return fromRaw(raw >= 0 ? INT32_MAX : INT32_MIN);
+
+			return fromRaw(static_cast<int32_t>(static_cast<int64_t>(raw) * one / other.raw));
+		}
+
+		FixedPoint& operator+=(const FixedPoint other)
+		{
+			raw += other.raw;
+			return *this;
+		}
+
+		FixedPoint& operator-=(const FixedPoint other)
+		{
+			raw -= other.raw;
+			return *this;
+		}
+
+		FixedPoint& operator*=(const FixedPoint other)
+		{
+			*this = *this * other;
+			return *this;
+		}
+
+		FixedPoint& operator/=(const FixedPoint other)
+		{
+			*this = *this / other;
+			return *this;
+		}
+
+		constexpr bool operator==(const FixedPoint other) const { return raw == other.raw; }
+		constexpr bool operator!=(const FixedPoint other) const { return raw != other.raw; }
+		constexpr bool operator<(const FixedPoint other) const { return raw < other.raw; }
+		constexpr bool operator>(const FixedPoint other) const { return raw > other.raw; }
+		constexpr bool operator<=(const FixedPoint other) const { return raw <= other.raw; }
+		constexpr bool operator>=(const FixedPoint other) const { return raw >= other.raw; }
+	};
+
+	typedef FixedPoint<16> Fixed;	// Q16.16
+
+	// Same functions for float and fixed point - for code that works with both
+	inline float toFloat(const float value)
+	{
+		return value;
+	}
+
+	template<uint8_t fracBits>
+	inline float toFloat(const FixedPoint<fracBits> value)
+	{
+		return static_cast<float>(value);
+	}
+
+	inline float absolute(const float value)
+	{
+		return fabsf(value);
+	}
+
+	template<uint8_t fracBits>
+	inline FixedPoint<fracBits> absolute(const FixedPoint<fracBits> value)
+	{
+		return (value.raw < 0) ? -value : value;
+	}
+
+	// Rounded towards 0 like a cast of a float
+	inline int32_t toInt(const float value)
+	{
+		return static_cast<int32_t>(value);
+	}
+
+	template<uint8_t fracBits>
+	inline int32_t toInt(const FixedPoint<fracBits> value)
+	{
+		return (value.raw >= 0) ? (value.raw >> fracBits) : -(-value.raw >> fracBits);
+	}
+}
\ No newline at end of file
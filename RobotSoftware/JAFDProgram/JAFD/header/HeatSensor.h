@@ -1,5 +1,5 @@
 /*
-This private part of the library is responsible for the AMG8833 heat sensors.
+This private part of the library is responsible for the heat sensors (TPA81 or AMG8833).
 */
 
 #pragma once
@@ -14,11 +14,19 @@ This private part of the library is responsible for the AMG8833 heat sensors.
 
 namespace JAFD
 {
+	// Both sensors are sampled in the background by SensorFusion::updateSensors()
+	// TPA81: the readings are part of the multiplexer batch of the distance sensors
+	// AMG8833: the frames are read on Wire1 by AsyncI2C between two updates
 	namespace HeatSensor
 	{
 		ReturnCode setup();
 		ReturnCode reset();
 
-		bool detectVictim(HeatSensorSide sensor);
+		void queueUpdate();							// Before DistanceSensors::updateDistSensors() - queue the readings if the sample interval has elapsed
+		bool finishUpdate(HeatSensData& data);		// At the end of the update - evaluate finished readings, false if there are none
+
+		bool detectVictim(HeatSensorSide sensor);	// Confidence of the last readings >= 0.5 - doesn't read the sensor
+		float getConfidence(HeatSensorSide sensor);
+		float getAmbientTemp();
 	}
-}
+}
\ No newline at end of file
@@ -6,8 +6,17 @@ This private file of the library is responsible for math functions (fast trig fu
 
 #include "AllDatatypes.h"
 
+#include <string.h>
+
 namespace JAFD
 {
+	// Bounds of the fast functions over their whole range (checked by benchmarkFastMath())
+	// The Cortex-M3 has no FPU - libm needs hundreds of cycles per call, the polynomials only a few multiplications
+	constexpr float fastSinCosMaxError = 2e-7f;			// Absolute
+	constexpr float fastAtan2MaxError = 3e-6f;			// Absolute (rad)
+	constexpr float fastInvSqrtMaxRelError = 1e-5f;		// Relative
+	constexpr float fitAngleMaxError = 1e-5f;			// Absolute (rad) for |angle| < 100 rad
+
 	inline int8_t sgn(const int val) {
 		if (val < 0) return -1;
 		else if (val == 0) return 0;
@@ -20,17 +29,116 @@ namespace JAFD
 		else return 1;
 	}
 
-	// Fits angle to interval [-pi; +pi]
+	// Fits angle to interval [-pi; +pi] - without loops, so far away angles don't take longer
 	inline float fitAngleToInterval(const float angle)
 	{
-		float result = angle;
+		return angle - 6.28318531f * floorf(angle * 0.159154943f + 0.5f);
+	}
+
+	// sin and cos of any angle at once (|angle| < 1000 rad)
+	inline void fastSinCos(const float angle, float& sinResult, float& cosResult)
+	{
+		// Remainder in [-pi/4; pi/4] - pi/2 is split in three parts (Cody-Waite), so the remainder keeps its precision
+		// The first two parts have only 8 and 12 significant bits - their products with the quadrant are exact up to 2^12 quadrants
+		const float quadrant = floorf(angle * 0.636619772f + 0.5f);
+		const float x = ((angle - quadrant * 1.5703125f) - quadrant * 4.8387050629e-4f) - quadrant * -4.3711388287e-8f;
+		const float x2 = x * x;
+
+		// Taylor polynomials (like the kernels of the fdlibm)
+		const float sinX = x + x * x2 * (-1.6666667163e-1f + x2 * (8.3333337680e-3f + x2 * (-1.9841270114e-4f + x2 * 2.7557314297e-6f)));
+		const float cosX = 1.0f - 0.5f * x2 + x2 * x2 * (4.1666667908e-2f + x2 * (-1.3888889225e-3f + x2 * (2.4801587642e-5f + x2 * -2.7557314297e-7f)));
+
+		switch (static_cast<int32_t>(quadrant) & 0b11)
+		{
+		case 0:
+			sinResult = sinX;
+			cosResult = cosX;
+			break;
+		case 1:
+			sinResult = cosX;
+			cosResult = -sinX;
+			break;
+		case 2:
+			sinResult = -sinX;
+			cosResult = -cosX;
+			break;
+		default:
+			sinResult = -cosX;
+			cosResult = sinX;
+			break;
+		}
+	}
+
+	inline float fastSin(const float angle)
+	{
+		float sinResult, cosResult;
+		fastSinCos(angle, sinResult, cosResult);
+
+		return sinResult;
+	}
+
+	inline float fastCos(const float angle)
+	{
+		float sinResult, cosResult;
+		fastSinCos(angle, sinResult, cosResult);
+
+		return cosResult;
+	}
+
+	// Same result range as atan2f ([-pi; +pi])
+	inline float fastAtan2(const float y, const float x)
+	{
+		const float absX = fabsf(x);
+		const float absY = fabsf(y);
 
-		while (result > M_PI) result -= M_TWOPI;
-		while (result < -M_PI) result += M_TWOPI;
+		if (absX == 0.0f && absY == 0.0f) return 0.0f;
+
+		// Polynomial of atan in [0; 1] - the other octants by symmetry
+		const bool swapped = absY > absX;
+		const float a = swapped ? absX / absY : absY / absX;
+		const float a2 = a * a;
+
+		float result = a * (0.99997726f + a2 * (-0.33262347f + a2 * (0.19354346f + a2 * (-0.11643287f + a2 * (0.05265332f + a2 * -0.01172120f)))));
+
+		if (swapped) result = 1.57079633f - result;
+		if (x < 0.0f) result = 3.14159265f - result;
+
+		return (y < 0.0f) ? -result : result;
+	}
+
+	// 1 / sqrt(x) for x > 0
+	inline float fastInvSqrt(const float x)
+	{
+		uint32_t bits;
+		float result;
+
+		// Estimation by the exponent and two newton iterations
+		memcpy(&bits, &x, sizeof(float));
+		bits = 0x5f375a86 - (bits >> 1);
+		memcpy(&result, &bits, sizeof(float));
+
+		result *= 1.5f - 0.5f * x * result * result;
+		result *= 1.5f - 0.5f * x * result * result;
 
 		return result;
 	}
 
+	inline float fastSqrt(const float x)
+	{
+		if (x <= 0.0f) return 0.0f;
+
+		return x * fastInvSqrt(x);
+	}
+
+	// Input is clamped to [-1; 1]
+	inline float fastAsin(const float x)
+	{
+		if (x >= 1.0f) return 1.57079633f;
+		if (x <= -1.0f) return -1.57079633f;
+
+		return fastAtan2(x, fastSqrt(1.0f - x * x));
+	}
+
 	// Interpolates two orientations in the correct way.
 	// Angles must be in range [-pi; pi]
 	// if factor=0 => result=a
@@ -67,25 +175,33 @@ namespace JAFD
 	// Get heading relative to starting position using the normalized forward vector
 	inline float getGlobalHeading(const Vec3f& forwardVec)
 	{
-		return atan2f(forwardVec.y, forwardVec.x);
+		return fastAtan2(forwardVec.y, forwardVec.x);
 	}
 
 	// Get pitch relative to starting position using the normalized forward vector
 	inline float getPitch(const Vec3f& forwardVec)
 	{
-		return asinf(forwardVec.z);
+		return fastAsin(forwardVec.z);
 	}
 
 	inline Vec3f toForwardVec(const float globalHeading, const float pitch)
 	{
 		Vec3f result;
 
-		float cosPitch = cosf(pitch);
+		float sinPitch, cosPitch;
+		float sinHeading, cosHeading;
 
-		result.z = sinf(pitch);
-		result.x = cosf(globalHeading) * cosPitch;
-		result.y = sinf(globalHeading) * cosPitch;
+		fastSinCos(pitch, sinPitch, cosPitch);
+		fastSinCos(globalHeading, sinHeading, cosHeading);
+
+		result.z = sinPitch;
+		result.x = cosHeading * cosPitch;
+		result.y = sinHeading * cosPitch;
 
 		return result;
 	}
+
+	// Compare the fast functions with libm over their range and print the errors and run times per call (ns) over Serial
+	// Error if a function exceeds its bound
+	ReturnCode benchmarkFastMath();
 }
\ No newline at end of file
@@ -21,31 +21,149 @@ namespace JAFD
 			constexpr uint8_t west = 0b11 << 1;
 		}
 
-		// Usable size for the maze mapping
-		constexpr uint32_t usableSize = 64 * 1024;
-
 		// Maximum/minimum coordinates that can fit in the SRAM
 		constexpr int8_t maxX = 31;
 		constexpr int8_t minX = -32;
 		constexpr int8_t maxY = 31;
 		constexpr int8_t minY = -32;
 
+		// Layout in the NVSRAM: floor 0 | floor 1 | ... | ramp table
+		// A floor is row after row (x-Axis first) with 3 packed bytes per cell: cell connections, cell state, BFS value
+		constexpr uint8_t bytesPerCell = 3;
+		constexpr uint16_t rowSize = (maxX - minX + 1) * bytesPerCell;
+		constexpr uint16_t floorSize = rowSize * (maxY - minY + 1);
+		constexpr uint8_t maxFloors = 5;
+		constexpr uint8_t maxRampTransitions = 16;
+		constexpr uint32_t rampTableAddr = maxFloors * floorSize;		// Relative to the start of the maze mapping
+
+		// Usable size for the maze mapping
+		constexpr uint32_t usableSize = 64 * 1024;
+
 		// Namespace for the Breadth-First-Search-Algorithm to find the shortest Path
 		namespace BFAlgorithm
 		{
 			// Reset all BFS Values in this floor
 			void resetBFSValues();
 
-			// Find the shortest known path from a to b
+			// Find the shortest known path from a to b (uses own scratch memory, the stored BFS values are not changed)
 			ReturnCode findShortestPath(const MapCoordinate start, uint8_t* directions, const uint8_t maxPathLength, bool(*goalCondition)(MapCoordinate coor, GridCell cell), bool(*ispassable)(GridCell cell));
 		}
 
-		// Setup the MazeMapper
-		ReturnCode setup();
+		// Namespace for the weighted path planner (costs for turns, ramps and bumps are in JAFDSettings)
+		// The path is terminated with EntranceDirections::nowhere if it is shorter than maxPathLength, longer paths are cut after maxPathLength steps
+		namespace PathPlanner
+		{
+			// Find the fastest known path to a cell that fulfills the goal condition (Dijkstra)
+			ReturnCode findFastestPath(const MapCoordinate start, const AbsoluteDir startDir, uint8_t* directions, const uint8_t maxPathLength, bool(*goalCondition)(MapCoordinate coor, GridCell cell), bool(*isPassable)(GridCell cell));
+
+			// Find the fastest known path to one cell (A* with Manhattan heuristic)
+			ReturnCode findFastestPath(const MapCoordinate start, const AbsoluteDir startDir, const MapCoordinate goal, uint8_t* directions, const uint8_t maxPathLength, bool(*isPassable)(GridCell cell));
+		}
+
+		// Namespace for the incremental planner (D* Lite with all frontier cells as goals) - keeps the cost to the nearest frontier cell for every cell
+		// Changed cells and frontiers only repair the affected part, the search stops as soon as the cost of the start is known
+		// Same costs as PathPlanner except for turns (one byte per cell in multiples of JAFDSettings::MazeMapping::IncrementalPlanner::costUnit)
+		namespace IncrementalPlanner
+		{
+			// Path to the nearest frontier cell - error if there is none or the open list is full (the next call starts from scratch then)
+			// Equal costs prefer driving straight on
+			ReturnCode getPath(const MapCoordinate start, const AbsoluteDir startDir, uint8_t* directions, const uint8_t maxPathLength, bool(*isPassable)(GridCell cell));
+
+			// Informs about a changed cell or frontier (called by setGridCell and Exploration)
+			void cellChanged(const MapCoordinate coor);
+
+			// Discard the costs - the next call of getPath() starts from scratch (called by Exploration::rebuild)
+			void reset();
+		}
+
+		// Namespace for the frontier based exploration - frontier cells aren't visited yet, but can be entered from a visited cell
+		// The set of frontier cells is updated with every changed cell, so finding the next target doesn't scan the whole map
+		namespace Exploration
+		{
+			// Path to the frontier cell with the lowest travel time (IncrementalPlanner, PathPlanner if it fails) - error if there is none (exploration finished)
+			// Uses the decision of planAhead() if the robot is at the last target and it is a dead end - otherwise new frontier cells next to the target usually end the search after a few cells
+			ReturnCode findNextPath(const MapCoordinate start, const AbsoluteDir startDir, uint8_t* directions, const uint8_t maxPathLength, bool(*isPassable)(GridCell cell));
+
+			// Plan the decision after the target of the last path while driving there (once per path)
+			void planAhead(bool(*isPassable)(GridCell cell));
+
+			// Target of the last path
+			MapCoordinate getTarget();
+
+			uint16_t getNumFrontiers();
+			bool isFrontier(const MapCoordinate coor);
+
+			// Informs about a changed cell (called by setGridCell)
+			void cellChanged(const MapCoordinate coor);
+
+			// Find all frontier cells of the current floor (called by loadCache and resetAllCells)
+			void rebuild();
+		}
+
+		// Namespace for the victim evidence - camera and heat detections are projected onto the wall they face and accumulated per cell and wall
+		// Side table next to the cell cache: only walls with a positive detection get an entry, the weakest entry is replaced if it is full
+		// Entries are kept per floor - all functions work on the current floor, the checkpoint snapshot holds all floors
+		namespace VictimEvidence
+		{
+			// Accumulated evidence for one wall
+			struct WallEvidence
+			{
+				uint16_t visual[7];		// Sum of camera weights (0 - 255 per frame) in the order of VisVictimProb (harmed, stable, unharmed, red, green, yellow, none)
+				uint8_t visualFrames;	// Number of camera frames
+				uint8_t heatHits;		// Heat readings above the threshold
+				uint8_t heatReadings;	// Number of heat readings
+				bool rescued;			// Rescue kits are dropped (RobotLogic)
+			};
+
+			// Add a camera frame (weights 0.0 - 1.0) - the camera looks to the left or right side of the robot at position (cm) and global heading (rad)
+			void addVisual(const Vec2f position, const float heading, const bool left, const VisVictimProb& frame);
+
+			// Add a heat reading - same projection as for the camera
+			void addHeat(const Vec2f position, const float heading, const bool left, const bool detected);
+
+			// Get the evidence of a wall (error if there is none)
+			ReturnCode getEvidence(const MapCoordinate coor, const AbsoluteDir wall, WallEvidence& evidence);
+
+			// Average camera weights of a wall
+			VisVictimProb getVisualProb(const MapCoordinate coor, const AbsoluteDir wall);
+
+			// Share of heat readings above the threshold
+			float getHeatProb(const MapCoordinate coor, const AbsoluteDir wall);
+
+			// The victim of a wall is handled - it isn't reported again (error if the wall has no evidence)
+			ReturnCode setRescued(const MapCoordinate coor, const AbsoluteDir wall);
+
+			// Delete all evidence
+			void reset();
+
+			// Evidence of one wall with its position (for the checkpoint snapshot)
+			struct StoredWall
+			{
+				MapCoordinate coor;
+				uint8_t floor;
+				AbsoluteDir wall;
+				WallEvidence evidence;
+			};
+
+			// Copy all walls with evidence - returns the number of walls
+			uint8_t exportWalls(StoredWall* walls, const uint8_t maxWalls);
+
+			// Replace all evidence
+			void importWalls(const StoredWall* walls, const uint8_t numWalls);
+		}
+
+		// Setup the MazeMapper - keepMap continues with the maze stored in the NVSRAM (resume from a checkpoint)
+		ReturnCode setup(const bool keepMap = false);
 		
 		// Reset stored maze
 		void resetAllCells();
 
+		// Write changed cells from the RAM cache back to the NVSRAM
+		void flushCache();
+
+		// Load the stored maze from the NVSRAM into the RAM cache
+		void loadCache();
+
 		// Set a grid cell in the RAM
 		void setGridCell(const GridCell gridCell, const MapCoordinate coor);
 		void setGridCell(const uint8_t bfsValue, const MapCoordinate coor);
@@ -58,5 +176,18 @@ namespace JAFD
 
 		// Set current cell and recalculate certainty
 		void setCurrentCell(const GridCell gridCell, float& currentCertainty, const float updateCertainty, MapCoordinate coor);
+
+		// Floors - the RAM cache holds the current floor, the others are only in the NVSRAM (all grid cell functions work on the current floor)
+		// Floors are numbered in the order they are discovered: every ramp transition is stored in both directions
+		uint8_t getFloor();
+		uint8_t getNumFloors();
+
+		// Write the current floor back and load another one (error if the floor doesn't exist)
+		ReturnCode setFloor(const uint8_t floor);
+
+		// The robot drove over a ramp from cell "from" in direction "dir" and arrived at "to" - changes to the floor at the end of the ramp (called by SensorFusion)
+		// Both ends get the ramp direction in their cell connections
+		// A known ramp leads to its stored floor, an unknown one to a new floor (error if there are no free floors or transitions)
+		ReturnCode traverseRamp(const MapCoordinate from, const AbsoluteDir dir, const MapCoordinate to);
 	}
 }
@@ -0,0 +1,45 @@
+/*
+This private file of the library is responsible for jerk limited motion profiles
+*/
+
+#pragma once
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include "../../JAFDSettings.h"
+#include "AllDatatypes.h"
+
+namespace JAFD
+{
+	// Velocity profile over a distance (or angle) with limited acceleration and jerk (S-curve)
+	// The profile is planned once and stored as a table of speeds over the travelled distance, so a controller only needs a lookup per tick
+	// All values are absolute - the direction is handled by the caller
+	class MotionProfile
+	{
+	private:
+		float _speeds[JAFDSettings::MotionProfile::tableSize];	// Speed at i * _distance / (tableSize - 1)
+		float _distance;										// Total distance
+
+		// Time needed to change speed from startSpeed to endSpeed
+		static float transitionTime(const float startSpeed, const float endSpeed, const float maxAcc, const float maxJerk);
+
+		// Distance needed to change speed from startSpeed to endSpeed
+		static float transitionDist(const float startSpeed, const float endSpeed, const float maxAcc, const float maxJerk);
+
+		// Speed at time t of a speed change from startSpeed to endSpeed
+		static float transitionSpeed(const float startSpeed, const float endSpeed, const float maxAcc, const float maxJerk, const float t);
+	public:
+		MotionProfile();
+
+		// Plan profile: start speed -> peak speed (at most maxSpeed) -> end speed
+		// If the distance is too short for the speed change, acceleration and jerk are increased so that the profile still ends at distance
+		ReturnCode plan(const float distance, const float startSpeed, const float endSpeed, const float maxSpeed, const float maxAcc, const float maxJerk);
+
+		// Desired speed after travelling drivenDist
+		float getSpeed(const float drivenDist) const;
+	};
+}
\ No newline at end of file
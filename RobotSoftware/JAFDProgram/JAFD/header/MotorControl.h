@@ -32,10 +32,17 @@ namespace JAFD
 		// Interrupthandler for Encoder
 		void encoderInterrupt(const Interrupts::InterruptSource source, const uint32_t isr);
 
+		// Interrupthandler for the ADC (end of one half of the DMA buffer)
+		void adcInterrupt();
+
 		// Set motor speed (cm/2)
 		void setSpeeds(const WheelSpeeds wheelSpeeds);
 
-		// Get the current
+		// Get the current (average of the last half of the DMA buffer - doesn't wait)
 		float getCurrent(const Motor motor);
+
+		// Identify the feedforward tables of both motors and store them in the calibration block (blocking, scheduler has to run)
+		// The robot drives forward and backward on the spot with increasing PWM - needs about 20 cm of free space in front
+		ReturnCode characterize();
 	}
 }
\ No newline at end of file
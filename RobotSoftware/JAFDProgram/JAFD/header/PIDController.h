@@ -6,6 +6,8 @@ This part is responsible for a PID-Controller
 
 #include <stdint.h>
 
+#include "Fixed.h"
+
 namespace JAFD
 {
 	struct PIDSettings
@@ -21,18 +23,45 @@ namespace JAFD
 		constexpr PIDSettings(float kp, float ki, float kd, float maxAbsInt, float maxAbsDiff, float minOutput, float maxOutput) : kp(kp), ki(ki), kd(kd), maxAbsInt(maxAbsInt), maxAbsDiff(maxAbsDiff), minOutput(minOutput), maxOutput(maxOutput) {}
 	};
 
-	class PIDController
+	// Terms of the last output (before limiting)
+	struct PIDTerms
+	{
+		float p;	// Proportional term
+		float i;	// Integral term
+		float d;	// Differential term
+
+		constexpr PIDTerms(float p = 0.0f, float i = 0.0f, float d = 0.0f) : p(p), i(i), d(d) {}
+	};
+
+	// PID controller for float or fixed point numbers (see Fixed.h) - the settings are converted once
+	template<typename Number>
+	class BasicPIDController
 	{
 	private:
-		const PIDSettings settings;		// Settings 
-		float errorInt;					// Error integral
-		float lastErr;					// Last error
+		Number kp;						// Settings (gains can be scheduled)
+		Number ki;
+		Number kd;
+		const Number maxAbsInt;
+		const Number maxAbsDiff;
+		const Number minOutput;
+		const Number maxOutput;
+		Number errorInt;				// Error integral
+		Number lastErr;					// Last error
 		uint32_t lastTimePoint;			// Last time 'process()' has been called in ms.
 		bool firstCall;					// Is it the first call to process after a reset?
+		Number lastP;					// Terms of the last call to process
+		Number lastI;
+		Number lastD;
 	public:
-		PIDController(const PIDSettings settings);
-		float process(const float setPoint, const float currentValue);					// Process inputs and get controller output
-		float process(const float setPoint, const float currentValue, const float dt);	// Process inputs and get controller output with specified dt.
-		void reset();																	// Reset the controller
+		BasicPIDController(const PIDSettings settings);
+		Number process(const Number setPoint, const Number currentValue);					// Process inputs and get controller output
+		Number process(const Number setPoint, const Number currentValue, const Number dt);	// Process inputs and get controller output with specified dt.
+		void reset();																		// Reset the controller
+		void setGains(const Number kp, const Number ki, const Number kd);					// Change the gains - the limits stay
+		PIDTerms getLastTerms() const;														// Terms of the last output
 	};
+
+	typedef BasicPIDController<float> PIDController;
+	typedef BasicPIDController<Fixed> FixedPIDController;		// Q16.16 for the interrupts - limits and terms have to stay in +-32768
+
 }
\ No newline at end of file
@@ -0,0 +1,48 @@
+/*
+This private file of the library is responsible for the extended kalman filter estimating the robot pose
+*/
+
+#pragma once
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include "AllDatatypes.h"
+
+namespace JAFD
+{
+	// EKF over (x, y, heading, forward velocity, angular velocity) with a constant velocity model
+	// Not interrupt safe - calls from the main loop have to be locked against sensorFiltering()
+	namespace PoseEKF
+	{
+		// Estimated state
+		struct PoseState
+		{
+			float x;			// Position (cm)
+			float y;
+			float heading;		// Global heading including full turns (rad)
+			float vel;			// Forward velocity (cm/s)
+			float angularVel;	// Yaw rate (rad/s)
+		};
+
+		// Reset state and covariance to a certain pose
+		void reset(const float x, const float y, const float heading);
+
+		// Predict step (dt in s); cosPitch scales the velocity projected to the xy-plane
+		void predict(const float dt, const float cosPitch);
+
+		// Update steps with a direct measurement of one state variable and its variance
+		// Error if the measurement is rejected as outlier
+		ReturnCode updateX(const float x, const float variance);
+		ReturnCode updateY(const float y, const float variance);
+		ReturnCode updateHeading(const float heading, const float variance);	// Heading may be in any interval
+		ReturnCode updateVel(const float vel, const float variance);
+		ReturnCode updateAngularVel(const float angularVel, const float variance);
+
+		// Current estimate
+		PoseState getState();
+	}
+}
\ No newline at end of file
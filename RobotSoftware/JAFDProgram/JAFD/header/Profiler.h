@@ -0,0 +1,49 @@
+/*
+This private file of the library is responsible for measuring the run time of code sections
+*/
+
+#pragma once
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include "AllDatatypes.h"
+
+namespace JAFD
+{
+	// Profiler using the DWT cycle counter (MCK cycles)
+	// Every section has min / avg / max statistics in a fixed table; a section must only be measured from one context
+	// The times include interrupts that interrupted the section
+	namespace Profiler
+	{
+		typedef uint8_t SectionID;
+
+		constexpr SectionID invalidSection = 0xff;		// Returned if the table is full - measuring it does nothing
+
+		// Start cycle counter
+		ReturnCode setup();
+
+		// Add a named section (name must stay valid)
+		SectionID addSection(const char* name);
+
+		// Current value of the cycle counter
+		inline uint32_t getCycles()
+		{
+			return DWT->CYCCNT;
+		}
+
+		// Measure a section
+		void start(const SectionID section);
+		void stop(const SectionID section);
+		void record(const SectionID section, const uint32_t cycles);
+
+		// Clear all statistics
+		void reset();
+
+		// Print all statistics over Serial
+		void dump();
+	}
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+/*
+This private file of the library is responsible for calling periodic jobs from the timer interrupts
+*/
+
+#pragma once
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include "AllDatatypes.h"
+
+namespace JAFD
+{
+	// Static scheduler for periodic jobs
+	// Every priority has its own timer interrupt (TC3 / TC4 / TC5) - jobs with higher priority interrupt jobs with lower priority
+	// Jobs of the same priority are called in the order they were added
+	namespace Scheduler
+	{
+		enum class Priority : uint8_t
+		{
+			high,		// TC3 - base frequency: JAFDSettings::Scheduler::highFreq
+			medium,		// TC4 - base frequency: JAFDSettings::Scheduler::mediumFreq
+			low,		// TC5 - base frequency: JAFDSettings::Scheduler::lowFreq
+			numPriorities
+		};
+
+		// Periodic job - gets its own frequency
+		typedef void(*Job)(const uint8_t freq);
+
+		// Add a job (only before setup()) - the base frequency of the priority has to be a multiple of freq
+		// Named jobs get a section in the profiler
+		ReturnCode addJob(Job job, const uint8_t freq, const Priority priority, const char* name = nullptr);
+
+		// Start the timers of all priorities with jobs (after Profiler::setup())
+		ReturnCode setup();
+
+		// Number of times the jobs of a priority didn't finish before the next period started
+		uint16_t getOverruns(const Priority priority);
+		uint16_t getOverruns(Job job);
+
+		// Called by the timer interrupts
+		void tick(const Priority priority);
+	}
+}
\ No newline at end of file
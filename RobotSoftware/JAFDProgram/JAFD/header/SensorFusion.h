@@ -11,17 +11,42 @@ This file of the library is responsible for the sensor fusion
 #endif
 
 #include "AllDatatypes.h"
+#include "DistanceSensors.h"
 
 namespace JAFD
 {
 	namespace SensorFusion
 	{
+		// Pose of the robot at a time
+		struct TimedPose
+		{
+			uint32_t time;		// Time of the pose (ms)
+			Vec2f position;		// Position (cm)
+			float heading;		// Global heading (rad)
+		};
+
+		// Inputs of sensorFiltering() - recorded by the telemetry, so a run can be replayed on the host (JAFDBench replay)
+		struct FilterInputs
+		{
+			uint32_t time;					// Time of the readings (ms)
+			FloatWheelSpeeds wheelSpeeds;	// Speeds of the wheels (cm/s)
+			Vec3f bnoForwardVec;			// Forward vector of the Bno055
+			float bnoRotSpeed;				// Rotation speed of the Bno055 (deg/s)
+		};
+
 		void sensorFiltering(const uint8_t freq);					// Apply filter and calculate robot state
+		void filterInputs(const FilterInputs& inputs, const uint8_t freq);	// Filter given inputs (sensorFiltering() reads them from the sensors)
 		void untimedFusion();										// Update sensor values
+		void untimedFusion(const uint32_t now);						// Update sensor values at a given time (ms)
 		void updateSensors();										// Update all sensors
-		const volatile FusedData& getFusedData();					// Get current robot state
+		FusedData getFusedData();									// Get a consistent copy of the fused data (without masking interrupts)
+		RobotState getRobotState();									// Get a consistent copy of the robot state (without masking interrupts)
 		void setCertainRobotPosition(Vec3f pos, float heading);		// Set a certain robot position and angle
 		void setDistances(Distances distances);
 		void setDistSensStates(DistSensorStates distSensorStates);
+		uint32_t getDistSampleTime(const DistanceSensors::SensorID sensor);	// Get time of the last sample of a distance sensor
+		ReturnCode getPoseAt(const uint32_t time, TimedPose& pose);	// Get the pose at a past time (interpolated, error if older than the history)
+		void setDistSensPoseUpdates(const bool enabled);			// Enable or disable the corrections of the pose by the distance sensors
+		ReturnCode getDistSensMounting(const DistanceSensors::SensorID sensor, Vec2f& position, Vec2f& direction);	// Mounting of a short distance sensor in the robot frame (cm, x forward, y left)
 	}
 }
\ No newline at end of file
@@ -20,11 +20,25 @@ namespace JAFD
 		ReturnCode resetBus();
 	}
 
+	// The main loop and all interrupts share one stack (MSP) - at setup the free RAM below it is painted with a pattern,
+	// so the deepest point that was ever reached (high-water mark) can be found later by searching the first overwritten word
 	namespace MemWatcher
 	{
 		uint32_t getDynamicRam();
 		uint32_t getStackRam();
 		uint32_t getFreeRam();
+
+		void paintStack();								// Paint the free RAM - first thing in the setup
+		uint32_t getStackHighWater();					// Deepest stack use since paintStack() (bytes) - searches the painted RAM (~1 ms)
+		void sampleInterruptStack();					// At the start of interrupts - records the deepest stack pointer
+		uint32_t getInterruptStackDepth();				// Largest stack use at the start of a sampled interrupt (bytes)
+		uint32_t getStaticRam();						// .data and .bss (bytes)
+
+		ReturnCode addBuffer(const char* name, const uint32_t size);	// Account a static buffer of a subsystem - error if the table is full
+		uint32_t getBufferRam();						// Sum of the added buffers (bytes)
+
+		void update();									// In the main loop - sends a memory record every reportInterval
+		void dump();									// Print RAM usage and the buffer table over Serial
 	}
 
 	namespace Wait
@@ -34,7 +48,7 @@ namespace JAFD
 		void waitForFinishedTask();
 	}
 
-	// TODO
+	// Switch on the robot - pressed while booting starts a new run instead of resuming from the last checkpoint
 	namespace Switch
 	{
 		void setup();
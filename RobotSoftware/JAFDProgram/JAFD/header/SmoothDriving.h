@@ -9,6 +9,7 @@ This part of the Library is responsible for driving smoothly.
 #include "../../JAFDSettings.h"
 #include "AllDatatypes.h"
 #include "Vector.h"
+#include "MotionProfile.h"
 
 namespace JAFD
 {
@@ -37,21 +38,24 @@ namespace JAFD
 
 		class Accelerate : public ITask
 		{
+			friend class TaskArray;
 		private:
 			int16_t _endSpeeds;					// End speed of both wheels
 			float _distance;					// Distance the robot has to travel
 			Vec2f _targetDir;					// Target direction (guranteed to be normalized)
 			Vec2f _startPos;					// Start position
 			int16_t _startSpeeds;				// Average start speed of both wheels
-			float _totalTime;					// Calculated time needed to drive
+			int16_t _maxSpeeds;					// Peak speed between start and end (0 = no peak)
+			MotionProfile _profile;				// Speed over driven distance
 		public:
-			explicit Accelerate(int16_t endSpeeds = 0, float distance = 0.0f);
+			explicit Accelerate(int16_t endSpeeds = 0, float distance = 0.0f, int16_t maxSpeeds = 0);	// Jerk limited; optionally accelerate up to maxSpeeds and slow down to endSpeeds in time
 			ReturnCode startTask(RobotState startState);
 			WheelSpeeds updateSpeeds(const uint8_t freq);
 		};
 
 		class DriveStraight : public ITask
 		{
+			friend class TaskArray;
 		private:
 			int16_t _speeds;					// Speeds of both wheels
 			float _distance;					// Distance the robot has to travel
@@ -76,8 +80,7 @@ namespace JAFD
 			float _maxAngularVel;			// Maximum angular velocity
 			float _angle;					// Angle the robot has to rotate in rad
 			float _startAngle;				// Angle at start
-			float _totalTime;				// Calculated time needed to drive
-			bool _accelerate;				// Still accelerating?	
+			MotionProfile _profile;			// Angular velocity over rotated angle
 		public:
 			explicit Rotate(float maxAngularVel = 0, float angle = 0.0f);			// Set angular velocity in rad/s and angle in degree
 			ReturnCode startTask(RobotState startState);
@@ -107,10 +110,56 @@ namespace JAFD
 			WheelSpeeds updateSpeeds(const uint8_t freq);
 		};
 
-		class TaskArray : public ITask
+		// Drive along a path of cells without stopping - straight runs are merged and turns are driven as arcs
+		// An initial turn is done on the spot; the path ends before the first reversal
+		// The profile of the next segment is planned by planAhead() in the main loop
+		class FollowPath : public ITask
 		{
+			friend void planAhead();
 		private:
-			enum class _TaskType : uint8_t
+			enum class _SegmentType : uint8_t
+			{
+				turn,		// Turn on the spot (length in rad)
+				line,		// Straight line (length in cm)
+				arc			// Quarter circle (length in cm)
+			};
+
+			struct _Segment
+			{
+				_SegmentType type;
+				Vec2f start;			// Start point
+				float heading;			// Heading at start (global heading including full turns)
+				float length;			// Length of the segment
+				float curvature;		// Heading change per length (positive = left)
+				float maxSpeed;			// Speed limit (cm/s or rad/s)
+				float endSpeed;			// Speed at the end
+			};
+
+			uint8_t _directions[JAFDSettings::SmoothDriving::maxPathLength];	// Path as EntranceDirections
+			uint8_t _pathLength;												// Number of directions
+
+			_Segment _segments[JAFDSettings::SmoothDriving::maxPathLength * 2 + 1];
+			uint8_t _numSegments;
+			uint8_t _currentSegment;
+			MotionProfile _profile;				// Speed over the current segment
+			MotionProfile _nextProfile;			// Speed over the next segment (planned ahead)
+			volatile bool _nextPlanned;			// Is _nextProfile planned for the segment after _currentSegment?
+
+			ReturnCode addSegment(const _SegmentType type, const Vec2f start, const float heading, const float length, const float curvature, const float maxSpeed);
+			ReturnCode planSegment(const uint8_t segment, const float startSpeed, MotionProfile& profile) const;
+			ReturnCode nextSegment();			// Switch to the next segment - plans it in the interrupt if planAhead() was too late
+		public:
+			explicit FollowPath(const uint8_t* directions = nullptr, const uint8_t pathLength = 0);		// Directions as EntranceDirections, terminated by nowhere if shorter than pathLength
+			ReturnCode startTask(RobotState startState);
+			WheelSpeeds updateSpeeds(const uint8_t freq);
+		};
+
+		// Static pool for the tasks of TaskArrays - no heap and every slot only as large as its own task type
+		// Tasks are referenced by handles with a reference count, so copying a TaskArray only copies handles
+		namespace TaskPool
+		{
+			// Same order as Telemetry::TaskType
+			enum class TaskType : uint8_t
 			{
 				accelerate,
 				straight,
@@ -118,30 +167,62 @@ namespace JAFD
 				rotate,
 				forceSpeed,
 				alignFront
-			} _taskTypes[JAFDSettings::SmoothDriving::maxArrrayedTasks];
+			};
 
-			union _TaskCopies
+			struct Handle
 			{
-				Accelerate accelerate;
-				DriveStraight straight;
-				Stop stop;
-				Rotate rotate;
-				ForceSpeed forceSpeed;
-				AlignFront alignFront;
-
-				_TaskCopies() : stop() {};
-				~_TaskCopies() {}
-			} _taskCopies[JAFDSettings::SmoothDriving::maxArrrayedTasks];
-
-			ITask* _taskArray[JAFDSettings::SmoothDriving::maxArrrayedTasks];
+				TaskType type;
+				uint8_t index;		// Slot in the pool of the task type
+			};
+
+			// Copy a task into a free slot (reference count 1) - error if the pool is full
+			ReturnCode add(const Accelerate& task, Handle& handle);
+			ReturnCode add(const DriveStraight& task, Handle& handle);
+			ReturnCode add(const Stop& task, Handle& handle);
+			ReturnCode add(const Rotate& task, Handle& handle);
+			ReturnCode add(const ForceSpeed& task, Handle& handle);
+			ReturnCode add(const AlignFront& task, Handle& handle);
+
+			void retain(const Handle handle);		// Increase reference count
+			void release(const Handle handle);		// Decrease reference count, slot is free at 0
+			ITask* get(const Handle handle);		// Task of a handle
+			ReturnCode unshare(Handle& handle);		// Copy a shared task into its own slot (the handle is unchanged on error)
+			uint8_t getFreeSlots(const TaskType type);
+		}
+
+		// Queue of tasks in the task pool
+		// Copies share their tasks until they are started - startTask() copies shared tasks into their own slots
+		class TaskArray : public ITask
+		{
+		private:
+			TaskPool::Handle _tasks[JAFDSettings::SmoothDriving::maxArrrayedTasks];	// Tasks in reverse order (index 0 is the last task)
 
 			uint8_t _numTasks = 0;
 			int16_t _currentTaskNum = 0;
+			bool _valid = true;				// False if a task didn't fit into the pool or the array
+
+			// Add a task in front of all others (constructors are called from the last to the first task)
+			template<typename T>
+			void addFirst(const T& task)
+			{
+				if (_numTasks >= JAFDSettings::SmoothDriving::maxArrrayedTasks || TaskPool::add(task, _tasks[_numTasks]) != ReturnCode::ok)
+				{
+					_valid = false;
+					return;
+				}
+
+				_currentTaskNum = _numTasks;
+				_numTasks++;
+			}
+
+			void mergeLinearTasks();		// Merge consecutive Accelerate / DriveStraight tasks into one continuous profile
 
 		public:
 			TaskArray() = delete;
 
 			TaskArray(const TaskArray& taskArray);
+			TaskArray& operator=(const TaskArray& taskArray);
+			~TaskArray();
 
 			TaskArray(const Accelerate& task);
 			TaskArray(const DriveStraight& task);
@@ -154,56 +235,62 @@ namespace JAFD
 			template<typename ...Rem, typename = char[JAFDSettings::SmoothDriving::maxArrrayedTasks - sizeof ...(Rem)]>
 			TaskArray(const Accelerate& task, const Rem&... rem) : TaskArray(rem...)
 			{
-				_taskTypes[_numTasks] = _TaskType::accelerate;
-				_taskArray[_numTasks] = new(&(_taskCopies[_numTasks].accelerate)) Accelerate(task);
-				_numTasks++;
+				addFirst(task);
 			}
 
 			// Uses SFINAE to prohibit more than maximum arguments.
 			template<typename ...Rem, typename = char[JAFDSettings::SmoothDriving::maxArrrayedTasks - sizeof ...(Rem)]>
 			TaskArray(const DriveStraight& task, const Rem&... rem) : TaskArray(rem...)
 			{
-				_taskTypes[_numTasks] = _TaskType::straight;
-				_taskArray[_numTasks] = new(&(_taskCopies[_numTasks].straight)) DriveStraight(task);
-				_numTasks++;
+				addFirst(task);
 			}
 
 			// Uses SFINAE to prohibit more than maximum arguments.
 			template<typename ...Rem, typename = char[JAFDSettings::SmoothDriving::maxArrrayedTasks - sizeof ...(Rem)]>
 			TaskArray(const Stop& task, const Rem&... rem) : TaskArray(rem...)
 			{
-				_taskTypes[_numTasks] = _TaskType::stop;
-				_taskArray[_numTasks] = new(&(_taskCopies[_numTasks].stop)) Stop(task);
-				_numTasks++;
+				addFirst(task);
 			}
 
 			// Uses SFINAE to prohibit more than maximum arguments.
 			template<typename ...Rem, typename = char[JAFDSettings::SmoothDriving::maxArrrayedTasks - sizeof ...(Rem)]>
 			TaskArray(const Rotate& task, const Rem&... rem) : TaskArray(rem...)
 			{
-				_taskTypes[_numTasks] = _TaskType::rotate;
-				_taskArray[_numTasks] = new(&(_taskCopies[_numTasks].rotate)) Rotate(task);
-				_numTasks++;
+				addFirst(task);
 			}
 
 			// Uses SFINAE to prohibit more than maximum arguments.
 			template<typename ...Rem, typename = char[JAFDSettings::SmoothDriving::maxArrrayedTasks - sizeof ...(Rem)]>
 			TaskArray(const ForceSpeed& task, const Rem&... rem) : TaskArray(rem...)
 			{
-				_taskTypes[_numTasks] = _TaskType::forceSpeed;
-				_taskArray[_numTasks] = new(&(_taskCopies[_numTasks].forceSpeed)) ForceSpeed(task);
-				_numTasks++;
+				addFirst(task);
 			}
 
 			// Uses SFINAE to prohibit more than maximum arguments.
 			template<typename ...Rem, typename = char[JAFDSettings::SmoothDriving::maxArrrayedTasks - sizeof ...(Rem)]>
 			TaskArray(const AlignFront& task, const Rem&... rem) : TaskArray(rem...)
 			{
-				_taskTypes[_numTasks] = _TaskType::alignFront;
-				_taskArray[_numTasks] = new(&(_taskCopies[_numTasks].alignFront)) AlignFront(task);
+				addFirst(task);
+			}
+
+			// Add a task at the end of the queue - for sequences built at runtime
+			template<typename T>
+			ReturnCode append(const T& task)
+			{
+				TaskPool::Handle handle;
+
+				if (_numTasks >= JAFDSettings::SmoothDriving::maxArrrayedTasks || TaskPool::add(task, handle) != ReturnCode::ok) return ReturnCode::error;
+
+				for (uint8_t i = _numTasks; i > 0; i--) _tasks[i] = _tasks[i - 1];
+
+				_tasks[0] = handle;
 				_numTasks++;
+				_currentTaskNum = _numTasks - 1;
+
+				return ReturnCode::ok;
 			}
 
+			uint8_t getNumTasks() const;
 			ReturnCode startTask(RobotState startState);
 			WheelSpeeds updateSpeeds(const uint8_t freq);
 		};
@@ -284,6 +371,18 @@ namespace JAFD
 
 		ReturnCode setNewTask(const AlignFront& newTask, RobotState startState, const bool forceOverride = false);
 
+		// Set new FollowPath task
+		template<NewStateType stateType>
+		ReturnCode setNewTask(const FollowPath& newTask, const bool forceOverride = false);
+
+		template<>
+		ReturnCode setNewTask<NewStateType::currentState>(const FollowPath& newTask, const bool forceOverride);
+
+		template<>
+		ReturnCode setNewTask<NewStateType::lastEndState>(const FollowPath& newTask, const bool forceOverride);
+
+		ReturnCode setNewTask(const FollowPath& newTask, RobotState startState, const bool forceOverride = false);
+
 		// Set new TaskArray task
 		template<NewStateType stateType>
 		ReturnCode setNewTask(const TaskArray& newTask, const bool forceOverride = false);
@@ -298,5 +397,8 @@ namespace JAFD
 	
 		// Stop current task
 		void stopTask();
+
+		// Plan upcoming parts of the current task with enabled interrupts (call from the main loop)
+		void planAhead();
 	}
 }
\ No newline at end of file
@@ -26,6 +26,14 @@ namespace JAFD
 		// Devise specific constants
 		constexpr uint16_t pageSize = 256;
 
+		// Operation modes (value of the mode register)
+		enum class Mode : uint8_t
+		{
+			byte = 0b00000000,			// Access only one byte
+			page = 0b10000000,			// Access one page (address wraps at page end)
+			sequential = 0b01000000		// Access the whole array
+		};
+
 		// Init
 		ReturnCode setup();
 
@@ -34,5 +42,43 @@ namespace JAFD
 		void writeByte(const uint32_t address, const uint8_t byte);
 		void readStream(const uint32_t address, uint8_t* buffer, const uint32_t length);
 		void writeStream(uint32_t address, uint8_t* buffer, const uint32_t length);
+		void fill(const uint32_t address, const uint8_t value, const uint32_t length);
+
+		// Asynchronous read and write functions using DMA - buffer must stay valid until the transfer is finished
+		// Callback is called from the interrupt when the transfer is finished
+		ReturnCode readStreamAsync(const uint32_t address, uint8_t* buffer, const uint32_t length, void(*finishedCallback)() = nullptr);
+		ReturnCode writeStreamAsync(const uint32_t address, uint8_t* buffer, const uint32_t length, void(*finishedCallback)() = nullptr);
+		ReturnCode fillAsync(const uint32_t address, const uint8_t value, const uint32_t length, void(*finishedCallback)() = nullptr);
+
+		// Status of asynchronous transfers
+		bool isBusy();
+		void waitForTransfer();		// Safe in interrupts - the DMA channel is polled if the DMA interrupt can't preempt (the callback runs in the caller then)
+
+		// DMA interrupt
+		void dmaInterrupt();
+
+		// Check of persistent blocks - CRC-16-CCITT (poly 0x1021, init 0xffff)
+		uint16_t crc16(const uint8_t* bytes, const uint32_t length);
+
+		// Versioned blocks in two slots: SlotHeader | data | CRC-16 of header and data
+		// Every store goes to the other slot, so a broken store keeps the last valid block
+		struct SlotHeader
+		{
+			uint16_t version;
+			uint16_t size;		// Size of the data - catches changed layouts without a new version
+			uint32_t sequence;	// Increased with every store - the newer slot is loaded
+		};
+
+		constexpr uint32_t slotSize(const uint32_t dataSize)
+		{
+			return sizeof(SlotHeader) + dataSize + sizeof(uint16_t);
+		}
+
+		// Load the data of the newer valid slot - error if no slot is valid (data, sequence and nextSlot are unchanged then)
+		// Both slots are read in one stream, so buffer must hold 2 * slotSize(dataSize) bytes
+		ReturnCode loadNewestSlot(const uint32_t address, const uint16_t version, void* data, const uint16_t dataSize, uint8_t* buffer, uint32_t& sequence, uint8_t& nextSlot);
+
+		// Fill a slot (header, data and CRC) to be written
+		void buildSlot(uint8_t* buffer, const uint16_t version, const uint32_t sequence, const void* data, const uint16_t dataSize);
 	}
 }
\ No newline at end of file
@@ -4,40 +4,66 @@ This file of the library is responsible for an Array-based Queue
 
 #pragma once
 
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include <type_traits>
+
 #include "AllDatatypes.h"
 
 namespace JAFD
 {
-	// Template class for an Array-based queue
-	template <typename T, uint8_t maxSize>
+	// Template class for an Array-based queue (ring buffer)
+	// maxSize has to be a power of two
+	// With singleProducerSingleConsumer = true, one interrupt can enqueue while the main loop dequeues (or the other way round) without locking
+	template <typename T, uint16_t maxSize, bool singleProducerSingleConsumer = false>
 	class StaticQueue
 	{
+		static_assert(maxSize > 0 && (maxSize & (maxSize - 1)) == 0, "maxSize of StaticQueue has to be a power of two");
+		static_assert(maxSize <= 0x8000, "maxSize of StaticQueue is too big");
+
 	private:
+		typedef typename std::conditional<singleProducerSingleConsumer, volatile uint16_t, uint16_t>::type IndexType;
+
+		static constexpr uint16_t _mask = maxSize - 1;
+
 		T arr[maxSize];		// Array to store queue elements
-		int8_t front;  		// Front points to front element in the queue
-		int8_t rear;   		// Rear points to last element in the queue
-		uint8_t count;  	// Current size of the queue
+		IndexType front;  	// Number of removed elements (only changed by the consumer)
+		IndexType rear;   	// Number of added elements (only changed by the producer)
 
-	public:
-		// Constructor
-		StaticQueue()
+		// Make sure that the data is written before the index is changed
+		inline void barrier()
 		{
-			front = 0;
-			rear = -1;
+			if (singleProducerSingleConsumer)
+			{
+				__DMB();
+			}
 		}
 
+	public:
+		// Constructor
+		StaticQueue() : front(0), rear(0) {}
+
 		// Remove front element from the queue
 		ReturnCode dequeue(T* element)
 		{
-			if (count == 0)
+			const uint16_t currentFront = front;
+
+			if ((uint16_t)(rear - currentFront) == 0)
 			{
 				return ReturnCode::error;
 			}
 
-			*element = arr[front];
+			barrier();
+
+			*element = arr[currentFront & _mask];
 
-			front = (front + 1) % maxSize;
-			count--;
+			barrier();
+
+			front = currentFront + 1;
 
 			return ReturnCode::ok;
 		}
@@ -45,34 +71,44 @@ namespace JAFD
 		// Add an item to the queue
 		ReturnCode enqueue(T item)
 		{
-			if (count == maxSize)
+			const uint16_t currentRear = rear;
+
+			if ((uint16_t)(currentRear - front) == maxSize)
 			{
 				return ReturnCode::error;
 			}
 
-			rear = (rear + 1) % maxSize;
-			arr[rear] = item;
-			count++;
+			arr[currentRear & _mask] = item;
+
+			barrier();
+
+			rear = currentRear + 1;
 
 			return ReturnCode::ok;
 		}
 
+		// Remove all elements (only from the consumer)
+		void clear()
+		{
+			front = rear;
+		}
+
 		// Return the size
-		uint8_t size()
+		uint16_t size() const
 		{
-			return count;
+			return rear - front;
 		}
 
 		// Check if queue is full
-		bool isFull()
+		bool isFull() const
 		{
-			return (count == maxSize);
+			return size() == maxSize;
 		}
 
 		// Check if queue is empty
-		bool isEmpty()
+		bool isEmpty() const
 		{
-			return (count == 0);
+			return size() == 0;
 		}
 	};
 }
\ No newline at end of file
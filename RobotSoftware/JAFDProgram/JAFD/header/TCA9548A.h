@@ -16,5 +16,15 @@ namespace JAFD
 		ReturnCode setup();
 		uint8_t getChannel();
 		uint8_t selectChannel(uint8_t channel);
+
+		// Batching of register operations of devices behind the multiplexer
+		// Operations are sorted by channel and reads of neighbouring registers are combined
+		namespace Batch
+		{
+			ReturnCode queueRead(const uint8_t channel, const uint8_t i2cAddr, const uint16_t regAddr, const uint8_t regAddrSize, uint8_t* buffer, const uint8_t length);	// buffer must stay valid until execute() is finished
+			ReturnCode queueWrite(const uint8_t channel, const uint8_t i2cAddr, const uint16_t regAddr, const uint8_t regAddrSize, const uint8_t value);
+			uint8_t numQueued();
+			ReturnCode execute();
+		}
 	}
 }
\ No newline at end of file
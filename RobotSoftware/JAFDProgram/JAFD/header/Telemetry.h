@@ -0,0 +1,102 @@
+/*
+This private file of the library is responsible for streaming binary telemetry records over SerialUSB
+*/
+
+#pragma once
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include "AllDatatypes.h"
+#include "PIDController.h"
+
+namespace JAFD
+{
+	// Binary telemetry - records are written into a lock-free ring buffer from any context (main loop or interrupts) without allocation
+	// The main loop drains the buffer over the native USB port; if the buffer is full the record is dropped and counted
+	// Record layout (little endian):
+	// [0] sync byte 0xA5 | [1] version | [2] record type | [3] payload length | [4-7] timestamp (ms) | payload | XOR checksum of bytes 1 to end of payload
+	// Decoder for the host: "Telemetry Python/decode.py"
+	namespace Telemetry
+	{
+		constexpr uint8_t syncByte = 0xA5;
+		constexpr uint8_t version = 1;
+
+		enum class RecordType : uint8_t
+		{
+			status,			// uint32 dropped records, uint16 used buffer bytes
+			robotState,		// float left wheel, right wheel (cm/s), forward vel (cm/s), x, y, z (cm), angular vel (rad/s), global heading, pitch (rad)
+			distances,		// 7 x uint16 distance (mm), 7 x uint8 DistSensorStatus (frontLeft, frontRight, frontLong, leftFront, leftBack, rightFront, rightBack)
+			pid,			// uint8 PIDID, float set point, value, p term, i term, d term, output
+			task,			// uint8 TaskEvent, uint8 TaskType, uint8 index in task array
+			event,			// uint8 Event, int32 value
+			filterInputs,	// uint32 time (ms), float left wheel, right wheel (cm/s), x, y, z of the Bno055 forward vector, Bno055 rot speed (deg/s), uint8 frequency (Hz)
+			fusionTime,		// uint32 time of SensorFusion::untimedFusion() (ms) - the fused distances are in the last distances record
+			memory,			// uint32 free, dynamic, static, accounted buffers, stack high-water, interrupt stack depth (bytes) - see MemWatcher
+			distCalib		// uint8 DistanceSensors::SensorID, uint8 valid, uint8 points, float k, d (mm), rms (mm) of DistanceSensors::autoCalibration()
+		};
+
+		enum class PIDID : uint8_t
+		{
+			leftMotor,
+			rightMotor
+		};
+
+		// Same order as SmoothDriving::TaskPool::TaskType
+		enum class TaskType : uint8_t
+		{
+			accelerate,
+			straight,
+			stop,
+			rotate,
+			forceSpeed,
+			alignFront,
+			taskArray,
+			followPath
+		};
+
+		enum class TaskEvent : uint8_t
+		{
+			started,
+			finished,
+			subTaskStarted
+		};
+
+		enum class Event : uint8_t
+		{
+			distSensorTimeout,	// value: ID of the sensor
+			distSensorI2CError,	// value: ID of the sensor
+			i2cTimeout,			// value: AsyncI2C::Bus
+			distSensorStalled,	// value: DistanceSensors::SensorID
+			distSensorSetupError,	// value: DistanceSensors::SensorID
+			distCalibAborted,	// value: ReturnCode of the drive
+			floorChanged,		// value: new floor (MazeMapping)
+			rampNotStored,		// value: current floor - no free floor or ramp transition left
+			dispenserTurnFailed,	// value: ReturnCode of Dispenser::startTurn() - the rest of the drop is cancelled
+			segmentPlannedLate	// value: FollowPath segment planned in the 20 Hz interrupt - planAhead() wasn't called in time
+		};
+
+		// Start USB port
+		ReturnCode setup();
+
+		// Send committed records over SerialUSB (only from the main loop)
+		void drain();
+
+		// Write records
+		void logRobotState(const RobotState& state);
+		void logDistances(const Distances& distances, const DistSensorStates& states);
+		void logPID(const PIDID id, const float setPoint, const float value, const PIDTerms& terms, const float output);
+		void logTask(const TaskEvent event, const TaskType type, const uint8_t index);
+		void logEvent(const Event event, const int32_t value);
+		void logFilterInputs(const uint32_t time, const FloatWheelSpeeds& wheelSpeeds, const Vec3f& bnoForwardVec, const float bnoRotSpeed, const uint8_t freq);
+		void logFusionTime(const uint32_t time);
+		void logMemory(const uint32_t free, const uint32_t dynamic, const uint32_t staticRam, const uint32_t buffers, const uint32_t stackHighWater, const uint32_t interruptStack);
+		void logDistCalib(const uint8_t sensor, const bool valid, const uint8_t points, const float k, const float d, const float rms);
+
+		// Number of records dropped because the buffer was full
+		uint32_t getDropped();
+	}
+}
\ No newline at end of file
@@ -30,12 +30,11 @@ namespace JAFD
 		explicit Vec2f(const volatile Vec3f& vec);
 		explicit constexpr Vec2f(const Vec3f& vec);
 
-		inline const volatile Vec2f& operator=(const volatile Vec2f vec) volatile
+		// Assignments to volatile objects return nothing - a returned volatile reference can't be discarded without a warning
+		inline void operator=(const volatile Vec2f vec) volatile
 		{
 			x = vec.x;
 			y = vec.y;
-
-			return *this;
 		}
 
 		inline const Vec2f& operator=(const Vec2f& vec)
@@ -142,40 +141,34 @@ namespace JAFD
 			return Vec2f(x / val, y / val);
 		}
 
-		inline const volatile Vec2f& operator+=(const volatile Vec2f vec) volatile
+		inline void operator+=(const volatile Vec2f vec) volatile
 		{
 			*this = *this + vec;
-			return *this;
 		}
 
-		inline const volatile Vec2f& operator+=(const volatile float val) volatile
+		inline void operator+=(const volatile float val) volatile
 		{
 			*this = *this + val;
-			return *this;
 		}
 
-		inline const volatile Vec2f& operator-=(const volatile Vec2f vec) volatile
+		inline void operator-=(const volatile Vec2f vec) volatile
 		{
 			*this = *this - vec;
-			return *this;
 		}
 
-		inline const volatile Vec2f& operator-=(const volatile float val) volatile
+		inline void operator-=(const volatile float val) volatile
 		{
 			*this = *this - val;
-			return *this;
 		}
 
-		inline const volatile Vec2f& operator*=(const volatile float val) volatile
+		inline void operator*=(const volatile float val) volatile
 		{
 			*this = *this * val;
-			return *this;
 		}
 
-		inline const volatile Vec2f& operator/=(const volatile float val) volatile
+		inline void operator/=(const volatile float val) volatile
 		{
 			*this = *this / val;
-			return *this;
 		}
 
 		inline float length() const volatile
@@ -203,13 +196,11 @@ namespace JAFD
 		explicit Vec3f(const volatile Vec2f& vec) : x(vec.x), y(vec.y), z(0.0f) {}
 		explicit constexpr Vec3f(const Vec2f& vec) : x(vec.x), y(vec.y), z(0.0f) {}
 
-		inline const volatile Vec3f& operator=(const volatile Vec3f vec) volatile
+		inline void operator=(const volatile Vec3f vec) volatile
 		{
 			x = vec.x;
 			y = vec.y;
 			z = vec.z;
-
-			return *this;
 		}
 		
 		inline const Vec3f& operator=(const Vec3f& vec)
@@ -317,40 +308,34 @@ namespace JAFD
 			return Vec3f(x / val, y / val, z / val);
 		}
 
-		inline const volatile Vec3f& operator+=(const volatile Vec3f vec) volatile
+		inline void operator+=(const volatile Vec3f vec) volatile
 		{
 			*this = *this + vec;
-			return *this;
 		}
 
-		inline const volatile Vec3f& operator+=(const volatile float val) volatile
+		inline void operator+=(const volatile float val) volatile
 		{
 			*this = *this + val;
-			return *this;
 		}
 
-		inline const volatile Vec3f& operator-=(const volatile Vec3f vec) volatile
+		inline void operator-=(const volatile Vec3f vec) volatile
 		{
 			*this = *this - vec;
-			return *this;
 		}
 
-		inline const volatile Vec3f& operator-=(const volatile float val) volatile
+		inline void operator-=(const volatile float val) volatile
 		{
 			*this = *this - val;
-			return *this;
 		}
 
-		inline const volatile Vec3f& operator*=(const volatile float val) volatile
+		inline void operator*=(const volatile float val) volatile
 		{
 			*this = *this * val;
-			return *this;
 		}
 
-		inline const volatile Vec3f& operator/=(const volatile float val) volatile
+		inline void operator/=(const volatile float val) volatile
 		{
 			*this = *this / val;
-			return *this;
 		}
 
 		inline float length() const volatile
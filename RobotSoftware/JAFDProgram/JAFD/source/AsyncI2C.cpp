@@ -0,0 +1,292 @@
+/*
+This private file of the library is responsible for the non-blocking access to both I2C buses
+*/
+
+#include <Wire.h>
+
+#include "../../JAFDSettings.h"
+#include "../header/AsyncI2C.h"
+#include "../header/StaticQueue.h"
+#include "../header/SmallThings.h"
+#include "../header/Telemetry.h"
+
+namespace JAFD
+{
+	namespace AsyncI2C
+	{
+		namespace
+		{
+			// One queued transaction
+			struct Transaction
+			{
+				uint8_t i2cAddr;		// I2C address of device
+				uint8_t regAddrSize;	// Size of internal register address (0 - 3 bytes)
+				bool write;				// Write or read?
+				uint8_t length;			// Number of bytes
+				uint32_t regAddr;		// Internal register address
+				uint8_t* buffer;		// Data
+				Callback callback;		// Called when finished
+			};
+
+			// State of one TWI peripheral
+			struct BusState
+			{
+				Twi* const twi;
+				const IRQn_Type irq;
+				StaticQueue<Transaction, JAFDSettings::AsyncI2C::queueSize, true> queue;	// Filled by main loop, emptied by interrupt
+				Transaction current;		// Running transaction
+				volatile uint8_t index;		// Number of transferred bytes of the running transaction
+				volatile bool busy;			// Is a transaction running?
+				volatile bool failed;		// Did a transaction fail since the last waitForBus()?
+				volatile uint32_t startTime;	// Start of the running transaction (ms)
+				volatile uint16_t duration;		// Transfer time of the running transaction (ms, rounded up)
+
+				BusState(Twi* twi, IRQn_Type irq) : twi(twi), irq(irq), current(), index(0), busy(false), failed(false), startTime(0), duration(0) {}
+			};
+
+			BusState _buses[static_cast<uint8_t>(Bus::numBuses)] = { BusState(TWI1, TWI1_IRQn), BusState(TWI0, TWI0_IRQn) };
+
+			// The Arduino Wire library already defines TWI0_Handler and TWI1_Handler (slave mode) - so the vector table
+			// gets copied to RAM and both TWI entries are redirected. The table has to be aligned to its size (power of two).
+			alignas(256) DeviceVectors _ramVectors;
+
+			// Time on the bus (ms, rounded up) - 9 clocks per byte: address, register address, repeated address of a read and data
+			uint16_t transferTime(const Transaction& transaction)
+			{
+				const uint32_t bytes = 1 + transaction.regAddrSize + (transaction.write ? 0 : 1) + transaction.length;
+
+				return (bytes * 9 * 1000 + JAFDSettings::AsyncI2C::clock - 1) / JAFDSettings::AsyncI2C::clock;
+			}
+
+			// Start the transaction in busState.current
+			void startTransaction(BusState& busState)
+			{
+				Twi* const twi = busState.twi;
+				const Transaction& transaction = busState.current;
+
+				busState.index = 0;
+				busState.startTime = millis();
+				busState.duration = transferTime(transaction);
+
+				twi->TWI_MMR = 0;
+				twi->TWI_MMR = TWI_MMR_DADR(transaction.i2cAddr) | (transaction.regAddrSize << TWI_MMR_IADRSZ_Pos) | (transaction.write ? 0 : TWI_MMR_MREAD);
+				twi->TWI_IADR = transaction.regAddr;
+
+				if (transaction.write)
+				{
+					// Writing the first byte starts the transfer
+					twi->TWI_THR = transaction.buffer[busState.index++];
+
+					if (transaction.length == 1)
+					{
+						twi->TWI_CR = TWI_CR_STOP;
+						twi->TWI_IER = TWI_IER_TXCOMP | TWI_IER_NACK;
+					}
+					else
+					{
+						twi->TWI_IER = TWI_IER_TXRDY | TWI_IER_NACK;
+					}
+				}
+				else
+				{
+					// STOP has to be set together with START, if there is only one byte
+					if (transaction.length == 1) twi->TWI_CR = TWI_CR_START | TWI_CR_STOP;
+					else twi->TWI_CR = TWI_CR_START;
+
+					twi->TWI_IER = TWI_IER_RXRDY | TWI_IER_NACK;
+				}
+			}
+
+			// Start next transaction of the queue or go idle
+			void startNext(BusState& busState)
+			{
+				if (busState.queue.dequeue(&busState.current) == ReturnCode::ok)
+				{
+					busState.busy = true;
+					startTransaction(busState);
+				}
+				else
+				{
+					busState.busy = false;
+				}
+			}
+
+			// Finish the running transaction
+			void finishTransaction(BusState& busState, const ReturnCode code)
+			{
+				busState.twi->TWI_IDR = ~0ul;
+
+				if (code != ReturnCode::ok) busState.failed = true;
+				if (busState.current.callback) busState.current.callback(code);
+
+				startNext(busState);
+			}
+
+			// State machine of one bus
+			void handleInterrupt(BusState& busState)
+			{
+				Twi* const twi = busState.twi;
+				const Transaction& transaction = busState.current;
+				const uint32_t status = twi->TWI_SR & twi->TWI_IMR;
+
+				if (status & TWI_SR_NACK)
+				{
+					finishTransaction(busState, ReturnCode::error);
+				}
+				else if (status & TWI_SR_RXRDY)
+				{
+					// STOP has to be set before the last byte is received
+					if (transaction.length - busState.index == 2) twi->TWI_CR = TWI_CR_STOP;
+
+					transaction.buffer[busState.index++] = twi->TWI_RHR;
+
+					if (busState.index >= transaction.length)
+					{
+						twi->TWI_IDR = TWI_IDR_RXRDY;
+						twi->TWI_IER = TWI_IER_TXCOMP;
+					}
+				}
+				else if (status & TWI_SR_TXRDY)
+				{
+					twi->TWI_THR = transaction.buffer[busState.index++];
+
+					if (busState.index >= transaction.length)
+					{
+						twi->TWI_CR = TWI_CR_STOP;
+						twi->TWI_IDR = TWI_IDR_TXRDY;
+						twi->TWI_IER = TWI_IER_TXCOMP;
+					}
+				}
+				else if (status & TWI_SR_TXCOMP)
+				{
+					finishTransaction(busState, ReturnCode::ok);
+				}
+			}
+
+			void twi0Interrupt()
+			{
+				handleInterrupt(_buses[static_cast<uint8_t>(Bus::wire1)]);
+			}
+
+			void twi1Interrupt()
+			{
+				handleInterrupt(_buses[static_cast<uint8_t>(Bus::wire)]);
+			}
+
+			ReturnCode queueTransaction(const Bus bus, const Transaction& transaction)
+			{
+				if (bus >= Bus::numBuses || transaction.length == 0 || transaction.regAddrSize > 3) return ReturnCode::error;
+
+				BusState& busState = _buses[static_cast<uint8_t>(bus)];
+
+				if (busState.queue.enqueue(transaction) != ReturnCode::ok) return ReturnCode::error;
+
+				// Start transfer if the bus is idle
+				NVIC_DisableIRQ(busState.irq);
+
+				if (!busState.busy) startNext(busState);
+
+				NVIC_EnableIRQ(busState.irq);
+
+				return ReturnCode::ok;
+			}
+		}
+
+		ReturnCode setup()
+		{
+			// Relocate vector table
+			__disable_irq();
+
+			memcpy(&_ramVectors, reinterpret_cast<void*>(SCB->VTOR), sizeof(DeviceVectors));
+
+			_ramVectors.pfnTWI0_Handler = reinterpret_cast<void*>(twi0Interrupt);
+			_ramVectors.pfnTWI1_Handler = reinterpret_cast<void*>(twi1Interrupt);
+
+			SCB->VTOR = reinterpret_cast<uint32_t>(&_ramVectors);
+
+			__DSB();
+			__enable_irq();
+
+			for (auto& busState : _buses)
+			{
+				busState.twi->TWI_IDR = ~0ul;
+				busState.queue.clear();
+				busState.busy = false;
+				busState.failed = false;
+
+				NVIC_ClearPendingIRQ(busState.irq);
+				NVIC_SetPriority(busState.irq, 1);
+				NVIC_EnableIRQ(busState.irq);
+			}
+
+			return ReturnCode::ok;
+		}
+
+		ReturnCode queueRead(const Bus bus, const uint8_t i2cAddr, const uint32_t regAddr, const uint8_t regAddrSize, uint8_t* buffer, const uint8_t length, Callback callback)
+		{
+			Transaction transaction;
+
+			transaction.i2cAddr = i2cAddr;
+			transaction.regAddrSize = regAddrSize;
+			transaction.write = false;
+			transaction.length = length;
+			transaction.regAddr = regAddr;
+			transaction.buffer = buffer;
+			transaction.callback = callback;
+
+			return queueTransaction(bus, transaction);
+		}
+
+		ReturnCode queueWrite(const Bus bus, const uint8_t i2cAddr, const uint32_t regAddr, const uint8_t regAddrSize, uint8_t* buffer, const uint8_t length, Callback callback)
+		{
+			Transaction transaction;
+
+			transaction.i2cAddr = i2cAddr;
+			transaction.regAddrSize = regAddrSize;
+			transaction.write = true;
+			transaction.length = length;
+			transaction.regAddr = regAddr;
+			transaction.buffer = buffer;
+			transaction.callback = callback;
+
+			return queueTransaction(bus, transaction);
+		}
+
+		bool isBusy(const Bus bus)
+		{
+			return _buses[static_cast<uint8_t>(bus)].busy;
+		}
+
+		ReturnCode waitForBus(const Bus bus)
+		{
+			BusState& busState = _buses[static_cast<uint8_t>(bus)];
+
+			// The bus hangs if the running transaction takes much longer than its transfer time - long batches don't time out
+			while (busState.busy)
+			{
+				if (millis() - busState.startTime > busState.duration + JAFDSettings::AsyncI2C::timeoutMargin)
+				{
+					// Bus hangs - abort everything
+					NVIC_DisableIRQ(busState.irq);
+
+					busState.twi->TWI_IDR = ~0ul;
+					busState.queue.clear();
+					busState.busy = false;
+					busState.failed = false;
+
+					NVIC_EnableIRQ(busState.irq);
+
+					Telemetry::logEvent(Telemetry::Event::i2cTimeout, static_cast<int32_t>(bus));
+					I2CBus::resetBus();
+
+					return ReturnCode::error;
+				}
+			}
+
+			const bool failed = busState.failed;
+			busState.failed = false;
+
+			return failed ? ReturnCode::error : ReturnCode::ok;
+		}
+	}
+}
\ No newline at end of file
@@ -9,10 +9,11 @@ This part of the Library is responsible for the 9 DOF-IMU (BNO055).
 #endif
 
 #include "../../JAFDSettings.h"
-#include "../header/SpiNVSRAM.h"
+#include "../header/Calibration.h"
 #include "../header/Bno055.h"
 #include "../header/AllDatatypes.h"
 #include "../header/Math.h"
+#include "../header/AsyncI2C.h"
 
 #include <Adafruit_BNO055.h>
 #include <Adafruit_Sensor.h>
@@ -33,6 +34,34 @@ namespace JAFD
 			imu::Quaternion quat;				// tared quaternion
 			imu::Quaternion tareQuat;			// conjugate of quaternion to tare
 
+			// Asynchronous reading of the sensor data
+			constexpr uint8_t _i2cAddr = 0x28;
+			constexpr uint8_t _regSensorData = 0x14;		// Start of gyroscope, euler, quaternion and linear acceleration data
+			constexpr uint8_t _sensorDataLength = 26;
+			uint8_t _sensorData[_sensorDataLength];			// Raw data of one update
+			bool _updateRunning = false;					// Is an update running in the background?
+
+			constexpr uint8_t _regChipID = 0x00;
+			constexpr uint8_t _chipID = 0xA0;
+
+			// Has the Bno055 finished booting? Reading the chip id only succeeds afterwards
+			bool chipReady()
+			{
+				Wire1.beginTransmission(_i2cAddr);
+				Wire1.write(_regChipID);
+
+				if (Wire1.endTransmission() != 0) return false;
+				if (Wire1.requestFrom(_i2cAddr, static_cast<uint8_t>(1)) != 1) return false;
+
+				return Wire1.read() == _chipID;
+			}
+
+			// Read signed 16 bit value of the raw data
+			inline int16_t rawValue(const uint8_t offset)
+			{
+				return static_cast<int16_t>(_sensorData[offset] | (static_cast<uint16_t>(_sensorData[offset + 1]) << 8));
+			}
+
 			// Convert linear motion to the global axis based on the robot start orientation
 			Vec3f toXYZ(Vec3f vec)
 			{
@@ -44,13 +73,19 @@ namespace JAFD
 		{
 			bno055 = Adafruit_BNO055(55, 0x28, &Wire1);
 
+			// Poll the boot - begin() would wait a fixed second if the chip is not ready yet
+			const uint32_t start = millis();
+
+			while (!chipReady())
+			{
+				if (millis() - start > JAFDSettings::Bno055::bootTimeout) return ReturnCode::error;
+			}
+
 			if (!bno055.begin())
 			{
 				return ReturnCode::error;
 			}
 
-			delay(500);
-
 			bno055.setExtCrystalUse(true);
 
 			calibFromRAM();
@@ -102,6 +137,19 @@ namespace JAFD
 			calibToRAM();
 		}
 
+		ReturnCode waitForFusion()
+		{
+			const uint32_t start = millis();
+
+			// The quaternion is zero until the fusion has started
+			while (fabs(bno055.getQuat().magnitude() - 1.0) > 0.1)
+			{
+				if (millis() - start > JAFDSettings::Bno055::fusionTimeout) return ReturnCode::error;
+			}
+
+			return ReturnCode::ok;
+		}
+
 		void tare()
 		{
 			tareQuat = bno055.getQuat().conjugate();
@@ -122,11 +170,44 @@ namespace JAFD
 
 		void updateValues()					//gets values from the sensors
 		{
-			bno055.getEvent(&linearAccelEvent, Adafruit_BNO055::VECTOR_LINEARACCEL);
+			if (startUpdate() == ReturnCode::ok) finishUpdate();
+		}
+
+		ReturnCode startUpdate()
+		{
+			if (_updateRunning) return ReturnCode::ok;
+
+			// All values are read in one transaction
+			if (AsyncI2C::queueRead(AsyncI2C::Bus::wire1, _i2cAddr, _regSensorData, 1, _sensorData, _sensorDataLength) != ReturnCode::ok) return ReturnCode::error;
+
+			_updateRunning = true;
+
+			return ReturnCode::ok;
+		}
+
+		ReturnCode finishUpdate()
+		{
+			if (!_updateRunning) return ReturnCode::error;
+
+			_updateRunning = false;
+
+			if (AsyncI2C::waitForBus(AsyncI2C::Bus::wire1) != ReturnCode::ok) return ReturnCode::error;
+
+			// Same scaling as the Adafruit library (1 dps = 16 LSB; 1 m/s^2 = 100 LSB; 1 = 2^14 LSB)
+			rotSpeedEvent.type = SENSOR_TYPE_GYROSCOPE;
+			rotSpeedEvent.gyro.x = rawValue(0) / 16.0f;
+			rotSpeedEvent.gyro.y = rawValue(2) / 16.0f;
+			rotSpeedEvent.gyro.z = rawValue(4) / 16.0f;
 
-			quat = bno055.getQuat() * tareQuat;
+			constexpr float quatScale = 1.0f / (1 << 14);
+			quat = imu::Quaternion(rawValue(12) * quatScale, rawValue(14) * quatScale, rawValue(16) * quatScale, rawValue(18) * quatScale) * tareQuat;
 
-			bno055.getEvent(&rotSpeedEvent, Adafruit_BNO055::VECTOR_GYROSCOPE);
+			linearAccelEvent.type = SENSOR_TYPE_LINEAR_ACCELERATION;
+			linearAccelEvent.acceleration.x = rawValue(20) / 100.0f;
+			linearAccelEvent.acceleration.y = rawValue(22) / 100.0f;
+			linearAccelEvent.acceleration.z = rawValue(24) / 100.0f;
+
+			return ReturnCode::ok;
 		}
 
 		Vec3f getLinAcc()
@@ -153,7 +234,7 @@ namespace JAFD
 			forwardVec.y = -2.0f * (quat.x() * quat.y() - quat.w() * quat.z());
 			forwardVec.z = -2.0f * (quat.y() * quat.z() + quat.w() * quat.x());
 
-			forwardVec = forwardVec.normalized();
+			forwardVec = forwardVec * fastInvSqrt(forwardVec.x * forwardVec.x + forwardVec.y * forwardVec.y + forwardVec.z * forwardVec.z);
 
 			return forwardVec;
 		}
@@ -175,71 +256,49 @@ namespace JAFD
 
 			bno055.getSensorOffsets(calib_data);		//write values in structure calib_data
 
-			auto accel_offset_x = calib_data.accel_offset_x;
-			auto accel_offset_y = calib_data.accel_offset_y;
-			auto accel_offset_z = calib_data.accel_offset_z;
-			auto accel_radius = calib_data.accel_radius;
-
-			auto gyro_offset_x = calib_data.gyro_offset_x;
-			auto gyro_offset_y = calib_data.gyro_offset_y;
-			auto gyro_offset_z = calib_data.gyro_offset_z;
-
-			auto mag_offset_x = calib_data.mag_offset_x;
-			auto mag_offset_y = calib_data.mag_offset_y;
-			auto mag_offset_z = calib_data.mag_offset_z;
-			auto mag_radius = calib_data.mag_radius;
-
-			SpiNVSRAM::writeByte(JAFDSettings::SpiNVSRAM::bno055StartAddr, (accel_offset_x >> 8));		//schreibt obere tetrade des 16 Bit int auf Startaddresse
-			SpiNVSRAM::writeByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 1, (accel_offset_x & 0xFF));
-
-			SpiNVSRAM::writeByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 2, (accel_offset_y >> 8));
-			SpiNVSRAM::writeByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 3, (accel_offset_y & 0xFF));
+			auto& calib = Calibration::getData().bno055;
 
-			SpiNVSRAM::writeByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 4, (accel_offset_z >> 8));
-			SpiNVSRAM::writeByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 5, (accel_offset_z & 0xFF));
+			calib.accelOffset[0] = calib_data.accel_offset_x;
+			calib.accelOffset[1] = calib_data.accel_offset_y;
+			calib.accelOffset[2] = calib_data.accel_offset_z;
+			calib.accelRadius = calib_data.accel_radius;
 
-			SpiNVSRAM::writeByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 6, (accel_radius >> 8));
-			SpiNVSRAM::writeByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 7, (accel_radius & 0xFF));
+			calib.gyroOffset[0] = calib_data.gyro_offset_x;
+			calib.gyroOffset[1] = calib_data.gyro_offset_y;
+			calib.gyroOffset[2] = calib_data.gyro_offset_z;
 
-			SpiNVSRAM::writeByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 8, (gyro_offset_x >> 8));		//schreibt obere tetrade des 16 Bit int auf Startaddresse
-			SpiNVSRAM::writeByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 9, (gyro_offset_x & 0xFF));
+			calib.magOffset[0] = calib_data.mag_offset_x;
+			calib.magOffset[1] = calib_data.mag_offset_y;
+			calib.magOffset[2] = calib_data.mag_offset_z;
+			calib.magRadius = calib_data.mag_radius;
 
-			SpiNVSRAM::writeByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 10, (gyro_offset_y >> 8));
-			SpiNVSRAM::writeByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 11, (gyro_offset_y & 0xFF));
+			calib.valid = true;
 
-			SpiNVSRAM::writeByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 12, (gyro_offset_z >> 8));
-			SpiNVSRAM::writeByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 13, (gyro_offset_z & 0xFF));
-
-			SpiNVSRAM::writeByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 14, (mag_offset_x >> 8));
-			SpiNVSRAM::writeByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 15, (mag_offset_x & 0xFF));
-
-			SpiNVSRAM::writeByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 16, (mag_offset_y >> 8));
-			SpiNVSRAM::writeByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 17, (mag_offset_y & 0xFF));
-
-			SpiNVSRAM::writeByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 18, (mag_offset_z >> 8));
-			SpiNVSRAM::writeByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 19, (mag_offset_z & 0xFF));
-
-			SpiNVSRAM::writeByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 20, (mag_radius >> 8));
-			SpiNVSRAM::writeByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 21, (mag_radius & 0xFF));
+			Calibration::store();
 		}
 
 		void calibFromRAM()			//get Offsets from RAM
 		{
+			const auto& calib = Calibration::getData().bno055;
+
+			// Keep the offsets of the sensor if there is no calibration
+			if (!calib.valid) return;
+
 			adafruit_bno055_offsets_t calib_data;
 
-			calib_data.accel_offset_x = (SpiNVSRAM::readByte(JAFDSettings::SpiNVSRAM::bno055StartAddr) << 8) + SpiNVSRAM::readByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 1);
-			calib_data.accel_offset_y = (SpiNVSRAM::readByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 2) << 8) + SpiNVSRAM::readByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 3);
-			calib_data.accel_offset_z = (SpiNVSRAM::readByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 4) << 8) + SpiNVSRAM::readByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 5);
-			calib_data.accel_radius = (SpiNVSRAM::readByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 6) << 8) + SpiNVSRAM::readByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 7);
+			calib_data.accel_offset_x = calib.accelOffset[0];
+			calib_data.accel_offset_y = calib.accelOffset[1];
+			calib_data.accel_offset_z = calib.accelOffset[2];
+			calib_data.accel_radius = calib.accelRadius;
 
-			calib_data.gyro_offset_x = (SpiNVSRAM::readByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 8) << 8) + SpiNVSRAM::readByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 9);
-			calib_data.gyro_offset_y = (SpiNVSRAM::readByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 10) << 8) + SpiNVSRAM::readByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 11);
-			calib_data.gyro_offset_z = (SpiNVSRAM::readByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 12) << 8) + SpiNVSRAM::readByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 13);
+			calib_data.gyro_offset_x = calib.gyroOffset[0];
+			calib_data.gyro_offset_y = calib.gyroOffset[1];
+			calib_data.gyro_offset_z = calib.gyroOffset[2];
 
-			calib_data.mag_offset_x = (SpiNVSRAM::readByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 14) << 8) + SpiNVSRAM::readByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 15);
-			calib_data.mag_offset_y = (SpiNVSRAM::readByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 16) << 8) + SpiNVSRAM::readByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 17);
-			calib_data.mag_offset_z = (SpiNVSRAM::readByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 18) << 8) + SpiNVSRAM::readByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 19);
-			calib_data.mag_radius = (SpiNVSRAM::readByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 20) << 8) + SpiNVSRAM::readByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 21);
+			calib_data.mag_offset_x = calib.magOffset[0];
+			calib_data.mag_offset_y = calib.magOffset[1];
+			calib_data.mag_offset_z = calib.magOffset[2];
+			calib_data.mag_radius = calib.magRadius;
 
 			bno055.setSensorOffsets(calib_data);	//write values to sensor offsets
 		}
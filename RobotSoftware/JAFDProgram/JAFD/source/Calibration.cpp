@@ -0,0 +1,75 @@
+/*
+This private file of the library is responsible for the persistent calibration data in the SPI NVSRAM
+*/
+
+#include "../../JAFDSettings.h"
+#include "../header/Calibration.h"
+#include "../header/SpiNVSRAM.h"
+
+#include <string.h>
+
+namespace JAFD
+{
+	namespace Calibration
+	{
+		namespace
+		{
+			constexpr uint16_t slotSize = SpiNVSRAM::slotSize(sizeof(Data));
+
+			static_assert(2 * slotSize <= JAFDSettings::SpiNVSRAM::checkpointStartAddr - JAFDSettings::SpiNVSRAM::calibrationStartAddr, "Calibration slots overlap the checkpoint snapshot");
+
+			Data _data;
+			uint32_t _sequence = 0;
+			uint8_t _nextSlot = 0;		// Slot of the next store
+
+			void setDefaults()
+			{
+				// Also clears the padding, so the CRC of a stored block doesn't depend on it
+				memset(&_data, 0, sizeof(Data));
+
+				for (auto& distSensor : _data.distSensors)
+				{
+					distSensor.k = 1.0f;
+				}
+			}
+		}
+
+		ReturnCode setup()
+		{
+			uint8_t buffer[2 * slotSize];	// Both slots
+
+			setDefaults();
+
+			_sequence = 0;
+			_nextSlot = 0;
+
+			return SpiNVSRAM::loadNewestSlot(JAFDSettings::SpiNVSRAM::calibrationStartAddr, version, &_data, sizeof(Data), buffer, _sequence, _nextSlot);
+		}
+
+		ReturnCode store()
+		{
+			uint8_t buffer[slotSize];
+			uint8_t readBack[slotSize];
+
+			SpiNVSRAM::buildSlot(buffer, version, _sequence + 1, &_data, sizeof(Data));
+
+			const uint32_t address = JAFDSettings::SpiNVSRAM::calibrationStartAddr + _nextSlot * slotSize;
+
+			SpiNVSRAM::writeStream(address, buffer, slotSize);
+			SpiNVSRAM::readStream(address, readBack, slotSize);
+
+			// The other slot still holds the last valid block
+			if (memcmp(buffer, readBack, slotSize) != 0) return ReturnCode::error;
+
+			_sequence++;
+			_nextSlot ^= 1;
+
+			return ReturnCode::ok;
+		}
+
+		Data& getData()
+		{
+			return _data;
+		}
+	}
+}
\ No newline at end of file
@@ -2,7 +2,11 @@
 This private part of the Library is responsible for the communication with the RasPI for the camera recognition.
 */
 
+#include "../../JAFDSettings.h"
 #include "../header/CamRec.h"
+#include "../header/SensorFusion.h"
+#include "../header/MazeMapping.h"
+#include "../header/SmallThings.h"
 
 namespace JAFD
 {
@@ -10,134 +14,300 @@ namespace JAFD
 	{
 		namespace
 		{
+			constexpr uint8_t victimsPayloadSize = 12;
+			constexpr uint8_t maxPayloadSize = 32;
+
+			// Decoder state
+			enum class DecodeState : uint8_t
+			{
+				sync,
+				version,
+				type,
+				length,
+				payload,
+				crc
+			};
+
+			// Reception by the PDC - while it fills one half, the other one is decoded
+			uint8_t _rxBuffer[2][JAFDSettings::CamRec::rxHalfBufferSize];
+			uint8_t _readBuffer = 0;		// Half that is decoded next
+			uint16_t _readPos = 0;			// Decoded bytes of this half
+
+			DecodeState _state = DecodeState::sync;
+			uint8_t _type = 0;
+			uint8_t _length = 0;
+			uint8_t _crc = 0;
+			uint8_t _payload[maxPayloadSize];
+			uint8_t _payloadPos = 0;
+
+			bool _ready = false;			// Has a ready frame been received?
+			bool _firstFrame = true;		// No sequence number received yet
+			uint16_t _lastSequence = 0;
+			uint16_t _lostFrames = 0;
+			uint16_t _badFrames = 0;
+			uint32_t _lastFrameTime = 0;	// Capture time of the last frame (local ms)
+			uint32_t _fieldStart = 0;		// Time of the last call of newField()
+			uint32_t _handshakeTime = 0;	// Time of the handshake request
+
 			VisVictimProb leftProb;
 			VisVictimProb rightProb;
 			uint16_t leftDet = 0;
 			uint16_t rightDet = 0;
-		}
 
-		ReturnCode setup()
-		{
-			Serial1.begin(9600);
+			uint8_t crc8(uint8_t crc, const uint8_t byte)
+			{
+				crc ^= byte;
 
-			Serial1.write("B");
+				for (uint8_t i = 0; i < 8; i++)
+				{
+					crc = (crc & 0x80) ? static_cast<uint8_t>((crc << 1) ^ 0x07) : static_cast<uint8_t>(crc << 1);
+				}
 
-			if (Serial1.find("OK\n"))
-			{
-				return ReturnCode::ok;
+				return crc;
 			}
-			else
+
+			uint16_t readUInt16(const uint8_t* bytes)
 			{
-				return ReturnCode::fatalError;
+				return bytes[0] | (bytes[1] << 8);
 			}
-		}
-
-		void loop()
-		{
-			auto start = millis();
 
-			// Wait for at least one full package
-			while (true)
+			// Result of one camera weighted by its confidence (false for unknown codes)
+			bool getFrameProb(const uint8_t code, const uint8_t confidence, VisVictimProb& frame)
 			{
-				if ((millis() - start) > 50)
+				const float weight = confidence / 255.0f;
+
+				frame = VisVictimProb();
+
+				switch (static_cast<VictimCode>(code))
 				{
-					return;
+				case VictimCode::harmed:
+					frame.harmed = weight;
+					break;
+
+				case VictimCode::stable:
+					frame.stable = weight;
+					break;
+
+				case VictimCode::unharmed:
+					frame.unharmed = weight;
+					break;
+
+				case VictimCode::red:
+					frame.red = weight;
+					break;
+
+				case VictimCode::green:
+					frame.green = weight;
+					break;
+
+				case VictimCode::yellow:
+					frame.yellow = weight;
+					break;
+
+				case VictimCode::none:
+					frame.none = weight;
+					break;
+
+				default:
+					return false;
 				}
 
-				if (Serial1.peek() != 'l')
+				return true;
+			}
+
+			// Add the result of one camera to the evidence of the wall it was looking at and to the current field
+			void addVictim(const bool left, const bool validPose, const SensorFusion::TimedPose& pose, const bool currentField, const uint8_t code, const uint8_t confidence)
+			{
+				VisVictimProb frame;
+
+				if (!getFrameProb(code, confidence, frame)) return;
+
+				if (validPose) MazeMapping::VictimEvidence::addVisual(pose.position, pose.heading, left, frame);
+
+				if (!currentField) return;
+
+				if (left)
 				{
-					Serial1.read();
+					leftProb += frame;
+					leftDet++;
 				}
-				else if (Serial1.available() >= 5)
+				else
 				{
-					break;
+					rightProb += frame;
+					rightDet++;
 				}
 			}
 
-			while (Serial1.available() >= 5)
+			// Handle a frame with valid CRC
+			void handleFrame()
 			{
-				Serial1.read();						// Discard 'l'
-				auto leftByte = Serial1.read();		// left victim code
-				Serial1.read();						// Discard 'r'
-				auto rightByte = Serial1.read();	// right victim code
-				Serial1.read();						// Discard '\n'
-
-				leftDet++;
-
-				switch (leftByte)
+				switch (static_cast<FrameType>(_type))
 				{
-				case 'H':
-					leftProb.harmed++;
+				case FrameType::ready:
+					_ready = true;
 					break;
 
-				case 'S':
-					leftProb.stable++;
-					break;
+				case FrameType::victims:
+				{
+					if (_length != victimsPayloadSize) break;
 
-				case 'U':
-					leftProb.unharmed++;
-					break;
+					const uint16_t sequence = readUInt16(&_payload[0]);
+					const uint16_t age = readUInt16(&_payload[6]);
 
-				case 'R':
-					leftProb.red++;
-					break;
+					if (!_firstFrame && sequence != static_cast<uint16_t>(_lastSequence + 1)) _lostFrames += static_cast<uint16_t>(sequence - _lastSequence - 1);
 
-				case 'G':
-					leftProb.green++;
-					break;
+					_firstFrame = false;
+					_lastSequence = sequence;
+					_lastFrameTime = millis() - age;
 
-				case 'Y':
-					leftProb.yellow++;
-					break;
+					// Pose at the capture time - frames that arrive late still go to the right wall
+					SensorFusion::TimedPose pose;
+					const bool validPose = SensorFusion::getPoseAt(_lastFrameTime, pose) == ReturnCode::ok;
+					const bool currentField = static_cast<int32_t>(_lastFrameTime - _fieldStart) >= 0;		// Captured after newField()
 
-				case 'N':
-					leftProb.none++;
+					addVictim(true, validPose, pose, currentField, _payload[8], _payload[9]);
+					addVictim(false, validPose, pose, currentField, _payload[10], _payload[11]);
 					break;
+				}
 
 				default:
-					leftDet--;
 					break;
 				}
+			}
 
-				rightDet++;
-
-				switch (rightByte)
+			// Feed one received byte into the decoder
+			void decode(const uint8_t byte)
+			{
+				switch (_state)
 				{
-				case 'H':
-					rightProb.harmed++;
+				case DecodeState::sync:
+					if (byte == syncByte)
+					{
+						_crc = 0;
+						_state = DecodeState::version;
+					}
 					break;
 
-				case 'S':
-					rightProb.stable++;
-					break;
+				case DecodeState::version:
+					_crc = crc8(_crc, byte);
 
-				case 'U':
-					rightProb.unharmed++;
+					if (byte == version)
+					{
+						_state = DecodeState::type;
+					}
+					else if (byte == syncByte)
+					{
+						_crc = 0;		// Resynchronize - last sync byte was noise
+					}
+					else
+					{
+						_badFrames++;
+						_state = DecodeState::sync;
+					}
 					break;
 
-				case 'R':
-					rightProb.red++;
+				case DecodeState::type:
+					_crc = crc8(_crc, byte);
+					_type = byte;
+					_state = DecodeState::length;
 					break;
 
-				case 'G':
-					rightProb.green++;
+				case DecodeState::length:
+					_crc = crc8(_crc, byte);
+					_length = byte;
+					_payloadPos = 0;
+
+					if (_length > maxPayloadSize)
+					{
+						_badFrames++;
+						_state = DecodeState::sync;
+					}
+					else
+					{
+						_state = (_length == 0) ? DecodeState::crc : DecodeState::payload;
+					}
 					break;
 
-				case 'Y':
-					rightProb.yellow++;
+				case DecodeState::payload:
+					_crc = crc8(_crc, byte);
+					_payload[_payloadPos++] = byte;
+
+					if (_payloadPos >= _length) _state = DecodeState::crc;
 					break;
 
-				case 'N':
-					rightProb.none++;
+				case DecodeState::crc:
+					if (byte == _crc) handleFrame();
+					else _badFrames++;
+
+					_state = DecodeState::sync;
 					break;
 
 				default:
-					rightDet--;
+					_state = DecodeState::sync;
 					break;
 				}
 			}
 		}
 
+		ReturnCode setup()
+		{
+			Serial1.begin(JAFDSettings::CamRec::baudRate);
+
+			// Reception by the PDC instead of the receive interrupt of the core
+			USART0->US_IDR = US_IDR_RXRDY;
+			USART0->US_PTCR = US_PTCR_RXTDIS;
+			USART0->US_RPR = reinterpret_cast<uint32_t>(_rxBuffer[0]);
+			USART0->US_RCR = JAFDSettings::CamRec::rxHalfBufferSize;
+			USART0->US_RNPR = reinterpret_cast<uint32_t>(_rxBuffer[1]);
+			USART0->US_RNCR = JAFDSettings::CamRec::rxHalfBufferSize;
+			USART0->US_PTCR = US_PTCR_RXTEN;
+
+			Serial1.write(handshakeRequest);
+
+			_handshakeTime = millis();
+
+			MemWatcher::addBuffer("camRecRx", sizeof(_rxBuffer));
+
+			return ReturnCode::ok;
+		}
+
+		ReturnCode waitForReady()
+		{
+			while (!_ready)
+			{
+				if (millis() - _handshakeTime > JAFDSettings::CamRec::handshakeTimeout) return ReturnCode::fatalError;
+
+				loop();
+			}
+
+			return ReturnCode::ok;
+		}
+
+		void loop()
+		{
+			while (true)
+			{
+				const uint32_t base = reinterpret_cast<uint32_t>(_rxBuffer[_readBuffer]);
+				const uint32_t pointer = USART0->US_RPR;
+				uint16_t received;
+
+				// Half is full as soon as the PDC has moved to the other one
+				if (pointer >= base && pointer < base + JAFDSettings::CamRec::rxHalfBufferSize) received = pointer - base;
+				else received = JAFDSettings::CamRec::rxHalfBufferSize;
+
+				for (; _readPos < received; _readPos++) decode(_rxBuffer[_readBuffer][_readPos]);
+
+				if (received < JAFDSettings::CamRec::rxHalfBufferSize) break;
+
+				// Give the decoded half back to the PDC
+				USART0->US_RNPR = base;
+				USART0->US_RNCR = JAFDSettings::CamRec::rxHalfBufferSize;
+
+				_readBuffer ^= 1;
+				_readPos = 0;
+			}
+		}
+
 		VisVictimProb getVictims(bool left)
 		{
 			if (left)
@@ -171,6 +341,23 @@ namespace JAFD
 
 			leftProb = VisVictimProb();
 			rightProb = VisVictimProb();
+
+			_fieldStart = millis();
+		}
+
+		uint32_t getLastFrameTime()
+		{
+			return _lastFrameTime;
+		}
+
+		uint16_t getLostFrames()
+		{
+			return _lostFrames;
+		}
+
+		uint16_t getBadFrames()
+		{
+			return _badFrames;
 		}
 	}
 }
\ No newline at end of file
@@ -0,0 +1,91 @@
+/*
+This private file of the library is responsible for the snapshot of the robot state at the last checkpoint
+*/
+
+#include "../../JAFDSettings.h"
+#include "../header/Checkpoint.h"
+#include "../header/SpiNVSRAM.h"
+#include "../header/SensorFusion.h"
+#include "../header/Dispenser.h"
+
+namespace JAFD
+{
+	namespace Checkpoint
+	{
+		namespace
+		{
+			constexpr uint16_t slotSize = SpiNVSRAM::slotSize(sizeof(Data));
+
+			Data _data;						// Last stored or loaded snapshot
+			bool _valid = false;
+			uint32_t _sequence = 0;
+			uint8_t _nextSlot = 0;			// Slot of the next store
+			uint8_t _buffer[slotSize];		// Written by the DMA - must stay valid until the transfer is finished
+		}
+
+		ReturnCode setup()
+		{
+			uint8_t buffer[2 * slotSize];	// Both slots
+
+			_valid = false;
+			_sequence = 0;
+			_nextSlot = 0;
+
+			if (SpiNVSRAM::loadNewestSlot(JAFDSettings::SpiNVSRAM::checkpointStartAddr, version, &_data, sizeof(Data), buffer, _sequence, _nextSlot) != ReturnCode::ok) return ReturnCode::error;
+
+			_valid = true;
+
+			return ReturnCode::ok;
+		}
+
+		ReturnCode store(const MapCoordinate coor, const AbsoluteDir heading)
+		{
+			// The buffer of the last snapshot could still be in use
+			SpiNVSRAM::waitForTransfer();
+
+			_data.coor = coor;
+			_data.floor = MazeMapping::getFloor();
+			_data.heading = heading;
+			_data.leftCubes = Dispenser::getLeftCubeCount();
+			_data.rightCubes = Dispenser::getRightCubeCount();
+			_data.numWalls = MazeMapping::VictimEvidence::exportWalls(_data.walls, maxWalls);
+
+			SpiNVSRAM::buildSlot(_buffer, version, _sequence + 1, &_data, sizeof(Data));
+
+			if (SpiNVSRAM::writeStreamAsync(JAFDSettings::SpiNVSRAM::checkpointStartAddr + _nextSlot * slotSize, _buffer, slotSize) != ReturnCode::ok) return ReturnCode::error;
+
+			_valid = true;
+			_sequence++;
+			_nextSlot ^= 1;
+
+			return ReturnCode::ok;
+		}
+
+		ReturnCode resume()
+		{
+			if (!_valid) return ReturnCode::error;
+
+			if (MazeMapping::setFloor(_data.floor) != ReturnCode::ok) return ReturnCode::error;
+
+			// Middle of the checkpoint cell - north = 0, west = pi / 2
+			const Vec3f position(_data.coor.x * JAFDSettings::Field::cellWidth, _data.coor.y * JAFDSettings::Field::cellWidth, 0.0f);
+
+			SensorFusion::setCertainRobotPosition(position, -static_cast<uint8_t>(_data.heading) * M_PI_2);
+
+			MazeMapping::VictimEvidence::importWalls(_data.walls, _data.numWalls);
+			Dispenser::setCubeCounts(_data.leftCubes, _data.rightCubes);
+
+			return ReturnCode::ok;
+		}
+
+		void clear()
+		{
+			SpiNVSRAM::waitForTransfer();
+			SpiNVSRAM::fill(JAFDSettings::SpiNVSRAM::checkpointStartAddr, 0, 2 * slotSize);
+
+			_valid = false;
+			_sequence = 0;
+			_nextSlot = 0;
+		}
+	}
+}
\ No newline at end of file
@@ -6,8 +6,6 @@ This part is responsible for dispensing the rescue packages.
 #include "../../JAFDSettings.h"
 #include "../header/SmoothDriving.h"
 #include "../header/DuePinMapping.h"
-#include "../header/SensorFusion.h"
-#include "../header/SmallThings.h"
 
 namespace JAFD
 {
@@ -21,6 +19,88 @@ namespace JAFD
 			constexpr auto leftPWMCh = PinMapping::getPWMChannel(leftPWMPin);
 			uint8_t leftCubeCount = JAFDSettings::Dispenser::Left::startCubeCount;
 			uint8_t rightCubeCount = JAFDSettings::Dispenser::Right::startCubeCount;
+
+			enum class State : uint8_t
+			{
+				idle,
+				extending,		// Piston is pushing out a cube
+				retracting,		// Piston moves back
+				waitingForStop,	// Side is empty - wait for the current driving task before turning
+				waitingForTurn,	// The main loop has to start the turn (needsTurn())
+				rotating		// Turning by 180 degrees, so the other side faces the victim
+			};
+
+			volatile State _state = State::idle;
+			uint32_t _stateStart = 0;		// Time of the last state change
+			bool _left = true;				// Side that is dropping
+			uint8_t _remaining = 0;			// Cubes still to drop on this side
+			uint8_t _otherRemaining = 0;	// Cubes to drop on the other side after turning
+
+			void setServo(const bool left, const bool extended)
+			{
+				if (left)
+				{
+					PWM->PWM_CH_NUM[leftPWMCh].PWM_CDTYUPD = (extended ? JAFDSettings::Dispenser::Left::startDty : JAFDSettings::Dispenser::Left::endDty) * PWM->PWM_CH_NUM[leftPWMCh].PWM_CPRD;
+				}
+				else
+				{
+					PWM->PWM_CH_NUM[rightPWMCh].PWM_CDTYUPD = (extended ? JAFDSettings::Dispenser::Right::startDty : JAFDSettings::Dispenser::Right::endDty) * PWM->PWM_CH_NUM[rightPWMCh].PWM_CPRD;
+				}
+
+				PWM->PWM_SCUC = PWM_SCUC_UPDULOCK;
+			}
+
+			void setState(const State state)
+			{
+				_state = state;
+				_stateStart = millis();
+			}
+
+			// Push out the next cube of this side, turn if it is empty or finish
+			void nextDrop()
+			{
+				if (_remaining > 0)
+				{
+					setServo(_left, true);
+					setState(State::extending);
+				}
+				else if (_otherRemaining > 0)
+				{
+					setState(State::waitingForStop);
+				}
+				else
+				{
+					setState(State::idle);
+				}
+			}
+
+			ReturnCode startDispensing(const bool left, const uint8_t num)
+			{
+				//Max Packs to be allowed to get dispensed
+				if (num > 3 || num < 1) return ReturnCode::error;
+				if (num > (getRightCubeCount() + getLeftCubeCount())) return ReturnCode::error;
+
+				__disable_irq();
+
+				if (_state != State::idle)
+				{
+					__enable_irq();
+					return ReturnCode::error;
+				}
+
+				const uint8_t sideCount = left ? leftCubeCount : rightCubeCount;
+
+				// The rest is dropped from the other side after turning
+				_left = left;
+				_remaining = (sideCount >= num) ? num : sideCount;
+				_otherRemaining = num - _remaining;
+
+				nextDrop();
+
+				__enable_irq();
+
+				return ReturnCode::ok;
+			}
 		}
 
 		// Set up the Dispenser System
@@ -92,156 +172,98 @@ namespace JAFD
 			return leftCubeCount;
 		}
 
-		ReturnCode dispenseRight(uint8_t num)
+		void setCubeCounts(const uint8_t left, const uint8_t right)
 		{
-			//Max Packs to be allowed to get dispensed
-			if (num > 3 || num < 1)
-			{
-				return ReturnCode::error;
-			}
-			else if (num > (getRightCubeCount() + getLeftCubeCount()))
-			{
-				return ReturnCode::error;
-			}
-			else if (getRightCubeCount() >= num)
-			{
-				for (int i = 0; i < num; i++)
-				{
-					PWM->PWM_CH_NUM[rightPWMCh].PWM_CDTYUPD = JAFDSettings::Dispenser::Right::startDty * PWM->PWM_CH_NUM[rightPWMCh].PWM_CPRD;
-					PWM->PWM_SCUC = PWM_SCUC_UPDULOCK;
-					
-					Wait::delayUnblocking(JAFDSettings::Dispenser::pause);
-
-					PWM->PWM_CH_NUM[rightPWMCh].PWM_CDTYUPD = JAFDSettings::Dispenser::Right::endDty * PWM->PWM_CH_NUM[rightPWMCh].PWM_CPRD;
-					PWM->PWM_SCUC = PWM_SCUC_UPDULOCK;
-
-					Wait::delayUnblocking(JAFDSettings::Dispenser::pause);
-
-					rightCubeCount--;
-				}
-
-				return ReturnCode::ok;
-			}
-			else
-			{
-				uint16_t remainPacks = num - getRightCubeCount();
-
-				for (int i = 0; i < getRightCubeCount(); i++)
-				{
-					PWM->PWM_CH_NUM[rightPWMCh].PWM_CDTYUPD = JAFDSettings::Dispenser::Right::startDty * PWM->PWM_CH_NUM[rightPWMCh].PWM_CPRD;
-					PWM->PWM_SCUC = PWM_SCUC_UPDULOCK;
-
-					Wait::delayUnblocking(JAFDSettings::Dispenser::pause);
+			leftCubeCount = left;
+			rightCubeCount = right;
+		}
 
-					PWM->PWM_CH_NUM[rightPWMCh].PWM_CDTYUPD = JAFDSettings::Dispenser::Right::endDty * PWM->PWM_CH_NUM[rightPWMCh].PWM_CPRD;
-					PWM->PWM_SCUC = PWM_SCUC_UPDULOCK;
+		ReturnCode dispenseRight(uint8_t num)
+		{
+			return startDispensing(false, num);
+		}
 
-					Wait::delayUnblocking(JAFDSettings::Dispenser::pause);
+		ReturnCode dispenseLeft(uint8_t num)
+		{
+			return startDispensing(true, num);
+		}
 
-					rightCubeCount--;
-				}
+		bool isFinished()
+		{
+			return _state == State::idle;
+		}
 
-				SmoothDriving::setNewTask<SmoothDriving::NewStateType::lastEndState>(SmoothDriving::TaskArray(
-					SmoothDriving::Stop(),
-					SmoothDriving::Rotate(4.0f, 180.0f),
-					SmoothDriving::Stop()), true);
+		bool needsTurn()
+		{
+			return _state == State::waitingForTurn;
+		}
 
-				Wait::waitForFinishedTask();
+		// Planning the rotation is too slow for the scheduler job
+		ReturnCode startTurn()
+		{
+			if (_state != State::waitingForTurn) return ReturnCode::error;
 
-				for (int i = 0; i < remainPacks; i++)
-				{
-					PWM->PWM_CH_NUM[leftPWMCh].PWM_CDTYUPD = JAFDSettings::Dispenser::Left::startDty * PWM->PWM_CH_NUM[leftPWMCh].PWM_CPRD;
-					PWM->PWM_SCUC = PWM_SCUC_UPDULOCK;
+			if (SmoothDriving::setNewTask<SmoothDriving::NewStateType::lastEndState>(SmoothDriving::Rotate(4.0f, 180.0f)) != ReturnCode::ok)
+			{
+				// The remaining cubes are not dropped
+				__disable_irq();
 
-					Wait::delayUnblocking(JAFDSettings::Dispenser::pause);
+				_remaining = 0;
+				_otherRemaining = 0;
+				setState(State::idle);
 
-					PWM->PWM_CH_NUM[leftPWMCh].PWM_CDTYUPD = JAFDSettings::Dispenser::Left::endDty * PWM->PWM_CH_NUM[leftPWMCh].PWM_CPRD;
-					PWM->PWM_SCUC = PWM_SCUC_UPDULOCK;
+				__enable_irq();
 
-					Wait::delayUnblocking(JAFDSettings::Dispenser::pause);
+				return ReturnCode::error;
+			}
 
-					leftCubeCount--;
-				}
+			setState(State::rotating);
 
-				return ReturnCode::ok;
-			}
 			return ReturnCode::ok;
 		}
 
-		ReturnCode dispenseLeft(uint8_t num)
+		void update(const uint8_t freq)
 		{
-			//Max Packs to be allowed to get dispensed
-			if (num > 3 || num < 1)
-			{
-				return ReturnCode::error;
-			}
-			else if (num > (getRightCubeCount() + getLeftCubeCount()))
-			{
-				return ReturnCode::error;
-			}
-			else if (getLeftCubeCount() >= num)
-			{
-				for (int i = 0; i < num; i++)
-				{
-					PWM->PWM_CH_NUM[leftPWMCh].PWM_CDTYUPD = JAFDSettings::Dispenser::Left::startDty * PWM->PWM_CH_NUM[leftPWMCh].PWM_CPRD;
-					PWM->PWM_SCUC = PWM_SCUC_UPDULOCK;
-
-					Wait::delayUnblocking(JAFDSettings::Dispenser::pause);
-
-					PWM->PWM_CH_NUM[leftPWMCh].PWM_CDTYUPD = JAFDSettings::Dispenser::Left::endDty * PWM->PWM_CH_NUM[leftPWMCh].PWM_CPRD;
-					PWM->PWM_SCUC = PWM_SCUC_UPDULOCK;
-
-					Wait::delayUnblocking(JAFDSettings::Dispenser::pause);
-
-					leftCubeCount--;
-				}
+			const uint32_t now = millis();
 
-				return ReturnCode::ok;
-			}
-			else
+			switch (_state)
 			{
-				uint16_t remainPacks = num - getLeftCubeCount();
-
-				for (int i = 0; i < getLeftCubeCount(); i++)
-				{
-					PWM->PWM_CH_NUM[leftPWMCh].PWM_CDTYUPD = JAFDSettings::Dispenser::Left::startDty * PWM->PWM_CH_NUM[leftPWMCh].PWM_CPRD;
-					PWM->PWM_SCUC = PWM_SCUC_UPDULOCK;
-
-					Wait::delayUnblocking(JAFDSettings::Dispenser::pause);
+			case State::extending:
+				if (now - _stateStart < JAFDSettings::Dispenser::pause) break;
 
-					PWM->PWM_CH_NUM[leftPWMCh].PWM_CDTYUPD = JAFDSettings::Dispenser::Left::endDty * PWM->PWM_CH_NUM[leftPWMCh].PWM_CPRD;
-					PWM->PWM_SCUC = PWM_SCUC_UPDULOCK;
+				setServo(_left, false);
+				setState(State::retracting);
+				break;
 
-					Wait::delayUnblocking(JAFDSettings::Dispenser::pause);
+			case State::retracting:
+				if (now - _stateStart < JAFDSettings::Dispenser::pause) break;
 
-					leftCubeCount--;
-				}
-				
-				SmoothDriving::setNewTask<SmoothDriving::NewStateType::lastEndState>(SmoothDriving::TaskArray(
-					SmoothDriving::Stop(),
-					SmoothDriving::Rotate(4.0f, 180.0f),
-					SmoothDriving::Stop()), true);
-
-				Wait::waitForFinishedTask();
+				if (_left) leftCubeCount--;
+				else rightCubeCount--;
 
-				for (int i = 0; i < remainPacks; i++)
-				{
-					PWM->PWM_CH_NUM[rightPWMCh].PWM_CDTYUPD = JAFDSettings::Dispenser::Right::startDty * PWM->PWM_CH_NUM[rightPWMCh].PWM_CPRD;
-					PWM->PWM_SCUC = PWM_SCUC_UPDULOCK;
+				_remaining--;
+				nextDrop();
+				break;
 
-					Wait::delayUnblocking(JAFDSettings::Dispenser::pause);
+			case State::waitingForStop:
+				// Let the current task (e.g. the deceleration at the victim) finish before turning
+				if (!SmoothDriving::isTaskFinished()) break;
 
-					PWM->PWM_CH_NUM[rightPWMCh].PWM_CDTYUPD = JAFDSettings::Dispenser::Right::endDty * PWM->PWM_CH_NUM[rightPWMCh].PWM_CPRD;
-					PWM->PWM_SCUC = PWM_SCUC_UPDULOCK;
+				setState(State::waitingForTurn);
+				break;
 
-					Wait::delayUnblocking(JAFDSettings::Dispenser::pause);
+			case State::rotating:
+				if (!SmoothDriving::isTaskFinished()) break;
 
-					rightCubeCount--;
-				}
+				_left = !_left;
+				_remaining = _otherRemaining;
+				_otherRemaining = 0;
+				nextDrop();
+				break;
 
-				return ReturnCode::ok;
+			default:
+				break;
 			}
-			return ReturnCode::ok;
 		}
 	}
 }
\ No newline at end of file
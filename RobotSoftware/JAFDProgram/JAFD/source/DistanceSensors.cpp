@@ -5,9 +5,11 @@ This file is responsible for all distance sensors
 #include "../../JAFDSettings.h"
 #include "../header/DistanceSensors.h"
 #include "../header/TCA9548A.h"
-#include "../header/SpiNVSRAM.h"
+#include "../header/Calibration.h"
 #include "../header/SensorFusion.h"
 #include "../header/SmallThings.h"
+#include "../header/SmoothDriving.h"
+#include "../header/Telemetry.h"
 
 namespace JAFD
 {
@@ -58,26 +60,28 @@ namespace JAFD
 
 		void VL6180::storeCalibData()
 		{
-			uint32_t startAddr = JAFDSettings::SpiNVSRAM::distSensStartAddr + JAFDSettings::DistanceSensors::bytesPerCalibData * _id;
+			auto& calib = Calibration::getData().distSensors[_id];
 
-			uint16_t storeK = _k * 100.0f;
-			uint16_t storeD = ((uint16_t)(abs(_d)) & 0x7fff) | ((_d < 0) ? 1 << 15 : 0);
+			calib.k = _k;
+			calib.d = _d;
+			calib.valid = true;
 
-			SpiNVSRAM::writeByte(startAddr, storeK & 0xff);
-			SpiNVSRAM::writeByte(startAddr + 1, storeK >> 8);
-			SpiNVSRAM::writeByte(startAddr + 2, storeD & 0xff);
-			SpiNVSRAM::writeByte(startAddr + 3, storeD >> 8);
+			Calibration::store();
 		}
 
 		void VL6180::restoreCalibData()
 		{
-			uint32_t startAddr = JAFDSettings::SpiNVSRAM::distSensStartAddr + JAFDSettings::DistanceSensors::bytesPerCalibData * _id;
+			const auto& calib = Calibration::getData().distSensors[_id];
 
-			uint16_t storeK = SpiNVSRAM::readByte(startAddr) | (SpiNVSRAM::readByte(startAddr + 1) << 8);
-			_k = storeK / 100.0f;
-
-			uint16_t storeD = SpiNVSRAM::readByte(startAddr + 2) | ((uint16_t)SpiNVSRAM::readByte(startAddr + 3) << 8);
-			_d = (storeD & 0x7fff) * ((storeD >> 15) ? -1 : 1);
+			if (calib.valid)
+			{
+				_k = calib.k;
+				_d = calib.d;
+			}
+			else
+			{
+				resetCalibData();
+			}
 		}
 
 		void VL6180::resetCalibData()
@@ -86,6 +90,12 @@ namespace JAFD
 			_d = 0;
 		}
 
+		void VL6180::setCalibData(float k, int16_t d)
+		{
+			_k = k;
+			_d = d;
+		}
+
 		void VL6180::loadSettings() const
 		{
 			if (I2CMultiplexer::getChannel() != _multiplexCh)
@@ -149,7 +159,10 @@ namespace JAFD
 			// Select single mode (to stop eventual continuous )
 			write8(_regRangeStart, 0x01);
 
-			delay(100);
+			// Wait until the device is ready for the next start instead of a fixed delay
+			const uint32_t start = millis();
+
+			while (!(read8(_regRangeStatus) & 0x01) && millis() - start < JAFDSettings::DistanceSensors::readyTimeout);
 
 			// Start continuous mode
 			write8(_regRangeStart, 0x03);
@@ -209,35 +222,20 @@ namespace JAFD
 
 		uint16_t VL6180::getDistance()
 		{
-			uint16_t distance;
-
-			if (I2CMultiplexer::getChannel() != _multiplexCh)
-			{
-				I2CMultiplexer::selectChannel(_multiplexCh);
-			}
-
 			// Poll until data is available
 			auto startMillis = millis();
-			while (!(read8(_regIntStatus) & 0x04))
+
+			while (!dataReady())
 			{
 				if (millis() - startMillis > JAFDSettings::DistanceSensors::timeout)
 				{
-					// Select single mode (to stop eventual continuous )
-					write8(_regRangeStart, 0x01);
+					stopRanging();
 
-					delay(100);
+					delay(JAFDSettings::DistanceSensors::restartDelay);
 
-					// Start continuous mode
-					write8(_regRangeStart, 0x03);
+					startRanging();
 
-					if (read8(_regModelID) != 0xB4)
-					{
-						Serial.println("I2C problem");
-						I2CBus::resetBus();
-					}
-
-					Serial.print("to");
-					Serial.print(_id);
+					Telemetry::logEvent(Telemetry::Event::distSensorTimeout, _id);
 
 					// Timeout
 					clearInterrupt();
@@ -246,17 +244,69 @@ namespace JAFD
 				}
 			}
 
-			// Read range in mm
-			float tempDist = read8(_regRangeResult) * _k + _d;
+			return readDistance();
+		}
 
-			if (tempDist < 0.0f) distance = 0;
-			else distance = (uint16_t)roundf(tempDist);
+		bool VL6180::dataReady() const
+		{
+			if (I2CMultiplexer::getChannel() != _multiplexCh)
+			{
+				I2CMultiplexer::selectChannel(_multiplexCh);
+			}
+
+			return read8(_regIntStatus) & 0x04;
+		}
+
+		uint16_t VL6180::readDistance()
+		{
+			if (I2CMultiplexer::getChannel() != _multiplexCh)
+			{
+				I2CMultiplexer::selectChannel(_multiplexCh);
+			}
+
+			// Read range in mm
+			const uint8_t rawRange = read8(_regRangeResult);
 
 			// Clear interrupt
 			clearInterrupt();
 
 			// Read status
-			_status = static_cast<Status>(read8(_regRangeStatus) >> 4);
+			return evaluateMeasurement(rawRange, read8(_regRangeStatus));
+		}
+
+		void VL6180::queueResultRead()
+		{
+			// Nothing is ready if the batch fails
+			_batchIntStatus = 0;
+
+			// All three registers are read in one transaction
+			I2CMultiplexer::Batch::queueRead(_multiplexCh, _i2cAddr, _regRangeStatus, 2, &_batchRangeStatus, 1);
+			I2CMultiplexer::Batch::queueRead(_multiplexCh, _i2cAddr, _regIntStatus, 2, &_batchIntStatus, 1);
+			I2CMultiplexer::Batch::queueRead(_multiplexCh, _i2cAddr, _regRangeResult, 2, &_batchRangeResult, 1);
+		}
+
+		bool VL6180::batchedDataReady() const
+		{
+			return _batchIntStatus & 0x04;
+		}
+
+		uint16_t VL6180::readBatchedDistance()
+		{
+			I2CMultiplexer::Batch::queueWrite(_multiplexCh, _i2cAddr, _regIntClear, 2, 0x07);
+
+			return evaluateMeasurement(_batchRangeResult, _batchRangeStatus);
+		}
+
+		uint16_t VL6180::evaluateMeasurement(const uint8_t rawRange, const uint8_t rawStatus)
+		{
+			uint16_t distance;
+
+			float tempDist = rawRange * _k + _d;
+
+			if (tempDist < 0.0f) distance = 0;
+			else distance = (uint16_t)roundf(tempDist);
+
+			_status = static_cast<Status>(rawStatus >> 4);
 
 			if (_status == Status::noError || _status == Status::eceFailure || _status == Status::noiseError)
 			{
@@ -275,6 +325,34 @@ namespace JAFD
 			return distance;
 		}
 
+		void VL6180::stopRanging() const
+		{
+			if (I2CMultiplexer::getChannel() != _multiplexCh)
+			{
+				I2CMultiplexer::selectChannel(_multiplexCh);
+			}
+
+			// Select single mode (to stop eventual continuous )
+			write8(_regRangeStart, 0x01);
+		}
+
+		void VL6180::startRanging() const
+		{
+			if (I2CMultiplexer::getChannel() != _multiplexCh)
+			{
+				I2CMultiplexer::selectChannel(_multiplexCh);
+			}
+
+			// Start continuous mode
+			write8(_regRangeStart, 0x03);
+
+			if (read8(_regModelID) != 0xB4)
+			{
+				Telemetry::logEvent(Telemetry::Event::distSensorI2CError, _id);
+				I2CBus::resetBus();
+			}
+		}
+
 		void VL6180::clearInterrupt()
 		{
 			if (I2CMultiplexer::getChannel() != _multiplexCh)
@@ -325,8 +403,7 @@ namespace JAFD
 				return ReturnCode::error;
 			}
 
-			delay(100);
-
+			// The search for the header waits for the first frame
 			uint8_t numCharsRead = 0;
 			uint8_t lastChar = 0x00;
 			auto startMillis = millis();
@@ -492,26 +569,28 @@ namespace JAFD
 
 		void TFMini::storeCalibData()
 		{
-			uint32_t startAddr = JAFDSettings::SpiNVSRAM::distSensStartAddr + JAFDSettings::DistanceSensors::bytesPerCalibData * _id;
+			auto& calib = Calibration::getData().distSensors[_id];
 
-			uint16_t storeK = _k * 100.0f;
-			uint16_t storeD = ((uint16_t)(abs(_d)) & 0x7fff) | ((_d < 0) ? 1 << 15 : 0);
+			calib.k = _k;
+			calib.d = _d;
+			calib.valid = true;
 
-			SpiNVSRAM::writeByte(startAddr, storeK & 0xff);
-			SpiNVSRAM::writeByte(startAddr + 1, storeK >> 8);
-			SpiNVSRAM::writeByte(startAddr + 2, storeD & 0xff);
-			SpiNVSRAM::writeByte(startAddr + 3, storeD >> 8);
+			Calibration::store();
 		}
 
 		void TFMini::restoreCalibData()
 		{
-			uint32_t startAddr = JAFDSettings::SpiNVSRAM::distSensStartAddr + JAFDSettings::DistanceSensors::bytesPerCalibData * _id;
+			const auto& calib = Calibration::getData().distSensors[_id];
 
-			uint16_t storeK = SpiNVSRAM::readByte(startAddr) | (SpiNVSRAM::readByte(startAddr + 1) << 8);
-			_k = storeK / 100.0f;
-
-			uint16_t storeD = SpiNVSRAM::readByte(startAddr + 2) | ((uint16_t)SpiNVSRAM::readByte(startAddr + 3) << 8);
-			_d = (storeD & 0x7fff) * ((storeD >> 15) ? -1 : 1);
+			if (calib.valid)
+			{
+				_k = calib.k;
+				_d = calib.d;
+			}
+			else
+			{
+				resetCalibData();
+			}
 		}
 
 		void TFMini::resetCalibData()
@@ -520,6 +599,12 @@ namespace JAFD
 			_d = 0;
 		}
 
+		void TFMini::setCalibData(float k, int16_t d)
+		{
+			_k = k;
+			_d = d;
+		}
+
 		TFMini::Status TFMini::getStatus() const
 		{
 			return _status;
@@ -552,6 +637,22 @@ namespace JAFD
 		}
 
 		uint16_t VL53L0::getDistance()
+		{
+			// The library waits until the measurement is finished
+			return readDistance();
+		}
+
+		bool VL53L0::dataReady()
+		{
+			if (I2CMultiplexer::getChannel() != _multiplexCh)
+			{
+				I2CMultiplexer::selectChannel(_multiplexCh);
+			}
+
+			return (_sensor.readReg(_sensor.RESULT_INTERRUPT_STATUS) & 0x07) != 0;
+		}
+
+		uint16_t VL53L0::readDistance()
 		{
 			if (I2CMultiplexer::getChannel() != _multiplexCh)
 			{
@@ -560,27 +661,81 @@ namespace JAFD
 
 			uint16_t distance = _sensor.readRangeContinuousMillimeters();
 
-			float tempDist = distance * _k + _d;
+			if (_sensor.timeoutOccurred())
+			{
+				Telemetry::logEvent(Telemetry::Event::distSensorTimeout, _id);
+				_status = Status::timeOut;
+				I2CBus::resetBus();
+
+				return 0;
+			}
+
+			return evaluateMeasurement(distance);
+		}
+
+		void VL53L0::queueResultRead()
+		{
+			// Nothing is ready if the batch fails
+			_batchIntStatus = 0;
+
+			// Both registers are read in one transaction
+			I2CMultiplexer::Batch::queueRead(_multiplexCh, _sensor.getAddress(), _sensor.RESULT_INTERRUPT_STATUS, 1, &_batchIntStatus, 1);
+			I2CMultiplexer::Batch::queueRead(_multiplexCh, _sensor.getAddress(), _sensor.RESULT_RANGE_STATUS + 10, 1, _batchRange, 2);
+		}
+
+		bool VL53L0::batchedDataReady() const
+		{
+			return (_batchIntStatus & 0x07) != 0;
+		}
+
+		uint16_t VL53L0::readBatchedDistance()
+		{
+			I2CMultiplexer::Batch::queueWrite(_multiplexCh, _sensor.getAddress(), _sensor.SYSTEM_INTERRUPT_CLEAR, 1, 0x01);
+
+			return evaluateMeasurement(((uint16_t)_batchRange[0] << 8) | _batchRange[1]);
+		}
+
+		uint16_t VL53L0::evaluateMeasurement(const uint16_t rawDistance)
+		{
+			uint16_t distance;
+
+			float tempDist = rawDistance * _k + _d;
 
 			if (tempDist < 0.0f) distance = 0;
 			else distance = (uint16_t)roundf(tempDist);
 
 			_status = Status::noError;
 
-			if (_sensor.timeoutOccurred())
+			if (distance > maxDist) _status = Status::overflow;
+			else if (distance < minDist) _status = Status::underflow;
+
+			return distance;
+		}
+
+		void VL53L0::stopRanging()
+		{
+			if (I2CMultiplexer::getChannel() != _multiplexCh)
 			{
-				Serial.print("to");
-				Serial.println(_id);
-				_status = Status::timeOut;
-				I2CBus::resetBus();
+				I2CMultiplexer::selectChannel(_multiplexCh);
 			}
-			else
+
+			_sensor.stopContinuous();
+		}
+
+		void VL53L0::startRanging()
+		{
+			if (I2CMultiplexer::getChannel() != _multiplexCh)
 			{
-				if (distance > maxDist) _status = Status::overflow;
-				else if (distance < minDist) _status = Status::underflow;
+				I2CMultiplexer::selectChannel(_multiplexCh);
 			}
 
-			return distance;
+			_sensor.startContinuous();
+
+			if (_sensor.readReg(_sensor.IDENTIFICATION_MODEL_ID) != 0xEE)
+			{
+				Telemetry::logEvent(Telemetry::Event::distSensorI2CError, _id);
+				I2CBus::resetBus();
+			}
 		}
 
 		void VL53L0::clearInterrupt()
@@ -614,26 +769,28 @@ namespace JAFD
 
 		void VL53L0::storeCalibData()
 		{
-			uint32_t startAddr = JAFDSettings::SpiNVSRAM::distSensStartAddr + JAFDSettings::DistanceSensors::bytesPerCalibData * _id;
+			auto& calib = Calibration::getData().distSensors[_id];
 
-			uint16_t storeK = _k * 100.0f;
-			uint16_t storeD = ((uint16_t)(abs(_d)) & 0x7fff) | ((_d < 0) ? 1 << 15 : 0);
+			calib.k = _k;
+			calib.d = _d;
+			calib.valid = true;
 
-			SpiNVSRAM::writeByte(startAddr, storeK & 0xff);
-			SpiNVSRAM::writeByte(startAddr + 1, storeK >> 8);
-			SpiNVSRAM::writeByte(startAddr + 2, storeD & 0xff);
-			SpiNVSRAM::writeByte(startAddr + 3, storeD >> 8);
+			Calibration::store();
 		}
 
 		void VL53L0::restoreCalibData()
 		{
-			uint32_t startAddr = JAFDSettings::SpiNVSRAM::distSensStartAddr + JAFDSettings::DistanceSensors::bytesPerCalibData * _id;
-
-			uint16_t storeK = SpiNVSRAM::readByte(startAddr) | (SpiNVSRAM::readByte(startAddr + 1) << 8);
-			_k = storeK / 100.0f;
+			const auto& calib = Calibration::getData().distSensors[_id];
 
-			uint16_t storeD = SpiNVSRAM::readByte(startAddr + 2) | ((uint16_t)SpiNVSRAM::readByte(startAddr + 3) << 8);
-			_d = (storeD & 0x7fff) * ((storeD >> 15) ? -1 : 1);
+			if (calib.valid)
+			{
+				_k = calib.k;
+				_d = calib.d;
+			}
+			else
+			{
+				resetCalibData();
+			}
 		}
 
 		void VL53L0::resetCalibData()
@@ -642,6 +799,12 @@ namespace JAFD
 			_d = 0;
 		}
 
+		void VL53L0::setCalibData(float k, int16_t d)
+		{
+			_k = k;
+			_d = d;
+		}
+
 		VL53L0::Status VL53L0::getStatus() const
 		{
 			return _status;
@@ -657,6 +820,94 @@ namespace JAFD
 		VL6180 rightFront(JAFDSettings::DistanceSensors::RightFront::multiplexCh, 6);
 		VL6180 rightBack(JAFDSettings::DistanceSensors::RightBack::multiplexCh, 7);
 
+		namespace
+		{
+			// State of one sensor in the acquisition scheduler
+			struct AcquisitionState
+			{
+				uint32_t lastSampleTime = 0;	// Time of the last sample or (re-)start
+				bool restarting = false;		// Is the sensor stopped and waiting for a restart?
+			};
+
+			AcquisitionState acquisitionStates[static_cast<uint8_t>(SensorID::numSensors)];		// States of all short distance sensors
+			StaticQueue<DistSample, JAFDSettings::DistanceSensors::sampleBufferSize> sampleBuffer;	// Timestamped samples for the sensor fusion
+
+			// Convert the status of a sensor to the status of a sample
+			template<typename StatusType>
+			DistSensorStatus toDistSensorStatus(const StatusType status)
+			{
+				if (status == StatusType::noError) return DistSensorStatus::ok;
+				else if (status == StatusType::overflow) return DistSensorStatus::overflow;
+				else if (status == StatusType::underflow) return DistSensorStatus::underflow;
+				else return DistSensorStatus::error;
+			}
+
+			// Queue reading of the measurement of one sensor in the multiplexer batch
+			template<typename SensorType>
+			void queueResultRead(SensorType& sensor, const SensorID id)
+			{
+				if (!acquisitionStates[static_cast<uint8_t>(id)].restarting) sensor.queueResultRead();
+			}
+
+			// Collect the batched measurement of one sensor if it is finished - never waits for the sensor
+			template<typename SensorType>
+			void pollSensor(SensorType& sensor, const SensorID id)
+			{
+				auto& state = acquisitionStates[static_cast<uint8_t>(id)];
+				const uint32_t now = millis();
+
+				DistSample sample;
+				sample.timestamp = now;
+				sample.sensor = id;
+
+				if (state.restarting)
+				{
+					if (now - state.lastSampleTime >= JAFDSettings::DistanceSensors::restartDelay)
+					{
+						sensor.startRanging();
+
+						state.restarting = false;
+						state.lastSampleTime = now;
+					}
+
+					return;
+				}
+				else if (sensor.batchedDataReady())
+				{
+					sample.distance = sensor.readBatchedDistance();
+					sample.status = toDistSensorStatus(sensor.getStatus());
+
+					state.lastSampleTime = now;
+				}
+				else if (now - state.lastSampleTime > JAFDSettings::DistanceSensors::timeout)
+				{
+					// Sensor hangs - stop it now and start it again in one of the next updates
+					Telemetry::logEvent(Telemetry::Event::distSensorStalled, static_cast<int32_t>(id));
+
+					sensor.stopRanging();
+
+					state.restarting = true;
+					state.lastSampleTime = now;
+
+					sample.distance = 0;
+					sample.status = DistSensorStatus::error;
+				}
+				else
+				{
+					return;
+				}
+
+				// Drop the oldest sample if nobody collected the samples
+				if (sampleBuffer.isFull())
+				{
+					DistSample oldSample;
+					sampleBuffer.dequeue(&oldSample);
+				}
+
+				sampleBuffer.enqueue(sample);
+			}
+		}
+
 		ReturnCode reset()
 		{
 			return setup();
@@ -668,37 +919,37 @@ namespace JAFD
 
 			if (leftFront.setup() != ReturnCode::ok)
 			{
-				Serial.println("lf");
+				Telemetry::logEvent(Telemetry::Event::distSensorSetupError, static_cast<int32_t>(SensorID::leftFront));
 				code = ReturnCode::fatalError;
 			}
 
 			if (leftBack.setup() != ReturnCode::ok)
 			{
-				Serial.println("lb");
+				Telemetry::logEvent(Telemetry::Event::distSensorSetupError, static_cast<int32_t>(SensorID::leftBack));
 				code = ReturnCode::fatalError;
 			}
 
 			if (rightFront.setup() != ReturnCode::ok)
 			{
-				Serial.println("rf");
+				Telemetry::logEvent(Telemetry::Event::distSensorSetupError, static_cast<int32_t>(SensorID::rightFront));
 				code = ReturnCode::fatalError;
 			}
 
 			if (rightBack.setup() != ReturnCode::ok)
 			{
-				Serial.println("rb");
+				Telemetry::logEvent(Telemetry::Event::distSensorSetupError, static_cast<int32_t>(SensorID::rightBack));
 				code = ReturnCode::fatalError;
 			}
 
 			if (frontLeft.setup() != ReturnCode::ok)
 			{
-				Serial.println("fl");
+				Telemetry::logEvent(Telemetry::Event::distSensorSetupError, static_cast<int32_t>(SensorID::frontLeft));
 				code = ReturnCode::fatalError;
 			}
 
 			if (frontRight.setup() != ReturnCode::ok)
 			{
-				Serial.println("fr");
+				Telemetry::logEvent(Telemetry::Event::distSensorSetupError, static_cast<int32_t>(SensorID::frontRight));
 				code = ReturnCode::fatalError;
 			}
 
@@ -716,415 +967,363 @@ namespace JAFD
 			DistanceSensors::frontRight.restoreCalibData();
 			DistanceSensors::frontLeft.restoreCalibData();
 
+			// Start acquisition
+			for (auto& state : acquisitionStates)
+			{
+				state.lastSampleTime = millis();
+				state.restarting = false;
+			}
+
+			sampleBuffer.clear();
+
 			return code;
 		}
 
 		void updateDistSensors()
 		{
-			struct TempData
+			// Read status and results of all sensors in one batch
+			queueResultRead(frontLeft, SensorID::frontLeft);
+			queueResultRead(frontRight, SensorID::frontRight);
+			queueResultRead(leftBack, SensorID::leftBack);
+			queueResultRead(leftFront, SensorID::leftFront);
+			queueResultRead(rightBack, SensorID::rightBack);
+			queueResultRead(rightFront, SensorID::rightFront);
+
+			I2CMultiplexer::Batch::execute();
+
+			// Collect finished measurements - clearing of the interrupts gets batched, too
+			pollSensor(frontLeft, SensorID::frontLeft);
+			pollSensor(frontRight, SensorID::frontRight);
+			pollSensor(leftBack, SensorID::leftBack);
+			pollSensor(leftFront, SensorID::leftFront);
+			pollSensor(rightBack, SensorID::rightBack);
+			pollSensor(rightFront, SensorID::rightFront);
+
+			I2CMultiplexer::Batch::execute();
+		}
+
+		ReturnCode getSample(DistSample* sample)
+		{
+			return sampleBuffer.dequeue(sample);
+		}
+
+		void forceNewMeasurement()
+		{
+			frontLeft.clearInterrupt();
+			frontRight.clearInterrupt();
+			leftFront.clearInterrupt();
+			leftBack.clearInterrupt();
+			rightFront.clearInterrupt();
+			rightBack.clearInterrupt();
+
+			// Old samples could be from before the measurement was forced
+			sampleBuffer.clear();
+		}
+
+		namespace
+		{
+			constexpr uint8_t numSensors = static_cast<uint8_t>(SensorID::numSensors);
+
+			// Fused measurement of a sensor (order of SensorID)
+			struct FusedDistance
 			{
-				uint32_t tempAverageDist = 0;
-				uint8_t numCorrectSamples = 0;
-				uint8_t numOverflowSamples = 0;
-				uint8_t numUnderflowSamples = 0;
+				uint16_t Distances::* distance;
+				DistSensorStatus DistSensorStates::* status;
 			};
 
-			TempData flData, frData, lfData, lbData, rfData, rbData;
-			uint16_t tempDist = 0;
+			constexpr FusedDistance fusedDistances[numSensors] = {
+				{ &Distances::frontLeft, &DistSensorStates::frontLeft },
+				{ &Distances::frontRight, &DistSensorStates::frontRight },
+				{ &Distances::leftFront, &DistSensorStates::leftFront },
+				{ &Distances::leftBack, &DistSensorStates::leftBack },
+				{ &Distances::rightFront, &DistSensorStates::rightFront },
+				{ &Distances::rightBack, &DistSensorStates::rightBack }
+			};
 
-			auto tempFusedData = SensorFusion::getFusedData();
+			// Least squares fit of the true over the measured distance (true = k * measured + d)
+			struct CalibFit
+			{
+				uint8_t n = 0;
+				float sumM = 0.0f;
+				float sumT = 0.0f;
+				float sumMM = 0.0f;
+				float sumMT = 0.0f;
+				float sumTT = 0.0f;
+				float minM = 0.0f;
+				float maxM = 0.0f;
 
-			//// Front long
-			//tempDist = DistanceSensors::frontLong.getDistance();
+				void add(const float measured, const float trueDist)
+				{
+					if (n == 0 || measured < minM) minM = measured;
+					if (n == 0 || measured > maxM) maxM = measured;
+
+					n++;
+					sumM += measured;
+					sumT += trueDist;
+					sumMM += measured * measured;
+					sumMT += measured * trueDist;
+					sumTT += trueDist * trueDist;
+				}
 
-			//if (DistanceSensors::frontLong.getStatus() == decltype(DistanceSensors::frontLong)::Status::noError)
-			//{
-			//	if (tempFusedData.distSensorState.frontLong == DistSensorStatus::ok)
-			//	{
-			//		tempFusedData.distances.frontLong = tempDist * JAFDSettings::SensorFusion::longDistSensIIRFactor + tempFusedData.distances.frontLong * (1.0f - JAFDSettings::SensorFusion::longDistSensIIRFactor);
-			//	}
-			//	else
-			//	{
-			//		tempFusedData.distances.frontLong = tempDist;
-			//	}
-
-			//	tempFusedData.distSensorState.frontLong = DistSensorStatus::ok;
-			//}
-			//else if (DistanceSensors::frontLong.getStatus() == decltype(DistanceSensors::frontLong)::Status::overflow)
-			//{
-			//	tempFusedData.distSensorState.frontLong = DistSensorStatus::overflow;
-			//	tempFusedData.distances.frontLong = 0;
-			//}
-			//else if (DistanceSensors::frontLong.getStatus() == decltype(DistanceSensors::frontLong)::Status::underflow)
-			//{
-			//	tempFusedData.distSensorState.frontLong = DistSensorStatus::underflow;
-			//	tempFusedData.distances.frontLong = 0;
-			//}
-			//else
-			//{
-			//	tempFusedData.distSensorState.frontLong = DistSensorStatus::error;
-			//	tempFusedData.distances.frontLong = 0;
-			//}
+				// False if there are too few points or they are too close together
+				bool calc(float& k, float& d, float& rms) const
+				{
+					if (n < JAFDSettings::DistanceSensors::AutoCalibration::minPoints || maxM - minM < JAFDSettings::DistanceSensors::minCalibDataDiff) return false;
 
-			tempFusedData.distSensorState.frontLong = DistSensorStatus::error;
+					k = (n * sumMT - sumM * sumT) / (n * sumMM - sumM * sumM);
 
-			// Front Left
-			tempDist = DistanceSensors::frontLeft.getDistance();
+					if (k < JAFDSettings::DistanceSensors::AutoCalibration::minK || k > JAFDSettings::DistanceSensors::AutoCalibration::maxK) return false;
 
-			if (DistanceSensors::frontLeft.getStatus() == decltype(DistanceSensors::frontLeft)::Status::noError)
-			{
-				flData.numCorrectSamples++;
-				flData.tempAverageDist += tempDist;
-			}
-			else if (DistanceSensors::frontLeft.getStatus() == decltype(DistanceSensors::frontLeft)::Status::overflow)
-			{
-				flData.numOverflowSamples++;
-			}
-			else if (DistanceSensors::frontLeft.getStatus() == decltype(DistanceSensors::frontLeft)::Status::underflow)
-			{
-				flData.numUnderflowSamples++;
-			}
+					d = (sumT - k * sumM) / n;
 
-			// Front Right
-			tempDist = DistanceSensors::frontRight.getDistance();
+					const float squaredError = sumTT - 2.0f * k * sumMT - 2.0f * d * sumT + k * k * sumMM + 2.0f * k * d * sumM + n * d * d;
+					rms = sqrtf(fmaxf(squaredError, 0.0f) / n);
+
+					return true;
+				}
+			};
 
-			if (DistanceSensors::frontRight.getStatus() == decltype(DistanceSensors::frontRight)::Status::noError)
+			// Keep the fused data up to date while waiting
+			void updateWhileWaiting(const uint16_t ms)
 			{
-				frData.numCorrectSamples++;
-				frData.tempAverageDist += tempDist;
+				const uint32_t start = millis();
+
+				while (millis() - start < ms)
+				{
+					SensorFusion::updateSensors();
+					SensorFusion::untimedFusion();
+				}
 			}
-			else if (DistanceSensors::frontRight.getStatus() == decltype(DistanceSensors::frontRight)::Status::overflow)
+
+			// Pose in the frame of the dead end (middle of the start cell, x towards the front wall)
+			void getCalibPose(const RobotState& startState, Vec2f& position, float& heading)
 			{
-				frData.numOverflowSamples++;
+				const RobotState state = SensorFusion::getRobotState();
+				const Vec2f diff = (Vec2f)(state.position) - (Vec2f)(startState.position);
+				const float startCos = cosf(startState.globalHeading);
+				const float startSin = sinf(startState.globalHeading);
+
+				position = Vec2f(diff.x * startCos + diff.y * startSin, diff.y * startCos - diff.x * startSin);
+				heading = state.globalHeading - startState.globalHeading;
 			}
-			else if (DistanceSensors::frontRight.getStatus() == decltype(DistanceSensors::frontRight)::Status::underflow)
+
+			// Drive forward / backward to an offset from the middle of the cell - only with heading 0
+			ReturnCode driveTo(const RobotState& startState, const float offset)
 			{
-				frData.numUnderflowSamples++;
-			}
+				Vec2f position;
+				float heading;
 
-			// Left Back
-			tempDist = DistanceSensors::leftBack.getDistance();
+				getCalibPose(startState, position, heading);
 
-			if (DistanceSensors::leftBack.getStatus() == decltype(DistanceSensors::leftBack)::Status::noError)
-			{
-				lbData.numCorrectSamples++;
-				lbData.tempAverageDist += tempDist;
-			}
-			else if (DistanceSensors::leftBack.getStatus() == decltype(DistanceSensors::leftBack)::Status::overflow)
-			{
-				lbData.numOverflowSamples++;
-			}
-			else if (DistanceSensors::leftBack.getStatus() == decltype(DistanceSensors::leftBack)::Status::underflow)
-			{
-				lbData.numUnderflowSamples++;
-			}
+				const float distance = offset - position.x;
 
-			// Left Front
-			tempDist = DistanceSensors::leftFront.getDistance();
+				if (fabsf(distance) < 0.5f) return ReturnCode::ok;
 
-			if (DistanceSensors::leftFront.getStatus() == decltype(DistanceSensors::leftFront)::Status::noError)
-			{
-				lfData.numCorrectSamples++;
-				lfData.tempAverageDist += tempDist;
-			}
-			else if (DistanceSensors::leftFront.getStatus() == decltype(DistanceSensors::leftFront)::Status::overflow)
-			{
-				lfData.numOverflowSamples++;
-			}
-			else if (DistanceSensors::leftFront.getStatus() == decltype(DistanceSensors::leftFront)::Status::underflow)
-			{
-				lfData.numUnderflowSamples++;
-			}
+				const int16_t speed = distance > 0.0f ? JAFDSettings::DistanceSensors::AutoCalibration::speed : -JAFDSettings::DistanceSensors::AutoCalibration::speed;
 
-			// Right Back
-			tempDist = DistanceSensors::rightBack.getDistance();
+				if (SmoothDriving::setNewTask<SmoothDriving::NewStateType::currentState>(SmoothDriving::TaskArray(SmoothDriving::Accelerate(0, distance, speed), SmoothDriving::Stop()), true) != ReturnCode::ok) return ReturnCode::error;
 
-			if (DistanceSensors::rightBack.getStatus() == decltype(DistanceSensors::rightBack)::Status::noError)
-			{
-				rbData.numCorrectSamples++;
-				rbData.tempAverageDist += tempDist;
-			}
-			else if (DistanceSensors::rightBack.getStatus() == decltype(DistanceSensors::rightBack)::Status::overflow)
-			{
-				rbData.numOverflowSamples++;
+				Wait::waitForFinishedTask();
+
+				return ReturnCode::ok;
 			}
-			else if (DistanceSensors::rightBack.getStatus() == decltype(DistanceSensors::rightBack)::Status::underflow)
+
+			// Rotate on the spot to an angle relative to the start (deg)
+			ReturnCode rotateTo(const RobotState& startState, const float angle)
 			{
-				rbData.numUnderflowSamples++;
-			}
+				Vec2f position;
+				float heading;
 
-			// Right Front
-			tempDist = DistanceSensors::rightFront.getDistance();
+				getCalibPose(startState, position, heading);
 
-			if (DistanceSensors::rightFront.getStatus() == decltype(DistanceSensors::rightFront)::Status::noError)
-			{
-				rfData.numCorrectSamples++;
-				rfData.tempAverageDist += tempDist;
-			}
-			else if (DistanceSensors::rightFront.getStatus() == decltype(DistanceSensors::rightFront)::Status::overflow)
-			{
-				rfData.numOverflowSamples++;
-			}
-			else if (DistanceSensors::rightFront.getStatus() == decltype(DistanceSensors::rightFront)::Status::underflow)
-			{
-				rfData.numUnderflowSamples++;
-			}
+				const float rotation = angle - RAD_TO_DEG * heading;
 
-			if (flData.numCorrectSamples > 0)
-			{
-				if (tempFusedData.distSensorState.frontLeft == DistSensorStatus::ok)
-				{
-					tempFusedData.distances.frontLeft = static_cast<uint16_t>((static_cast<float>(flData.tempAverageDist) / flData.numCorrectSamples) * JAFDSettings::SensorFusion::shortDistSensIIRFactor + tempFusedData.distances.frontLeft * (1.0f - JAFDSettings::SensorFusion::shortDistSensIIRFactor));
-				}
-				else
-				{
-					tempFusedData.distances.frontLeft = static_cast<uint16_t>(static_cast<float>(flData.tempAverageDist) / flData.numCorrectSamples);
-				}
+				if (fabsf(rotation) < 0.5f) return ReturnCode::ok;
 
-				tempFusedData.distSensorState.frontLeft = DistSensorStatus::ok;
-			}
-			else
-			{
-				if (flData.numOverflowSamples > 0)
-				{
-					tempFusedData.distSensorState.frontLeft = DistSensorStatus::overflow;
-				}
-				else if (flData.numUnderflowSamples > 0)
-				{
-					tempFusedData.distSensorState.frontLeft = DistSensorStatus::underflow;
-				}
-				else
-				{
-					tempFusedData.distSensorState.frontLeft = DistSensorStatus::error;
-				}
+				const float angularVel = rotation > 0.0f ? JAFDSettings::DistanceSensors::AutoCalibration::angularVel : -JAFDSettings::DistanceSensors::AutoCalibration::angularVel;
 
-				tempFusedData.distances.frontLeft = 0;
-			}
+				if (SmoothDriving::setNewTask<SmoothDriving::NewStateType::currentState>(SmoothDriving::TaskArray(SmoothDriving::Rotate(angularVel, rotation), SmoothDriving::Stop()), true) != ReturnCode::ok) return ReturnCode::error;
 
-			if (frData.numCorrectSamples > 0)
-			{
-				if (tempFusedData.distSensorState.frontRight == DistSensorStatus::ok)
-				{
-					tempFusedData.distances.frontRight = static_cast<uint16_t>((static_cast<float>(frData.tempAverageDist) / frData.numCorrectSamples) * JAFDSettings::SensorFusion::shortDistSensIIRFactor + tempFusedData.distances.frontRight * (1.0f - JAFDSettings::SensorFusion::shortDistSensIIRFactor));
-				}
-				else
-				{
-					tempFusedData.distances.frontRight = static_cast<uint16_t>(static_cast<float>(frData.tempAverageDist) / frData.numCorrectSamples);
-				}
+				Wait::waitForFinishedTask();
 
-				tempFusedData.distSensorState.frontRight = DistSensorStatus::ok;
+				return ReturnCode::ok;
 			}
-			else
+
+			// Length of the measurement to the wall a sensor looks at (mm) - false if the hit point is not on the wall or the angle of incidence is too large
+			bool expectedDistance(const SensorID id, const Vec2f& position, const float heading, float& distance)
 			{
-				if (frData.numOverflowSamples > 0)
-				{
-					tempFusedData.distSensorState.frontRight = DistSensorStatus::overflow;
-				}
-				else if (frData.numUnderflowSamples > 0)
-				{
-					tempFusedData.distSensorState.frontRight = DistSensorStatus::underflow;
-				}
-				else
-				{
-					tempFusedData.distSensorState.frontRight = DistSensorStatus::error;
-				}
+				Vec2f mountPos;
+				Vec2f mountDir;
 
-				tempFusedData.distances.frontRight = 0;
-			}
+				if (SensorFusion::getDistSensMounting(id, mountPos, mountDir) != ReturnCode::ok) return false;
 
-			if (lbData.numCorrectSamples > 0)
-			{
-				if (tempFusedData.distSensorState.leftBack == DistSensorStatus::ok)
-				{
-					tempFusedData.distances.leftBack = static_cast<uint16_t>((static_cast<float>(lbData.tempAverageDist) / lbData.numCorrectSamples) * JAFDSettings::SensorFusion::shortDistSensIIRFactor + tempFusedData.distances.leftBack * (1.0f - JAFDSettings::SensorFusion::shortDistSensIIRFactor));
-				}
-				else
-				{
-					tempFusedData.distances.leftBack = static_cast<uint16_t>(static_cast<float>(lbData.tempAverageDist) / lbData.numCorrectSamples);
-				}
+				const float headingCos = cosf(heading);
+				const float headingSin = sinf(heading);
+				const Vec2f sensorPos = position + Vec2f(mountPos.x * headingCos - mountPos.y * headingSin, mountPos.x * headingSin + mountPos.y * headingCos);
+				const Vec2f dir(mountDir.x * headingCos - mountDir.y * headingSin, mountDir.x * headingSin + mountDir.y * headingCos);
+				const float halfCell = JAFDSettings::Field::cellWidth / 2.0f;
 
-				tempFusedData.distSensorState.leftBack = DistSensorStatus::ok;
-			}
-			else
-			{
-				if (lbData.numOverflowSamples > 0)
-				{
-					tempFusedData.distSensorState.leftBack = DistSensorStatus::overflow;
-				}
-				else if (lbData.numUnderflowSamples > 0)
-				{
-					tempFusedData.distSensorState.leftBack = DistSensorStatus::underflow;
-				}
-				else
-				{
-					tempFusedData.distSensorState.leftBack = DistSensorStatus::error;
-				}
+				// Front sensors look at the wall at x = halfCell, left and right sensors at y = +-halfCell
+				const bool front = mountDir.x > 0.5f;
+				const float side = mountDir.y > 0.0f ? 1.0f : -1.0f;
+				const float normal = front ? dir.x : dir.y * side;		// Part of the direction perpendicular to the wall
+				const float gap = front ? halfCell - sensorPos.x : halfCell - sensorPos.y * side;
 
-				tempFusedData.distances.leftBack = 0;
-			}
+				if (normal < cosf(DEG_TO_RAD * JAFDSettings::DistanceSensors::AutoCalibration::maxIncidence) || gap <= 0.0f) return false;
 
-			if (lfData.numCorrectSamples > 0)
-			{
-				if (tempFusedData.distSensorState.leftFront == DistSensorStatus::ok)
-				{
-					tempFusedData.distances.leftFront = static_cast<uint16_t>((static_cast<float>(lfData.tempAverageDist) / lfData.numCorrectSamples) * JAFDSettings::SensorFusion::shortDistSensIIRFactor + tempFusedData.distances.leftFront * (1.0f - JAFDSettings::SensorFusion::shortDistSensIIRFactor));
-				}
-				else
-				{
-					tempFusedData.distances.leftFront = static_cast<uint16_t>(static_cast<float>(lfData.tempAverageDist) / lfData.numCorrectSamples);
-				}
+				const float length = gap / normal;
+				const float along = front ? sensorPos.y + dir.y * length : sensorPos.x + dir.x * length;
 
-				tempFusedData.distSensorState.leftFront = DistSensorStatus::ok;
-			}
-			else
-			{
-				if (lfData.numOverflowSamples > 0)
-				{
-					tempFusedData.distSensorState.leftFront = DistSensorStatus::overflow;
-				}
-				else if (lfData.numUnderflowSamples > 0)
-				{
-					tempFusedData.distSensorState.leftFront = DistSensorStatus::underflow;
-				}
-				else
-				{
-					tempFusedData.distSensorState.leftFront = DistSensorStatus::error;
-				}
+				if (fabsf(along) > halfCell - JAFDSettings::DistanceSensors::AutoCalibration::wallMargin) return false;
+
+				distance = length * 10.0f;
 
-				tempFusedData.distances.leftFront = 0;
+				return true;
 			}
 
-			if (rbData.numCorrectSamples > 0)
+			// Sample all sensors at the current pose and add the averages to their fits
+			void samplePose(const RobotState& startState, CalibFit (&fits)[numSensors])
 			{
-				if (tempFusedData.distSensorState.rightBack == DistSensorStatus::ok)
-				{
-					tempFusedData.distances.rightBack = static_cast<uint16_t>((static_cast<float>(rbData.tempAverageDist) / rbData.numCorrectSamples) * JAFDSettings::SensorFusion::shortDistSensIIRFactor + tempFusedData.distances.rightBack * (1.0f - JAFDSettings::SensorFusion::shortDistSensIIRFactor));
-				}
-				else
-				{
-					tempFusedData.distances.rightBack = static_cast<uint16_t>(static_cast<float>(rbData.tempAverageDist) / rbData.numCorrectSamples);
-				}
+				float sums[numSensors] = { 0.0f };
+				uint16_t counts[numSensors] = { 0 };
+				uint32_t lastTimes[numSensors];
 
-				tempFusedData.distSensorState.rightBack = DistSensorStatus::ok;
-			}
-			else
-			{
-				if (rbData.numOverflowSamples > 0)
-				{
-					tempFusedData.distSensorState.rightBack = DistSensorStatus::overflow;
-				}
-				else if (rbData.numUnderflowSamples > 0)
-				{
-					tempFusedData.distSensorState.rightBack = DistSensorStatus::underflow;
-				}
-				else
-				{
-					tempFusedData.distSensorState.rightBack = DistSensorStatus::error;
-				}
+				updateWhileWaiting(JAFDSettings::DistanceSensors::AutoCalibration::settleTime);
 
-				tempFusedData.distances.rightBack = 0;
-			}
+				for (uint8_t i = 0; i < numSensors; i++) lastTimes[i] = SensorFusion::getDistSampleTime(static_cast<SensorID>(i));
 
-			if (rfData.numCorrectSamples > 0)
-			{
-				if (tempFusedData.distSensorState.rightFront == DistSensorStatus::ok)
+				const uint32_t start = millis();
+
+				while (millis() - start < JAFDSettings::DistanceSensors::AutoCalibration::sampleTime)
 				{
-					tempFusedData.distances.rightFront = static_cast<uint16_t>((static_cast<float>(rfData.tempAverageDist) / rfData.numCorrectSamples) * JAFDSettings::SensorFusion::shortDistSensIIRFactor + tempFusedData.distances.rightFront * (1.0f - JAFDSettings::SensorFusion::shortDistSensIIRFactor));
+					SensorFusion::updateSensors();
+					SensorFusion::untimedFusion();
+
+					const FusedData fusedData = SensorFusion::getFusedData();
+
+					for (uint8_t i = 0; i < numSensors; i++)
+					{
+						const uint32_t time = SensorFusion::getDistSampleTime(static_cast<SensorID>(i));
+
+						// Only new samples
+						if (time == lastTimes[i]) continue;
+
+						lastTimes[i] = time;
+
+						if (fusedData.distSensorState.*fusedDistances[i].status == DistSensorStatus::ok)
+						{
+							sums[i] += fusedData.distances.*fusedDistances[i].distance;
+							counts[i]++;
+						}
+					}
 				}
-				else
+
+				Vec2f position;
+				float heading;
+
+				getCalibPose(startState, position, heading);
+
+				for (uint8_t i = 0; i < numSensors; i++)
 				{
-					tempFusedData.distances.rightFront = static_cast<uint16_t>(static_cast<float>(rfData.tempAverageDist) / rfData.numCorrectSamples);
-				}
+					float trueDist;
+
+					if (counts[i] < JAFDSettings::DistanceSensors::AutoCalibration::minSamples) continue;
+					if (!expectedDistance(static_cast<SensorID>(i), position, heading, trueDist)) continue;
 
-				tempFusedData.distSensorState.rightFront = DistSensorStatus::ok;
+					fits[i].add(sums[i] / counts[i], trueDist);
+				}
 			}
-			else
+
+			// Apply a fit to a sensor and store it - without fit the sensor keeps its old calibration
+			template<typename SensorType>
+			bool applyFit(SensorType& sensor, const CalibFit& fit, const SensorID id)
 			{
-				if (rfData.numOverflowSamples > 0)
-				{
-					tempFusedData.distSensorState.rightFront = DistSensorStatus::overflow;
-				}
-				else if (rfData.numUnderflowSamples > 0)
-				{
-					tempFusedData.distSensorState.rightFront = DistSensorStatus::underflow;
-				}
-				else
+				float k = 0.0f;
+				float d = 0.0f;
+				float rms = 0.0f;
+
+				const bool valid = fit.calc(k, d, rms);
+
+				Telemetry::logDistCalib(static_cast<uint8_t>(id), valid, fit.n, k, d, rms);
+
+				if (!valid)
 				{
-					tempFusedData.distSensorState.rightFront = DistSensorStatus::error;
+					sensor.restoreCalibData();
+					return false;
 				}
 
-				tempFusedData.distances.rightFront = 0;
-			}
+				sensor.setCalibData(k, static_cast<int16_t>(roundf(d)));
+				sensor.storeCalibData();
 
-			SensorFusion::setDistances(tempFusedData.distances);
-			SensorFusion::setDistSensStates(tempFusedData.distSensorState);
+				return true;
+			}
 		}
 
-		void forceNewMeasurement()
+		ReturnCode autoCalibration()
 		{
-			frontLeft.clearInterrupt();
-			frontRight.clearInterrupt();
-			leftFront.clearInterrupt();
-			leftBack.clearInterrupt();
-			rightFront.clearInterrupt();
-			rightBack.clearInterrupt();
-		}
+			CalibFit fits[numSensors];
+			ReturnCode code = ReturnCode::ok;
 
-		void averagedCalibration()
-		{
-			auto startCalibTime = millis();
-			auto avgDist = 0.0f;
-			uint16_t avgCount = 0;
+			// Raw measurements
+			frontLeft.resetCalibData();
+			frontRight.resetCalibData();
+			leftFront.resetCalibData();
+			leftBack.resetCalibData();
+			rightFront.resetCalibData();
+			rightBack.resetCalibData();
+
+			// The pose must only come from the wheels and the Bno055
+			SensorFusion::setDistSensPoseUpdates(false);
 
-			DistanceSensors::rightBack.resetCalibData();
+			const RobotState startState = SensorFusion::getRobotState();
 
-			while (millis() - startCalibTime < 1000)
+			// Positions in front of the front wall
+			for (uint8_t i = 0; i < JAFDSettings::DistanceSensors::AutoCalibration::numOffsets && code == ReturnCode::ok; i++)
 			{
-				SensorFusion::updateSensors();
-				SensorFusion::untimedFusion();
-				auto fusedData = SensorFusion::getFusedData();
+				code = driveTo(startState, JAFDSettings::DistanceSensors::AutoCalibration::firstOffset - i * JAFDSettings::DistanceSensors::AutoCalibration::offsetStep);
 
-				if (fusedData.distSensorState.rightBack == DistSensorStatus::ok)
-				{
-					avgDist += fusedData.distances.rightBack;
-					avgCount++;
-				}
+				if (code == ReturnCode::ok) samplePose(startState, fits);
 			}
 
-			Serial.println(avgDist / (float)avgCount);
-			while (!Serial.available());
-			auto trueFirst = (uint16_t)Serial.parseInt();
-			auto measFirst = (uint16_t)(avgDist / (float)avgCount);
+			if (code == ReturnCode::ok) code = driveTo(startState, 0.0f);
 
-			do
+			// Rotations in the middle of the cell - both sides see their wall at an angle
+			for (int8_t side = 1; side >= -1 && code == ReturnCode::ok; side -= 2)
 			{
-				while (!Serial.available());
-			} while (Serial.readString().indexOf('o') != -1);
+				for (uint8_t i = 1; i <= JAFDSettings::DistanceSensors::AutoCalibration::numAngles && code == ReturnCode::ok; i++)
+				{
+					code = rotateTo(startState, side * i * JAFDSettings::DistanceSensors::AutoCalibration::angleStep);
+
+					if (code == ReturnCode::ok) samplePose(startState, fits);
+				}
+			}
+
+			if (code == ReturnCode::ok) code = rotateTo(startState, 0.0f);
 
-			startCalibTime = millis();
-			avgDist = 0.0f;
-			avgCount = 0;
+			SensorFusion::setDistSensPoseUpdates(true);
 
-			while (millis() - startCalibTime < 1000)
+			if (code != ReturnCode::ok)
 			{
-				SensorFusion::updateSensors();
-				SensorFusion::untimedFusion();
-				auto fusedData = SensorFusion::getFusedData();
+				Telemetry::logEvent(Telemetry::Event::distCalibAborted, static_cast<int32_t>(code));
 
-				if (fusedData.distSensorState.rightBack == DistSensorStatus::ok)
-				{
-					avgDist += fusedData.distances.rightBack;
-					avgCount++;
-				}
+				frontLeft.restoreCalibData();
+				frontRight.restoreCalibData();
+				leftFront.restoreCalibData();
+				leftBack.restoreCalibData();
+				rightFront.restoreCalibData();
+				rightBack.restoreCalibData();
+
+				return code;
 			}
 
-			Serial.println(avgDist / (float)avgCount);
-			while (!Serial.available());
-			auto trueSecond = (uint16_t)Serial.parseInt();
-			auto measSecond = (uint16_t)(avgDist / (float)avgCount);
+			if (!applyFit(frontLeft, fits[static_cast<uint8_t>(SensorID::frontLeft)], SensorID::frontLeft)) code = ReturnCode::error;
+			if (!applyFit(frontRight, fits[static_cast<uint8_t>(SensorID::frontRight)], SensorID::frontRight)) code = ReturnCode::error;
+			if (!applyFit(leftFront, fits[static_cast<uint8_t>(SensorID::leftFront)], SensorID::leftFront)) code = ReturnCode::error;
+			if (!applyFit(leftBack, fits[static_cast<uint8_t>(SensorID::leftBack)], SensorID::leftBack)) code = ReturnCode::error;
+			if (!applyFit(rightFront, fits[static_cast<uint8_t>(SensorID::rightFront)], SensorID::rightFront)) code = ReturnCode::error;
+			if (!applyFit(rightBack, fits[static_cast<uint8_t>(SensorID::rightBack)], SensorID::rightBack)) code = ReturnCode::error;
 
-			DistanceSensors::rightBack.calcCalibData(trueFirst, measFirst, trueSecond, measSecond);
-			DistanceSensors::rightBack.storeCalibData();
+			return code;
 		}
 	}
 }
\ No newline at end of file
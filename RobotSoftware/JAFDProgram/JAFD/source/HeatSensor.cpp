@@ -12,14 +12,10 @@ This part of the Library is responsible for heat sensors
 #include "../header/AllDatatypes.h"
 #include "../header/HeatSensor.h"
 #include "../header/TCA9548A.h"
-#include <Adafruit_AMG88xx.h>
-#include <TPA81.h>
-
-#include <algorithm>
-#include <functional>
+#include "../header/AsyncI2C.h"
 
-#ifdef USE_AMG833
-#error "AMG8833 doesn't work on Wire1"
+#ifndef USE_AMG8833
+#include <TPA81.h>
 #endif
 
 namespace JAFD
@@ -28,65 +24,284 @@ namespace JAFD
 	{
 		namespace
 		{
-#ifdef USE_AMG833
-			Adafruit_AMG88xx amgLeft;
-			Adafruit_AMG88xx amgRight;
+#ifdef USE_AMG8833
+			// The Adafruit library only supports Wire - both sensors are read on Wire1 by AsyncI2C
+			constexpr AsyncI2C::Bus amgBus = AsyncI2C::Bus::wire1;
+			constexpr uint8_t amgRegPowerControl = 0x00;
+			constexpr uint8_t amgRegReset = 0x01;
+			constexpr uint8_t amgRegFrameRate = 0x02;
+			constexpr uint8_t amgRegThermistor = 0x0E;
+			constexpr uint8_t amgRegPixels = 0x80;
+
+			constexpr uint8_t width = 8;
+			constexpr uint8_t numPix = width * width;
+
+			uint8_t _thermistorData[2][2];			// 12 bit sign magnitude, 0.0625 C per LSB
+			uint8_t _pixelData[2][2 * numPix];		// 12 bit two's complement, 0.25 C per LSB
+
+			uint8_t _queuedReads = 0;				// Transactions of the running frame read - only written by the main loop
+			volatile uint8_t _finishedReads = 0;	// Only written by the callback
+			volatile bool _readFailed = false;
 #else
+			constexpr uint8_t tpaRegAmbient = 0x01;	// Ambient temperature followed by the 8 pixels (C)
+			constexpr uint8_t numPix = 8;
+
 			TPA81 tpaLeft;
 			TPA81 tpaRight;
+
+			uint8_t _readData[2][1 + numPix];		// Ambient and pixels of both sensors - ambient 0 marks a failed read
 #endif
 
-			float ambientTemp = 23.0f;
+			bool _readQueued = false;
+			uint32_t _lastSample = 0;
 
-			ReturnCode readAmbientTemp()
+			float _ambientTemp = 23.0f;
+			bool _ambientValid = false;
+			float _confidences[2] = { 0.0f, 0.0f };
+
+			inline uint8_t sideIndex(const HeatSensorSide side)
 			{
+				return side == HeatSensorSide::left ? 0 : 1;
+			}
+
+			// Confidence of a victim from the temperature difference to the ambient
+			float toConfidence(const float difference)
+			{
+				const float confidence = (difference - JAFDSettings::HeatSensors::threshold + JAFDSettings::HeatSensors::confidenceBand) / (2.0f * JAFDSettings::HeatSensors::confidenceBand);
+
+				if (confidence < 0.0f) return 0.0f;
+				else if (confidence > 1.0f) return 1.0f;
+				else return confidence;
+			}
+
+			// Rolling estimate - readings with a victim in view are skipped, because the victim would raise the estimate
+			void updateAmbient(const float ambientSample, const bool victimInView)
+			{
+				if (!_ambientValid)
+				{
+					_ambientTemp = ambientSample;
+					_ambientValid = true;
+				}
+				else if (!victimInView)
+				{
+					_ambientTemp += JAFDSettings::HeatSensors::ambientAlpha * (ambientSample - _ambientTemp);
+				}
+			}
+
 #ifdef USE_AMG8833
-				float pixels[AMG88xx_PIXEL_ARRAY_SIZE];
+			void readFinished(const ReturnCode code)
+			{
+				if (code != ReturnCode::ok) _readFailed = true;
+
+				_finishedReads++;
+			}
+
+			ReturnCode writeRegister(const uint8_t i2cAddr, const uint8_t reg, uint8_t value)
+			{
+				if (AsyncI2C::queueWrite(amgBus, i2cAddr, reg, 1, &value, 1) != ReturnCode::ok) return ReturnCode::error;
+
+				return AsyncI2C::waitForBus(amgBus);
+			}
+
+			ReturnCode setupSensor(const uint8_t i2cAddr)
+			{
+				if (writeRegister(i2cAddr, amgRegPowerControl, 0x00) != ReturnCode::ok) return ReturnCode::error;	// Normal mode
+				if (writeRegister(i2cAddr, amgRegReset, 0x3F) != ReturnCode::ok) return ReturnCode::error;			// Initial reset
+
+				delay(2);
+
+				return writeRegister(i2cAddr, amgRegFrameRate, 0x00);		// 10 FPS
+			}
+
+			ReturnCode queueRead(const uint8_t index, const uint8_t i2cAddr)
+			{
+				if (AsyncI2C::queueRead(amgBus, i2cAddr, amgRegThermistor, 1, _thermistorData[index], 2, readFinished) != ReturnCode::ok) return ReturnCode::error;
+
+				_queuedReads++;
+
+				if (AsyncI2C::queueRead(amgBus, i2cAddr, amgRegPixels, 1, _pixelData[index], 2 * numPix, readFinished) != ReturnCode::ok) return ReturnCode::error;
+
+				_queuedReads++;
+
+				return ReturnCode::ok;
+			}
+
+			float pixelTemp(const uint8_t index, const uint8_t pixel)
+			{
+				int16_t raw = static_cast<int16_t>((_pixelData[index][2 * pixel + 1] << 8) | _pixelData[index][2 * pixel]);
+
+				// Sign extension of 12 bit
+				if (raw & 0x0800) raw |= 0xF000;
+
+				return raw * 0.25f;
+			}
+
+			float thermistorTemp(const uint8_t index)
+			{
+				const uint16_t raw = static_cast<uint16_t>((_thermistorData[index][1] << 8) | _thermistorData[index][0]);
+				const float temp = (raw & 0x07FF) * 0.0625f;
+
+				return (raw & 0x0800) ? -temp : temp;
+			}
+
+			// Connected blobs of hot pixels in one 8x8 frame - the confidence of the best blob with at least minBlobSize pixels
+			// Also returns the mean of all cold pixels for the ambient estimate
+			float detectBlobs(const uint8_t index, float& coldMean)
+			{
+				const float hotTemp = _ambientTemp + JAFDSettings::HeatSensors::threshold - JAFDSettings::HeatSensors::confidenceBand;
+
+				float temps[numPix];
+				bool visited[numPix];
+				uint8_t stack[numPix];
 
-				amgLeft.readPixels(pixels);
+				float coldSum = 0.0f;
+				uint8_t numCold = 0;
 
-				for (size_t i = 0; i < AMG88xx_PIXEL_ARRAY_SIZE; i++)
+				for (uint8_t i = 0; i < numPix; i++)
 				{
-					ambientTemp += pixels[i];
+					temps[i] = pixelTemp(index, i);
+					visited[i] = temps[i] < hotTemp;
+
+					if (visited[i])
+					{
+						coldSum += temps[i];
+						numCold++;
+					}
 				}
 
-				amgRight.readPixels(pixels);
+				coldMean = numCold > 0 ? coldSum / numCold : _ambientTemp;
+
+				float bestConfidence = 0.0f;
 
-				for (size_t i = 0; i < AMG88xx_PIXEL_ARRAY_SIZE; i++)
+				for (uint8_t start = 0; start < numPix; start++)
 				{
-					ambientTemp += pixels[i];
+					if (visited[start]) continue;
+
+					// Flood fill with 4 neighbours
+					uint8_t stackSize = 0;
+					uint8_t blobSize = 0;
+					float blobSum = 0.0f;
+
+					stack[stackSize++] = start;
+					visited[start] = true;
+
+					while (stackSize > 0)
+					{
+						const uint8_t pixel = stack[--stackSize];
+						const uint8_t x = pixel % width;
+						const uint8_t y = pixel / width;
+
+						blobSum += temps[pixel];
+						blobSize++;
+
+						if (x > 0 && !visited[pixel - 1]) { visited[pixel - 1] = true; stack[stackSize++] = pixel - 1; }
+						if (x < width - 1 && !visited[pixel + 1]) { visited[pixel + 1] = true; stack[stackSize++] = pixel + 1; }
+						if (y > 0 && !visited[pixel - width]) { visited[pixel - width] = true; stack[stackSize++] = pixel - width; }
+						if (y < width - 1 && !visited[pixel + width]) { visited[pixel + width] = true; stack[stackSize++] = pixel + width; }
+					}
+
+					if (blobSize < JAFDSettings::HeatSensors::minBlobSize) continue;
+
+					const float confidence = toConfidence(blobSum / blobSize - _ambientTemp);
+
+					if (confidence > bestConfidence) bestConfidence = confidence;
 				}
 
-				ambientTemp /= (2.0f * AMG88xx_PIXEL_ARRAY_SIZE);
-				ambientTemp = (ambientTemp + amgLeft.readThermistor() + amgRight.readThermistor()) / 3.0f;
-#else
-				int pixels[8];
+				return bestConfidence;
+			}
+
+			bool evaluateReadings()
+			{
+				float coldMeans[2];
 
-				I2CMultiplexer::selectChannel(JAFDSettings::HeatSensors::Left::i2cChannel);
-				int leftAmbient = tpaLeft.getAll(pixels);
+				// Hot pixels of the first frame are found with the thermistors
+				if (!_ambientValid) _ambientTemp = (thermistorTemp(0) + thermistorTemp(1)) / 2.0f;
 
-				if (leftAmbient == 0 || leftAmbient > 40) return ReturnCode::error;
+				_confidences[0] = detectBlobs(0, coldMeans[0]);
+				_confidences[1] = detectBlobs(1, coldMeans[1]);
 
-				for (size_t i = 0; i < 8; i++)
+				const float ambientSample = (coldMeans[0] + coldMeans[1] + thermistorTemp(0) + thermistorTemp(1)) / 4.0f;
+
+				updateAmbient(ambientSample, _confidences[0] >= 0.5f || _confidences[1] >= 0.5f);
+
+				return true;
+			}
+#else
+			// Average of the hottest pixels - only the top pixels are kept in order instead of sorting the whole array
+			float averageTop(const uint8_t* pixels, float& restMean)
+			{
+				uint8_t top[JAFDSettings::HeatSensors::topPixels];
+				uint8_t numTop = 0;
+				uint16_t sum = 0;
+
+				for (uint8_t i = 0; i < numPix; i++)
 				{
-					ambientTemp += pixels[i];
-				}
+					const uint8_t pixel = pixels[i];
+
+					sum += pixel;
+
+					if (numTop < JAFDSettings::HeatSensors::topPixels) numTop++;
+					else if (pixel <= top[numTop - 1]) continue;
 
-				I2CMultiplexer::selectChannel(JAFDSettings::HeatSensors::Right::i2cChannel);
-				int rightAmbient = tpaRight.getAll(pixels);
+					uint8_t j = numTop - 1;
 
-				if (rightAmbient == 0 || rightAmbient > 40) return ReturnCode::error;
+					for (; j > 0 && top[j - 1] < pixel; j--)
+					{
+						top[j] = top[j - 1];
+					}
 
-				for (size_t i = 0; i < 8; i++)
+					top[j] = pixel;
+				}
+
+				uint16_t topSum = 0;
+
+				for (uint8_t i = 0; i < numTop; i++)
 				{
-					ambientTemp += pixels[i];
+					topSum += top[i];
 				}
 
-				ambientTemp /= (2.0f * 8.0f);
-				ambientTemp = (ambientTemp + leftAmbient + rightAmbient) / 3.0f;
-#endif
-				return ReturnCode::ok;
+				restMean = numTop < numPix ? static_cast<float>(sum - topSum) / (numPix - numTop) : static_cast<float>(sum) / numPix;
+
+				return static_cast<float>(topSum) / numTop;
 			}
+
+			inline bool isValid(const uint8_t index)
+			{
+				return _readData[index][0] != 0 && _readData[index][0] <= 40;
+			}
+
+			void queueRead()
+			{
+				// A failed batch doesn't overwrite the buffers
+				_readData[0][0] = 0;
+				_readData[1][0] = 0;
+
+				I2CMultiplexer::Batch::queueRead(JAFDSettings::HeatSensors::Left::i2cChannel, JAFDSettings::HeatSensors::i2cAddr, tpaRegAmbient, 1, _readData[0], 1 + numPix);
+				I2CMultiplexer::Batch::queueRead(JAFDSettings::HeatSensors::Right::i2cChannel, JAFDSettings::HeatSensors::i2cAddr, tpaRegAmbient, 1, _readData[1], 1 + numPix);
+			}
+
+			bool evaluateReadings()
+			{
+				if (!isValid(0) || !isValid(1)) return false;
+
+				float tops[2];
+				float restMeans[2];
+
+				tops[0] = averageTop(&_readData[0][1], restMeans[0]);
+				tops[1] = averageTop(&_readData[1][1], restMeans[1]);
+
+				const float ambientSample = (_readData[0][0] + _readData[1][0] + restMeans[0] + restMeans[1]) / 4.0f;
+
+				if (!_ambientValid) updateAmbient(ambientSample, false);
+
+				_confidences[0] = toConfidence(tops[0] - _ambientTemp);
+				_confidences[1] = toConfidence(tops[1] - _ambientTemp);
+
+				updateAmbient(ambientSample, _confidences[0] >= 0.5f || _confidences[1] >= 0.5f);
+
+				return true;
+			}
+#endif
 		}
 
 		ReturnCode reset()
@@ -96,63 +311,120 @@ namespace JAFD
 
 		ReturnCode setup()
 		{
-#ifdef USE_AMG833
-			if (!amgLeft.begin(JAFDSettings::HeatSensors::Left::i2cAddr) || !amgRight.begin(JAFDSettings::HeatSensors::Right::i2cAddr)) return ReturnCode::error;
+			ReturnCode code = ReturnCode::ok;
+
+			_readQueued = false;
+			_ambientValid = false;
+			_confidences[0] = 0.0f;
+			_confidences[1] = 0.0f;
+
+#ifdef USE_AMG8833
+			// Wait for a running frame read
+			AsyncI2C::waitForBus(amgBus);
+
+			_queuedReads = 0;
+			_finishedReads = 0;
+			_readFailed = false;
+
+			if (setupSensor(JAFDSettings::HeatSensors::Left::i2cAddr) != ReturnCode::ok || setupSensor(JAFDSettings::HeatSensors::Right::i2cAddr) != ReturnCode::ok) return ReturnCode::error;
+
+			// First frame is only available after the reset
+			delay(100);
+
+			if (queueRead(0, JAFDSettings::HeatSensors::Left::i2cAddr) != ReturnCode::ok || queueRead(1, JAFDSettings::HeatSensors::Right::i2cAddr) != ReturnCode::ok) code = ReturnCode::error;
+			if (AsyncI2C::waitForBus(amgBus) != ReturnCode::ok || _readFailed) code = ReturnCode::error;
+
+			_queuedReads = 0;
+			_finishedReads = 0;
+			_readFailed = false;
 
-			amgLeft.setMovingAverageMode(false);
-			amgRight.setMovingAverageMode(false);
+			if (code == ReturnCode::ok) evaluateReadings();
 #else
-#endif
 			I2CMultiplexer::selectChannel(JAFDSettings::HeatSensors::Left::i2cChannel);
-			tpaLeft.setup(0xD0);
+			tpaLeft.setup(JAFDSettings::HeatSensors::i2cAddr << 1);
 
+			I2CMultiplexer::selectChannel(JAFDSettings::HeatSensors::Right::i2cChannel);
+			tpaRight.setup(JAFDSettings::HeatSensors::i2cAddr << 1);
 
+			// First ambient estimate
+			queueRead();
 
-			I2CMultiplexer::selectChannel(JAFDSettings::HeatSensors::Right::i2cChannel);
-			tpaRight.setup(0xD0);
+			if (I2CMultiplexer::Batch::execute() != ReturnCode::ok || !evaluateReadings()) code = ReturnCode::error;
+#endif
+			_lastSample = millis();
 
-			return readAmbientTemp();
+			return code;
 		}
 
-		bool detectVictim(HeatSensorSide sensor)
+		void queueUpdate()
 		{
-#ifdef USE_AMG833
-			constexpr uint8_t numPix = AMG88xx_PIXEL_ARRAY_SIZE;
-			float pixels[numPix];
-#else
-			constexpr uint8_t numPix = 8;
-			int pixels[numPix];
+#ifndef USE_AMG8833
+			if (millis() - _lastSample < JAFDSettings::HeatSensors::sampleInterval) return;
+
+			_lastSample = millis();
+
+			queueRead();
+			_readQueued = true;
 #endif
+		}
+
+		bool finishUpdate(HeatSensData& data)
+		{
+			bool newReadings = false;
 
-			if (sensor == HeatSensorSide::left)
+#ifdef USE_AMG8833
+			// Frame read of the last update is finished
+			if (_readQueued && _finishedReads == _queuedReads)
 			{
-#ifdef USE_AMG833
-				amgLeft.readPixels(pixels);
-#else
-				I2CMultiplexer::selectChannel(JAFDSettings::HeatSensors::Left::i2cChannel);
-				tpaLeft.getAll(pixels);
-#endif
+				_readQueued = false;
+				_queuedReads = 0;
+				_finishedReads = 0;
+
+				if (!_readFailed) newReadings = evaluateReadings();
+
+				_readFailed = false;
 			}
-			else
+
+			// Read the next frame in the background - a failed queueing is finished by the callbacks of the queued transactions
+			if (!_readQueued && millis() - _lastSample >= JAFDSettings::HeatSensors::sampleInterval)
 			{
-#ifdef USE_AMG833
-				amgLeft.readPixels(pixels);
+				_lastSample = millis();
+				_readQueued = true;
+
+				if (queueRead(0, JAFDSettings::HeatSensors::Left::i2cAddr) != ReturnCode::ok || queueRead(1, JAFDSettings::HeatSensors::Right::i2cAddr) != ReturnCode::ok) _readFailed = true;
+			}
 #else
-				I2CMultiplexer::selectChannel(JAFDSettings::HeatSensors::Right::i2cChannel);
-				tpaRight.getAll(pixels);
+			if (_readQueued)
+			{
+				_readQueued = false;
+				newReadings = evaluateReadings();
+			}
 #endif
+
+			if (newReadings)
+			{
+				data.leftConfidence = _confidences[0];
+				data.rightConfidence = _confidences[1];
+				data.ambientTemp = _ambientTemp;
+				data.timestamp = _lastSample;
 			}
 
-#ifdef USE_AMG833
-			std::sort(pixels, pixels + numPix, std::greater<float>());
-#else
-			std::sort(pixels, pixels + numPix, std::greater<int>());
-#endif
-			float avgHigh = (pixels[0] + pixels[1]) / 2.0f;
+			return newReadings;
+		}
 
-			if (avgHigh >= JAFDSettings::HeatSensors::threshold + ambientTemp) return true;
-			else return false;
+		bool detectVictim(HeatSensorSide sensor)
+		{
+			return _confidences[sideIndex(sensor)] >= 0.5f;
 		}
-	}
-}
 
+		float getConfidence(HeatSensorSide sensor)
+		{
+			return _confidences[sideIndex(sensor)];
+		}
+
+		float getAmbientTemp()
+		{
+			return _ambientTemp;
+		}
+	}
+}
\ No newline at end of file
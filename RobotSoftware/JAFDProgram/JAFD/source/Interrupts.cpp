@@ -10,6 +10,8 @@ In this part are all interrupt handler
 #include "../header/Bno055.h"
 #include "../header/TCS34725.h"
 #include "../header/DistanceSensors.h"
+#include "../header/SpiNVSRAM.h"
+#include "../header/Scheduler.h"
 
 void handleISR(JAFD::Interrupts::InterruptSource interruptSrc, uint32_t isr)
 {
@@ -37,70 +39,45 @@ void PIOD_Handler()
 	handleISR(JAFD::Interrupts::InterruptSource::pioD, PIOD->PIO_ISR);
 }
 
+void DMAC_Handler()
+{
+	JAFD::SpiNVSRAM::dmaInterrupt();
+}
+
+void ADC_Handler()
+{
+	JAFD::MotorControl::adcInterrupt();
+}
+
 // TC0 - TC2 are reserved for Arduino Framework
+// TC3 - TC5 call the periodic jobs of the scheduler
 
-// 1kHz 
-// Not active
+// High priority (JAFDSettings::Scheduler::highFreq)
 void TC3_Handler()
 {
 	{
 		volatile auto dummy = TC1->TC_CHANNEL[0].TC_SR;
 	}
+
+	JAFD::Scheduler::tick(JAFD::Scheduler::Priority::high);
 }
 
-// 100Hz
-// Not active
+// Medium priority (JAFDSettings::Scheduler::mediumFreq)
 void TC4_Handler()
 {
-	static uint8_t i = 0;
-
 	{
 		volatile auto dummy = TC1->TC_CHANNEL[1].TC_SR;
 	}
 
-	i++;
-
-	// 100Hz:
-
-	if (i % 2 == 0)
-	{
-		// 50Hz:
-	}
+	JAFD::Scheduler::tick(JAFD::Scheduler::Priority::medium);
 }
 
-// 20Hz
-// Active
+// Low priority (JAFDSettings::Scheduler::lowFreq)
 void TC5_Handler()
 {
-	static uint8_t i = 0;
-
 	{
 		volatile auto dummy = TC1->TC_CHANNEL[2].TC_SR;
 	}
 
-	i++;
-
-	// 20Hz:
-	JAFD::MotorControl::calcMotorSpeed(20);
-	JAFD::SensorFusion::sensorFiltering(20);
-	JAFD::SmoothDriving::updateSpeeds(20);
-	JAFD::MotorControl::speedPID(20);
-
-	if (i % 2 == 0)
-	{
-		// 10Hz:
-
-		if (i % 4 == 0)
-		{
-			// 5Hz:
-
-			if (i % 20 == 0)
-			{
-				i = 0;
-
-				// 1Hz:
-
-			}
-		}
-	}
+	JAFD::Scheduler::tick(JAFD::Scheduler::Priority::low);
 }
\ No newline at end of file
@@ -19,6 +19,9 @@
 #include "../header/SpiNVSRAM.h"
 #include "../header/DistanceSensors.h"
 #include "../header/AllDatatypes.h"
+#include "../header/AsyncI2C.h"
+#include "../header/Calibration.h"
+#include "../header/Checkpoint.h"
 #include "../header/RobotLogic.h"
 #include "../header/SmoothDriving.h"
 #include "../header/TCS34725.h"
@@ -27,15 +30,39 @@
 #include "../header/SmallThings.h"
 #include "../header/CamRec.h"
 #include "../header/Math.h"
+#include "../header/Scheduler.h"
+#include "../header/Profiler.h"
+#include "../header/Telemetry.h"
 
 #include <SPI.h>
 #include <Wire.h>
 
 namespace JAFD
 {
+	namespace
+	{
+		Profiler::SectionID updateSensorsSection = Profiler::invalidSection;	// Run time of SensorFusion::updateSensors()
+		Profiler::SectionID untimedFusionSection = Profiler::invalidSection;	// Run time of SensorFusion::untimedFusion()
+		Profiler::SectionID robotLoopSection = Profiler::invalidSection;		// Run time of robotLoop()
+		Profiler::SectionID telemetrySection = Profiler::invalidSection;		// Run time of Telemetry::drain()
+
+		// Setup of a device on one of the I2C buses - false if it failed
+		bool setupI2CDevice(ReturnCode(*setup)(), const char* error)
+		{
+			if (setup() == ReturnCode::ok) return true;
+
+			Serial.println(error);
+
+			return false;
+		}
+	}
+
 	// Just for testing...
 	void robotSetup()
 	{
+		// Before anything uses the stack deeper than now
+		MemWatcher::paintStack();
+
 		// Setup the SPI-Bus
 		SPI.begin();
 		SPI.beginTransaction(SPISettings(10e+6, MSBFIRST, SPI_MODE0));
@@ -61,10 +88,11 @@ namespace JAFD
 		NVIC_EnableIRQ(PIOD_IRQn);
 		NVIC_SetPriority(PIOD_IRQn, 0);
 
-		// Setup of power LEDs
-		if (PowerLEDs::setup() != ReturnCode::ok)
+		// Stage 1: Buses - the devices on the I2C buses and the RasPI boot from here on
+		// Setup of binary telemetry over native USB
+		if (Telemetry::setup() != ReturnCode::ok)
 		{
-			Serial.println("Error power LEDs");
+			Serial.println("Error Telemetry");
 		}
 
 		// Setup I2C-Bus-Power
@@ -73,14 +101,46 @@ namespace JAFD
 			Serial.println("Error I2C bus power");
 		}
 
+		// Setup of asynchronous I2C transactions
+		if (AsyncI2C::setup() != ReturnCode::ok)
+		{
+			Serial.println("Error AsyncI2C");
+		}
+
+		// Setup communication with RasPI for camera recognition - the ready frame is awaited at the end
+		if (CamRec::setup() != ReturnCode::ok)
+		{
+			Serial.println("Error CamRec!");
+		}
+
+		// Stage 2: Everything without I2C while the I2C devices boot
+		// Setup of power LEDs
+		if (PowerLEDs::setup() != ReturnCode::ok)
+		{
+			Serial.println("Error power LEDs");
+		}
+
 		// Setup of SPI NVSRAM
 		if (SpiNVSRAM::setup() != ReturnCode::ok)
 		{
 			Serial.println("Error SPI NVSRAM");
 		}
 
-		// Setup of MazeMapper
-		if (MazeMapping::setup() != ReturnCode::ok)
+		// Read calibration data of all sensors in one stream
+		if (Calibration::setup() != ReturnCode::ok)
+		{
+			Serial.println("Error Calibration");
+		}
+
+		// Snapshot of the last checkpoint - holding the switch while booting starts a new run
+		Switch::setup();
+
+		if (Switch::getState()) Checkpoint::clear();
+
+		const bool resume = Checkpoint::setup() == ReturnCode::ok;
+
+		// Setup of MazeMapper - the stored maze is kept when resuming
+		if (MazeMapping::setup(resume) != ReturnCode::ok)
 		{
 			Serial.println("Error Maze Mapping");
 		}
@@ -91,71 +151,25 @@ namespace JAFD
 			Serial.println("Error Motor Control");
 		}
 
-		// Setup of I2C Multiplexer
-		if (I2CMultiplexer::setup() != ReturnCode::ok)
-		{
-			Serial.println("Error I2C Multiplexer");
-
-			if (I2CBus::resetBus() != ReturnCode::ok)
-			{
-				Serial.println("Error resetting I2C Bus");
-			}
-		}
-
 		// Setup of Dispenser
 		if (Dispenser::setup() != ReturnCode::ok)
 		{
 			Serial.println("Error Dispenser");
 		}
-		
-		// Setup of Distance Sensors
-		if (DistanceSensors::setup() != ReturnCode::ok)
-		{
-			Serial.println("Error Distance Sensor");
 
-			if (I2CBus::resetBus() != ReturnCode::ok)
-			{
-				Serial.println("Error resetting I2C Bus");
-			}
-		}
-		
-		// Setup of Bno055
-		if (Bno055::setup() != ReturnCode::ok)
-		{
-			Serial.println("Error BNO055");
+		// Stage 3: I2C devices - the setups poll the readiness; after a failure the bus is reset once at the end of the stage
+		bool i2cFailed = false;
 
-			if (I2CBus::resetBus() != ReturnCode::ok)
-			{
-				Serial.println("Error resetting I2C Bus");
-			}
-		}
-		
-		// Setup of color sensor
-		if (ColorSensor::setup() != ReturnCode::ok)
-		{
-			Serial.println("Error Color Sensor");
+		if (!setupI2CDevice(I2CMultiplexer::setup, "Error I2C Multiplexer")) i2cFailed = true;
+		if (!setupI2CDevice(DistanceSensors::setup, "Error Distance Sensor")) i2cFailed = true;
+		if (!setupI2CDevice(ColorSensor::setup, "Error Color Sensor")) i2cFailed = true;
+		if (!setupI2CDevice(HeatSensor::setup, "Error Heat Sensor")) i2cFailed = true;
+		if (!setupI2CDevice(Bno055::setup, "Error BNO055")) i2cFailed = true;
 
-			if (I2CBus::resetBus() != ReturnCode::ok)
-			{
-				Serial.println("Error resetting I2C Bus");
-			}
-		}
-		
-		// Setup of heat sensors
-		if (HeatSensor::setup() != ReturnCode::ok)
+		// Sets up all I2C devices again
+		if (i2cFailed && I2CBus::resetBus() != ReturnCode::ok)
 		{
-			Serial.println("Error Heat Sensor");
-
-			if (I2CBus::resetBus() != ReturnCode::ok)
-			{
-				Serial.println("Error resetting I2C Bus");
-			}
-		}
-
-		// Setup communication with RasPI for camera recognition
-		if (CamRec::setup() != ReturnCode::ok)
-		{
-			Serial.println("Error CamRec!");
+			Serial.println("Error resetting I2C Bus");
 		}
 
 		// Clear all interrupts once
@@ -166,62 +180,56 @@ namespace JAFD
 			temp = PIOD->PIO_ISR;
 		}
 
-		////Setup TC3 for an interrupt every ms -> 1kHz (MCK / 32 / 2625)
-		//PMC->PMC_PCER0 = 1 << ID_TC3;
-
-		//TC1->TC_CHANNEL[0].TC_CMR = TC_CMR_TCCLKS_TIMER_CLOCK3 | TC_CMR_WAVE | TC_CMR_WAVSEL_UP_RC;
-		//TC1->TC_CHANNEL[0].TC_RC = 2625;
-
-		//TC1->TC_CHANNEL[0].TC_IER = TC_IER_CPCS;
-		//TC1->TC_CHANNEL[0].TC_IDR = ~TC_IER_CPCS;
-
-		//NVIC_EnableIRQ(TC3_IRQn);
-		//NVIC_SetPriority(TC3_IRQn, 1);
-		//TC1->TC_CHANNEL[0].TC_CCR = TC_CCR_SWTRG | TC_CCR_CLKEN;
-
-		////Setup TC4 for an interrupt every 10ms -> 100Hz (MCK / 32 / 26250)
-		//PMC->PMC_PCER0 = 1 << ID_TC4;
-
-		//TC1->TC_CHANNEL[1].TC_CMR = TC_CMR_TCCLKS_TIMER_CLOCK3 | TC_CMR_WAVE | TC_CMR_WAVSEL_UP_RC;
-		//TC1->TC_CHANNEL[1].TC_RC = 26250;
-
-		//TC1->TC_CHANNEL[1].TC_IER = TC_IER_CPCS;
-		//TC1->TC_CHANNEL[1].TC_IDR = ~TC_IER_CPCS;
-
-		//NVIC_EnableIRQ(TC4_IRQn);
-		//NVIC_SetPriority(TC4_IRQn, 1);
-
-		//TC1->TC_CHANNEL[1].TC_CCR = TC_CCR_SWTRG | TC_CCR_CLKEN;
+		// Profiling
+		Profiler::setup();
 
-		// Setup TC4 for an interrupt every ~50ms -> 19.9997Hz (MCK / 128 / 32813)
-		PMC->PMC_PCER1 = PMC_PCER1_PID32;
+		updateSensorsSection = Profiler::addSection("updateSensors");
+		untimedFusionSection = Profiler::addSection("untimedFusion");
+		robotLoopSection = Profiler::addSection("robotLoop");
+		telemetrySection = Profiler::addSection("telemetry");
 
-		TC1->TC_CHANNEL[2].TC_CMR = TC_CMR_TCCLKS_TIMER_CLOCK4 | TC_CMR_WAVE | TC_CMR_WAVSEL_UP_RC;
-		TC1->TC_CHANNEL[2].TC_RC = 32813;
+		// Periodic jobs
+		// 100Hz: Motor speed control
+		Scheduler::addJob(MotorControl::calcMotorSpeed, 100, Scheduler::Priority::medium, "calcMotorSpeed");
+		Scheduler::addJob(MotorControl::speedPID, 100, Scheduler::Priority::medium, "speedPID");
 
-		TC1->TC_CHANNEL[2].TC_IER = TC_IER_CPCS;
-		TC1->TC_CHANNEL[2].TC_IDR = ~TC_IER_CPCS;
+		// 20Hz: Sensor fusion, driving & dispenser
+		Scheduler::addJob(SensorFusion::sensorFiltering, 20, Scheduler::Priority::low, "sensorFiltering");
+		Scheduler::addJob(SmoothDriving::updateSpeeds, 20, Scheduler::Priority::low, "updateSpeeds");
+		Scheduler::addJob(Dispenser::update, 20, Scheduler::Priority::low, "dispenser");
 
-		NVIC_EnableIRQ(TC5_IRQn);
-		NVIC_SetPriority(TC5_IRQn, 1);
-		TC1->TC_CHANNEL[2].TC_CCR = TC_CCR_SWTRG | TC_CCR_CLKEN;
+		if (Scheduler::setup() != ReturnCode::ok)
+		{
+			Serial.println("Error Scheduler!");
+		}
 
-		delay(500);
+		// Stage 4: Wait for the orientation instead of fixed delays - then set start for 9DOF
+		if (Bno055::waitForFusion() != ReturnCode::ok)
+		{
+			Serial.println("Error BNO055 fusion");
+		}
 
-		//Set start for 9DOF
 		Bno055::tare();
 
-		delay(1000);
+		// Continue exploring from the last checkpoint
+		if (resume && Checkpoint::resume() != ReturnCode::ok)
+		{
+			Serial.println("Error resuming checkpoint");
+		}
+
+		// The RasPI had the whole setup to boot
+		if (CamRec::waitForReady() != ReturnCode::ok)
+		{
+			Serial.println("Error CamRec!");
+		}
 		
 		return;
 	}
 
 	void robotLoop()
 	{
-		static float fps = 0.0f;
+		Profiler::start(robotLoopSection);
 
-		auto time = millis();
-		
 		using namespace SmoothDriving;
 
 		//static const TaskArray tasks[] = {
@@ -244,17 +252,66 @@ namespace JAFD
 		//	i++;
 		//}
 
+		Profiler::start(updateSensorsSection);
 		SensorFusion::updateSensors();
+		Profiler::stop(updateSensorsSection);
+
+		Profiler::start(untimedFusionSection);
 		SensorFusion::untimedFusion();
+		Profiler::stop(untimedFusionSection);
+
+		// Turn of the dispenser when one side is empty - RobotLogic doesn't set tasks until the drop is finished
+		if (Dispenser::needsTurn())
+		{
+			const ReturnCode code = Dispenser::startTurn();
+
+			if (code != ReturnCode::ok) Telemetry::logEvent(Telemetry::Event::dispenserTurnFailed, static_cast<int32_t>(code));
+		}
+
+		// Motion profiles of upcoming path segments - keeps the planning out of the 20Hz interrupt
+		SmoothDriving::planAhead();
 		//RobotLogic::loop();
 		
 		auto fusedData = SensorFusion::getFusedData();
 		fusedData.robotState.globalHeading;
 
-		auto freeRam = MemWatcher::getFreeRam();
+		Profiler::stop(robotLoopSection);
+
+		// Memory record (searches the painted stack)
+		MemWatcher::update();
 
-		if (fps < 0.01f) fps = 1000.0f / (millis() - time);
-		else fps = fps * 0.4f + 600.0f / (millis() - time);
+		// Send telemetry records
+		Profiler::start(telemetrySection);
+		Telemetry::drain();
+		Profiler::stop(telemetrySection);
+
+		// Commands over Serial - every byte is consumed, so unknown bytes (e.g. newlines) don't block the others
+		if (Serial.available())
+		{
+			switch (Serial.read())
+			{
+			// Print run times
+			case 'p':
+				Profiler::dump();
+				break;
+			// Print memory usage
+			case 'm':
+				MemWatcher::dump();
+				break;
+			// Calibrate the short distance sensors - the robot has to stand in the middle of a dead end, facing the front wall
+			// Every fit is sent as distCalib record and stored in the NVSRAM
+			case 'k':
+				DistanceSensors::autoCalibration();
+				break;
+			// Identify the feedforward of both motors - the robot needs about 20 cm of free space in front
+			// The tables are stored in the calibration block (replaces a missing or outdated calibration)
+			case 'c':
+				MotorControl::characterize();
+				break;
+			default:
+				break;
+			}
+		}
 
 		return;
 	}
@@ -0,0 +1,155 @@
+/*
+This private file of the library is responsible for checking the fast math functions against libm
+*/
+
+#include "../../JAFDSettings.h"
+#include "../header/Math.h"
+#include "../header/Profiler.h"
+
+namespace JAFD
+{
+	namespace
+	{
+		constexpr uint16_t numSamples = 1000;	// Samples per function
+		volatile float _sink = 0.0f;			// Results are added here, so the compiler doesn't remove the calls
+
+		// Run time of one call - the cycle counter counts MCK cycles (on the host the time of a steady clock in MCK cycles)
+		constexpr float nsPerCall = 1000000000.0f / VARIANT_MCK / numSamples;
+
+		// Print one line - false if the bound is exceeded
+		bool printResult(const char* name, const float maxError, const float bound, const uint32_t fastCycles, const uint32_t libmCycles)
+		{
+			Serial.print(name);
+			Serial.print(": max error ");
+			Serial.print(maxError, 8);
+			Serial.print(" (bound ");
+			Serial.print(bound, 8);
+			Serial.print("), ns per call ");
+			Serial.print(fastCycles * nsPerCall, 1);
+			Serial.print(" (libm ");
+			Serial.print(libmCycles * nsPerCall, 1);
+			Serial.println(")");
+
+			return maxError <= bound;
+		}
+	}
+
+	ReturnCode benchmarkFastMath()
+	{
+		bool ok = true;
+		float maxError;
+		uint32_t start;
+		uint32_t fastCycles;
+		uint32_t libmCycles;
+
+		// sin and cos over several turns and up to the end of the range (1000 rad)
+		maxError = 0.0f;
+
+		for (uint16_t i = 0; i < numSamples; i++)
+		{
+			const float angles[] = { -8.0f * static_cast<float>(M_PI) + 16.0f * static_cast<float>(M_PI) * i / numSamples, -1000.0f + 2000.0f * (i + 0.5f) / numSamples };
+
+			for (const float angle : angles)
+			{
+				float sinResult, cosResult;
+
+				fastSinCos(angle, sinResult, cosResult);
+
+				maxError = fmaxf(maxError, fmaxf(fabsf(sinResult - sinf(angle)), fabsf(cosResult - cosf(angle))));
+			}
+		}
+
+		start = Profiler::getCycles();
+
+		for (uint16_t i = 0; i < numSamples; i++)
+		{
+			float sinResult, cosResult;
+
+			fastSinCos(i * 0.01f, sinResult, cosResult);
+			_sink += sinResult + cosResult;
+		}
+
+		fastCycles = Profiler::getCycles() - start;
+		start = Profiler::getCycles();
+
+		for (uint16_t i = 0; i < numSamples; i++) _sink += sinf(i * 0.01f) + cosf(i * 0.01f);
+
+		libmCycles = Profiler::getCycles() - start;
+
+		ok &= printResult("fastSinCos", maxError, fastSinCosMaxError, fastCycles, libmCycles);
+
+		// atan2 around the circle with different radii
+		maxError = 0.0f;
+
+		for (uint16_t i = 0; i < numSamples; i++)
+		{
+			const float angle = -static_cast<float>(M_PI) + static_cast<float>(M_TWOPI) * i / numSamples;
+			const float radius = 1.0f + i % 7;
+			const float y = sinf(angle) * radius;
+			const float x = cosf(angle) * radius;
+
+			maxError = fmaxf(maxError, fabsf(fastAtan2(y, x) - atan2f(y, x)));
+		}
+
+		start = Profiler::getCycles();
+
+		for (uint16_t i = 0; i < numSamples; i++) _sink += fastAtan2(i * 0.01f - 5.0f, 3.0f - i * 0.005f);
+
+		fastCycles = Profiler::getCycles() - start;
+		start = Profiler::getCycles();
+
+		for (uint16_t i = 0; i < numSamples; i++) _sink += atan2f(i * 0.01f - 5.0f, 3.0f - i * 0.005f);
+
+		libmCycles = Profiler::getCycles() - start;
+
+		ok &= printResult("fastAtan2", maxError, fastAtan2MaxError, fastCycles, libmCycles);
+
+		// Inverse sqrt (relative error) over several decades
+		maxError = 0.0f;
+
+		for (uint16_t i = 1; i <= numSamples; i++)
+		{
+			const float x = i * i * 0.001f;
+
+			maxError = fmaxf(maxError, fabsf(fastInvSqrt(x) * sqrtf(x) - 1.0f));
+		}
+
+		start = Profiler::getCycles();
+
+		for (uint16_t i = 1; i <= numSamples; i++) _sink += fastInvSqrt(i * 0.1f);
+
+		fastCycles = Profiler::getCycles() - start;
+		start = Profiler::getCycles();
+
+		for (uint16_t i = 1; i <= numSamples; i++) _sink += 1.0f / sqrtf(i * 0.1f);
+
+		libmCycles = Profiler::getCycles() - start;
+
+		ok &= printResult("fastInvSqrt", maxError, fastInvSqrtMaxRelError, fastCycles, libmCycles);
+
+		// Angle wrap - the loops took longer for every turn
+		maxError = 0.0f;
+
+		for (uint16_t i = 0; i < numSamples; i++)
+		{
+			const float angle = -20.0f * static_cast<float>(M_PI) + 40.0f * static_cast<float>(M_PI) * (i + 0.5f) / numSamples;	// Not on odd multiples of pi - there both ends are right
+
+			maxError = fmaxf(maxError, fabsf(fitAngleToInterval(angle) - remainderf(angle, M_TWOPI)));
+		}
+
+		start = Profiler::getCycles();
+
+		for (uint16_t i = 0; i < numSamples; i++) _sink += fitAngleToInterval(i * 0.1f - 50.0f);
+
+		fastCycles = Profiler::getCycles() - start;
+		start = Profiler::getCycles();
+
+		for (uint16_t i = 0; i < numSamples; i++) _sink += remainderf(i * 0.1f - 50.0f, M_TWOPI);
+
+		libmCycles = Profiler::getCycles() - start;
+
+		ok &= printResult("fitAngleToInterval", maxError, fitAngleMaxError, fastCycles, libmCycles);
+
+		return ok ? ReturnCode::ok : ReturnCode::error;
+	}
+}
\ No newline at end of file
@@ -5,20 +5,263 @@ This part of the Library is responsible for mapping the maze and finding the sho
 #include "../header/MazeMapping.h"
 #include "../header/SpiNVSRAM.h"
 #include "../header/StaticQueue.h"
-#include "../header/DistanceSensors.h"
-#include "../header/SensorFusion.h"
-#include "../header/SmoothDriving.h"
+#include "../header/SmallThings.h"
 #include "../../JAFDSettings.h"
 
 #include <algorithm>
+#include <string.h>
 
 namespace JAFD
 {
 	namespace MazeMapping
 	{
+		namespace
+		{
+			constexpr uint8_t _cellsPerRow = maxX - minX + 1;								// Cells in one row (same y)
+			constexpr uint8_t _numRows = maxY - minY + 1;									// Rows in one floor
+			constexpr uint16_t _numCells = _cellsPerRow * _numRows;							// Cells in one floor
+
+			// Transition between two floors (stored for both directions)
+			// Only plain bytes, so the packed layout is exactly the one in the NVSRAM
+			struct __attribute__((packed)) RampTransition
+			{
+				int8_t fromX;			// Last cell before the ramp
+				int8_t fromY;
+				uint8_t fromFloor;
+				uint8_t dir;			// AbsoluteDir of the ramp
+				uint8_t toFloor;
+			};
+
+			// Ramp table in the NVSRAM
+			struct __attribute__((packed)) RampTable
+			{
+				uint8_t numFloors;		// 0 after a reset - same as 1
+				uint8_t numTransitions;
+				RampTransition transitions[maxRampTransitions];
+			};
+
+			static_assert(rampTableAddr + sizeof(RampTable) <= usableSize, "Floors and ramp table don't fit into the maze mapping area");
+			static_assert(JAFDSettings::SpiNVSRAM::mazeMappingStartAddr + usableSize <= JAFDSettings::SpiNVSRAM::calibrationStartAddr, "Maze mapping area overlaps the calibration block");
+
+			// One cell in the RAM cache (3 bytes like in the NVSRAM)
+			struct CachedCell
+			{
+				uint8_t cellConnections;
+				uint8_t cellState;
+				uint8_t bfsValue;		// Only valid if the bit of the cell in _bfsValid is set
+			};
+
+			static_assert(sizeof(CachedCell) == bytesPerCell, "A cached cell has to be as small as a cell in the NVSRAM");
+
+			CachedCell _cache[_numCells];				// RAM copy of the current floor
+			uint32_t _bfsValid[_numCells / 32];			// One bit for every cell with a BFS value of the current search
+			uint32_t _dirtyRows[_numRows / 32];			// One bit for every row that has to be written back
+
+			uint8_t _floor = 0;							// Floor in the cache
+			RampTable _rampTable;						// RAM copy of the ramp table
+
+			// Index of a cell in the cache (same order as in the NVSRAM)
+			inline uint16_t getCellIndex(const MapCoordinate coor)
+			{
+				return ((coor.x + 0x20) & 0x3f) | (((coor.y + 0x20) & 0x3f) << 6);	// Bit 0 - 5 = x-Axis / 6 - 11 = y-Axis / 0 = 0x20
+			}
+
+			// BFS value of a cell in the current search
+			inline uint8_t getBFSValue(const uint16_t index)
+			{
+				return (_bfsValid[index / 32] & (1 << (index % 32))) ? _cache[index].bfsValue : 0;
+			}
+
+			// Set the BFS value of a cell for the current search
+			inline void setBFSValue(const uint16_t index, const uint8_t bfsValue)
+			{
+				_cache[index].bfsValue = bfsValue;
+				_bfsValid[index / 32] |= 1 << (index % 32);
+			}
+
+			// Coordinate of a cell index
+			inline MapCoordinate getCellCoor(const uint16_t index)
+			{
+				return MapCoordinate { (int8_t)((index & 0x3f) - 0x20), (int8_t)((index >> 6) - 0x20) };
+			}
+
+			// Mark the row of a cell as dirty
+			inline void markDirty(const uint16_t index)
+			{
+				const uint8_t row = index / _cellsPerRow;
+
+				_dirtyRows[row / 32] |= 1 << (row % 32);
+			}
+
+			// Address of a row in the NVSRAM
+			inline uint32_t getRowAddr(const uint8_t floor, const uint8_t row)
+			{
+				return JAFDSettings::SpiNVSRAM::mazeMappingStartAddr + floor * floorSize + row * rowSize;
+			}
+
+			// Write one row of the cache to the NVSRAM (one burst)
+			void writeRow(const uint8_t row)
+			{
+				uint8_t buffer[rowSize];
+
+				uint16_t index = row * _cellsPerRow;
+
+				for (uint16_t i = 0; i < rowSize; i += bytesPerCell, index++)
+				{
+					buffer[i] = _cache[index].cellConnections;
+					buffer[i + 1] = _cache[index].cellState;
+					buffer[i + 2] = getBFSValue(index);
+				}
+
+				SpiNVSRAM::writeStream(getRowAddr(_floor, row), buffer, rowSize);
+			}
+
+			void storeRampTable()
+			{
+				SpiNVSRAM::writeStream(JAFDSettings::SpiNVSRAM::mazeMappingStartAddr + rampTableAddr, reinterpret_cast<uint8_t*>(&_rampTable), sizeof(RampTable));
+			}
+
+			void loadRampTable()
+			{
+				SpiNVSRAM::readStream(JAFDSettings::SpiNVSRAM::mazeMappingStartAddr + rampTableAddr, reinterpret_cast<uint8_t*>(&_rampTable), sizeof(RampTable));
+
+				if (_rampTable.numFloors == 0 || _rampTable.numFloors > maxFloors || _rampTable.numTransitions > maxRampTransitions)
+				{
+					memset(&_rampTable, 0, sizeof(RampTable));
+				}
+
+				if (_rampTable.numFloors == 0) _rampTable.numFloors = 1;
+			}
+
+			// Scratch state of one search (kept in RAM, so that the map isn't touched)
+			class SearchState
+			{
+			private:
+				uint32_t _visited[_numCells / 32];		// Bitset of discovered cells
+				uint8_t _parents[_numCells / 4];		// 2 bit per cell: direction back to the cell it was discovered from
+
+			public:
+				SearchState()
+				{
+					memset(_visited, 0, sizeof(_visited));
+				}
+
+				bool isDiscovered(const MapCoordinate coor) const
+				{
+					const uint16_t index = getCellIndex(coor);
+
+					return _visited[index / 32] & (1 << (index % 32));
+				}
+
+				// Mark cell as discovered and store the direction back (SolverState::north/east/south/west)
+				void discover(const MapCoordinate coor, const uint8_t dirBack)
+				{
+					const uint16_t index = getCellIndex(coor);
+					const uint8_t shift = (index % 4) * 2;
+
+					_visited[index / 32] |= 1 << (index % 32);
+					_parents[index / 4] = (_parents[index / 4] & ~(0b11 << shift)) | (((dirBack >> 1) & 0b11) << shift);
+				}
+
+				// Direction back to the previous cell (SolverState::north/east/south/west)
+				uint8_t getDirBack(const MapCoordinate coor) const
+				{
+					const uint16_t index = getCellIndex(coor);
+
+					return ((_parents[index / 4] >> ((index % 4) * 2)) & 0b11) << 1;
+				}
+			};
+
+			// Direction back to the previous cell (SolverState) for a direction of travel
+			inline uint8_t toDirBack(const AbsoluteDir dir)
+			{
+				return (((uint8_t)dir + 2) & 0b11) << 1;
+			}
+
+			// Direction of travel for a direction back to the previous cell (SolverState)
+			inline AbsoluteDir fromDirBack(const uint8_t dirBack)
+			{
+				return (AbsoluteDir)((((dirBack >> 1) & 0b11) + 2) & 0b11);
+			}
+
+			// One step back to the previous cell - returns the direction of travel of this step (EntranceDirections::nowhere if the state is broken)
+			uint8_t stepBack(const SearchState& state, MapCoordinate& coor)
+			{
+				switch (state.getDirBack(coor))
+				{
+				case SolverState::north:
+					coor = MapCoordinate { coor.x, static_cast<int8_t>(coor.y + 1) };
+					return EntranceDirections::south; // Opposite direction
+
+				case SolverState::east:
+					coor = MapCoordinate { static_cast<int8_t>(coor.x + 1), coor.y };
+					return EntranceDirections::west; // Opposite direction
+
+				case SolverState::south:
+					coor = MapCoordinate { coor.x, static_cast<int8_t>(coor.y - 1) };
+					return EntranceDirections::north; // Opposite direction
+
+				case SolverState::west:
+					coor = MapCoordinate { static_cast<int8_t>(coor.x - 1), coor.y };
+					return EntranceDirections::east; // Opposite direction
+
+				default:
+					return EntranceDirections::nowhere;
+				}
+			}
+
+			// Write the path to a cell that was found by a search - only the first maxPathLength steps of longer paths (the caller plans again on the way)
+			ReturnCode reconstructPath(const SearchState& state, const MapCoordinate start, const MapCoordinate goal, uint8_t* directions, const uint8_t maxPathLength)
+			{
+				uint16_t distance = 0;
+				MapCoordinate coor = goal;
+
+				// Go the whole way backwards to get the length...
+				while (coor != start)
+				{
+					if (stepBack(state, coor) == EntranceDirections::nowhere || ++distance >= _numCells)
+					{
+						return ReturnCode::error;
+					}
+				}
+
+				// Fill the rest with "nowhere" so the caller knows the path length
+				if (distance < maxPathLength)
+				{
+					directions[distance] = EntranceDirections::nowhere;
+				}
+
+				// ...and once more to write the directions from the end
+				coor = goal;
+
+				for (uint16_t i = distance; i > 0; i--)
+				{
+					const uint8_t dir = stepBack(state, coor);
+
+					if (i <= maxPathLength)
+					{
+						directions[i - 1] = dir;
+					}
+				}
+
+				return ReturnCode::ok;
+			}
+		}
+
 		// Setup the MazeMapper
-		ReturnCode setup()
+		ReturnCode setup(const bool keepMap)
 		{
+			MemWatcher::addBuffer("mazeCache", sizeof(_cache) + sizeof(_bfsValid));
+
+			_floor = 0;
+
+			// Maze of the last run (the checkpoint changes the floor if necessary)
+			if (keepMap)
+			{
+				loadRampTable();
+				loadCache();
+			}
+
 			const uint8_t randVal1 = random(UINT8_MAX + 1);
 			const uint8_t randVal2 = random(UINT8_MAX + 1);
 			const uint8_t randBFVal = random(UINT8_MAX + 1);
@@ -27,14 +270,30 @@ namespace JAFD
 
 			const GridCell randomCell(randVal1, randVal2);
 
+			GridCell oldCell;
+			uint8_t oldBFVal;
+
+			getGridCell(&oldCell, &oldBFVal, randCoor);
 			setGridCell(randomCell, randBFVal, randCoor);
+
+			// Write the cell to the NVSRAM and read it back, so that the SPI connection is tested
+			flushCache();
+			loadCache();
 			
 			GridCell readCell;
 			uint8_t readBFVal;
 
 			getGridCell(&readCell, &readBFVal, randCoor);
 
-			resetAllCells();
+			if (keepMap)
+			{
+				setGridCell(oldCell, oldBFVal, randCoor);
+				flushCache();
+			}
+			else
+			{
+				resetAllCells();
+			}
 
 			if (readCell.cellConnections != randomCell.cellConnections || readCell.cellState != randomCell.cellState || randBFVal != readBFVal)
 			{
@@ -48,120 +307,202 @@ namespace JAFD
 		
 		void resetAllCells()
 		{
-			for (int8_t x = minX; x <= maxX; x++)
+			VictimEvidence::reset();
+
+			memset(_cache, 0, sizeof(_cache));
+			memset(_bfsValid, 0, sizeof(_bfsValid));
+			memset(_dirtyRows, 0, sizeof(_dirtyRows));
+			memset(&_rampTable, 0, sizeof(RampTable));
+
+			_floor = 0;
+			_rampTable.numFloors = 1;
+
+			Exploration::rebuild();
+
+			// Clear all floors and the ramp table in the background (following accesses wait for it)
+			SpiNVSRAM::waitForTransfer();
+			SpiNVSRAM::fillAsync(JAFDSettings::SpiNVSRAM::mazeMappingStartAddr, 0, usableSize);
+		}
+
+		// Write all changed rows of the cache to the NVSRAM
+		void flushCache()
+		{
+			for (uint8_t row = 0; row < _numRows; row++)
+			{
+				if (_dirtyRows[row / 32] & (1 << (row % 32)))
+				{
+					writeRow(row);
+				}
+			}
+
+			memset(_dirtyRows, 0, sizeof(_dirtyRows));
+		}
+
+		// Load the whole floor from the NVSRAM into the cache (discards unsaved changes)
+		void loadCache()
+		{
+			uint8_t buffer[rowSize];
+
+			for (uint8_t row = 0; row < _numRows; row++)
 			{
-				for (int8_t y = minY; y <= maxY; y++)
+				SpiNVSRAM::readStream(getRowAddr(_floor, row), buffer, rowSize);
+
+				CachedCell* cell = &_cache[row * _cellsPerRow];
+
+				for (uint16_t i = 0; i < rowSize; i += bytesPerCell, cell++)
 				{
-					setGridCell(GridCell(), 0, MapCoordinate { x, y });
+					cell->cellConnections = buffer[i];
+					cell->cellState = buffer[i + 1];
+					cell->bfsValue = buffer[i + 2];
 				}
 			}
+
+			// The stored BFS values are valid until the next search
+			memset(_bfsValid, 0xff, sizeof(_bfsValid));
+			memset(_dirtyRows, 0, sizeof(_dirtyRows));
+
+			Exploration::rebuild();
+		}
+
+		uint8_t getFloor()
+		{
+			return _floor;
+		}
+
+		uint8_t getNumFloors()
+		{
+			return _rampTable.numFloors;
+		}
+
+		ReturnCode setFloor(const uint8_t floor)
+		{
+			if (floor >= _rampTable.numFloors) return ReturnCode::error;
+
+			if (floor == _floor) return ReturnCode::ok;
+
+			flushCache();
+
+			_floor = floor;
+
+			loadCache();
+
+			return ReturnCode::ok;
+		}
+
+		namespace
+		{
+			// Mark the ramp at both ends (for the costs of the PathPlanner) and change the floor
+			ReturnCode changeFloorOverRamp(const MapCoordinate from, const AbsoluteDir dir, const MapCoordinate to, const uint8_t floor)
+			{
+				GridCell cell;
+
+				getGridCell(&cell, from);
+				cell.cellConnections |= RampDirections::north << static_cast<uint8_t>(dir);
+				setGridCell(cell, from);
+
+				if (setFloor(floor) != ReturnCode::ok) return ReturnCode::error;
+
+				getGridCell(&cell, to);
+				cell.cellConnections |= RampDirections::north << ((static_cast<uint8_t>(dir) + 2) & 0b11);
+				setGridCell(cell, to);
+
+				return ReturnCode::ok;
+			}
+		}
+
+		ReturnCode traverseRamp(const MapCoordinate from, const AbsoluteDir dir, const MapCoordinate to)
+		{
+			// Known ramp?
+			for (uint8_t i = 0; i < _rampTable.numTransitions; i++)
+			{
+				const RampTransition& transition = _rampTable.transitions[i];
+
+				if (transition.fromFloor == _floor && transition.fromX == from.x && transition.fromY == from.y && transition.dir == static_cast<uint8_t>(dir)) return changeFloorOverRamp(from, dir, to, transition.toFloor);
+			}
+
+			if (_rampTable.numFloors >= maxFloors || _rampTable.numTransitions + 2 > maxRampTransitions) return ReturnCode::error;
+
+			// New floor - the way back starts at the end of the ramp
+			const uint8_t newFloor = _rampTable.numFloors++;
+			const uint8_t backDir = (static_cast<uint8_t>(dir) + 2) & 0b11;
+
+			_rampTable.transitions[_rampTable.numTransitions++] = RampTransition{ from.x, from.y, _floor, static_cast<uint8_t>(dir), newFloor };
+			_rampTable.transitions[_rampTable.numTransitions++] = RampTransition{ to.x, to.y, newFloor, backDir, _floor };
+
+			storeRampTable();
+
+			return changeFloorOverRamp(from, dir, to, newFloor);
 		}
 
 		// Set a grid cell in the RAM
 		void setGridCell(const GridCell gridCell, const MapCoordinate coor)
 		{
-			// Memory address
-			uint32_t address = JAFDSettings::SpiNVSRAM::mazeMappingStartAddr;
-			
-			// Calculate address (MSB is unused)
-			address += ((coor.x + 0x20) & 0x3f) << 3;	// Bit 4 - 9 = x-Axis / 0 = 0x20
-			address += ((coor.y + 0x20) & 0x3f) << 9;	// Bit 10 - 15 = y-Axis / 0 = 0x20
+			const uint16_t index = getCellIndex(coor);
+
+			const bool changed = _cache[index].cellConnections != gridCell.cellConnections || _cache[index].cellState != gridCell.cellState;
+
+			_cache[index].cellConnections = gridCell.cellConnections;
+			_cache[index].cellState = gridCell.cellState;
 
-			// Data as a byte array
-			uint8_t bytes[2] = { gridCell.cellConnections, gridCell.cellState };
+			markDirty(index);
 
-			// Write data
-			SpiNVSRAM::writeStream(address, bytes, 2);
+			if (changed)
+			{
+				Exploration::cellChanged(coor);
+				IncrementalPlanner::cellChanged(coor);
+			}
 		}
 
 		// Read a grid cell from the RAM
 		void getGridCell(GridCell* gridCell, const MapCoordinate coor)
 		{
-			// Memory address
-			uint32_t address = JAFDSettings::SpiNVSRAM::mazeMappingStartAddr;
-
-			// Calculate address
-			address += ((coor.x + 0x20) & 0x3f) << 3;	// Bit 4 - 9 = x-Axis / 0 = 0x20
-			address += ((coor.y + 0x20) & 0x3f) << 9;	// Bit 10 - 15 = y-Axis / 0 = 0x20
-
-			// Data as a byte array
-			uint8_t bytes[2];
+			const CachedCell& cell = _cache[getCellIndex(coor)];
 
-			// Read data
-			SpiNVSRAM::readStream(address, bytes, 2);
-
-			// Return data
-			gridCell->cellConnections = bytes[0];
-			gridCell->cellState = bytes[1];
+			gridCell->cellConnections = cell.cellConnections;
+			gridCell->cellState = cell.cellState;
 		}
 
 		// Set a grid cell in the RAM (only informations for the BF Algorithm)
+		// BFS values are only temporary, so they don't mark the page as dirty
 		void setGridCell(const uint8_t bfsValue, const MapCoordinate coor)
 		{
-			// Memory address
-			uint32_t address = JAFDSettings::SpiNVSRAM::mazeMappingStartAddr;
-			
-			// Calculate address
-			address += ((coor.x + 0x20) & 0x3f) << 3;	// Bit 4 - 9 = x-Axis / 0 = 0x20
-			address += ((coor.y + 0x20) & 0x3f) << 9;	// Bit 10 - 15 = y-Axis / 0 = 0x20
-			address += 2;								// Go to the solver value
-
-			// Write data
-			SpiNVSRAM::writeByte(address, bfsValue);
+			setBFSValue(getCellIndex(coor), bfsValue);
 		}
 
 		// Read a grid cell from the RAM (only informations for the BF Algorithm)
 		void getGridCell(uint8_t* bfsValue, const MapCoordinate coor)
 		{
-			// Memory address
-			uint32_t address = JAFDSettings::SpiNVSRAM::mazeMappingStartAddr;
-
-			// Calculate address
-			address += ((coor.x + 0x20) & 0x3f) << 3;	// Bit 4 - 9 = x-Axis / 0 = 0x20
-			address += ((coor.y + 0x20) & 0x3f) << 9;	// Bit 10 - 15 = y-Axis / 0 = 0x20
-			address += 2;								// Go to the solver value
-
-			// Read data
-			*bfsValue = SpiNVSRAM::readByte(address);
+			*bfsValue = getBFSValue(getCellIndex(coor));
 		}
 
 		// Set a grid cell in the RAM (including informations for the BF Algorithm)
 		void setGridCell(const GridCell gridCell, const uint8_t bfsValue, const MapCoordinate coor)
 		{
-			// Memory address
-			uint32_t address = JAFDSettings::SpiNVSRAM::mazeMappingStartAddr;
+			const uint16_t index = getCellIndex(coor);
+
+			const bool changed = _cache[index].cellConnections != gridCell.cellConnections || _cache[index].cellState != gridCell.cellState;
 
-			// Calculate address
-			address += ((coor.x + 0x20) & 0x3f) << 3;	// Bit 4 - 9 = x-Axis / 0 = 0x20
-			address += ((coor.y + 0x20) & 0x3f) << 9;	// Bit 10 - 15 = y-Axis / 0 = 0x20
+			_cache[index].cellConnections = gridCell.cellConnections;
+			_cache[index].cellState = gridCell.cellState;
+			setBFSValue(index, bfsValue);
 
-			// Data as a byte array
-			uint8_t bytes[3] = { gridCell.cellConnections, gridCell.cellState, bfsValue };
+			markDirty(index);
 
-			// Write data
-			SpiNVSRAM::writeStream(address, bytes, 3);
+			if (changed)
+			{
+				Exploration::cellChanged(coor);
+				IncrementalPlanner::cellChanged(coor);
+			}
 		}
 
 		// Read a grid cell from the RAM (includeing informations for the BF Algorithm)
 		void getGridCell(GridCell* gridCell, uint8_t* bfsValue, const MapCoordinate coor)
 		{
-			// Memory address
-			uint32_t address = JAFDSettings::SpiNVSRAM::mazeMappingStartAddr;
+			const uint16_t index = getCellIndex(coor);
 
-			// Calculate address
-			address += ((coor.x + 0x20) & 0x3f) << 3;	// Bit 4 - 9 = x-Axis / 0 = 0x20
-			address += ((coor.y + 0x20) & 0x3f) << 9;	// Bit 10 - 15 = y-Axis / 0 = 0x20
-
-			// Data as a byte array
-			uint8_t bytes[3];
-
-			// Read data
-			SpiNVSRAM::readStream(address, bytes, 3);
-
-			// Return data
-			gridCell->cellConnections = bytes[0];
-			gridCell->cellState = bytes[1];
-			*bfsValue = bytes[2];
+			gridCell->cellConnections = _cache[index].cellConnections;
+			gridCell->cellState = _cache[index].cellState;
+			*bfsValue = getBFSValue(index);
 		}
 
 		// Set current cell and recalculate certainty
@@ -169,42 +510,40 @@ namespace JAFD
 		{
 			currentCertainty = 0.25f * updateCertainty + 0.5f * updateCertainty * updateCertainty + 0.15f * currentCertainty + 0.55f * currentCertainty * updateCertainty - 0.7f * currentCertainty * updateCertainty * updateCertainty + 0.3f * currentCertainty * currentCertainty + 0.1f * currentCertainty * currentCertainty * updateCertainty - 0.2f * currentCertainty * currentCertainty * updateCertainty * updateCertainty + 0.05;
 			setGridCell(gridCell, coor);
+
+			// Save the map persistently when reaching a checkpoint
+			if (gridCell.cellState & CellState::checkpoint)
+			{
+				flushCache();
+			}
 		}
 
 		namespace BFAlgorithm
 		{
 			// Reset all BFS Values in this floor
+			// Only the valid bits are cleared (one bit per cell) - the old values stay in the cache
 			void resetBFSValues()
 			{
-				for (int8_t x = minX; x <= maxX; x++)
-				{
-					for (int8_t y = minY; y <= maxY; y++)
-					{
-						setGridCell(0, MapCoordinate { x, y});
-					}
-				}
+				memset(_bfsValid, 0, sizeof(_bfsValid));
 			}
 
 			// Find the shortest known path from a to b
 			ReturnCode findShortestPath(const MapCoordinate start, uint8_t* directions, const uint8_t maxPathLength, bool(*goalCondition)(MapCoordinate coor, GridCell cell), bool(*isPassable)(GridCell cell))
 			{
-				StaticQueue<MapCoordinate, 64> queue; // MaxSize = 64, because this is enough for a normal labyrinth (4*63 would be maximum)
+				StaticQueue<MapCoordinate, 256> queue; // MaxSize = 256, so that even the front of the search on a completely open floor fits (about 4 * 64 cells)
+
+				SearchState state;
 
 				GridCell gridCellV;
-				uint8_t bfsValueV;
 				MapCoordinate coorV;
 
 				GridCell gridCellW;
-				uint8_t bfsValueW;
 				MapCoordinate coorW;
 
-				uint8_t distance = 0;
-
-				setGridCell(SolverState::discovered, start);
+				state.discover(start, SolverState::north);
 
 				if (queue.enqueue(start) != ReturnCode::ok)
 				{
-					resetBFSValues();
 					return ReturnCode::error;
 				}
 
@@ -212,7 +551,6 @@ namespace JAFD
 				{
 					if (queue.dequeue(&coorV) != ReturnCode::ok)
 					{
-						resetBFSValues();
 						return ReturnCode::error;
 					}
 
@@ -220,141 +558,1097 @@ namespace JAFD
 
 					if (goalCondition(coorV, gridCellV))
 					{
-						// Go the whole way backwards...
-						while (coorV != start)
-						{
-							getGridCell(&bfsValueV, coorV);
-
-							switch (bfsValueV & ~SolverState::discovered)
-							{
-							case SolverState::north:
-								directions[distance] = EntranceDirections::south; // Set the opposite direction
-								coorV = MapCoordinate { coorV.x, coorV.y + 1 };
-								break;
-
-							case SolverState::east:
-								directions[distance] = EntranceDirections::west; // Set the opposite direction
-								coorV = MapCoordinate { coorV.x + 1, coorV.y };
-								break;
-
-							case SolverState::south:
-								directions[distance] = EntranceDirections::north; // Set the opposite direction
-								coorV = MapCoordinate { coorV.x, coorV.y - 1 };
-								break;
-
-							case SolverState::west:
-								directions[distance] = EntranceDirections::east; // Set the opposite direction
-								coorV = MapCoordinate { coorV.x - 1, coorV.y };
-								break;
-
-							default:
-								resetBFSValues();
-								return ReturnCode::error;
-							}
-
-							distance++;
-
-							if (distance > maxPathLength)
-							{
-								resetBFSValues();
-								return ReturnCode::aborted;
-							}
-						}
-
-						if (distance > 0)
-						{
-							std::reverse(directions, directions + distance - 1);
-						}
-
-						return ReturnCode::ok;
+						return reconstructPath(state, start, coorV, directions, maxPathLength);
 					}
 					else
 					{
 						// Check the north
 						if (coorV.y < maxY && ((gridCellV.cellConnections & EntranceDirections::north) || (gridCellV.cellConnections & RampDirections::north)))
 						{
-							coorW = MapCoordinate { coorV.x, coorV.y + 1 };
-							getGridCell(&gridCellW, &bfsValueW, coorW);
+							coorW = MapCoordinate { coorV.x, static_cast<int8_t>(coorV.y + 1) };
+							getGridCell(&gridCellW, coorW);
 
-							if (!(bfsValueW & SolverState::discovered) && !(gridCellW.cellState & CellState::blackTile) && isPassable(gridCellW))
+							if (!state.isDiscovered(coorW) && !(gridCellW.cellState & CellState::blackTile) && isPassable(gridCellW))
 							{
-								bfsValueW = SolverState::discovered | SolverState::south; // Set discovered-bit, store the shortest path back
+								state.discover(coorW, SolverState::south); // Store the shortest path back
 
 								if (queue.enqueue(coorW) != ReturnCode::ok)
 								{
-									resetBFSValues();
 									return ReturnCode::error;
 								}
-
-								setGridCell(bfsValueW, coorW);
 							}
 						}
 
 						// Check the east
 						if (coorV.x < maxX && ((gridCellV.cellConnections & EntranceDirections::east) || (gridCellV.cellConnections & RampDirections::east)))
 						{
-							coorW = MapCoordinate { coorV.x + 1, coorV.y };
-							getGridCell(&gridCellW, &bfsValueW, coorW);
+							coorW = MapCoordinate { static_cast<int8_t>(coorV.x + 1), coorV.y };
+							getGridCell(&gridCellW, coorW);
 
-							if (!(bfsValueW & SolverState::discovered) && !(gridCellW.cellState & CellState::blackTile) && isPassable(gridCellW))
+							if (!state.isDiscovered(coorW) && !(gridCellW.cellState & CellState::blackTile) && isPassable(gridCellW))
 							{
-								bfsValueW = SolverState::discovered | SolverState::west; // Set discovered-bit, store the shortest path back
+								state.discover(coorW, SolverState::west); // Store the shortest path back
 
 								if (queue.enqueue(coorW) != ReturnCode::ok)
 								{
-									resetBFSValues();
 									return ReturnCode::error;
 								}
-
-								setGridCell(bfsValueW, coorW);
 							}
 						}
 
 						// Check the south
 						if (coorV.y > minY && ((gridCellV.cellConnections & EntranceDirections::south) || (gridCellV.cellConnections & RampDirections::south)))
 						{
-							coorW = MapCoordinate { coorV.x, coorV.y - 1 };
-							getGridCell(&gridCellW, &bfsValueW, coorW);
+							coorW = MapCoordinate { coorV.x, static_cast<int8_t>(coorV.y - 1) };
+							getGridCell(&gridCellW, coorW);
 							
-							if (!(bfsValueW & SolverState::discovered) && !(gridCellW.cellState & CellState::blackTile) && isPassable(gridCellW))
+							if (!state.isDiscovered(coorW) && !(gridCellW.cellState & CellState::blackTile) && isPassable(gridCellW))
 							{
-								bfsValueW = SolverState::discovered | SolverState::north; // Set discovered-bit, store the shortest path back
+								state.discover(coorW, SolverState::north); // Store the shortest path back
 
 								if (queue.enqueue(coorW) != ReturnCode::ok)
 								{
-									resetBFSValues();
 									return ReturnCode::error;
 								}
-
-								setGridCell(bfsValueW, coorW);
 							}
 						}
 
 						// Check the west
 						if (coorV.x > minX && ((gridCellV.cellConnections & EntranceDirections::west) || (gridCellV.cellConnections & RampDirections::west)))
 						{
-							coorW = MapCoordinate { coorV.x - 1, coorV.y };
-							getGridCell(&gridCellW, &bfsValueW, coorW);
+							coorW = MapCoordinate { static_cast<int8_t>(coorV.x - 1), coorV.y };
+							getGridCell(&gridCellW, coorW);
 
-							if (!(bfsValueW & SolverState::discovered) && !(gridCellW.cellState & CellState::blackTile) && isPassable(gridCellW))
+							if (!state.isDiscovered(coorW) && !(gridCellW.cellState & CellState::blackTile) && isPassable(gridCellW))
 							{
-								bfsValueW = SolverState::discovered | SolverState::east; // Set discovered-bit, store the shortest path back
+								state.discover(coorW, SolverState::east); // Store the shortest path back
 
 								if (queue.enqueue(coorW) != ReturnCode::ok)
 								{
-									resetBFSValues();
 									return ReturnCode::error;
 								}
-
-								setGridCell(bfsValueW, coorW);
 							}
 						}
 					}
 				}
 
-				resetBFSValues();
 				return ReturnCode::error;
 			}
 		}
+
+		namespace PathPlanner
+		{
+			namespace
+			{
+				// Entry of the open list
+				struct OpenEntry
+				{
+					uint16_t priority;		// Cost + estimated remaining cost
+					uint16_t index;			// Cell index
+				};
+
+				uint16_t _costs[_numCells];								// Cost from the start to every discovered cell
+				uint32_t _closed[_numCells / 32];						// Bitset of cells whose cost is final
+				OpenEntry _openList[JAFDSettings::MazeMapping::PathPlanner::openListSize];	// Binary min-heap
+				uint16_t _openListSize = 0;
+
+				// Add an entry to the open list
+				ReturnCode pushOpen(const uint16_t priority, const uint16_t index)
+				{
+					if (_openListSize >= JAFDSettings::MazeMapping::PathPlanner::openListSize)
+					{
+						return ReturnCode::error;
+					}
+
+					uint16_t i = _openListSize++;
+
+					while (i > 0 && _openList[(i - 1) / 2].priority > priority)
+					{
+						_openList[i] = _openList[(i - 1) / 2];
+						i = (i - 1) / 2;
+					}
+
+					_openList[i] = OpenEntry{ priority, index };
+
+					return ReturnCode::ok;
+				}
+
+				// Remove the entry with the lowest priority from the open list
+				OpenEntry popOpen()
+				{
+					const OpenEntry top = _openList[0];
+					const OpenEntry last = _openList[--_openListSize];
+
+					uint16_t i = 0;
+
+					while (2 * i + 1 < _openListSize)
+					{
+						uint16_t child = 2 * i + 1;
+
+						if (child + 1 < _openListSize && _openList[child + 1].priority < _openList[child].priority)
+						{
+							child++;
+						}
+
+						if (_openList[child].priority >= last.priority)
+						{
+							break;
+						}
+
+						_openList[i] = _openList[child];
+						i = child;
+					}
+
+					_openList[i] = last;
+
+					return top;
+				}
+
+				// Estimated remaining cost (admissible, because no step is cheaper than driving straight)
+				inline uint16_t heuristic(const MapCoordinate coor, const MapCoordinate* goal)
+				{
+					if (goal == nullptr) return 0;
+
+					return (abs(coor.x - goal->x) + abs(coor.y - goal->y)) * JAFDSettings::MazeMapping::PathPlanner::straightCost;
+				}
+
+				// Cost for driving from one cell to the neighbour in the given direction
+				uint16_t stepCost(const GridCell& from, const GridCell& to, const AbsoluteDir heading, const AbsoluteDir dir)
+				{
+					uint16_t cost = JAFDSettings::MazeMapping::PathPlanner::straightCost;
+
+					switch (((uint8_t)dir - (uint8_t)heading) & 0b11)
+					{
+					case 1:
+					case 3:
+						cost += JAFDSettings::MazeMapping::PathPlanner::turn90Cost;
+						break;
+
+					case 2:
+						cost += JAFDSettings::MazeMapping::PathPlanner::turn180Cost;
+						break;
+
+					default:
+						break;
+					}
+
+					if ((from.cellConnections & (RampDirections::north << (uint8_t)dir)) || (to.cellState & CellState::ramp))
+					{
+						cost += JAFDSettings::MazeMapping::PathPlanner::rampCost;
+					}
+
+					if (to.cellState & CellState::bump)
+					{
+						cost += JAFDSettings::MazeMapping::PathPlanner::bumpCost;
+					}
+
+					return cost;
+				}
+
+				// Dijkstra (goal == nullptr) or A* search
+				ReturnCode search(const MapCoordinate start, const AbsoluteDir startDir, const MapCoordinate* goal, uint8_t* directions, const uint8_t maxPathLength, bool(*goalCondition)(MapCoordinate coor, GridCell cell), bool(*isPassable)(GridCell cell))
+				{
+					SearchState state;
+
+					memset(_closed, 0, sizeof(_closed));
+					_openListSize = 0;
+
+					const uint16_t startIndex = getCellIndex(start);
+
+					_costs[startIndex] = 0;
+					state.discover(start, toDirBack(startDir));
+
+					if (pushOpen(heuristic(start, goal), startIndex) != ReturnCode::ok)
+					{
+						return ReturnCode::error;
+					}
+
+					while (_openListSize > 0)
+					{
+						const uint16_t indexV = popOpen().index;
+
+						// Entry is outdated
+						if (_closed[indexV / 32] & (1 << (indexV % 32))) continue;
+
+						_closed[indexV / 32] |= 1 << (indexV % 32);
+
+						const MapCoordinate coorV = getCellCoor(indexV);
+						GridCell gridCellV;
+
+						getGridCell(&gridCellV, coorV);
+
+						if (goal != nullptr ? (coorV == *goal) : goalCondition(coorV, gridCellV))
+						{
+							return reconstructPath(state, start, coorV, directions, maxPathLength);
+						}
+
+						const AbsoluteDir heading = fromDirBack(state.getDirBack(coorV));
+
+						for (uint8_t d = 0; d < 4; d++)
+						{
+							const AbsoluteDir dir = (AbsoluteDir)d;
+							MapCoordinate coorW;
+
+							if (!(gridCellV.cellConnections & ((EntranceDirections::north | RampDirections::north) << d))) continue;
+
+							switch (dir)
+							{
+							case AbsoluteDir::north:
+								if (coorV.y >= maxY) continue;
+								coorW = MapCoordinate { coorV.x, static_cast<int8_t>(coorV.y + 1) };
+								break;
+
+							case AbsoluteDir::east:
+								if (coorV.x >= maxX) continue;
+								coorW = MapCoordinate { static_cast<int8_t>(coorV.x + 1), coorV.y };
+								break;
+
+							case AbsoluteDir::south:
+								if (coorV.y <= minY) continue;
+								coorW = MapCoordinate { coorV.x, static_cast<int8_t>(coorV.y - 1) };
+								break;
+
+							default:
+								if (coorV.x <= minX) continue;
+								coorW = MapCoordinate { static_cast<int8_t>(coorV.x - 1), coorV.y };
+								break;
+							}
+
+							const uint16_t indexW = getCellIndex(coorW);
+
+							if (_closed[indexW / 32] & (1 << (indexW % 32))) continue;
+
+							GridCell gridCellW;
+
+							getGridCell(&gridCellW, coorW);
+
+							if ((gridCellW.cellState & CellState::blackTile) || !isPassable(gridCellW)) continue;
+
+							const uint32_t costW = (uint32_t)_costs[indexV] + stepCost(gridCellV, gridCellW, heading, dir);
+
+							// Too expensive or not better than a known path
+							if (costW + heuristic(coorW, goal) > UINT16_MAX) continue;
+							if (state.isDiscovered(coorW) && costW >= _costs[indexW]) continue;
+
+							_costs[indexW] = costW;
+							state.discover(coorW, toDirBack(dir));
+
+							if (pushOpen(costW + heuristic(coorW, goal), indexW) != ReturnCode::ok)
+							{
+								return ReturnCode::error;
+							}
+						}
+					}
+
+					return ReturnCode::error;
+				}
+			}
+
+			// Find the fastest known path to a cell that fulfills the goal condition (Dijkstra)
+			ReturnCode findFastestPath(const MapCoordinate start, const AbsoluteDir startDir, uint8_t* directions, const uint8_t maxPathLength, bool(*goalCondition)(MapCoordinate coor, GridCell cell), bool(*isPassable)(GridCell cell))
+			{
+				return search(start, startDir, nullptr, directions, maxPathLength, goalCondition, isPassable);
+			}
+
+			// Find the fastest known path to one cell (A*)
+			ReturnCode findFastestPath(const MapCoordinate start, const AbsoluteDir startDir, const MapCoordinate goal, uint8_t* directions, const uint8_t maxPathLength, bool(*isPassable)(GridCell cell))
+			{
+				return search(start, startDir, &goal, directions, maxPathLength, nullptr, isPassable);
+			}
+		}
+
+		namespace IncrementalPlanner
+		{
+			namespace
+			{
+				constexpr uint8_t _infinity = UINT8_MAX;
+
+				static_assert(JAFDSettings::MazeMapping::PathPlanner::straightCost % JAFDSettings::MazeMapping::IncrementalPlanner::costUnit == 0 && JAFDSettings::MazeMapping::PathPlanner::rampCost % JAFDSettings::MazeMapping::IncrementalPlanner::costUnit == 0 && JAFDSettings::MazeMapping::PathPlanner::bumpCost % JAFDSettings::MazeMapping::IncrementalPlanner::costUnit == 0, "The costs of the IncrementalPlanner have to be multiples of its cost unit");
+
+				constexpr uint8_t _straightCost = JAFDSettings::MazeMapping::PathPlanner::straightCost / JAFDSettings::MazeMapping::IncrementalPlanner::costUnit;
+				constexpr uint8_t _rampCost = JAFDSettings::MazeMapping::PathPlanner::rampCost / JAFDSettings::MazeMapping::IncrementalPlanner::costUnit;
+				constexpr uint8_t _bumpCost = JAFDSettings::MazeMapping::PathPlanner::bumpCost / JAFDSettings::MazeMapping::IncrementalPlanner::costUnit;
+
+				// Entry of the open list (lazy: outdated entries are skipped when they are removed)
+				struct OpenEntry
+				{
+					uint16_t index;			// Cell index
+					uint8_t key;			// min(g, rhs) when the entry was added
+				};
+
+				bool _valid = false;								// Are the costs up to date with the map?
+				bool(*_isPassable)(GridCell cell) = nullptr;		// Additional condition for passable cells
+
+				uint8_t _g[_numCells];								// Cost to the nearest frontier cell (_infinity if unknown)
+				OpenEntry _openList[JAFDSettings::MazeMapping::IncrementalPlanner::openListSize];	// Binary min-heap
+				uint16_t _openListSize = 0;
+
+				// Neighbour in one direction (false if outside of the map)
+				bool getNeighbour(const uint16_t index, const uint8_t dir, uint16_t& neighbour)
+				{
+					const MapCoordinate coor = getCellCoor(index);
+
+					switch ((AbsoluteDir)dir)
+					{
+					case AbsoluteDir::north:
+						if (coor.y >= maxY) return false;
+						neighbour = getCellIndex(MapCoordinate { coor.x, static_cast<int8_t>(coor.y + 1) });
+						break;
+
+					case AbsoluteDir::east:
+						if (coor.x >= maxX) return false;
+						neighbour = getCellIndex(MapCoordinate { static_cast<int8_t>(coor.x + 1), coor.y });
+						break;
+
+					case AbsoluteDir::south:
+						if (coor.y <= minY) return false;
+						neighbour = getCellIndex(MapCoordinate { coor.x, static_cast<int8_t>(coor.y - 1) });
+						break;
+
+					default:
+						if (coor.x <= minX) return false;
+						neighbour = getCellIndex(MapCoordinate { static_cast<int8_t>(coor.x - 1), coor.y });
+						break;
+					}
+
+					return true;
+				}
+
+				// Cost of driving from a cell to its neighbour (_infinity if there is no way)
+				uint8_t edgeCost(const uint16_t from, const uint8_t dir, const uint16_t to)
+				{
+					const CachedCell& cellFrom = _cache[from];
+					const CachedCell& cellTo = _cache[to];
+
+					if (!(cellFrom.cellConnections & ((EntranceDirections::north | RampDirections::north) << dir))) return _infinity;
+					if ((cellTo.cellState & CellState::blackTile) || !_isPassable(GridCell(cellTo.cellConnections, cellTo.cellState))) return _infinity;
+
+					uint8_t cost = _straightCost;
+
+					if ((cellFrom.cellConnections & (RampDirections::north << dir)) || (cellTo.cellState & CellState::ramp)) cost += _rampCost;
+					if (cellTo.cellState & CellState::bump) cost += _bumpCost;
+
+					return cost;
+				}
+
+				// One step lookahead of g - 0 for frontier cells, otherwise the best cost over one neighbour
+				uint8_t getRhs(const uint16_t index, uint8_t* bestDir = nullptr, const uint8_t preferredDir = 0)
+				{
+					if (Exploration::isFrontier(getCellCoor(index))) return 0;
+
+					uint16_t minCost = _infinity;
+
+					for (uint8_t i = 0; i < 4; i++)
+					{
+						// Start with the preferred direction, so it wins equal costs
+						const uint8_t d = (preferredDir + i) & 0b11;
+						uint16_t neighbour;
+
+						if (!getNeighbour(index, d, neighbour) || _g[neighbour] == _infinity) continue;
+
+						const uint8_t cost = edgeCost(index, d, neighbour);
+
+						if (cost == _infinity) continue;
+
+						if ((uint16_t)cost + _g[neighbour] < minCost)
+						{
+							minCost = (uint16_t)cost + _g[neighbour];
+
+							if (bestDir) *bestDir = d;
+						}
+					}
+
+					return (minCost < _infinity) ? minCost : _infinity;
+				}
+
+				// Add an entry to the open list - the costs are invalid if it is full
+				void pushOpen(const uint16_t index, const uint8_t key)
+				{
+					if (_openListSize >= JAFDSettings::MazeMapping::IncrementalPlanner::openListSize)
+					{
+						_valid = false;
+						return;
+					}
+
+					uint16_t i = _openListSize++;
+
+					while (i > 0 && _openList[(i - 1) / 2].key > key)
+					{
+						_openList[i] = _openList[(i - 1) / 2];
+						i = (i - 1) / 2;
+					}
+
+					_openList[i] = OpenEntry{ index, key };
+				}
+
+				// Remove the entry with the lowest key from the open list
+				OpenEntry popOpen()
+				{
+					const OpenEntry top = _openList[0];
+					const OpenEntry last = _openList[--_openListSize];
+
+					uint16_t i = 0;
+
+					while (2 * i + 1 < _openListSize)
+					{
+						uint16_t child = 2 * i + 1;
+
+						if (child + 1 < _openListSize && _openList[child + 1].key < _openList[child].key) child++;
+						if (_openList[child].key >= last.key) break;
+
+						_openList[i] = _openList[child];
+						i = child;
+					}
+
+					_openList[i] = last;
+
+					return top;
+				}
+
+				// Queue the cell if it is inconsistent
+				void updateVertex(const uint16_t index)
+				{
+					const uint8_t rhs = getRhs(index);
+
+					if (_g[index] != rhs) pushOpen(index, std::min(_g[index], rhs));
+				}
+
+				// A changed cell changes its own rhs and the costs of the ways into it
+				void updateVertexAndNeighbours(const uint16_t index)
+				{
+					updateVertex(index);
+
+					for (uint8_t d = 0; d < 4; d++)
+					{
+						uint16_t neighbour;
+
+						if (getNeighbour(index, d, neighbour)) updateVertex(neighbour);
+					}
+				}
+
+				// Repair the costs until the cost of the start is final
+				void computeShortestPath(const uint16_t startIndex)
+				{
+					while (_valid && _openListSize > 0)
+					{
+						const uint8_t startRhs = getRhs(startIndex);
+
+						if (_openList[0].key >= std::min(_g[startIndex], startRhs) && _g[startIndex] == startRhs) break;
+
+						const OpenEntry top = popOpen();
+						const uint8_t rhs = getRhs(top.index);
+						const uint8_t key = std::min(_g[top.index], rhs);
+
+						// Outdated entry
+						if (_g[top.index] == rhs) continue;
+
+						if (top.key < key)
+						{
+							pushOpen(top.index, key);
+						}
+						else if (_g[top.index] > rhs)
+						{
+							_g[top.index] = rhs;
+
+							for (uint8_t d = 0; d < 4; d++)
+							{
+								uint16_t neighbour;
+
+								if (getNeighbour(top.index, d, neighbour)) updateVertex(neighbour);
+							}
+						}
+						else
+						{
+							_g[top.index] = _infinity;
+
+							updateVertexAndNeighbours(top.index);
+						}
+					}
+				}
+
+				// Start from scratch - all frontier cells are goals
+				void restart(bool(*isPassable)(GridCell cell))
+				{
+					memset(_g, _infinity, sizeof(_g));
+
+					_isPassable = isPassable;
+					_openListSize = 0;
+					_valid = true;
+
+					for (uint16_t i = 0; i < _numCells; i++)
+					{
+						if (Exploration::isFrontier(getCellCoor(i))) pushOpen(i, 0);
+					}
+				}
+			}
+
+			ReturnCode getPath(const MapCoordinate start, const AbsoluteDir startDir, uint8_t* directions, const uint8_t maxPathLength, bool(*isPassable)(GridCell cell))
+			{
+				if (!_valid || isPassable != _isPassable) restart(isPassable);
+
+				uint16_t index = getCellIndex(start);
+
+				computeShortestPath(index);
+
+				if (!_valid || _g[index] == _infinity) return ReturnCode::error;
+
+				// Follow the cheapest neighbours to the nearest frontier cell
+				uint8_t dir = (uint8_t)startDir;
+				uint8_t distance = 0;
+
+				// Only the first maxPathLength steps of longer paths
+				while (distance < maxPathLength && !Exploration::isFrontier(getCellCoor(index)))
+				{
+
+					if (getRhs(index, &dir, dir) == _infinity) return ReturnCode::error;
+
+					directions[distance++] = EntranceDirections::north << dir;
+					getNeighbour(index, dir, index);
+				}
+
+				if (distance < maxPathLength)
+				{
+					directions[distance] = EntranceDirections::nowhere;
+				}
+
+				return ReturnCode::ok;
+			}
+
+			void cellChanged(const MapCoordinate coor)
+			{
+				if (_valid) updateVertexAndNeighbours(getCellIndex(coor));
+			}
+
+			void reset()
+			{
+				_valid = false;
+			}
+		}
+
+		namespace Exploration
+		{
+			namespace
+			{
+				MapCoordinate _frontiers[JAFDSettings::MazeMapping::Exploration::maxFrontiers];	// Unordered list of the frontier cells
+				uint32_t _isFrontier[_numCells / 32];				// Same cells as bitset
+				uint16_t _numFrontiers = 0;
+				bool _overflow = false;								// Frontier cells were dropped, because the list was full
+
+				MapCoordinate _target;								// Target of the last path
+				bool _excludeTarget = false;						// The target is no goal (while planning the decision after it)
+
+				// Decision after the target - if the target is a dead end, the robot turns back to the cell before it and drives on from there
+				bool _aheadPending = false;								// Not planned yet
+				bool _aheadValid = false;
+				MapCoordinate _aheadStart;								// Cell before the target
+				AbsoluteDir _aheadDir;									// Direction from the target back to it
+				MapCoordinate _aheadTarget;
+				uint8_t _aheadPath[JAFDSettings::MazeMapping::Exploration::maxPathLength];
+				uint8_t _aheadLength = 0;								// Number of steps
+				uint8_t _maxPathLength = 0;								// Length limit of the last path
+
+				// Neighbour in a direction - false at the border of the map
+				bool getNeighbour(const MapCoordinate coor, const uint8_t dir, MapCoordinate& neighbour)
+				{
+					switch ((AbsoluteDir)dir)
+					{
+					case AbsoluteDir::north:
+						if (coor.y >= maxY) return false;
+						neighbour = MapCoordinate { coor.x, static_cast<int8_t>(coor.y + 1) };
+						break;
+
+					case AbsoluteDir::east:
+						if (coor.x >= maxX) return false;
+						neighbour = MapCoordinate { static_cast<int8_t>(coor.x + 1), coor.y };
+						break;
+
+					case AbsoluteDir::south:
+						if (coor.y <= minY) return false;
+						neighbour = MapCoordinate { coor.x, static_cast<int8_t>(coor.y - 1) };
+						break;
+
+					default:
+						if (coor.x <= minX) return false;
+						neighbour = MapCoordinate { static_cast<int8_t>(coor.x - 1), coor.y };
+						break;
+					}
+
+					return true;
+				}
+
+				// Not visited, but there is an entrance from a visited cell
+				bool isFrontierCell(const MapCoordinate coor)
+				{
+					if (_cache[getCellIndex(coor)].cellState & CellState::visited) return false;
+
+					for (uint8_t d = 0; d < 4; d++)
+					{
+						MapCoordinate neighbour;
+
+						if (!getNeighbour(coor, d, neighbour)) continue;
+
+						const CachedCell& cell = _cache[getCellIndex(neighbour)];
+
+						if ((cell.cellState & CellState::visited) && !(cell.cellState & CellState::blackTile) && (cell.cellConnections & ((EntranceDirections::north | RampDirections::north) << ((d + 2) & 0b11)))) return true;
+					}
+
+					return false;
+				}
+
+				void add(const MapCoordinate coor)
+				{
+					const uint16_t index = getCellIndex(coor);
+
+					if (_numFrontiers >= JAFDSettings::MazeMapping::Exploration::maxFrontiers)
+					{
+						_overflow = true;
+						return;
+					}
+
+					_frontiers[_numFrontiers++] = coor;
+					_isFrontier[index / 32] |= 1 << (index % 32);
+
+					IncrementalPlanner::cellChanged(coor);
+				}
+
+				void remove(const MapCoordinate coor)
+				{
+					const uint16_t index = getCellIndex(coor);
+
+					_isFrontier[index / 32] &= ~(1 << (index % 32));
+
+					for (uint16_t i = 0; i < _numFrontiers; i++)
+					{
+						if (_frontiers[i] == coor)
+						{
+							_frontiers[i] = _frontiers[--_numFrontiers];
+							break;
+						}
+					}
+
+					IncrementalPlanner::cellChanged(coor);
+				}
+
+				// Bring one cell of the set up to date
+				void update(const MapCoordinate coor)
+				{
+					const bool frontier = isFrontierCell(coor);
+
+					if (frontier == isFrontier(coor)) return;
+
+					if (frontier) add(coor);
+					else remove(coor);
+				}
+
+				bool isGoal(MapCoordinate coor, GridCell cell)
+				{
+					return isFrontier(coor) && !(_excludeTarget && coor == _target);
+				}
+
+				// Follow a path to its end - also returns the cell before the end, the direction of the last step and the number of steps
+				MapCoordinate getPathEnd(const MapCoordinate start, const uint8_t* directions, const uint8_t maxPathLength, MapCoordinate& previous, AbsoluteDir& lastDir, uint8_t& length)
+				{
+					MapCoordinate coor = start;
+
+					previous = start;
+
+					for (length = 0; length < maxPathLength && directions[length] != EntranceDirections::nowhere; length++)
+					{
+						const uint8_t i = length;
+
+						uint8_t d = 0;
+
+						while (d < 3 && !(directions[i] & (EntranceDirections::north << d))) d++;
+
+						previous = coor;
+						lastDir = (AbsoluteDir)d;
+
+						getNeighbour(previous, d, coor);
+					}
+
+					return coor;
+				}
+			}
+
+			ReturnCode findNextPath(const MapCoordinate start, const AbsoluteDir startDir, uint8_t* directions, const uint8_t maxPathLength, bool(*isPassable)(GridCell cell))
+			{
+				// Dropped cells can be found again
+				if (_overflow && _numFrontiers < JAFDSettings::MazeMapping::Exploration::maxFrontiers) rebuild();
+
+				_aheadPending = false;
+
+				// Exploration finished - no search necessary
+				if (_numFrontiers == 0)
+				{
+					_aheadValid = false;
+					return ReturnCode::error;
+				}
+
+				// Decision was planned ahead and the target is a dead end (the only entrance is the one from the cell before)
+				const bool deadEnd = !(_cache[getCellIndex(_target)].cellConnections & ~((EntranceDirections::north | RampDirections::north) << (uint8_t)_aheadDir));
+
+				if (_aheadValid && start == _target && deadEnd && isFrontier(_aheadTarget) && _aheadLength <= maxPathLength)
+				{
+					memcpy(directions, _aheadPath, _aheadLength);
+
+					if (_aheadLength < maxPathLength) directions[_aheadLength] = EntranceDirections::nowhere;
+				}
+				else
+				{
+					_excludeTarget = false;
+
+					// Only the changed part of the costs is repaired - a full search if that fails
+					ReturnCode code = IncrementalPlanner::getPath(start, startDir, directions, maxPathLength, isPassable);
+
+					if (code != ReturnCode::ok) code = PathPlanner::findFastestPath(start, startDir, directions, maxPathLength, isGoal, isPassable);
+
+					if (code != ReturnCode::ok)
+					{
+						_aheadValid = false;
+						return code;
+					}
+				}
+
+				AbsoluteDir lastDir = startDir;
+				uint8_t length;
+
+				_maxPathLength = maxPathLength;
+				_target = getPathEnd(start, directions, maxPathLength, _aheadStart, lastDir, length);
+				_aheadDir = (AbsoluteDir)(((uint8_t)lastDir + 2) & 0b11);
+				_aheadValid = false;
+				_aheadPending = true;
+
+				return ReturnCode::ok;
+			}
+
+			void planAhead(bool(*isPassable)(GridCell cell))
+			{
+				// Nothing to plan or the robot has already reached the target
+				if (!_aheadPending || !isFrontier(_target)) return;
+
+				_aheadPending = false;
+
+				// Back to the cell before the target, then to the next frontier cell
+				_aheadPath[0] = EntranceDirections::north << (uint8_t)_aheadDir;
+				_excludeTarget = true;
+
+				const uint8_t maxLength = std::min(_maxPathLength, JAFDSettings::MazeMapping::Exploration::maxPathLength) - 1;
+
+				_aheadValid = maxLength > 0 && PathPlanner::findFastestPath(_aheadStart, _aheadDir, _aheadPath + 1, maxLength, isGoal, isPassable) == ReturnCode::ok;
+
+				_excludeTarget = false;
+
+				if (_aheadValid)
+				{
+					MapCoordinate previous;
+					AbsoluteDir lastDir;
+
+					_aheadTarget = getPathEnd(_aheadStart, _aheadPath + 1, maxLength, previous, lastDir, _aheadLength);
+					_aheadLength++;
+				}
+			}
+
+			MapCoordinate getTarget()
+			{
+				return _target;
+			}
+
+			uint16_t getNumFrontiers()
+			{
+				return _numFrontiers;
+			}
+
+			bool isFrontier(const MapCoordinate coor)
+			{
+				const uint16_t index = getCellIndex(coor);
+
+				return _isFrontier[index / 32] & (1 << (index % 32));
+			}
+
+			// Only the cell itself and its neighbours can change their state
+			void cellChanged(const MapCoordinate coor)
+			{
+				update(coor);
+
+				for (uint8_t d = 0; d < 4; d++)
+				{
+					MapCoordinate neighbour;
+
+					if (getNeighbour(coor, d, neighbour)) update(neighbour);
+				}
+			}
+
+			void rebuild()
+			{
+				IncrementalPlanner::reset();
+
+				memset(_isFrontier, 0, sizeof(_isFrontier));
+				_numFrontiers = 0;
+				_overflow = false;
+				_aheadPending = false;
+				_aheadValid = false;
+
+				for (uint16_t i = 0; i < _numCells; i++)
+				{
+					const MapCoordinate coor = getCellCoor(i);
+
+					if (isFrontierCell(coor)) add(coor);
+				}
+			}
+		}
+
+		namespace VictimEvidence
+		{
+			namespace
+			{
+				constexpr uint16_t _emptyEntry = 0xffff;
+
+				// One wall in the side table
+				struct Entry
+				{
+					uint16_t cellIndex = _emptyEntry;		// Index in the cache, _emptyEntry if the entry is free
+					uint8_t floor;
+					AbsoluteDir wall;
+					WallEvidence evidence;
+				};
+
+				Entry _entries[JAFDSettings::MazeMapping::VictimEvidence::tableSize];
+
+				// Sum of all positive evidence
+				uint32_t getStrength(const WallEvidence& evidence)
+				{
+					uint32_t strength = evidence.heatHits * 255;
+
+					for (uint8_t i = 0; i < 6; i++) strength += evidence.visual[i];
+
+					return strength;
+				}
+
+				// Find the wall the sensor on the left / right side is looking at
+				bool projectToWall(const Vec2f position, const float heading, const bool left, MapCoordinate& coor, AbsoluteDir& wall)
+				{
+					const float angle = heading + (left ? M_PI_2 : -M_PI_2);
+					const float quarters = roundf(angle / M_PI_2);
+
+					if (fabsf(angle - quarters * M_PI_2) > JAFDSettings::MazeMapping::VictimEvidence::maxAngleError) return false;
+
+					// Global heading: 0 = north (+x), pi/2 = west (+y)
+					constexpr AbsoluteDir walls[4] = { AbsoluteDir::north, AbsoluteDir::west, AbsoluteDir::south, AbsoluteDir::east };
+					const uint8_t quadrant = static_cast<int32_t>(quarters) & 0b11;
+					const Vec2f dir(cosf(angle), sinf(angle));
+
+					const int8_t cellX = roundf(position.x / JAFDSettings::Field::cellWidth);
+					const int8_t cellY = roundf(position.y / JAFDSettings::Field::cellWidth);
+					const float sign = (quadrant == 0 || quadrant == 1) ? 1.0f : -1.0f;
+
+					wall = walls[quadrant];
+
+					// Intersect with the wall of the current cell - the hit point can be on the wall of a neighbour
+					if (quadrant % 2 == 0)
+					{
+						const float wallX = (cellX + sign * 0.5f) * JAFDSettings::Field::cellWidth;
+						const float dist = (wallX - position.x) / dir.x;
+
+						if (dist <= 0.0f || dist > JAFDSettings::MazeMapping::VictimEvidence::maxWallDist) return false;
+
+						coor = MapCoordinate(cellX, roundf((position.y + dir.y * dist) / JAFDSettings::Field::cellWidth));
+					}
+					else
+					{
+						const float wallY = (cellY + sign * 0.5f) * JAFDSettings::Field::cellWidth;
+						const float dist = (wallY - position.y) / dir.y;
+
+						if (dist <= 0.0f || dist > JAFDSettings::MazeMapping::VictimEvidence::maxWallDist) return false;
+
+						coor = MapCoordinate(roundf((position.x + dir.x * dist) / JAFDSettings::Field::cellWidth), cellY);
+					}
+
+					return coor.x >= minX && coor.x <= maxX && coor.y >= minY && coor.y <= maxY;
+				}
+
+				// Entry of a wall - a new one is only created for positive evidence
+				Entry* getEntry(const MapCoordinate coor, const AbsoluteDir wall, const bool create)
+				{
+					const uint16_t cellIndex = getCellIndex(coor);
+					Entry* freeEntry = nullptr;
+					Entry* weakestEntry = nullptr;
+					uint32_t weakestStrength = UINT32_MAX;
+
+					for (auto& entry : _entries)
+					{
+						if (entry.cellIndex == cellIndex && entry.floor == _floor && entry.wall == wall) return &entry;
+
+						if (entry.cellIndex == _emptyEntry)
+						{
+							if (freeEntry == nullptr) freeEntry = &entry;
+						}
+						else
+						{
+							const uint32_t strength = getStrength(entry.evidence);
+
+							if (strength < weakestStrength)
+							{
+								weakestStrength = strength;
+								weakestEntry = &entry;
+							}
+						}
+					}
+
+					if (!create) return nullptr;
+
+					Entry* entry = (freeEntry != nullptr) ? freeEntry : weakestEntry;
+
+					if (entry != nullptr)
+					{
+						entry->cellIndex = cellIndex;
+						entry->floor = _floor;
+						entry->wall = wall;
+						entry->evidence = WallEvidence();
+					}
+
+					return entry;
+				}
+			}
+
+			void addVisual(const Vec2f position, const float heading, const bool left, const VisVictimProb& frame)
+			{
+				MapCoordinate coor;
+				AbsoluteDir wall;
+
+				if (!projectToWall(position, heading, left, coor, wall)) return;
+
+				const float weights[7] = { frame.harmed, frame.stable, frame.unharmed, frame.red, frame.green, frame.yellow, frame.none };
+				const bool positive = frame.harmed > 0.0f || frame.stable > 0.0f || frame.unharmed > 0.0f || frame.red > 0.0f || frame.green > 0.0f || frame.yellow > 0.0f;
+
+				Entry* entry = getEntry(coor, wall, positive);
+
+				if (entry == nullptr) return;
+
+				WallEvidence& evidence = entry->evidence;
+
+				// Halve old evidence instead of overflowing
+				if (evidence.visualFrames == UINT8_MAX)
+				{
+					for (auto& sum : evidence.visual) sum /= 2;
+					evidence.visualFrames /= 2;
+				}
+
+				for (uint8_t i = 0; i < 7; i++) evidence.visual[i] += static_cast<uint16_t>(constrain(weights[i], 0.0f, 1.0f) * 255.0f);
+
+				evidence.visualFrames++;
+			}
+
+			void addHeat(const Vec2f position, const float heading, const bool left, const bool detected)
+			{
+				MapCoordinate coor;
+				AbsoluteDir wall;
+
+				if (!projectToWall(position, heading, left, coor, wall)) return;
+
+				Entry* entry = getEntry(coor, wall, detected);
+
+				if (entry == nullptr) return;
+
+				WallEvidence& evidence = entry->evidence;
+
+				if (evidence.heatReadings == UINT8_MAX)
+				{
+					evidence.heatHits /= 2;
+					evidence.heatReadings /= 2;
+				}
+
+				if (detected) evidence.heatHits++;
+
+				evidence.heatReadings++;
+			}
+
+			ReturnCode getEvidence(const MapCoordinate coor, const AbsoluteDir wall, WallEvidence& evidence)
+			{
+				const Entry* entry = getEntry(coor, wall, false);
+
+				if (entry == nullptr) return ReturnCode::error;
+
+				evidence = entry->evidence;
+
+				return ReturnCode::ok;
+			}
+
+			VisVictimProb getVisualProb(const MapCoordinate coor, const AbsoluteDir wall)
+			{
+				WallEvidence evidence;
+				VisVictimProb prob;
+
+				if (getEvidence(coor, wall, evidence) != ReturnCode::ok || evidence.visualFrames == 0) return prob;
+
+				const float factor = 1.0f / (255.0f * evidence.visualFrames);
+
+				prob.harmed = evidence.visual[0] * factor;
+				prob.stable = evidence.visual[1] * factor;
+				prob.unharmed = evidence.visual[2] * factor;
+				prob.red = evidence.visual[3] * factor;
+				prob.green = evidence.visual[4] * factor;
+				prob.yellow = evidence.visual[5] * factor;
+				prob.none = evidence.visual[6] * factor;
+
+				return prob;
+			}
+
+			float getHeatProb(const MapCoordinate coor, const AbsoluteDir wall)
+			{
+				WallEvidence evidence;
+
+				if (getEvidence(coor, wall, evidence) != ReturnCode::ok || evidence.heatReadings == 0) return 0.0f;
+
+				return static_cast<float>(evidence.heatHits) / evidence.heatReadings;
+			}
+
+			ReturnCode setRescued(const MapCoordinate coor, const AbsoluteDir wall)
+			{
+				Entry* entry = getEntry(coor, wall, false);
+
+				if (entry == nullptr) return ReturnCode::error;
+
+				entry->evidence.rescued = true;
+
+				return ReturnCode::ok;
+			}
+
+			void reset()
+			{
+				for (auto& entry : _entries) entry.cellIndex = _emptyEntry;
+			}
+
+			uint8_t exportWalls(StoredWall* walls, const uint8_t maxWalls)
+			{
+				uint8_t numWalls = 0;
+
+				for (const auto& entry : _entries)
+				{
+					if (entry.cellIndex == _emptyEntry) continue;
+					if (numWalls >= maxWalls) break;
+
+					walls[numWalls].coor = getCellCoor(entry.cellIndex);
+					walls[numWalls].floor = entry.floor;
+					walls[numWalls].wall = entry.wall;
+					walls[numWalls].evidence = entry.evidence;
+					numWalls++;
+				}
+
+				return numWalls;
+			}
+
+			void importWalls(const StoredWall* walls, const uint8_t numWalls)
+			{
+				reset();
+
+				for (uint8_t i = 0; i < numWalls && i < JAFDSettings::MazeMapping::VictimEvidence::tableSize; i++)
+				{
+					_entries[i].cellIndex = getCellIndex(walls[i].coor);
+					_entries[i].floor = walls[i].floor;
+					_entries[i].wall = walls[i].wall;
+					_entries[i].evidence = walls[i].evidence;
+				}
+			}
+		}
 	}
 }
@@ -0,0 +1,162 @@
+/*
+This private file of the library is responsible for jerk limited motion profiles
+*/
+
+#include "../header/MotionProfile.h"
+
+#include <algorithm>
+
+namespace JAFD
+{
+	MotionProfile::MotionProfile() : _speeds(), _distance(0.0f) {}
+
+	float MotionProfile::transitionTime(const float startSpeed, const float endSpeed, const float maxAcc, const float maxJerk)
+	{
+		const float deltaSpeed = fabsf(endSpeed - startSpeed);
+
+		// Phases: jerk - constant acceleration - jerk; without the constant phase if maxAcc isn't reached
+		if (deltaSpeed * maxJerk >= maxAcc * maxAcc) return deltaSpeed / maxAcc + maxAcc / maxJerk;
+		else return 2.0f * sqrtf(deltaSpeed / maxJerk);
+	}
+
+	float MotionProfile::transitionDist(const float startSpeed, const float endSpeed, const float maxAcc, const float maxJerk)
+	{
+		// The profile is point symmetric => average speed is (v_1 + v_2) / 2
+		return (startSpeed + endSpeed) / 2.0f * transitionTime(startSpeed, endSpeed, maxAcc, maxJerk);
+	}
+
+	float MotionProfile::transitionSpeed(const float startSpeed, const float endSpeed, const float maxAcc, const float maxJerk, const float t)
+	{
+		const float deltaSpeed = fabsf(endSpeed - startSpeed);
+		const float direction = (endSpeed >= startSpeed) ? 1.0f : -1.0f;
+		const float totalTime = transitionTime(startSpeed, endSpeed, maxAcc, maxJerk);
+
+		float jerkTime;		// Duration of one jerk phase
+		float accTime;		// Duration of constant acceleration
+
+		if (deltaSpeed * maxJerk >= maxAcc * maxAcc)
+		{
+			jerkTime = maxAcc / maxJerk;
+			accTime = deltaSpeed / maxAcc - jerkTime;
+		}
+		else
+		{
+			jerkTime = sqrtf(deltaSpeed / maxJerk);
+			accTime = 0.0f;
+		}
+
+		if (t <= 0.0f) return startSpeed;
+		else if (t >= totalTime) return endSpeed;
+		else if (t < jerkTime) return startSpeed + direction * maxJerk * t * t / 2.0f;
+		else if (t < jerkTime + accTime) return startSpeed + direction * maxJerk * jerkTime * (jerkTime / 2.0f + t - jerkTime);
+		else return endSpeed - direction * maxJerk * (totalTime - t) * (totalTime - t) / 2.0f;
+	}
+
+	ReturnCode MotionProfile::plan(const float distance, const float startSpeed, const float endSpeed, const float maxSpeed, const float maxAcc, const float maxJerk)
+	{
+		if (distance <= 0.0f || startSpeed < 0.0f || endSpeed < 0.0f || maxAcc <= 0.0f || maxJerk <= 0.0f) return ReturnCode::error;
+
+		float acc = maxAcc;
+		float jerk = maxJerk;
+		float peakSpeed = std::max(startSpeed, endSpeed);
+
+		const float minDist = transitionDist(startSpeed, peakSpeed, acc, jerk) + transitionDist(peakSpeed, endSpeed, acc, jerk);
+
+		if (minDist > distance)
+		{
+			// Too short - acc * k and jerk * k^2 make the speed change k times shorter
+			const float k = minDist / distance;
+
+			acc *= k;
+			jerk *= k * k;
+		}
+		else if (maxSpeed > peakSpeed)
+		{
+			// Find highest peak speed that fits into the distance
+			float low = peakSpeed;
+			float high = maxSpeed;
+
+			for (uint8_t i = 0; i < 20; i++)
+			{
+				const float mid = (low + high) / 2.0f;
+
+				if (transitionDist(startSpeed, mid, acc, jerk) + transitionDist(mid, endSpeed, acc, jerk) <= distance) low = mid;
+				else high = mid;
+			}
+
+			peakSpeed = low;
+		}
+
+		if (peakSpeed <= 0.0f) return ReturnCode::error;
+
+		const float accTime = transitionTime(startSpeed, peakSpeed, acc, jerk);
+		const float cruiseTime = std::max(distance - transitionDist(startSpeed, peakSpeed, acc, jerk) - transitionDist(peakSpeed, endSpeed, acc, jerk), 0.0f) / peakSpeed;
+		const float totalTime = accTime + cruiseTime + transitionTime(peakSpeed, endSpeed, acc, jerk);
+
+		auto speedAt = [&](const float t) -> float
+		{
+			if (t < accTime) return transitionSpeed(startSpeed, peakSpeed, acc, jerk, t);
+			else if (t < accTime + cruiseTime) return peakSpeed;
+			else return transitionSpeed(peakSpeed, endSpeed, acc, jerk, t - accTime - cruiseTime);
+		};
+
+		// Integrate speed over time (trapezoidal rule)
+		const float dt = totalTime / JAFDSettings::MotionProfile::integrationSteps;
+		float integratedDist = 0.0f;
+		float lastSpeed = startSpeed;
+
+		for (uint16_t i = 1; i <= JAFDSettings::MotionProfile::integrationSteps; i++)
+		{
+			const float speed = speedAt(i * dt);
+
+			integratedDist += (lastSpeed + speed) / 2.0f * dt;
+			lastSpeed = speed;
+		}
+
+		if (integratedDist <= 0.0f) return ReturnCode::error;
+
+		// Sample speed over distance - scale out the integration error
+		const float scale = distance / integratedDist;
+		const float tableStep = distance / (JAFDSettings::MotionProfile::tableSize - 1);
+		uint8_t index = 1;
+		float drivenDist = 0.0f;
+
+		lastSpeed = startSpeed;
+		_speeds[0] = startSpeed;
+
+		for (uint16_t i = 1; i <= JAFDSettings::MotionProfile::integrationSteps && index < JAFDSettings::MotionProfile::tableSize - 1; i++)
+		{
+			const float speed = speedAt(i * dt);
+			const float deltaDist = (lastSpeed + speed) / 2.0f * dt * scale;
+
+			while (index < JAFDSettings::MotionProfile::tableSize - 1 && drivenDist + deltaDist >= index * tableStep)
+			{
+				const float factor = (deltaDist > 0.0f) ? (index * tableStep - drivenDist) / deltaDist : 1.0f;
+
+				_speeds[index] = lastSpeed + factor * (speed - lastSpeed);
+				index++;
+			}
+
+			drivenDist += deltaDist;
+			lastSpeed = speed;
+		}
+
+		for (; index < JAFDSettings::MotionProfile::tableSize; index++) _speeds[index] = endSpeed;
+
+		_distance = distance;
+
+		return ReturnCode::ok;
+	}
+
+	float MotionProfile::getSpeed(const float drivenDist) const
+	{
+		if (drivenDist <= 0.0f) return _speeds[0];
+		if (drivenDist >= _distance) return _speeds[JAFDSettings::MotionProfile::tableSize - 1];
+
+		const float position = drivenDist / _distance * (JAFDSettings::MotionProfile::tableSize - 1);
+		const uint8_t index = static_cast<uint8_t>(position);
+		const float factor = position - index;
+
+		return _speeds[index] + factor * (_speeds[index + 1] - _speeds[index]);
+	}
+}
\ No newline at end of file
@@ -13,6 +13,14 @@ This part of the Library is responsible for driving the motors.
 #include "../header/DuePinMapping.h"
 #include "../header/PIDController.h"
 #include "../header/Math.h"
+#include "../header/Telemetry.h"
+#include "../header/Fixed.h"
+#include "../header/Calibration.h"
+#include "../header/SmallThings.h"
+
+#include <type_traits>
+#include <algorithm>
+#include <string.h>
 
 namespace JAFD
 {
@@ -44,7 +52,15 @@ namespace JAFD
 			constexpr auto rEncA = PinMapping::MappedPins[JAFDSettings::MotorControl::Right::encA];		// Encoder Pin A right motor
 			constexpr auto rEncB = PinMapping::MappedPins[JAFDSettings::MotorControl::Right::encB];		// Encoder Pin B right motor
 
-			constexpr auto cmPSToPerc = JAFDSettings::MotorControl::cmPSToPerc;		// Conversion factor from cm/s to motor PWM duty cycle
+			// Number type of the speed control (both jobs run in the interrupts)
+			typedef std::conditional<JAFDSettings::MotorControl::fixedPointControl, Fixed, float>::type Number;
+
+			constexpr Number cmPSToPerc = Number(JAFDSettings::MotorControl::cmPSToPerc);			// Conversion factor from cm/s to motor PWM duty cycle
+			constexpr Number minSpeed = Number(static_cast<float>(JAFDSettings::MotorControl::minSpeed));
+			constexpr Number initPWMReduction = Number(JAFDSettings::MotorControl::initPWMReduction);
+			constexpr Number pwmRedIIRFactor = Number(JAFDSettings::MotorControl::pwmRedIIRFactor);
+			constexpr Number minPWMForReduction = Number(0.2f);		// PWM reduction is only updated above this PWM value
+			constexpr Number motorVoltage = Number(JAFDSettings::MotorControl::motorVoltage);
 
 			constexpr uint8_t lPWMCh = PinMapping::getPWMChannel(lPWM);		// Left motor PWM channel
 			constexpr uint8_t rPWMCh = PinMapping::getPWMChannel(rPWM);		// Right motor PWM channel
@@ -58,36 +74,273 @@ namespace JAFD
 			constexpr uint8_t rVoltADCChA = PinMapping::getADCChannel(rVoltFbA);	// Right motor ADC channel for voltage measurement / A
 			constexpr uint8_t rVoltADCChB = PinMapping::getADCChannel(rVoltFbB);	// Right motor ADC channel for voltage measurement / B
 
-			PIDController leftPID(JAFDSettings::Controller::Motor::pidSettings);		// Left speed PID-Controller
-			PIDController rightPID(JAFDSettings::Controller::Motor::pidSettings);		// Right speed PID-Controller
+			constexpr uint8_t adcNumChannels = 6;		// Current and both voltage outputs of both motors
+			constexpr uint16_t adcHalfBufferSize = adcNumChannels * JAFDSettings::MotorControl::adcAveragedSequences;
+
+			// Free running conversions of all channels are written by the PDC - while it fills one half, the other one is averaged
+			uint16_t _adcBuffer[2][adcHalfBufferSize];		// Channel number in bit 12 - 15 (tag), value in bit 0 - 11
+			uint8_t _adcReadBuffer = 0;						// Half that is averaged next
+			volatile uint16_t _adcValues[16];				// Average of the last half for every channel
+			volatile uint16_t _adcHalves = 0;				// Number of averaged halves
+
+			BasicPIDController<Number> leftPID(JAFDSettings::Controller::Motor::pidSettings);		// Left speed PID-Controller
+			BasicPIDController<Number> rightPID(JAFDSettings::Controller::Motor::pidSettings);		// Right speed PID-Controller
+
+			BasicPIDController<Number> leftFFPID(JAFDSettings::Controller::Motor::ffPidSettingsLow);	// Correction of the left feedforward
+			BasicPIDController<Number> rightFFPID(JAFDSettings::Controller::Motor::ffPidSettingsLow);	// Correction of the right feedforward
+
+			// Gain schedule of the correction
+			constexpr Number scheduleLowSpeed = Number(JAFDSettings::Controller::Motor::scheduleLowSpeed);
+			constexpr Number scheduleSpeedRange = Number(JAFDSettings::Controller::Motor::scheduleHighSpeed - JAFDSettings::Controller::Motor::scheduleLowSpeed);
+			constexpr Number lowKp = Number(JAFDSettings::Controller::Motor::ffPidSettingsLow.kp);
+			constexpr Number lowKi = Number(JAFDSettings::Controller::Motor::ffPidSettingsLow.ki);
+			constexpr Number lowKd = Number(JAFDSettings::Controller::Motor::ffPidSettingsLow.kd);
+			constexpr Number highKp = Number(JAFDSettings::Controller::Motor::ffPidSettingsHigh.kp);
+			constexpr Number highKi = Number(JAFDSettings::Controller::Motor::ffPidSettingsHigh.ki);
+			constexpr Number highKd = Number(JAFDSettings::Controller::Motor::ffPidSettingsHigh.kd);
+
+			static_assert(JAFDSettings::Controller::Motor::scheduleHighSpeed > JAFDSettings::Controller::Motor::scheduleLowSpeed, "Speeds of the gain schedule are in the wrong order");
+
+			// Feedforward tables of the calibration block (drive for the speed i * step, before the PWM reduction)
+			Number _ffTables[2][Calibration::motorLUTSize];
+			Number _ffInvSteps[2];
+			volatile bool _ffValid = false;			// Tables of both motors are valid
+
+			// Open loop for characterize() - same duty cycle for both motors without PWM reduction
+			volatile bool _openLoop = false;
+			volatile float _openLoopDuty = 0.0f;	// Forward > 0
+
+			volatile int32_t lEncCnt = 0;		// Encoder count left motor (only without quadrature decoder)
+			volatile int32_t rEncCnt = 0;		// Encoder count right motor (only without quadrature decoder)
+
+			constexpr uint8_t qdecCountsPerPulse = 4;	// The quadrature decoder counts all edges of A and B; the software only rising edges of A
+
+			constexpr float lCountsPerRev = JAFDSettings::MotorControl::pulsePerRev * (JAFDSettings::MotorControl::Left::useQDEC ? qdecCountsPerPulse : 1);	// Encoder counts per revolution left motor
+			constexpr float rCountsPerRev = JAFDSettings::MotorControl::pulsePerRev * (JAFDSettings::MotorControl::Right::useQDEC ? qdecCountsPerPulse : 1);	// Encoder counts per revolution right motor
+
+			// Distance per encoder count (cm) - too small for Q16.16, so the fixed point speed is calculated with 32 fractional bits
+			constexpr float lCmPerCount = JAFDSettings::Mechanics::wheelDiameter * PI / lCountsPerRev;
+			constexpr float rCmPerCount = JAFDSettings::Mechanics::wheelDiameter * PI / rCountsPerRev;
+			constexpr int64_t lCmPerCountQ32 = static_cast<int64_t>(lCmPerCount * 4294967296.0f);
+			constexpr int64_t rCmPerCountQ32 = static_cast<int64_t>(rCmPerCount * 4294967296.0f);
+
+			// Speed (cm/s) from counts per second
+			inline void toSpeed(float& speed, const int32_t countsPerSec, const float cmPerCount, const int64_t cmPerCountQ32)
+			{
+				speed = countsPerSec * cmPerCount;
+			}
+
+			inline void toSpeed(Fixed& speed, const int32_t countsPerSec, const float cmPerCount, const int64_t cmPerCountQ32)
+			{
+				speed = Fixed::fromRaw(static_cast<int32_t>((countsPerSec * cmPerCountQ32) >> 16));
+			}
+
+			// Can the pin be a phase input of a quadrature decoder? (Only channel 0 of TC0 and TC2 - TIOA0/TIOB0 and TIOA6/TIOB6)
+			constexpr bool isQDECPin(const PinMapping::PinInformation pin)
+			{
+				return pin.tcChannel == PinMapping::TCChannel::tc0ChA0 || pin.tcChannel == PinMapping::TCChannel::tc0ChB0 ||
+					pin.tcChannel == PinMapping::TCChannel::tc2ChA6 || pin.tcChannel == PinMapping::TCChannel::tc2ChB6;
+			}
+
+			// Are both encoder pins connected to the same quadrature decoder?
+			constexpr bool isQDECCapable(const PinMapping::PinInformation encA, const PinMapping::PinInformation encB)
+			{
+				return isQDECPin(encA) && isQDECPin(encB) && PinMapping::getTCChannel(encA) == PinMapping::getTCChannel(encB) && encA.tcChannel != encB.tcChannel;
+			}
+
+			static_assert(!JAFDSettings::MotorControl::Left::useQDEC || isQDECCapable(lEncA, lEncB), "Encoder pins of left motor are not connected to a quadrature decoder");
+			static_assert(!JAFDSettings::MotorControl::Right::useQDEC || isQDECCapable(rEncA, rEncB), "Encoder pins of right motor are not connected to a quadrature decoder");
 
-			volatile int32_t lEncCnt = 0;		// Encoder count left motor
-			volatile int32_t rEncCnt = 0;		// Encoder count right motor
+			// Timer counter block of the quadrature decoder
+			Tc* getQDECTc(const PinMapping::PinInformation encA)
+			{
+				return PinMapping::getTCChannel(encA) == 0 ? TC0 : TC2;
+			}
+
+			// Setup quadrature decoder (channel 0 of the timer counter block counts the position)
+			void setupQDEC(const PinMapping::PinInformation encA, const PinMapping::PinInformation encB)
+			{
+				Tc* const tc = getQDECTc(encA);
+
+				// Give pins to the timer counter
+				encA.port->PIO_PUER = encA.pin;
+				encA.port->PIO_PDR = encA.pin;
+
+				if (PinMapping::toABPeripheral(encA)) encA.port->PIO_ABSR |= encA.pin;
+				else encA.port->PIO_ABSR &= ~encA.pin;
+
+				encB.port->PIO_PUER = encB.pin;
+				encB.port->PIO_PDR = encB.pin;
+
+				if (PinMapping::toABPeripheral(encB)) encB.port->PIO_ABSR |= encB.pin;
+				else encB.port->PIO_ABSR &= ~encB.pin;
+
+				// Enable clock of channel 0
+				if (PinMapping::getTCChannel(encA) == 0) PMC->PMC_PCER0 = 1 << ID_TC0;
+				else PMC->PMC_PCER1 = 1 << (ID_TC6 - 32);
+
+				// Phase A has to be the TIOA input - if encoder A is connected to TIOB, swap the phases
+				// Counts up if A leads B (same as the software decoder)
+				tc->TC_BMR = TC_BMR_QDEN | TC_BMR_POSEN | TC_BMR_FILTER | TC_BMR_MAXFILT(JAFDSettings::MotorControl::qdecFilter) |
+					((static_cast<uint8_t>(encA.tcChannel) % 2 == 1) ? TC_BMR_SWAP : 0);
+
+				tc->TC_CHANNEL[0].TC_CMR = TC_CMR_TCCLKS_XC0;
+				tc->TC_CHANNEL[0].TC_CCR = TC_CCR_CLKEN | TC_CCR_SWTRG;
+			}
+
+			// Get encoder count (see lCountsPerRev / rCountsPerRev)
+			int32_t getEncoderCount(const Motor motor)
+			{
+				if (motor == Motor::left)
+				{
+					if (JAFDSettings::MotorControl::Left::useQDEC) return static_cast<int32_t>(getQDECTc(lEncA)->TC_CHANNEL[0].TC_CV);
+					else return lEncCnt;
+				}
+				else
+				{
+					if (JAFDSettings::MotorControl::Right::useQDEC) return static_cast<int32_t>(getQDECTc(rEncA)->TC_CHANNEL[0].TC_CV);
+					else return rEncCnt;
+				}
+			}
 
 			volatile FloatWheelSpeeds speeds = FloatWheelSpeeds { 0.0f, 0.0f };		// Current motor speeds (cm/s)
+			Number leftSpeed = Number();			// Current motor speeds for the PID-Loop (same priority as calcMotorSpeed())
+			Number rightSpeed = Number();
 
 			volatile WheelSpeeds desSpeeds = WheelSpeeds{ 0.0f, 0.0f };				// Desired motor speed (cm/s)
 
-			// Get output voltage of motor
-			float getVoltage(const Motor motor)
+			// Voltage at the ADC pin
+			inline float toADCVoltage(const uint16_t value)
 			{
-				// Wait for end of conversion
-				while (!(ADC->ADC_ISR & ADC_ISR_DRDY));
+				return value * 3.3f / ((1 << 12) - 1);
+			}
 
-				if (motor == Motor::left)
+			// Motor voltage per ADC count of the voltage feedback (V) - with 32 fractional bits for the fixed point voltage like the speed
+			constexpr float voltsPerCount = 3.3f / ((1 << 12) - 1) * JAFDSettings::MotorControl::voltageSensFactor;
+			constexpr int64_t voltsPerCountQ32 = static_cast<int64_t>(voltsPerCount * 4294967296.0f);
+
+			// Motor voltage (V) from the difference of the ADC counts of both feedback outputs
+			inline void toVoltage(float& voltage, const int32_t counts)
+			{
+				voltage = counts * voltsPerCount;
+			}
+
+			inline void toVoltage(Fixed& voltage, const int32_t counts)
+			{
+				voltage = Fixed::fromRaw(static_cast<int32_t>((counts * voltsPerCountQ32) >> 16));
+			}
+
+			// Take over the feedforward tables of the calibration block
+			void loadFeedforward()
+			{
+				const auto& calib = Calibration::getData().motors;
+
+				_ffValid = false;
+
+				for (uint8_t m = 0; m < 2; m++)
 				{
-					float voltA = ADC->ADC_CDR[lVoltADCChA] * 3.3f / ((1 << 12) - 1) * JAFDSettings::MotorControl::voltageSensFactor;
-					float voltB = ADC->ADC_CDR[lVoltADCChB] * 3.3f / ((1 << 12) - 1) * JAFDSettings::MotorControl::voltageSensFactor;
+					if (!calib[m].valid || calib[m].speedStep <= 0.0f) return;
+
+					for (uint8_t i = 0; i < Calibration::motorLUTSize; i++) _ffTables[m][i] = Number(calib[m].drive[i]);
+
+					_ffInvSteps[m] = Number(1.0f / calib[m].speedStep);
+				}
+
+				leftFFPID.reset();
+				rightFFPID.reset();
+
+				_ffValid = true;
+			}
+
+			// Drive of a motor for a speed (cm/s) - linear between the points of the table, the last segment is extrapolated
+			Number getFeedforward(const uint8_t motor, const Number speed)
+			{
+				const Number x = absolute(speed) * _ffInvSteps[motor];
+				const int32_t i = std::min(toInt(x), static_cast<int32_t>(Calibration::motorLUTSize - 2));
+				const Number* table = _ffTables[motor];
+
+				const Number drive = table[i] + (table[i + 1] - table[i]) * (x - Number(i));
 
-					return fabsf(voltA - voltB);
+				return (speed < Number()) ? -drive : drive;
+			}
+
+			// Gains of the correction for a desired speed
+			void scheduleGains(BasicPIDController<Number>& pid, const Number desSpeed)
+			{
+				Number t = (absolute(desSpeed) - scheduleLowSpeed) / scheduleSpeedRange;
+
+				if (t < Number()) t = Number();
+				else if (t > Number(1)) t = Number(1);
+
+				pid.setGains(lowKp + (highKp - lowKp) * t, lowKi + (highKi - lowKi) * t, lowKd + (highKd - lowKd) * t);
+			}
+
+			// Drive of one motor before the PWM reduction: feedforward + scheduled correction, or only the PID without tables
+			Number controlSpeed(BasicPIDController<Number>& pid, BasicPIDController<Number>& ffPID, const uint8_t motor, const Telemetry::PIDID id, const int16_t desSpeedInt, const Number speed, const Number dt, const bool logTerms)
+			{
+				// When speed isn't 0, do PID controller
+				if (desSpeedInt == 0)
+				{
+					pid.reset();
+					ffPID.reset();
+					return Number();
+				}
+
+				const Number desSpeed = Number(static_cast<int32_t>(desSpeedInt));
+				Number set;
+
+				if (_ffValid)
+				{
+					scheduleGains(ffPID, desSpeed);
+
+					const Number correction = ffPID.process(desSpeed, speed, dt);
+
+					if (logTerms) Telemetry::logPID(id, toFloat(desSpeed), toFloat(speed), ffPID.getLastTerms(), toFloat(correction));
+
+					set = getFeedforward(motor, desSpeed) + correction * cmPSToPerc;
 				}
 				else
 				{
-					float voltA = ADC->ADC_CDR[rVoltADCChA] * 3.3f / (1 << 12 - 1) * JAFDSettings::MotorControl::voltageSensFactor;
-					float voltB = ADC->ADC_CDR[rVoltADCChB] * 3.3f / (1 << 12 - 1) * JAFDSettings::MotorControl::voltageSensFactor;
+					set = pid.process(desSpeed, speed, dt);
 
-					return fabsf(voltA - voltB);
+					if (logTerms) Telemetry::logPID(id, toFloat(desSpeed), toFloat(speed), pid.getLastTerms(), toFloat(set));
+
+					if (set < minSpeed && set > -minSpeed) set = (desSpeedInt < 0) ? -minSpeed : minSpeed;
+
+					set *= cmPSToPerc;
 				}
+
+				if (set >= Number(1)) set = Number(1);
+				else if (set <= Number(-1)) set = Number(-1);
+
+				return set;
+			}
+
+			// Get output voltage of motor (last average - doesn't wait)
+			float getVoltage(const Motor motor)
+			{
+				if (motor == Motor::left)
+				{
+					return fabsf(toADCVoltage(_adcValues[lVoltADCChA]) - toADCVoltage(_adcValues[lVoltADCChB])) * JAFDSettings::MotorControl::voltageSensFactor;
+				}
+				else
+				{
+					return fabsf(toADCVoltage(_adcValues[rVoltADCChA]) - toADCVoltage(_adcValues[rVoltADCChB])) * JAFDSettings::MotorControl::voltageSensFactor;
+				}
+			}
+
+			// Output voltage of motor in the number type of the speed control - from the raw ADC counts without float
+			Number getControlVoltage(const Motor motor)
+			{
+				Number voltage;
+				int32_t counts;
+
+				if (motor == Motor::left) counts = static_cast<int32_t>(_adcValues[lVoltADCChA]) - static_cast<int32_t>(_adcValues[lVoltADCChB]);
+				else counts = static_cast<int32_t>(_adcValues[rVoltADCChA]) - static_cast<int32_t>(_adcValues[rVoltADCChB]);
+
+				toVoltage(voltage, abs(counts));
+
+				return voltage;
 			}
 		}
 
@@ -97,7 +350,7 @@ namespace JAFD
 			if (!PinMapping::hasPWM(lPWM) || !PinMapping::hasPWM(rPWM) ||
 				!PinMapping::hasADC(lCurFb) || !PinMapping::hasADC(rCurFb) ||
 				!PinMapping::hasADC(lVoltFbA) || !PinMapping::hasADC(lVoltFbB) ||
-				!PinMapping::hasADC(lVoltFbA) || !PinMapping::hasADC(lVoltFbB))
+				!PinMapping::hasADC(rVoltFbA) || !PinMapping::hasADC(rVoltFbB))
 			{
 				return ReturnCode::fatalError;
 			}
@@ -123,45 +376,60 @@ namespace JAFD
 			rInB.port->PIO_OER = rInB.pin;
 			rInB.port->PIO_CODR = rInB.pin;
 
-			// Left Encoder A
-			lEncA.port->PIO_PER = lEncA.pin;
-			lEncA.port->PIO_ODR = lEncA.pin;
-			lEncA.port->PIO_PUER = lEncA.pin;
-			lEncA.port->PIO_IER = lEncA.pin;
-			lEncA.port->PIO_AIMER = lEncA.pin;
-			lEncA.port->PIO_ESR = lEncA.pin;
-			lEncA.port->PIO_REHLSR = lEncA.pin;
-			lEncA.port->PIO_DIFSR = lEncA.pin;
-			lEncA.port->PIO_SCDR = PIO_SCDR_DIV(0);
-			lEncA.port->PIO_IFER = lEncA.pin;
-
-			// Left Encoder B
-			lEncB.port->PIO_PER = lEncB.pin;
-			lEncB.port->PIO_ODR = lEncB.pin;
-			lEncB.port->PIO_PUER = lEncB.pin;
-			lEncB.port->PIO_DIFSR = lEncB.pin;
-			lEncB.port->PIO_SCDR = PIO_SCDR_DIV(0);
-			lEncB.port->PIO_IFER = lEncB.pin;
-
-			// Right Encoder A
-			rEncA.port->PIO_PER = rEncA.pin;
-			rEncA.port->PIO_ODR = rEncA.pin;
-			rEncA.port->PIO_PUER = rEncA.pin;
-			rEncA.port->PIO_IER = rEncA.pin;
-			rEncA.port->PIO_AIMER = rEncA.pin;
-			rEncA.port->PIO_ESR = rEncA.pin;
-			rEncA.port->PIO_REHLSR = rEncA.pin;
-			rEncA.port->PIO_DIFSR = rEncA.pin;
-			rEncA.port->PIO_SCDR = PIO_SCDR_DIV(0);
-			rEncA.port->PIO_IFER = rEncA.pin;
-
-			// Right Encoder B
-			rEncB.port->PIO_PER = rEncB.pin;
-			rEncB.port->PIO_ODR = rEncB.pin;
-			rEncB.port->PIO_PUER = rEncB.pin;
-			rEncB.port->PIO_DIFSR = rEncB.pin;
-			rEncB.port->PIO_SCDR = PIO_SCDR_DIV(0);
-			rEncB.port->PIO_IFER = rEncB.pin;
+			// Encoders - hardware quadrature decoder or software decoding with interrupts on rising edges of A
+			if (JAFDSettings::MotorControl::Left::useQDEC)
+			{
+				setupQDEC(lEncA, lEncB);
+			}
+			else
+			{
+				// Left Encoder A
+				lEncA.port->PIO_PER = lEncA.pin;
+				lEncA.port->PIO_ODR = lEncA.pin;
+				lEncA.port->PIO_PUER = lEncA.pin;
+				lEncA.port->PIO_IER = lEncA.pin;
+				lEncA.port->PIO_AIMER = lEncA.pin;
+				lEncA.port->PIO_ESR = lEncA.pin;
+				lEncA.port->PIO_REHLSR = lEncA.pin;
+				lEncA.port->PIO_DIFSR = lEncA.pin;
+				lEncA.port->PIO_SCDR = PIO_SCDR_DIV(0);
+				lEncA.port->PIO_IFER = lEncA.pin;
+
+				// Left Encoder B
+				lEncB.port->PIO_PER = lEncB.pin;
+				lEncB.port->PIO_ODR = lEncB.pin;
+				lEncB.port->PIO_PUER = lEncB.pin;
+				lEncB.port->PIO_DIFSR = lEncB.pin;
+				lEncB.port->PIO_SCDR = PIO_SCDR_DIV(0);
+				lEncB.port->PIO_IFER = lEncB.pin;
+			}
+
+			if (JAFDSettings::MotorControl::Right::useQDEC)
+			{
+				setupQDEC(rEncA, rEncB);
+			}
+			else
+			{
+				// Right Encoder A
+				rEncA.port->PIO_PER = rEncA.pin;
+				rEncA.port->PIO_ODR = rEncA.pin;
+				rEncA.port->PIO_PUER = rEncA.pin;
+				rEncA.port->PIO_IER = rEncA.pin;
+				rEncA.port->PIO_AIMER = rEncA.pin;
+				rEncA.port->PIO_ESR = rEncA.pin;
+				rEncA.port->PIO_REHLSR = rEncA.pin;
+				rEncA.port->PIO_DIFSR = rEncA.pin;
+				rEncA.port->PIO_SCDR = PIO_SCDR_DIV(0);
+				rEncA.port->PIO_IFER = rEncA.pin;
+
+				// Right Encoder B
+				rEncB.port->PIO_PER = rEncB.pin;
+				rEncB.port->PIO_ODR = rEncB.pin;
+				rEncB.port->PIO_PUER = rEncB.pin;
+				rEncB.port->PIO_DIFSR = rEncB.pin;
+				rEncB.port->PIO_SCDR = PIO_SCDR_DIV(0);
+				rEncB.port->PIO_IFER = rEncB.pin;
+			}
 
 			// Setup PWM - Controller (20kHz)
 			PWM->PWM_ENA = 1 << lPWMCh | 1 << rPWMCh;
@@ -205,85 +473,148 @@ namespace JAFD
 				rPWM.port->PIO_ABSR &= ~rPWM.pin;
 			}
 
-			// Setup ADC (Freerunning mode / 21MHz); No Gain and Offset
+			// Setup ADC (Freerunning mode / MCK / ((adcPrescaler + 1) * 2)); No Gain and Offset
 			PMC->PMC_PCER1 = PMC_PCER1_PID37;
 
-			ADC->ADC_MR = ADC_MR_FREERUN_ON | ADC_MR_PRESCAL(3) | ADC_MR_STARTUP_SUT896 | ADC_MR_SETTLING_AST5 | ADC_MR_TRACKTIM(0) | ADC_MR_TRANSFER(1);
+			ADC->ADC_CR = ADC_CR_SWRST;
+			ADC->ADC_MR = ADC_MR_FREERUN_ON | ADC_MR_PRESCAL(JAFDSettings::MotorControl::adcPrescaler) | ADC_MR_STARTUP_SUT896 | ADC_MR_SETTLING_AST5 | ADC_MR_TRACKTIM(0) | ADC_MR_TRANSFER(1);
+			ADC->ADC_EMR = ADC_EMR_TAG;
 			ADC->ADC_CHER = 1 << lCurADCCh | 1 << rCurADCCh | 1 << lVoltADCChA | 1 << rVoltADCChA | 1 << lVoltADCChB | 1 << rVoltADCChB;
 
+			// Conversions by the PDC into both halves of the buffer
+			ADC->ADC_PTCR = ADC_PTCR_RXTDIS;
+			ADC->ADC_RPR = reinterpret_cast<uint32_t>(_adcBuffer[0]);
+			ADC->ADC_RCR = adcHalfBufferSize;
+			ADC->ADC_RNPR = reinterpret_cast<uint32_t>(_adcBuffer[1]);
+			ADC->ADC_RNCR = adcHalfBufferSize;
+			ADC->ADC_PTCR = ADC_PTCR_RXTEN;
+
+			_adcReadBuffer = 0;
+			_adcHalves = 0;
+
+			ADC->ADC_IDR = 0xffffffff;
+			ADC->ADC_IER = ADC_IER_ENDRX;
+
+			NVIC_ClearPendingIRQ(ADC_IRQn);
+			NVIC_SetPriority(ADC_IRQn, 1);
+			NVIC_EnableIRQ(ADC_IRQn);
+
+			ADC->ADC_CR = ADC_CR_START;
+
+			MemWatcher::addBuffer("motorADC", sizeof(_adcBuffer));
+
+			loadFeedforward();
+
+			// The speed PID needs the voltages from the beginning
+			const uint32_t startTime = millis();
+
+			while (_adcHalves == 0)
+			{
+				if (millis() - startTime > JAFDSettings::MotorControl::adcTimeout) return ReturnCode::fatalError;
+			}
+
 			return ReturnCode::ok;
 		}
 
+		void adcInterrupt()
+		{
+			// The PDC has finished one half and moved on to the other one
+			if (!(ADC->ADC_ISR & ADC_ISR_ENDRX)) return;
+
+			uint32_t sums[16] = { 0 };
+			uint16_t counts[16] = { 0 };
+
+			const uint16_t* buffer = _adcBuffer[_adcReadBuffer];
+
+			for (uint16_t i = 0; i < adcHalfBufferSize; i++)
+			{
+				const uint8_t channel = buffer[i] >> 12;
+
+				sums[channel] += buffer[i] & 0xfff;
+				counts[channel]++;
+			}
+
+			for (uint8_t channel = 0; channel < 16; channel++)
+			{
+				if (counts[channel] > 0) _adcValues[channel] = sums[channel] / counts[channel];
+			}
+
+			// Give the averaged half back to the PDC (clears ENDRX)
+			ADC->ADC_RNPR = reinterpret_cast<uint32_t>(buffer);
+			ADC->ADC_RNCR = adcHalfBufferSize;
+
+			_adcReadBuffer ^= 1;
+			_adcHalves++;
+		}
+
 		void calcMotorSpeed(const uint8_t freq)
 		{
 			static int32_t lastLeftCnt = 0;
 			static int32_t lastRightCnt = 0;
 
+			const int32_t leftCnt = getEncoderCount(Motor::left);
+			const int32_t rightCnt = getEncoderCount(Motor::right);
+
 			// Calculate speeds
-			speeds.left = ((lEncCnt - lastLeftCnt) / (JAFDSettings::MotorControl::pulsePerRev) * JAFDSettings::Mechanics::wheelDiameter * PI * freq);
-			speeds.right = ((rEncCnt - lastRightCnt) / (JAFDSettings::MotorControl::pulsePerRev) * JAFDSettings::Mechanics::wheelDiameter * PI * freq);
+			toSpeed(leftSpeed, (leftCnt - lastLeftCnt) * freq, lCmPerCount, lCmPerCountQ32);
+			toSpeed(rightSpeed, (rightCnt - lastRightCnt) * freq, rCmPerCount, rCmPerCountQ32);
 
-			lastLeftCnt = lEncCnt;
-			lastRightCnt = rEncCnt;
+			speeds.left = toFloat(leftSpeed);
+			speeds.right = toFloat(rightSpeed);
+
+			lastLeftCnt = leftCnt;
+			lastRightCnt = rightCnt;
 		}
 
 		void speedPID(const uint8_t freq)
 		{
-			FloatWheelSpeeds setSpeed;	// Speed calculated by PID
+			const Number dt = Number(1) / Number(static_cast<int32_t>(freq));
 
-			static FloatWheelSpeeds lastPWMVal = FloatWheelSpeeds { 0.0f, 0.0f };	// Last PWM values
-			static float leftPWMReduction = JAFDSettings::MotorControl::initPWMReduction;	// PWM reduction to prevent overvoltage
-			static float rightPWMReduction = JAFDSettings::MotorControl::initPWMReduction;	// PWM reduction to prevent overvoltage
+			Number leftSet;		// Speed calculated by PID
+			Number rightSet;
 
-			// Update PWM reduction factor with IIR
-			if (lastPWMVal.left > 0.2)
+			static Number lastLeftPWM = Number();						// Last PWM values
+			static Number lastRightPWM = Number();
+			static Number leftPWMReduction = initPWMReduction;			// PWM reduction to prevent overvoltage
+			static Number rightPWMReduction = initPWMReduction;			// PWM reduction to prevent overvoltage
+			static uint8_t pidLogTicks = 0;								// Ticks since the PID terms were logged
+
+			bool logTerms = false;
+
+			if (JAFDSettings::Telemetry::pidLogDivider > 0 && ++pidLogTicks >= JAFDSettings::Telemetry::pidLogDivider)
 			{
-				leftPWMReduction = JAFDSettings::MotorControl::pwmRedIIRFactor * (lastPWMVal.left * 6.0f / getVoltage(Motor::left)) + (1 - JAFDSettings::MotorControl::pwmRedIIRFactor) * leftPWMReduction;
+				pidLogTicks = 0;
+				logTerms = true;
 			}
 
-			if (lastPWMVal.right > 0.2)
+			// Update PWM reduction factor with IIR
+			if (lastLeftPWM > minPWMForReduction)
 			{
-				rightPWMReduction = JAFDSettings::MotorControl::pwmRedIIRFactor * (lastPWMVal.right * 6.0f / getVoltage(Motor::right)) + (1 - JAFDSettings::MotorControl::pwmRedIIRFactor) * rightPWMReduction;
+				leftPWMReduction = pwmRedIIRFactor * (lastLeftPWM * motorVoltage / getControlVoltage(Motor::left)) + (Number(1) - pwmRedIIRFactor) * leftPWMReduction;
 			}
 
-			if (leftPWMReduction > 2.0f * JAFDSettings::MotorControl::initPWMReduction) leftPWMReduction = JAFDSettings::MotorControl::initPWMReduction;
-			if (rightPWMReduction > 2.0f * JAFDSettings::MotorControl::initPWMReduction) rightPWMReduction = JAFDSettings::MotorControl::initPWMReduction;
-
-			// When speed isn't 0, do PID controller
-			if (desSpeeds.left == 0)
+			if (lastRightPWM > minPWMForReduction)
 			{
-				leftPID.reset();
-				setSpeed.left = 0.0f;
+				rightPWMReduction = pwmRedIIRFactor * (lastRightPWM * motorVoltage / getControlVoltage(Motor::right)) + (Number(1) - pwmRedIIRFactor) * rightPWMReduction;
 			}
-			else
-			{
-				setSpeed.left = leftPID.process(desSpeeds.left, speeds.left, 1.0f / freq);
-
-				if (setSpeed.left < JAFDSettings::MotorControl::minSpeed && setSpeed.left > -JAFDSettings::MotorControl::minSpeed) setSpeed.left = JAFDSettings::MotorControl::minSpeed * sgn(desSpeeds.left);
-				
-				setSpeed.left *= cmPSToPerc;
 
-				if (setSpeed.left >= 1.0f) setSpeed.left = 1.0f;
-			}
+			if (leftPWMReduction > initPWMReduction * 2) leftPWMReduction = initPWMReduction;
+			if (rightPWMReduction > initPWMReduction * 2) rightPWMReduction = initPWMReduction;
 
-			if (desSpeeds.right == 0)
+			if (_openLoop)
 			{
-				rightPID.reset();
-				setSpeed.right = 0.0f;
+				// The right motor is mounted the other way round
+				leftSet = Number(_openLoopDuty);
+				rightSet = -leftSet;
 			}
 			else
 			{
-				setSpeed.right = rightPID.process(desSpeeds.right, speeds.right, 1.0f / freq);
-
-				if (setSpeed.right < JAFDSettings::MotorControl::minSpeed && setSpeed.right > -JAFDSettings::MotorControl::minSpeed) setSpeed.right = JAFDSettings::MotorControl::minSpeed * sgn(desSpeeds.right);
-			
-				setSpeed.right *= cmPSToPerc;
-
-				if (setSpeed.right >= 1.0f) setSpeed.right = 1.0f;
+				leftSet = controlSpeed(leftPID, leftFFPID, 0, Telemetry::PIDID::leftMotor, desSpeeds.left, leftSpeed, dt, logTerms);
+				rightSet = controlSpeed(rightPID, rightFFPID, 1, Telemetry::PIDID::rightMotor, desSpeeds.right, rightSpeed, dt, logTerms);
 			}
 
 			// Set driection of left motor
-			if (setSpeed.left < 0.0f)
+			if (leftSet < Number())
 			{
 				lInA.port->PIO_SODR = lInA.pin;
 				lInB.port->PIO_CODR = lInB.pin;
@@ -295,7 +626,7 @@ namespace JAFD
 			}
 
 			// Set driection of left motor
-			if (setSpeed.right < 0.0f)
+			if (rightSet < Number())
 			{
 				rInA.port->PIO_SODR = rInA.pin;
 				rInB.port->PIO_CODR = rInB.pin;
@@ -307,15 +638,19 @@ namespace JAFD
 			}
 
 			// Reduce PWM values
-			setSpeed.left *= leftPWMReduction;
-			setSpeed.right *= rightPWMReduction;
+			if (!_openLoop)
+			{
+				leftSet *= leftPWMReduction;
+				rightSet *= rightPWMReduction;
+			}
 
 			// Update last PWM values
-			lastPWMVal = setSpeed;
+			lastLeftPWM = leftSet;
+			lastRightPWM = rightSet;
 
 			// Set PWM Value
-			PWM->PWM_CH_NUM[lPWMCh].PWM_CDTYUPD = (PWM->PWM_CH_NUM[lPWMCh].PWM_CPRD * fabsf(setSpeed.left));
-			PWM->PWM_CH_NUM[rPWMCh].PWM_CDTYUPD = (PWM->PWM_CH_NUM[rPWMCh].PWM_CPRD * fabsf(setSpeed.right));
+			PWM->PWM_CH_NUM[lPWMCh].PWM_CDTYUPD = toInt(absolute(leftSet) * static_cast<int32_t>(PWM->PWM_CH_NUM[lPWMCh].PWM_CPRD));
+			PWM->PWM_CH_NUM[rPWMCh].PWM_CDTYUPD = toInt(absolute(rightSet) * static_cast<int32_t>(PWM->PWM_CH_NUM[rPWMCh].PWM_CPRD));
 			PWM->PWM_SCUC = PWM_SCUC_UPDULOCK;
 		}
 
@@ -333,17 +668,18 @@ namespace JAFD
 		{
 			if (motor == Motor::left)
 			{
-				return lEncCnt / JAFDSettings::MotorControl::pulsePerRev * JAFDSettings::Mechanics::wheelDiameter * PI;
+				return getEncoderCount(Motor::left) / lCountsPerRev * JAFDSettings::Mechanics::wheelDiameter * PI;
 			}
 			else
 			{
-				return rEncCnt / JAFDSettings::MotorControl::pulsePerRev * JAFDSettings::Mechanics::wheelDiameter * PI * -1;
+				return getEncoderCount(Motor::right) / rCountsPerRev * JAFDSettings::Mechanics::wheelDiameter * PI * -1;
 			}
 		}
 
 		void encoderInterrupt(const Interrupts::InterruptSource source, const uint32_t isr)
 		{
-			if (lEncA.portID == static_cast<uint8_t>(source) && (isr & lEncA.pin))
+			// Only without quadrature decoder
+			if (!JAFDSettings::MotorControl::Left::useQDEC && lEncA.portID == static_cast<uint8_t>(source) && (isr & lEncA.pin))
 			{
 				if (lEncB.port->PIO_PDSR & lEncB.pin)
 				{
@@ -355,7 +691,7 @@ namespace JAFD
 				}
 			}
 			
-			if (rEncA.portID == static_cast<uint8_t>(source) && (isr & rEncA.pin))
+			if (!JAFDSettings::MotorControl::Right::useQDEC && rEncA.portID == static_cast<uint8_t>(source) && (isr & rEncA.pin))
 			{
 				if (rEncB.port->PIO_PDSR & rEncB.pin)
 				{
@@ -380,25 +716,138 @@ namespace JAFD
 
 		float getCurrent(const Motor motor)
 		{
-			float result = 0.0f;
+			return toADCVoltage(_adcValues[(motor == Motor::left) ? lCurADCCh : rCurADCCh]) * JAFDSettings::MotorControl::currentSensFactor;
+		}
+
+		ReturnCode characterize()
+		{
+			namespace Settings = JAFDSettings::MotorControl::Characterization;
+
+			float speeds[2][Settings::numSteps];		// Average absolute speed of both directions (cm/s)
+			float drives[2][Settings::numSteps];		// Average voltage as share of the motor voltage
+
+			setSpeeds(WheelSpeeds{ 0, 0 });
 
-			// Sample values and return average
-			for (uint8_t i = 0; i < JAFDSettings::MotorControl::currentADCSampleCount; i++)
+			_openLoop = true;
+
+			for (uint8_t step = 0; step < Settings::numSteps; step++)
 			{
-				// Wait for end of conversion
-				while (!(ADC->ADC_ISR & ADC_ISR_DRDY));
+				const float duty = Settings::minDuty + (Settings::maxDuty - Settings::minDuty) * step / (Settings::numSteps - 1);
 
-				if (motor == Motor::left)
+				float speedSums[2] = { 0.0f, 0.0f };
+				float driveSums[2] = { 0.0f, 0.0f };
+				uint16_t numSamples = 0;
+
+				// Forward and the same way back
+				for (int8_t dir = 1; dir >= -1; dir -= 2)
 				{
-					result += ADC->ADC_CDR[lCurADCCh] * 3.3f / (1 << 12 - 1) * JAFDSettings::MotorControl::currentSensFactor;
+					_openLoopDuty = dir * duty;
+
+					delay(Settings::settleTime);
+
+					const uint32_t start = millis();
+
+					while (millis() - start < Settings::sampleTime)
+					{
+						const FloatWheelSpeeds wheelSpeeds = getFloatSpeeds();
+
+						speedSums[0] += fabsf(wheelSpeeds.left);
+						speedSums[1] += fabsf(wheelSpeeds.right);
+						driveSums[0] += getVoltage(Motor::left) / JAFDSettings::MotorControl::motorVoltage;
+						driveSums[1] += getVoltage(Motor::right) / JAFDSettings::MotorControl::motorVoltage;
+						numSamples++;
+
+						delay(Settings::sampleInterval);
+					}
+
+					_openLoopDuty = 0.0f;
+
+					delay(Settings::pauseTime);
 				}
-				else
+
+				for (uint8_t m = 0; m < 2; m++)
 				{
-					result += ADC->ADC_CDR[rCurADCCh] * 3.3f / (1 << 12 - 1) * JAFDSettings::MotorControl::currentSensFactor;
+					speeds[m][step] = speedSums[m] / numSamples;
+					drives[m][step] = driveSums[m] / numSamples;
 				}
 			}
 
-			return result / JAFDSettings::MotorControl::currentADCSampleCount;
+			_openLoop = false;
+
+			Calibration::MotorCalib calib[2];		// Only stored if both motors succeed
+			ReturnCode code = ReturnCode::ok;
+
+			// Clears the padding for the CRC of the calibration block
+			memset(calib, 0, sizeof(calib));
+
+			for (uint8_t m = 0; m < 2; m++)
+			{
+				// Steps where the motor turned - the speed has to increase with the drive
+				uint8_t first = 0;
+
+				while (first < Settings::numSteps && speeds[m][first] < Settings::minSpeed) first++;
+
+				bool valid = Settings::numSteps - first >= 2;
+
+				for (uint8_t step = first + 1; valid && step < Settings::numSteps; step++)
+				{
+					if (speeds[m][step] <= speeds[m][step - 1]) valid = false;
+				}
+
+				Serial.print(m == 0 ? "Left motor" : "Right motor");
+
+				if (!valid)
+				{
+					Serial.println(": failed");
+
+					code = ReturnCode::error;
+					continue;
+				}
+
+				// Table up to the maximum speed - below the first step its drive, above the last step extrapolated
+				calib[m].speedStep = static_cast<float>(JAFDSettings::MotorControl::maxSpeed) / (Calibration::motorLUTSize - 1);
+				calib[m].valid = true;
+
+				uint8_t segment = first;
+
+				for (uint8_t i = 0; i < Calibration::motorLUTSize; i++)
+				{
+					const float speed = i * calib[m].speedStep;
+
+					while (segment + 2 < Settings::numSteps && speed > speeds[m][segment + 1]) segment++;
+
+					if (speed <= speeds[m][first])
+					{
+						calib[m].drive[i] = drives[m][first];
+					}
+					else
+					{
+						const float t = (speed - speeds[m][segment]) / (speeds[m][segment + 1] - speeds[m][segment]);
+
+						calib[m].drive[i] = drives[m][segment] + (drives[m][segment + 1] - drives[m][segment]) * t;
+					}
+				}
+
+				Serial.print(": speed / drive");
+
+				for (uint8_t step = first; step < Settings::numSteps; step++)
+				{
+					Serial.print(" ");
+					Serial.print(speeds[m][step], 1);
+					Serial.print(" / ");
+					Serial.print(drives[m][step], 3);
+				}
+
+				Serial.println();
+			}
+
+			if (code != ReturnCode::ok) return code;
+
+			memcpy(Calibration::getData().motors, calib, sizeof(calib));
+
+			loadFeedforward();
+
+			return Calibration::store();
 		}
 	}
 }
\ No newline at end of file
@@ -12,71 +12,78 @@ This part is responsible for a PID-Controller
 
 namespace JAFD
 {
-	PIDController::PIDController(const PIDSettings settings) : settings(settings), errorInt(0.0f), lastErr(0.0f), lastTimePoint(0.0f), firstCall(true) {}
-	
-	float PIDController::process(const float setPoint, const float currentValue)
+	template<typename Number>
+	BasicPIDController<Number>::BasicPIDController(const PIDSettings settings) : kp(settings.kp), ki(settings.ki), kd(settings.kd), maxAbsInt(settings.maxAbsInt), maxAbsDiff(settings.maxAbsDiff), minOutput(settings.minOutput), maxOutput(settings.maxOutput), errorInt(), lastErr(), lastTimePoint(0), firstCall(true), lastP(), lastI(), lastD() {}
+
+	template<typename Number>
+	Number BasicPIDController<Number>::process(const Number setPoint, const Number currentValue)
 	{
 		const uint32_t currentTime = millis();
-		const float dt = (currentTime - lastTimePoint) / 1000.0f;
+		const Number dt = Number(static_cast<int32_t>(currentTime - lastTimePoint)) / Number(1000);
 		lastTimePoint = currentTime;
 
-		const float error = setPoint - currentValue;
-		float diffTerm = (error - lastErr) / dt;
-
-		if (firstCall) diffTerm = 0.0f;
-		else if (diffTerm > settings.maxAbsDiff) diffTerm = settings.maxAbsDiff;
-		else if (diffTerm < -settings.maxAbsDiff) diffTerm = -settings.maxAbsDiff;
-
-		errorInt += lastErr * dt;
-
-		if (firstCall) errorInt = 0.0f;
-		else if (errorInt > settings.maxAbsInt) errorInt = settings.maxAbsInt;
-		else if (errorInt < -settings.maxAbsInt) errorInt = -settings.maxAbsInt;
-
-		lastErr = error;
-
-		if (firstCall) firstCall = false;
-
-		float output = settings.kp * error + settings.ki * errorInt + settings.kd * diffTerm;
-
-		if (output > settings.maxOutput) output = settings.maxOutput;
-		else if (output < settings.minOutput) output = settings.minOutput;
-
-		return output;
+		return process(setPoint, currentValue, dt);
 	}
 
-	float PIDController::process(const float setPoint, const float currentValue, const float dt)
+	template<typename Number>
+	Number BasicPIDController<Number>::process(const Number setPoint, const Number currentValue, const Number dt)
 	{
-		const float error = setPoint - currentValue;
-		float diffTerm = (error - lastErr) / dt;
+		const Number error = setPoint - currentValue;
+		Number diffTerm = (error - lastErr) / dt;
 
-		if (firstCall) diffTerm = 0.0f;
-		else if (diffTerm > settings.maxAbsDiff) diffTerm = settings.maxAbsDiff;
-		else if (diffTerm < -settings.maxAbsDiff) diffTerm = -settings.maxAbsDiff;
+		if (firstCall) diffTerm = Number();
+		else if (diffTerm > maxAbsDiff) diffTerm = maxAbsDiff;
+		else if (diffTerm < -maxAbsDiff) diffTerm = -maxAbsDiff;
 
 		errorInt += lastErr * dt;
 
-		if (firstCall) errorInt = 0.0f;
-		else if (errorInt > settings.maxAbsInt) errorInt = settings.maxAbsInt;
-		else if (errorInt < -settings.maxAbsInt) errorInt = -settings.maxAbsInt;
+		if (firstCall) errorInt = Number();
+		else if (errorInt > maxAbsInt) errorInt = maxAbsInt;
+		else if (errorInt < -maxAbsInt) errorInt = -maxAbsInt;
 
 		lastErr = error;
 
 		if (firstCall) firstCall = false;
 
-		float output = settings.kp * error + settings.ki * errorInt + settings.kd * diffTerm;
+		lastP = kp * error;
+		lastI = ki * errorInt;
+		lastD = kd * diffTerm;
+
+		Number output = lastP + lastI + lastD;
 
-		if (output > settings.maxOutput) output = settings.maxOutput;
-		else if (output < settings.minOutput) output = settings.minOutput;
+		if (output > maxOutput) output = maxOutput;
+		else if (output < minOutput) output = minOutput;
 
 		return output;
 	}
 
-	void PIDController::reset()
+	template<typename Number>
+	void BasicPIDController<Number>::reset()
 	{
-		errorInt = 0.0f;
-		lastErr = 0.0f;
+		errorInt = Number();
+		lastErr = Number();
 		lastTimePoint = 0;
 		firstCall = true;
+		lastP = Number();
+		lastI = Number();
+		lastD = Number();
+	}
+
+	template<typename Number>
+	void BasicPIDController<Number>::setGains(const Number kp, const Number ki, const Number kd)
+	{
+		this->kp = kp;
+		this->ki = ki;
+		this->kd = kd;
 	}
+
+	template<typename Number>
+	PIDTerms BasicPIDController<Number>::getLastTerms() const
+	{
+		return PIDTerms(toFloat(lastP), toFloat(lastI), toFloat(lastD));
+	}
+
+	// All used number types
+	template class BasicPIDController<float>;
+	template class BasicPIDController<Fixed>;
 }
\ No newline at end of file
@@ -0,0 +1,214 @@
+/*
+This private file of the library is responsible for the extended kalman filter estimating the robot pose
+*/
+
+#include "../header/PoseEKF.h"
+#include "../header/Math.h"
+#include "../../JAFDSettings.h"
+
+#include <math.h>
+
+namespace JAFD
+{
+	namespace PoseEKF
+	{
+		namespace
+		{
+			constexpr uint8_t stateSize = 5;
+
+			// Indices of the state vector
+			enum StateIndex : uint8_t
+			{
+				iX,
+				iY,
+				iHeading,
+				iVel,
+				iAngularVel
+			};
+
+			float _state[stateSize] = { 0.0f };		// State vector
+
+			// Covariance of the state
+			float _covariance[stateSize][stateSize] = {
+				{ JAFDSettings::PoseEKF::initialPosNoise * JAFDSettings::PoseEKF::initialPosNoise, 0.0f, 0.0f, 0.0f, 0.0f },
+				{ 0.0f, JAFDSettings::PoseEKF::initialPosNoise * JAFDSettings::PoseEKF::initialPosNoise, 0.0f, 0.0f, 0.0f },
+				{ 0.0f, 0.0f, JAFDSettings::PoseEKF::initialHeadingNoise * JAFDSettings::PoseEKF::initialHeadingNoise, 0.0f, 0.0f },
+				{ 0.0f, 0.0f, 0.0f, JAFDSettings::PoseEKF::initialVelNoise * JAFDSettings::PoseEKF::initialVelNoise, 0.0f },
+				{ 0.0f, 0.0f, 0.0f, 0.0f, JAFDSettings::PoseEKF::initialAngularVelNoise * JAFDSettings::PoseEKF::initialAngularVelNoise }
+			};
+
+			// result = a * b
+			template<uint8_t rows, uint8_t inner, uint8_t cols>
+			inline void multiply(const float (&a)[rows][inner], const float (&b)[inner][cols], float (&result)[rows][cols])
+			{
+				for (uint8_t r = 0; r < rows; r++)
+				{
+					for (uint8_t c = 0; c < cols; c++)
+					{
+						float sum = 0.0f;
+
+						for (uint8_t i = 0; i < inner; i++) sum += a[r][i] * b[i][c];
+
+						result[r][c] = sum;
+					}
+				}
+			}
+
+			// result = a * b^T
+			template<uint8_t rows, uint8_t inner, uint8_t cols>
+			inline void multiplyTransposed(const float (&a)[rows][inner], const float (&b)[cols][inner], float (&result)[rows][cols])
+			{
+				for (uint8_t r = 0; r < rows; r++)
+				{
+					for (uint8_t c = 0; c < cols; c++)
+					{
+						float sum = 0.0f;
+
+						for (uint8_t i = 0; i < inner; i++) sum += a[r][i] * b[c][i];
+
+						result[r][c] = sum;
+					}
+				}
+			}
+
+			// Update with a measurement of a single state variable (H = unit row vector)
+			// No matrix inversion needed - the innovation covariance is a scalar
+			ReturnCode scalarUpdate(const uint8_t index, const float residual, const float variance)
+			{
+				const float innovationVar = _covariance[index][index] + variance;
+
+				if (innovationVar <= 0.0f) return ReturnCode::error;
+
+				// Outlier rejection
+				if (residual * residual > JAFDSettings::PoseEKF::outlierGate * innovationVar) return ReturnCode::error;
+
+				float gain[stateSize];
+				float row[stateSize];
+
+				for (uint8_t i = 0; i < stateSize; i++)
+				{
+					gain[i] = _covariance[i][index] / innovationVar;
+					row[i] = _covariance[index][i];
+				}
+
+				for (uint8_t i = 0; i < stateSize; i++)
+				{
+					_state[i] += gain[i] * residual;
+				}
+
+				// P = (I - K * H) * P
+				for (uint8_t r = 0; r < stateSize; r++)
+				{
+					for (uint8_t c = 0; c < stateSize; c++)
+					{
+						_covariance[r][c] -= gain[r] * row[c];
+					}
+				}
+
+				return ReturnCode::ok;
+			}
+		}
+
+		void reset(const float x, const float y, const float heading)
+		{
+			_state[iX] = x;
+			_state[iY] = y;
+			_state[iHeading] = heading;
+
+			for (uint8_t r = 0; r < stateSize; r++)
+			{
+				for (uint8_t c = 0; c < stateSize; c++) _covariance[r][c] = 0.0f;
+			}
+
+			_covariance[iX][iX] = JAFDSettings::PoseEKF::initialPosNoise * JAFDSettings::PoseEKF::initialPosNoise;
+			_covariance[iY][iY] = JAFDSettings::PoseEKF::initialPosNoise * JAFDSettings::PoseEKF::initialPosNoise;
+			_covariance[iHeading][iHeading] = JAFDSettings::PoseEKF::initialHeadingNoise * JAFDSettings::PoseEKF::initialHeadingNoise;
+			_covariance[iVel][iVel] = JAFDSettings::PoseEKF::initialVelNoise * JAFDSettings::PoseEKF::initialVelNoise;
+			_covariance[iAngularVel][iAngularVel] = JAFDSettings::PoseEKF::initialAngularVelNoise * JAFDSettings::PoseEKF::initialAngularVelNoise;
+		}
+
+		void predict(const float dt, const float cosPitch)
+		{
+			float headingSin, headingCos;
+			fastSinCos(_state[iHeading], headingSin, headingCos);
+
+			const float planarVel = _state[iVel] * cosPitch;
+
+			// Jacobian of the motion model
+			const float jacobian[stateSize][stateSize] = {
+				{ 1.0f, 0.0f, -planarVel * headingSin * dt, cosPitch * headingCos * dt, 0.0f },
+				{ 0.0f, 1.0f, planarVel * headingCos * dt, cosPitch * headingSin * dt, 0.0f },
+				{ 0.0f, 0.0f, 1.0f, 0.0f, dt },
+				{ 0.0f, 0.0f, 0.0f, 1.0f, 0.0f },
+				{ 0.0f, 0.0f, 0.0f, 0.0f, 1.0f }
+			};
+
+			// Motion model
+			_state[iX] += planarVel * headingCos * dt;
+			_state[iY] += planarVel * headingSin * dt;
+			_state[iHeading] += _state[iAngularVel] * dt;
+
+			// P = F * P * F^T + Q
+			float temp[stateSize][stateSize];
+
+			multiply(jacobian, _covariance, temp);
+			multiplyTransposed(temp, jacobian, _covariance);
+
+			_covariance[iX][iX] += JAFDSettings::PoseEKF::posNoise * JAFDSettings::PoseEKF::posNoise * dt;
+			_covariance[iY][iY] += JAFDSettings::PoseEKF::posNoise * JAFDSettings::PoseEKF::posNoise * dt;
+			_covariance[iHeading][iHeading] += JAFDSettings::PoseEKF::headingNoise * JAFDSettings::PoseEKF::headingNoise * dt;
+			_covariance[iVel][iVel] += JAFDSettings::PoseEKF::velNoise * JAFDSettings::PoseEKF::velNoise * dt;
+			_covariance[iAngularVel][iAngularVel] += JAFDSettings::PoseEKF::angularVelNoise * JAFDSettings::PoseEKF::angularVelNoise * dt;
+
+			// Keep covariance symmetric despite rounding errors
+			for (uint8_t r = 0; r < stateSize; r++)
+			{
+				for (uint8_t c = r + 1; c < stateSize; c++)
+				{
+					const float mean = (_covariance[r][c] + _covariance[c][r]) / 2.0f;
+
+					_covariance[r][c] = mean;
+					_covariance[c][r] = mean;
+				}
+			}
+		}
+
+		ReturnCode updateX(const float x, const float variance)
+		{
+			return scalarUpdate(iX, x - _state[iX], variance);
+		}
+
+		ReturnCode updateY(const float y, const float variance)
+		{
+			return scalarUpdate(iY, y - _state[iY], variance);
+		}
+
+		ReturnCode updateHeading(const float heading, const float variance)
+		{
+			return scalarUpdate(iHeading, fitAngleToInterval(heading - _state[iHeading]), variance);
+		}
+
+		ReturnCode updateVel(const float vel, const float variance)
+		{
+			return scalarUpdate(iVel, vel - _state[iVel], variance);
+		}
+
+		ReturnCode updateAngularVel(const float angularVel, const float variance)
+		{
+			return scalarUpdate(iAngularVel, angularVel - _state[iAngularVel], variance);
+		}
+
+		PoseState getState()
+		{
+			PoseState result;
+
+			result.x = _state[iX];
+			result.y = _state[iY];
+			result.heading = _state[iHeading];
+			result.vel = _state[iVel];
+			result.angularVel = _state[iAngularVel];
+
+			return result;
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,130 @@
+/*
+This private file of the library is responsible for measuring the run time of code sections
+*/
+
+#include "../../JAFDSettings.h"
+#include "../header/Profiler.h"
+#include "../header/SmallThings.h"
+
+namespace JAFD
+{
+	namespace Profiler
+	{
+		namespace
+		{
+			// Statistics of one section
+			struct Section
+			{
+				const char* name;
+				uint32_t startCycles;	// Cycle counter at start()
+				uint32_t count;			// Number of measurements
+				uint32_t minCycles;
+				uint32_t maxCycles;
+				uint64_t totalCycles;
+			};
+
+			Section _sections[JAFDSettings::Profiler::maxSections];
+			volatile uint8_t _numSections = 0;
+
+			constexpr float cyclesPerMicros = VARIANT_MCK / 1000000.0f;
+
+			void clearSection(Section& section)
+			{
+				section.count = 0;
+				section.minCycles = UINT32_MAX;
+				section.maxCycles = 0;
+				section.totalCycles = 0;
+			}
+		}
+
+		ReturnCode setup()
+		{
+			CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+			DWT->CYCCNT = 0;
+			DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+			MemWatcher::addBuffer("profiler", sizeof(_sections));
+
+			return ReturnCode::ok;
+		}
+
+		SectionID addSection(const char* name)
+		{
+			if (_numSections >= JAFDSettings::Profiler::maxSections) return invalidSection;
+
+			Section& section = _sections[_numSections];
+
+			section.name = name;
+			section.startCycles = 0;
+			clearSection(section);
+
+			return _numSections++;
+		}
+
+		void start(const SectionID section)
+		{
+			if (section >= _numSections) return;
+
+			_sections[section].startCycles = getCycles();
+		}
+
+		void stop(const SectionID section)
+		{
+			if (section >= _numSections) return;
+
+			record(section, getCycles() - _sections[section].startCycles);
+		}
+
+		void record(const SectionID section, const uint32_t cycles)
+		{
+			if (section >= _numSections) return;
+
+			Section& entry = _sections[section];
+
+			if (cycles < entry.minCycles) entry.minCycles = cycles;
+			if (cycles > entry.maxCycles) entry.maxCycles = cycles;
+
+			entry.totalCycles += cycles;
+			entry.count++;
+		}
+
+		void reset()
+		{
+			for (uint8_t i = 0; i < _numSections; i++)
+			{
+				__disable_irq();
+				clearSection(_sections[i]);
+				__enable_irq();
+			}
+		}
+
+		void dump()
+		{
+			Serial.println("Profiler (us): count / min / avg / max");
+
+			for (uint8_t i = 0; i < _numSections; i++)
+			{
+				// Copy - the section could be measured by an interrupt
+				__disable_irq();
+				const Section section = _sections[i];
+				__enable_irq();
+
+				Serial.print(section.name);
+				Serial.print(": ");
+				Serial.print(section.count);
+
+				if (section.count > 0)
+				{
+					Serial.print(" / ");
+					Serial.print(section.minCycles / cyclesPerMicros, 1);
+					Serial.print(" / ");
+					Serial.print(section.totalCycles / section.count / cyclesPerMicros, 1);
+					Serial.print(" / ");
+					Serial.print(section.maxCycles / cyclesPerMicros, 1);
+				}
+
+				Serial.println();
+			}
+		}
+	}
+}
\ No newline at end of file
@@ -8,60 +8,126 @@ This is the heart of the robot
 #include "../header/SmoothDriving.h"
 #include "../header/MotorControl.h"
 #include "../header/CamRec.h"
+#include "../header/Dispenser.h"
+#include "../../JAFDSettings.h"
 
 namespace JAFD
 {
 	namespace RobotLogic
 	{
-		void loop()
+		namespace
 		{
-			GridCell cell;
-			RelativeDir relativeTurnDir;
-			bool found = false;
+			bool isPassable(GridCell cell)
+			{
+				return !(cell.cellState & CellState::blackTile);
+			}
 
-			const auto tempFusedData = SensorFusion::getFusedData();
+			// Add new readings of both heat sensors to the victim evidence of the walls they face - the sensors are sampled in the background
+			void sampleHeatSensors()
+			{
+				static uint32_t lastSample = 0;
+
+				const HeatSensData heatData = SensorFusion::getFusedData().heatSensData;
+
+				if (heatData.timestamp == lastSample) return;
+
+				lastSample = heatData.timestamp;
+
+				SensorFusion::TimedPose pose;
+
+				if (SensorFusion::getPoseAt(lastSample, pose) != ReturnCode::ok) return;
+
+				MazeMapping::VictimEvidence::addHeat(pose.position, pose.heading, true, heatData.leftConfidence >= 0.5f);
+				MazeMapping::VictimEvidence::addHeat(pose.position, pose.heading, false, heatData.rightConfidence >= 0.5f);
+			}
+
+			// Decide from the accumulated evidence of a wall - false if there is no victim or it is already rescued
+			bool detectVictim(const MapCoordinate coor, const AbsoluteDir wall, uint8_t& kits)
+			{
+				MazeMapping::VictimEvidence::WallEvidence evidence;
+
+				if (MazeMapping::VictimEvidence::getEvidence(coor, wall, evidence) != ReturnCode::ok || evidence.rescued) return false;
+
+				// Most likely visual victim
+				if (evidence.visualFrames >= JAFDSettings::MazeMapping::VictimEvidence::minVisualFrames)
+				{
+					const VisVictimProb prob = MazeMapping::VictimEvidence::getVisualProb(coor, wall);
+
+					const float probs[6] = { prob.harmed, prob.stable, prob.unharmed, prob.red, prob.green, prob.yellow };
+					constexpr uint8_t victimKits[6] = { JAFDSettings::Dispenser::harmedKits, JAFDSettings::Dispenser::stableKits, JAFDSettings::Dispenser::unharmedKits, JAFDSettings::Dispenser::redKits, JAFDSettings::Dispenser::greenKits, JAFDSettings::Dispenser::yellowKits };
+
+					uint8_t best = 0;
+
+					for (uint8_t i = 1; i < 6; i++)
+					{
+						if (probs[i] > probs[best]) best = i;
+					}
+
+					if (probs[best] >= JAFDSettings::MazeMapping::VictimEvidence::minVisualProb && probs[best] > prob.none)
+					{
+						kits = victimKits[best];
+						return true;
+					}
+				}
 
-			if (tempFusedData.gridCellCertainty >= 0.5f)
+				if (evidence.heatReadings >= JAFDSettings::MazeMapping::VictimEvidence::minHeatReadings && MazeMapping::VictimEvidence::getHeatProb(coor, wall) >= JAFDSettings::MazeMapping::VictimEvidence::minHeatProb)
+				{
+					kits = JAFDSettings::Dispenser::heatKits;
+					return true;
+				}
+
+				return false;
+			}
+
+			// Rescue a victim on the left or right wall of the cell the robot stands on - true if the kits are being dropped
+			bool rescueVictims(const RobotState& state)
 			{
-				switch (relativeTurnDir)
+				for (uint8_t i = 0; i < 2; i++)
 				{
-				case RelativeDir::forward:
-					SmoothDriving::setNewTask<SmoothDriving::NewStateType::lastEndState>(SmoothDriving::TaskArray(SmoothDriving::Stop(),
-						SmoothDriving::Accelerate(20, 15.0f),
-						SmoothDriving::Accelerate(0, 15.0f),
-						SmoothDriving::Stop()));
-					break;
-				case RelativeDir::right:
-					SmoothDriving::setNewTask<SmoothDriving::NewStateType::lastEndState>(SmoothDriving::TaskArray(SmoothDriving::Stop(),
-						SmoothDriving::Rotate(-2.0f, -90.0f),
-						SmoothDriving::Accelerate(20, 15.0f),
-						SmoothDriving::Accelerate(0, 15.0f),
-						SmoothDriving::Stop()));
-					break;
-				case RelativeDir::backward:
-					SmoothDriving::setNewTask<SmoothDriving::NewStateType::lastEndState>(SmoothDriving::TaskArray(SmoothDriving::Stop(),
-						SmoothDriving::Rotate(3.0f, 180.0f),
-						SmoothDriving::Accelerate(20, 15.0f),
-						SmoothDriving::Accelerate(0, 15.0f),
-						SmoothDriving::Stop()));
-					break;
-				case RelativeDir::left:
-					SmoothDriving::setNewTask<SmoothDriving::NewStateType::lastEndState>(SmoothDriving::TaskArray(SmoothDriving::Stop(),
-						SmoothDriving::Rotate(2.0f, 90.0f),
-						SmoothDriving::Accelerate(20, 15.0f),
-						SmoothDriving::Accelerate(0, 15.0f),
-						SmoothDriving::Stop()));
-					break;
-				default:
-					break;
+					const bool left = i == 0;
+					const AbsoluteDir wall = makeAbsolute(left ? RelativeDir::left : RelativeDir::right, state.heading);
+					uint8_t kits = 0;
+
+					if (!detectVictim(state.mapCoordinate, wall, kits)) continue;
+
+					MazeMapping::VictimEvidence::setRescued(state.mapCoordinate, wall);
+
+					if (kits == 0) continue;
+
+					if ((left ? Dispenser::dispenseLeft(kits) : Dispenser::dispenseRight(kits)) == ReturnCode::ok) return true;
 				}
+
+				return false;
 			}
 		}
 
+		void loop()
+		{
+			uint8_t directions[JAFDSettings::MazeMapping::Exploration::maxPathLength];
+
+			const auto tempFusedData = SensorFusion::getFusedData();
+
+			if (tempFusedData.gridCellCertainty < 0.5f || !SmoothDriving::isTaskFinished() || !Dispenser::isFinished()) return;
+
+			// Victims of the current cell before driving on
+			if (rescueVictims(tempFusedData.robotState)) return;
+
+			// Drive the path to the next frontier cell in one go - straight runs are merged and turns are driven as arcs
+			// FollowPath takes the first JAFDSettings::SmoothDriving::maxPathLength steps of longer paths, the rest is planned again at their end
+			if (MazeMapping::Exploration::findNextPath(tempFusedData.robotState.mapCoordinate, tempFusedData.robotState.heading, directions, JAFDSettings::MazeMapping::Exploration::maxPathLength, isPassable) != ReturnCode::ok) return;
+
+			SmoothDriving::setNewTask<SmoothDriving::NewStateType::lastEndState>(SmoothDriving::FollowPath(directions, JAFDSettings::MazeMapping::Exploration::maxPathLength));
+		}
+
 		void timeBetweenUpdate()
 		{
-			// DEBUG
-			//CamRec::loop();
+			// Decode received frames - doesn't wait
+			CamRec::loop();
+
+			sampleHeatSensors();
+
+			// Decision after the current target - ready when the robot arrives there
+			MazeMapping::Exploration::planAhead(isPassable);
 		}
 	}
 }
\ No newline at end of file
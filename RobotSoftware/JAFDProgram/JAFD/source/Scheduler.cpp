@@ -0,0 +1,189 @@
+/*
+This private file of the library is responsible for calling periodic jobs from the timer interrupts
+*/
+
+#include "../../JAFDSettings.h"
+#include "../header/Scheduler.h"
+#include "../header/Profiler.h"
+#include "../header/SmallThings.h"
+
+namespace JAFD
+{
+	namespace Scheduler
+	{
+		namespace
+		{
+			constexpr uint32_t timerClockFreq = VARIANT_MCK / 32;	// TIMER_CLOCK3
+
+			// One registered job
+			struct ScheduledJob
+			{
+				Job job;				// Function to call
+				uint8_t freq;			// Frequency of the job
+				uint16_t divider;		// Call the job every divider-th tick of its priority
+				volatile uint16_t overruns;		// Number of times the period was over after this job
+				Profiler::SectionID section;	// Run time of the job
+			};
+
+			// Timer and jobs of one priority
+			struct Slot
+			{
+				Tc* const tc;
+				const uint8_t channel;
+				const IRQn_Type irq;
+				const uint8_t peripheralID;
+				const uint8_t nvicPriority;
+				const uint16_t freq;		// Base frequency
+				ScheduledJob jobs[JAFDSettings::Scheduler::maxJobsPerPriority];
+				uint8_t numJobs;
+				uint16_t tickCount;			// Ticks since the start of the current second
+				volatile uint16_t overruns;	// Number of periods that were too short for all jobs
+				const char* const tickName;
+				const char* const jitterName;
+				Profiler::SectionID tickSection;	// Run time of all jobs
+				Profiler::SectionID jitterSection;	// Deviation of the time between two ticks from the period
+				uint32_t lastTickCycles;	// Cycle counter at the start of the last tick
+				bool firstTick;
+
+				Slot(Tc* tc, uint8_t channel, IRQn_Type irq, uint8_t peripheralID, uint8_t nvicPriority, uint16_t freq, const char* tickName, const char* jitterName) : tc(tc), channel(channel), irq(irq), peripheralID(peripheralID), nvicPriority(nvicPriority), freq(freq), jobs(), numJobs(0), tickCount(0), overruns(0),
+					tickName(tickName), jitterName(jitterName), tickSection(Profiler::invalidSection), jitterSection(Profiler::invalidSection), lastTickCycles(0), firstTick(true) {}
+			};
+
+			Slot _slots[static_cast<uint8_t>(Priority::numPriorities)] = {
+				Slot(TC1, 0, TC3_IRQn, ID_TC3, 1, JAFDSettings::Scheduler::highFreq, "TC3", "TC3 jitter"),
+				Slot(TC1, 1, TC4_IRQn, ID_TC4, 2, JAFDSettings::Scheduler::mediumFreq, "TC4", "TC4 jitter"),
+				Slot(TC1, 2, TC5_IRQn, ID_TC5, 3, JAFDSettings::Scheduler::lowFreq, "TC5", "TC5 jitter")
+			};
+
+			bool _started = false;
+
+			static_assert(timerClockFreq % JAFDSettings::Scheduler::highFreq == 0 && timerClockFreq % JAFDSettings::Scheduler::mediumFreq == 0 && timerClockFreq % JAFDSettings::Scheduler::lowFreq == 0, "Base frequencies of the scheduler can't be generated exactly");
+		}
+
+		ReturnCode addJob(Job job, const uint8_t freq, const Priority priority, const char* name)
+		{
+			if (_started || job == nullptr || freq == 0 || priority >= Priority::numPriorities) return ReturnCode::error;
+
+			Slot& slot = _slots[static_cast<uint8_t>(priority)];
+
+			if (slot.numJobs >= JAFDSettings::Scheduler::maxJobsPerPriority || slot.freq % freq != 0) return ReturnCode::error;
+
+			ScheduledJob& scheduledJob = slot.jobs[slot.numJobs++];
+
+			scheduledJob.job = job;
+			scheduledJob.freq = freq;
+			scheduledJob.divider = slot.freq / freq;
+			scheduledJob.overruns = 0;
+			scheduledJob.section = (name != nullptr) ? Profiler::addSection(name) : Profiler::invalidSection;
+
+			return ReturnCode::ok;
+		}
+
+		ReturnCode setup()
+		{
+			if (_started) return ReturnCode::error;
+
+			for (auto& slot : _slots)
+			{
+				if (slot.numJobs == 0) continue;
+
+				slot.tickSection = Profiler::addSection(slot.tickName);
+				slot.jitterSection = Profiler::addSection(slot.jitterName);
+
+				// Interrupt every 1 / freq seconds (MCK / 32 / RC)
+				if (slot.peripheralID < 32) PMC->PMC_PCER0 = 1 << slot.peripheralID;
+				else PMC->PMC_PCER1 = 1 << (slot.peripheralID - 32);
+
+				TcChannel& channel = slot.tc->TC_CHANNEL[slot.channel];
+
+				channel.TC_CMR = TC_CMR_TCCLKS_TIMER_CLOCK3 | TC_CMR_WAVE | TC_CMR_WAVSEL_UP_RC;
+				channel.TC_RC = timerClockFreq / slot.freq;
+
+				channel.TC_IER = TC_IER_CPCS;
+				channel.TC_IDR = ~TC_IER_CPCS;
+
+				NVIC_ClearPendingIRQ(slot.irq);
+				NVIC_SetPriority(slot.irq, slot.nvicPriority);
+				NVIC_EnableIRQ(slot.irq);
+
+				channel.TC_CCR = TC_CCR_SWTRG | TC_CCR_CLKEN;
+			}
+
+			_started = true;
+
+			return ReturnCode::ok;
+		}
+
+		uint16_t getOverruns(const Priority priority)
+		{
+			if (priority >= Priority::numPriorities) return 0;
+
+			return _slots[static_cast<uint8_t>(priority)].overruns;
+		}
+
+		uint16_t getOverruns(Job job)
+		{
+			uint16_t result = 0;
+
+			for (const auto& slot : _slots)
+			{
+				for (uint8_t i = 0; i < slot.numJobs; i++)
+				{
+					if (slot.jobs[i].job == job) result += slot.jobs[i].overruns;
+				}
+			}
+
+			return result;
+		}
+
+		void tick(const Priority priority)
+		{
+			Slot& slot = _slots[static_cast<uint8_t>(priority)];
+			bool overrun = false;
+
+			MemWatcher::sampleInterruptStack();
+
+			const uint32_t tickCycles = Profiler::getCycles();
+
+			// Jitter
+			if (!slot.firstTick)
+			{
+				const uint32_t interval = tickCycles - slot.lastTickCycles;
+				const uint32_t period = VARIANT_MCK / slot.freq;
+
+				Profiler::record(slot.jitterSection, (interval > period) ? (interval - period) : (period - interval));
+			}
+
+			slot.lastTickCycles = tickCycles;
+			slot.firstTick = false;
+
+			for (uint8_t i = 0; i < slot.numJobs; i++)
+			{
+				ScheduledJob& scheduledJob = slot.jobs[i];
+
+				if (slot.tickCount % scheduledJob.divider != 0) continue;
+
+				const uint32_t jobCycles = Profiler::getCycles();
+
+				scheduledJob.job(scheduledJob.freq);
+
+				Profiler::record(scheduledJob.section, Profiler::getCycles() - jobCycles);
+
+				// The next period already started - blame the job that crossed the deadline
+				if (!overrun && NVIC_GetPendingIRQ(slot.irq))
+				{
+					overrun = true;
+					scheduledJob.overruns++;
+				}
+			}
+
+			if (overrun) slot.overruns++;
+
+			Profiler::record(slot.tickSection, Profiler::getCycles() - tickCycles);
+
+			slot.tickCount++;
+
+			if (slot.tickCount >= slot.freq) slot.tickCount = 0;
+		}
+	}
+}
\ No newline at end of file
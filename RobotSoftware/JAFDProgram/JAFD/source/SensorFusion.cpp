@@ -2,16 +2,19 @@
 This file of the library is responsible for the sensor fusion
 */
 
-#pragma once
-
 #include "../header/MazeMapping.h"
 #include "../header/Math.h"
 #include "../header/SensorFusion.h"
 #include "../header/MotorControl.h"
 #include "../header/DistanceSensors.h"
 #include "../header/Bno055.h"
+#include "../header/PoseEKF.h"
+#include "../header/DoubleBuffer.h"
 #include "../header/TCS34725.h"
+#include "../header/HeatSensor.h"
 #include "../header/RobotLogic.h"
+#include "../header/Telemetry.h"
+#include "../header/Checkpoint.h"
 #include "../../JAFDSettings.h"
 
 #include <cmath>
@@ -23,91 +26,172 @@ namespace JAFD
 	{
 		namespace
 		{
-			volatile FusedData fusedData;				// Fused data
-			volatile float totalHeadingOff = 0.0f;		// Total heading offset
-			volatile float distSensSpeed = 0.0f;		// Linear speed measured by distance sensors
-			volatile float distSensSpeedTrust = 0.0f;	// How much can I trust the measured speed by the distance sensors? (0.0 - 1.0)
-			volatile float distSensAngle = 0.0f;		// Angle measured by distance sensors (rad)
-			volatile float distSensAngleTrust = 0.0f;	// How much can I trust the measured angle? (0.0 - 1.0)
+			FusedData fusedData;						// Fused data - only used by the main loop (robotState is not used)
+			DoubleBuffer<FusedData> publishedFusedData;	// Copy of fusedData for all readers (published by the main loop)
+			DoubleBuffer<RobotState> publishedRobotState;	// Robot state (published by sensorFiltering())
 			volatile bool trustWheels = false;			// Should I trust the wheel measurements? Or are they slipping?
-			volatile float distSensX = 0.0f;
-			volatile float distSensY = 0.0f;
-			volatile float distSensXTrust = 0.0f;
-			volatile float distSensYTrust = 0.0f;
+			bool distSensPoseUpdates = true;			// Do the distance sensors correct the pose? (not while calibrating them)
+
+			TimedPose poseHistory[JAFDSettings::SensorFusion::poseHistorySize];	// Poses of the last calls of sensorFiltering()
+			volatile uint32_t poseHistoryCount = 0;		// Number of written poses (index = count % size)
+
+			// Mounting pose of a short distance sensor in the robot frame (x forward, y left)
+			struct DistSensorPose
+			{
+				uint16_t Distances::* distance;			// Measured distance in the fused data
+				DistSensorStatus DistSensorStates::* status;	// Status in the fused data
+				RelativeDir dir;						// Where does the sensor look?
+				float x;								// Offset forward from the middle of the robot (cm)
+				float y;								// Offset left from the middle of the robot (cm)
+				float dirX;								// Direction of measurement (unit vector)
+				float dirY;
+				float halfExtent;						// Distance from the middle of the robot to its side in direction of measurement (cm)
+			};
+
+			constexpr uint8_t numDistSensors = 6;
+
+			constexpr DistSensorPose distSensorPoses[numDistSensors] = {
+				{ &Distances::frontLeft, &DistSensorStates::frontLeft, RelativeDir::forward, JAFDSettings::Mechanics::distSensFrontBackDist / 2.0f, JAFDSettings::Mechanics::distSensFrontSpacing / 2.0f, 1.0f, 0.0f, JAFDSettings::Mechanics::robotLength / 2.0f },
+				{ &Distances::frontRight, &DistSensorStates::frontRight, RelativeDir::forward, JAFDSettings::Mechanics::distSensFrontBackDist / 2.0f, -JAFDSettings::Mechanics::distSensFrontSpacing / 2.0f, 1.0f, 0.0f, JAFDSettings::Mechanics::robotLength / 2.0f },
+				{ &Distances::leftFront, &DistSensorStates::leftFront, RelativeDir::left, JAFDSettings::Mechanics::distSensLRSpacing / 2.0f, JAFDSettings::Mechanics::distSensLeftRightDist / 2.0f, 0.0f, 1.0f, JAFDSettings::Mechanics::robotWidth / 2.0f },
+				{ &Distances::leftBack, &DistSensorStates::leftBack, RelativeDir::left, -JAFDSettings::Mechanics::distSensLRSpacing / 2.0f, JAFDSettings::Mechanics::distSensLeftRightDist / 2.0f, 0.0f, 1.0f, JAFDSettings::Mechanics::robotWidth / 2.0f },
+				{ &Distances::rightFront, &DistSensorStates::rightFront, RelativeDir::right, JAFDSettings::Mechanics::distSensLRSpacing / 2.0f, -JAFDSettings::Mechanics::distSensLeftRightDist / 2.0f, 0.0f, -1.0f, JAFDSettings::Mechanics::robotWidth / 2.0f },
+				{ &Distances::rightBack, &DistSensorStates::rightBack, RelativeDir::right, -JAFDSettings::Mechanics::distSensLRSpacing / 2.0f, -JAFDSettings::Mechanics::distSensLeftRightDist / 2.0f, 0.0f, -1.0f, JAFDSettings::Mechanics::robotWidth / 2.0f }
+			};
+
+			volatile uint32_t distSampleTimes[static_cast<uint8_t>(DistanceSensors::SensorID::numSensors)] = { 0 };	// Timestamps of the last samples of the distance sensors
+
+			// Apply one sample of a distance sensor to the fused data
+			void fuseDistSample(const DistanceSensors::DistSample& sample)
+			{
+				uint16_t* distance;
+				DistSensorStatus* status;
+
+				switch (sample.sensor)
+				{
+				case DistanceSensors::SensorID::frontLeft:
+					distance = &fusedData.distances.frontLeft;
+					status = &fusedData.distSensorState.frontLeft;
+					break;
+				case DistanceSensors::SensorID::frontRight:
+					distance = &fusedData.distances.frontRight;
+					status = &fusedData.distSensorState.frontRight;
+					break;
+				case DistanceSensors::SensorID::leftFront:
+					distance = &fusedData.distances.leftFront;
+					status = &fusedData.distSensorState.leftFront;
+					break;
+				case DistanceSensors::SensorID::leftBack:
+					distance = &fusedData.distances.leftBack;
+					status = &fusedData.distSensorState.leftBack;
+					break;
+				case DistanceSensors::SensorID::rightFront:
+					distance = &fusedData.distances.rightFront;
+					status = &fusedData.distSensorState.rightFront;
+					break;
+				case DistanceSensors::SensorID::rightBack:
+					distance = &fusedData.distances.rightBack;
+					status = &fusedData.distSensorState.rightBack;
+					break;
+				default:
+					return;
+				}
+
+				if (sample.status == DistSensorStatus::ok)
+				{
+					if (*status == DistSensorStatus::ok)
+					{
+						*distance = static_cast<uint16_t>(sample.distance * JAFDSettings::SensorFusion::shortDistSensIIRFactor + *distance * (1.0f - JAFDSettings::SensorFusion::shortDistSensIIRFactor));
+					}
+					else
+					{
+						*distance = sample.distance;
+					}
+				}
+				else
+				{
+					*distance = 0;
+				}
+
+				*status = sample.status;
+				distSampleTimes[static_cast<uint8_t>(sample.sensor)] = sample.timestamp;
+			}
 		}
 
 		void sensorFiltering(const uint8_t freq)
 		{
-			RobotState tempRobotState = fusedData.robotState;
+			FilterInputs inputs;
+
+			inputs.time = millis();
+			inputs.wheelSpeeds = MotorControl::getFloatSpeeds();
+			inputs.bnoForwardVec = Bno055::getForwardVec();
+			inputs.bnoRotSpeed = Bno055::getRotSpeed();
+
+			Telemetry::logFilterInputs(inputs.time, inputs.wheelSpeeds, inputs.bnoForwardVec, inputs.bnoRotSpeed, freq);
+
+			filterInputs(inputs, freq);
+		}
+
+		void filterInputs(const FilterInputs& inputs, const uint8_t freq)
+		{
+			RobotState tempRobotState = publishedRobotState.read();
 
-			tempRobotState.wheelSpeeds = MotorControl::getFloatSpeeds();
+			tempRobotState.wheelSpeeds = inputs.wheelSpeeds;
 
 			// Magic factor: *1.173
 
-			// Rotation
-			auto lastHeading = tempRobotState.globalHeading;
+			// Pitch is not part of the pose estimation
 			auto lastPitch = tempRobotState.pitch;
-			float currHeading = 0.0f;	// We don't handle rotation of robot on ramp (pitch != 0) completely correct! But it shouldn't matter.
 
-			auto bnoForwardVec = Bno055::getForwardVec();
-			auto bnoHeading = getGlobalHeading(bnoForwardVec);
-
-			auto excpectedHeading = lastHeading + tempRobotState.angularVel.x / freq;
+			auto bnoForwardVec = inputs.bnoForwardVec;
 			bool bnoErr = false;
 
-			if (Bno055::getRotSpeed() * DEG_TO_RAD > JAFDSettings::MotorControl::maxRotSpeed * 1.5f)
+			if (inputs.bnoRotSpeed * DEG_TO_RAD > JAFDSettings::MotorControl::maxRotSpeed * 1.5f)
 			{
-				bnoHeading = fitAngleToInterval(excpectedHeading);
 				bnoErr = true;
 			}
 
-			if (trustWheels)
+			if (bnoErr)
 			{
-				currHeading = (MotorControl::getDistance(Motor::right) - MotorControl::getDistance(Motor::left)) / (JAFDSettings::Mechanics::wheelDistToMiddle * 2.0f * 1.173f);
-				currHeading -= totalHeadingOff;
-				currHeading = interpolateAngle(fitAngleToInterval(currHeading), bnoHeading, JAFDSettings::SensorFusion::bno055RotPortion);
+				tempRobotState.pitch += tempRobotState.angularVel.z * 0.5f;
 			}
 			else
 			{
-				currHeading = bnoHeading;
+				tempRobotState.pitch = getPitch(bnoForwardVec) * JAFDSettings::SensorFusion::pitchIIRFactor + tempRobotState.pitch * (1.0f - JAFDSettings::SensorFusion::pitchIIRFactor);
 			}
 
-			currHeading = interpolateAngle(currHeading, fitAngleToInterval(distSensAngle), distSensAngleTrust * JAFDSettings::SensorFusion::distAngularPortion);
+			// Predict pose - we don't handle rotation of robot on ramp (pitch != 0) completely correct! But it shouldn't matter.
+			PoseEKF::predict(1.0f / freq, fastCos(tempRobotState.pitch));
 
-			if (bnoErr)
+			// Update with measurements sampled at this rate; distance sensors are fused on arrival in untimedFusion()
+			PoseEKF::updateVel((tempRobotState.wheelSpeeds.left + tempRobotState.wheelSpeeds.right) / 2.0f, JAFDSettings::PoseEKF::wheelVelNoise * JAFDSettings::PoseEKF::wheelVelNoise);
+
+			if (trustWheels)
 			{
-				tempRobotState.pitch += tempRobotState.angularVel.z * 0.5f;
+				PoseEKF::updateAngularVel((tempRobotState.wheelSpeeds.right - tempRobotState.wheelSpeeds.left) / (JAFDSettings::Mechanics::wheelDistToMiddle * 2.0f * 1.173f), JAFDSettings::PoseEKF::wheelAngularVelNoise * JAFDSettings::PoseEKF::wheelAngularVelNoise);
 			}
-			else
+
+			if (!bnoErr)
 			{
-				tempRobotState.pitch = getPitch(bnoForwardVec) * JAFDSettings::SensorFusion::pitchIIRFactor + tempRobotState.pitch * (1.0f - JAFDSettings::SensorFusion::pitchIIRFactor);
+				PoseEKF::updateHeading(getGlobalHeading(bnoForwardVec), JAFDSettings::PoseEKF::bnoHeadingNoise * JAFDSettings::PoseEKF::bnoHeadingNoise);
 			}
 
-			tempRobotState.globalHeading = makeRotationCoherent(lastHeading, currHeading);
+			const auto pose = PoseEKF::getState();
 
+			tempRobotState.globalHeading = pose.heading;
 			tempRobotState.forwardVec = toForwardVec(tempRobotState.globalHeading, tempRobotState.pitch);		// Calculate forward vector
 
-			// Angular velocity
-			float encoderYawVel = (tempRobotState.wheelSpeeds.right - tempRobotState.wheelSpeeds.left) / (JAFDSettings::Mechanics::wheelDistToMiddle * 2.0f * 1.173f);
-
-			auto lastAngularVel = tempRobotState.angularVel;
-
-			tempRobotState.angularVel.x = encoderYawVel * (1.0f - JAFDSettings::SensorFusion::angularVelDiffPortion) + ((tempRobotState.globalHeading - lastHeading) / freq) * JAFDSettings::SensorFusion::angularVelDiffPortion;
+			// Velocities
+			tempRobotState.angularVel.x = pose.angularVel;
 			tempRobotState.angularVel.z = (tempRobotState.pitch - lastPitch) / freq;
 			tempRobotState.angularVel.y = 0.0f;
 
-			tempRobotState.angularVel = tempRobotState.angularVel * JAFDSettings::SensorFusion::angularVelIIRFactor + lastAngularVel * (1.0f - JAFDSettings::SensorFusion::angularVelIIRFactor);
-
-			// Linear velocitys
-			tempRobotState.forwardVel = ((tempRobotState.wheelSpeeds.left + tempRobotState.wheelSpeeds.right) / 2.0f) * (1.0f - distSensSpeedTrust * JAFDSettings::SensorFusion::distSpeedPortion) + distSensSpeed * (distSensSpeedTrust * JAFDSettings::SensorFusion::distSpeedPortion);
-
-			tempRobotState.forwardVel = distSensSpeed * (distSensSpeedTrust * JAFDSettings::SensorFusion::distSpeedPortion) + tempRobotState.forwardVel * (1.0f - distSensSpeedTrust * JAFDSettings::SensorFusion::distSpeedPortion);
+			tempRobotState.forwardVel = pose.vel;
 
 			// Position
-			tempRobotState.position += tempRobotState.forwardVec * (tempRobotState.forwardVel / (float)freq);
-
-			tempRobotState.position.x = distSensX * (JAFDSettings::SensorFusion::distSensOffsetPortion * distSensXTrust) + tempRobotState.position.x * (1.0f - JAFDSettings::SensorFusion::distSensOffsetPortion * distSensXTrust);
-			tempRobotState.position.y = distSensY * (JAFDSettings::SensorFusion::distSensOffsetPortion * distSensYTrust) + tempRobotState.position.y * (1.0f - JAFDSettings::SensorFusion::distSensOffsetPortion * distSensYTrust);
+			tempRobotState.position.x = pose.x;
+			tempRobotState.position.y = pose.y;
+			tempRobotState.position.z += tempRobotState.forwardVec.z * (tempRobotState.forwardVel / (float)freq);
 
 			// Map coordinates
 			tempRobotState.mapCoordinate.x = roundf(tempRobotState.position.x / JAFDSettings::Field::cellWidth);
@@ -124,20 +208,40 @@ namespace JAFD
 			else if (RAD_TO_DEG * positiveAngle > 135.0f && RAD_TO_DEG * positiveAngle < 225.0f) tempRobotState.heading = AbsoluteDir::south;
 			else tempRobotState.heading = AbsoluteDir::east;
 
-			fusedData.robotState = tempRobotState;
+			publishedRobotState.publish(tempRobotState);
+
+			// Pose history for measurements that arrive late
+			TimedPose& historyEntry = poseHistory[poseHistoryCount % JAFDSettings::SensorFusion::poseHistorySize];
+
+			historyEntry.time = inputs.time;
+			historyEntry.position = Vec2f(tempRobotState.position.x, tempRobotState.position.y);
+			historyEntry.heading = tempRobotState.globalHeading;
+
+			__DMB();
+
+			poseHistoryCount++;
+
+			Telemetry::logRobotState(tempRobotState);
 		}
 
 		void untimedFusion()
+		{
+			const uint32_t now = millis();
+
+			Telemetry::logFusionTime(now);
+
+			untimedFusion(now);
+		}
+
+		void untimedFusion(const uint32_t now)
 		{
 			static uint32_t lastTime = 0;
-			uint32_t now = millis();
 
-			auto tempFusedData = fusedData;
+			auto tempFusedData = getFusedData();
 
 			// Speed measurement with distances
 			uint8_t validDistSpeedSamples = 0;			// Number of valid speed measurements by distance sensor
-			static uint16_t lastLeftDist = 0;			// Last distance left
-			static uint16_t lastRightDist = 0;			// Last distance right
+			static uint16_t lastDists[numDistSensors] = { 0 };	// Last distances of the front sensors
 			static uint16_t lastMiddleFrontDist = 0;	// Last distance middle front
 			float tempDistSensSpeed = 0.0f;				// Measured speed 
 
@@ -154,14 +258,6 @@ namespace JAFD
 			uint8_t leftBorderDetected = 0;		// How many times did a border left of us get detected
 			uint8_t rightBorderDetected = 0;		// How many times did a border right of us get detected
 
-			struct
-			{
-				bool lf = false;
-				bool lb = false;
-				bool rf = false;
-				bool rb = false;
-			} borderDetected;
-
 			// Offset calculation
 			float tempXOffset = 0.0f;
 			float tempYOffset = 0.0f;
@@ -177,559 +273,158 @@ namespace JAFD
 			tempCell.cellConnections = EntranceDirections::nowhere;
 			uint8_t walls = 0b0000;											// Where are the walls; inverted to cellConnections
 
-			if (lastPosition != tempFusedData.robotState.mapCoordinate)
-			{
-				lastDifferentPosittion = lastPosition;
+			// Ramps - the map isn't updated on the ramp, the floor changes when the robot is level again
+			static bool onRamp = false;
+			static MapCoordinate rampStart = homePosition;				// Last cell before the ramp
+			static AbsoluteDir rampDir = AbsoluteDir::north;
+			bool floorChanged = false;
 
-				MazeMapping::getGridCell(&tempFusedData.gridCell, tempFusedData.robotState.mapCoordinate);
+			if (!onRamp && fabsf(tempFusedData.robotState.pitch) > JAFDSettings::SensorFusion::minRampPitch)
+			{
+				onRamp = true;
+				rampStart = lastPosition;
+				rampDir = tempFusedData.robotState.heading;
+			}
+			else if (onRamp && fabsf(tempFusedData.robotState.pitch) < JAFDSettings::SensorFusion::maxLevelPitch)
+			{
+				onRamp = false;
 
-				if (tempFusedData.gridCell.cellState & CellState::visited)
+				if (MazeMapping::traverseRamp(rampStart, rampDir, tempFusedData.robotState.mapCoordinate) == ReturnCode::ok)
 				{
-					tempFusedData.gridCellCertainty = 0.6f;
-					tempCell.cellState = tempFusedData.gridCell.cellState;
+					floorChanged = true;
+					Telemetry::logEvent(Telemetry::Event::floorChanged, MazeMapping::getFloor());
 				}
 				else
 				{
-					tempFusedData.gridCellCertainty = 0.0f;
+					Telemetry::logEvent(Telemetry::Event::rampNotStored, MazeMapping::getFloor());
 				}
 			}
 
-			if (fabsf(tempFusedData.robotState.pitch) < JAFDSettings::SensorFusion::maxPitchForDistSensor)
+			if (floorChanged || lastPosition != tempFusedData.robotState.mapCoordinate)
 			{
-				float headingCos = cosf(tempFusedData.robotState.globalHeading);
-				float headingSin = sinf(tempFusedData.robotState.globalHeading);
-
-				if (tempFusedData.distSensorState.frontLeft == DistSensorStatus::ok)
-				{
-					bool hitPointIsOk = false;
-
-					// Measurement is ok
-					// Check if resulting hit point is a 90 wall in front of us
-					if (tempFusedData.robotState.heading == AbsoluteDir::north || tempFusedData.robotState.heading == AbsoluteDir::south)
-					{
-						float hitY = headingSin * tempFusedData.distances.frontLeft / 10.0f + tempFusedData.robotState.position.y + sinf(tempFusedData.robotState.globalHeading + JAFDSettings::Mechanics::distSensFrontAngleToMiddle) * JAFDSettings::Mechanics::distSensFrontDistToMiddle;
-
-						if (fabsf(hitY - tempFusedData.robotState.mapCoordinate.y * JAFDSettings::Field::cellWidth) < JAFDSettings::MazeMapping::widthSecureDetectFactor * JAFDSettings::Field::cellWidth / 2.0f)
-						{
-							hitPointIsOk = true;
-
-							// Helper variables for trig-calculations
-							float cos1 = headingCos * tempFusedData.distances.frontLeft / 10.0f;
-							float cos2 = cosf(tempFusedData.robotState.globalHeading + JAFDSettings::Mechanics::distSensFrontAngleToMiddle) * JAFDSettings::Mechanics::distSensFrontDistToMiddle;
-
-							float hitX = cos1 + tempFusedData.robotState.position.x + cos2;
-
-							if (fabsf(hitX - tempFusedData.robotState.mapCoordinate.x * JAFDSettings::Field::cellWidth) < JAFDSettings::Field::cellWidth / 2.0f + JAFDSettings::MazeMapping::distLongerThanBorder)
-							{
-								// Wall is directly in front of us
-								frontWallsDetected++;
-
-								// Cell-Midpoint offset calculation
-								tempXOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(cos1) - cos1 - cos2;
-								tempXOffTrust += 1.0f;
-							}
-						}
-					}
-					else
-					{
-						float hitX = headingCos * tempFusedData.distances.frontLeft / 10.0f + tempFusedData.robotState.position.x + cosf(tempFusedData.robotState.globalHeading + JAFDSettings::Mechanics::distSensFrontAngleToMiddle) * JAFDSettings::Mechanics::distSensFrontDistToMiddle;
-
-						if (fabsf(hitX - tempFusedData.robotState.mapCoordinate.x * JAFDSettings::Field::cellWidth) < JAFDSettings::MazeMapping::widthSecureDetectFactor * JAFDSettings::Field::cellWidth / 2.0f)
-						{
-							hitPointIsOk = true;
-
-							// Helper variables for trig-calculations
-							float sin1 = headingSin * tempFusedData.distances.frontLeft / 10.0f;
-							float sin2 = sinf(tempFusedData.robotState.globalHeading + JAFDSettings::Mechanics::distSensFrontAngleToMiddle) * JAFDSettings::Mechanics::distSensFrontDistToMiddle;
-
-							float hitY = sin1 + tempFusedData.robotState.position.y + sin2;
-
-							if (fabsf(hitY - tempFusedData.robotState.mapCoordinate.y * JAFDSettings::Field::cellWidth) < JAFDSettings::Field::cellWidth / 2.0f + JAFDSettings::MazeMapping::distLongerThanBorder)
-							{
-								// Wall is directly in front of us
-								frontWallsDetected++;
-
-								// Cell-Midpoint offset calculation
-								tempYOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(sin1) - sin1 - sin2;
-								tempYOffTrust += 1.0f;
-							}
-						}
-					}
-
-					if (hitPointIsOk)
-					{
-						if (lastLeftDist != 0 && lastTime != 0)
-						{
-							tempDistSensSpeed = (tempFusedData.distances.frontLeft - lastLeftDist) / 10.0f * 1000.0f / (now - lastTime);
-							validDistSpeedSamples++;
-						}
-
-						lastLeftDist = tempFusedData.distances.frontLeft;
-					}
-					else
-					{
-						lastLeftDist = 0;
-					}
-				}
-				else
-				{
-					lastLeftDist = 0;
-
-					if (tempFusedData.distSensorState.frontLeft == DistSensorStatus::underflow)
-					{
-						frontWallsDetected++;
+				lastDifferentPosittion = lastPosition;
 
-						switch (tempFusedData.robotState.heading)
-						{
-						case AbsoluteDir::north:
-							tempXOffset += 15.0f - JAFDSettings::Mechanics::robotLength / 2.0f;
-							tempXOffTrust += 1.0f;
-							break;
-						case AbsoluteDir::east:
-							tempYOffset += JAFDSettings::Mechanics::robotLength / 2.0f - 15.0f;
-							tempYOffTrust += 1.0f;
-							break;
-						case AbsoluteDir::south:
-							tempXOffset += JAFDSettings::Mechanics::robotLength / 2.0f - 15.0f;
-							tempXOffTrust += 1.0f;
-							break;
-						case AbsoluteDir::west:
-							tempYOffset += 15.0f - JAFDSettings::Mechanics::robotLength / 2.0f;
-							tempYOffTrust += 1.0f;
-							break;
-						default:
-							break;
-						}
-					}
-				}
+				MazeMapping::getGridCell(&tempFusedData.gridCell, tempFusedData.robotState.mapCoordinate);
 
-				if (tempFusedData.distSensorState.frontRight == DistSensorStatus::ok)
+				if (tempFusedData.gridCell.cellState & CellState::visited)
 				{
-					bool hitPointIsOk = false;
-
-					// Measurement is ok
-					// Check if resulting hit point is a 90 wall in front of us
-					if (tempFusedData.robotState.heading == AbsoluteDir::north || tempFusedData.robotState.heading == AbsoluteDir::south)
-					{
-						float hitY = headingSin * tempFusedData.distances.frontRight / 10.0f + tempFusedData.robotState.position.y + sinf(tempFusedData.robotState.globalHeading - JAFDSettings::Mechanics::distSensFrontAngleToMiddle) * JAFDSettings::Mechanics::distSensFrontDistToMiddle;
-
-						if (fabsf(hitY - tempFusedData.robotState.mapCoordinate.y * JAFDSettings::Field::cellWidth) < JAFDSettings::MazeMapping::widthSecureDetectFactor * JAFDSettings::Field::cellWidth / 2.0f)
-						{
-							hitPointIsOk = true;
-
-							// Helper variables for trig-calculations
-							float cos1 = headingCos * tempFusedData.distances.frontRight / 10.0f;
-							float cos2 = cosf(tempFusedData.robotState.globalHeading - JAFDSettings::Mechanics::distSensFrontAngleToMiddle) * JAFDSettings::Mechanics::distSensFrontDistToMiddle;
-
-							float hitX = cos1 + tempFusedData.robotState.position.x + cos2;
-
-							if (fabsf(hitX - tempFusedData.robotState.mapCoordinate.x * JAFDSettings::Field::cellWidth) < JAFDSettings::Field::cellWidth / 2.0f + JAFDSettings::MazeMapping::distLongerThanBorder)
-							{
-								// Wall is directly in front of us
-								frontWallsDetected++;
-
-								// Cell-Midpoint offset calculation
-								tempXOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(cos1) - cos1 - cos2;
-								tempXOffTrust += 1.0f;
-							}
-						}
-					}
-					else
-					{
-						float hitX = headingCos * tempFusedData.distances.frontRight / 10.0f + tempFusedData.robotState.position.x + cosf(tempFusedData.robotState.globalHeading - JAFDSettings::Mechanics::distSensFrontAngleToMiddle) * JAFDSettings::Mechanics::distSensFrontDistToMiddle;
-
-						if (fabsf(hitX - tempFusedData.robotState.mapCoordinate.x * JAFDSettings::Field::cellWidth) < JAFDSettings::MazeMapping::widthSecureDetectFactor * JAFDSettings::Field::cellWidth / 2.0f)
-						{
-							hitPointIsOk = true;
-
-							// Helper variables for trig-calculation
-							float sin1 = headingSin * tempFusedData.distances.frontRight / 10.0f;
-							float sin2 = sinf(tempFusedData.robotState.globalHeading - JAFDSettings::Mechanics::distSensFrontAngleToMiddle) * JAFDSettings::Mechanics::distSensFrontDistToMiddle;
-
-							float hitY = sin1 + tempFusedData.robotState.position.y + sin2;
-
-							if (fabsf(hitY - tempFusedData.robotState.mapCoordinate.y * JAFDSettings::Field::cellWidth) < JAFDSettings::Field::cellWidth / 2.0f + JAFDSettings::MazeMapping::distLongerThanBorder)
-							{
-								// Wall is directly in front of us
-								frontWallsDetected++;
-
-								// Cell-Midpoint offset calculation
-								tempYOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(sin1) - sin1 - sin2;
-								tempYOffTrust += 1.0f;
-							}
-						}
-					}
-
-					if (hitPointIsOk)
-					{
-						if (lastRightDist != 0 && lastTime != 0)
-						{
-							tempDistSensSpeed += (tempFusedData.distances.frontRight - lastRightDist) / 10.0f * 1000.0f / (now - lastTime);
-							validDistSpeedSamples++;
-						}
-
-						lastRightDist = tempFusedData.distances.frontRight;
-					}
-					else
-					{
-						lastRightDist = 0;
-					}
+					tempFusedData.gridCellCertainty = 0.6f;
+					tempCell.cellState = tempFusedData.gridCell.cellState;
 				}
 				else
 				{
-					lastRightDist = 0;
-
-					if (tempFusedData.distSensorState.frontRight == DistSensorStatus::underflow)
-					{
-						frontWallsDetected++;
-
-						switch (tempFusedData.robotState.heading)
-						{
-						case AbsoluteDir::north:
-							tempXOffset += 15.0f - JAFDSettings::Mechanics::robotLength / 2.0f;
-							tempXOffTrust += 1.0f;
-							break;
-						case AbsoluteDir::east:
-							tempYOffset += JAFDSettings::Mechanics::robotLength / 2.0f - 15.0f;
-							tempYOffTrust += 1.0f;
-							break;
-						case AbsoluteDir::south:
-							tempXOffset += JAFDSettings::Mechanics::robotLength / 2.0f - 15.0f;
-							tempXOffTrust += 1.0f;
-							break;
-						case AbsoluteDir::west:
-							tempYOffset += 15.0f - JAFDSettings::Mechanics::robotLength / 2.0f;
-							tempYOffTrust += 1.0f;
-							break;
-						default:
-							break;
-						}
-					}
+					tempFusedData.gridCellCertainty = 0.0f;
 				}
+			}
 
-				if (tempFusedData.distSensorState.leftFront == DistSensorStatus::ok)
-				{
-					// Measurement is ok
-					// Check if resulting hit point is a 90 wall in front of us
-					if (tempFusedData.robotState.heading == AbsoluteDir::north || tempFusedData.robotState.heading == AbsoluteDir::south)
-					{
-						float cos1 = headingCos * tempFusedData.distances.leftFront / 10.0f;
-						float cos2 = cosf(tempFusedData.robotState.globalHeading - JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
-
-						float hitY = cos1 + tempFusedData.robotState.position.y + cos2;
-
-						if (fabsf(hitY - tempFusedData.robotState.mapCoordinate.y * JAFDSettings::Field::cellWidth) < JAFDSettings::Field::cellWidth / 2.0f + JAFDSettings::MazeMapping::distLongerThanBorder)
-						{
-							leftBorderDetected++; borderDetected.lf = true;
-
-							float hitX = -headingSin * tempFusedData.distances.leftFront / 10.0f + tempFusedData.robotState.position.x - sinf(tempFusedData.robotState.globalHeading - JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
-
-							if (fabsf(hitX - tempFusedData.robotState.mapCoordinate.x * JAFDSettings::Field::cellWidth) < JAFDSettings::MazeMapping::widthSecureDetectFactor * JAFDSettings::Field::cellWidth / 2.0f)
-							{
-								// Wall is directly left of us
-								leftWallsDetected++;
-
-								tempYOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(cos1) - cos1 - cos2;
-								tempYOffTrust += 1.0f;
-							}
-						}
-					}
-					else
-					{
-						float sin1 = -headingSin * tempFusedData.distances.leftFront / 10.0f;
-						float sin2 = -sinf(tempFusedData.robotState.globalHeading + JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
-
-						float hitX = sin1 + tempFusedData.robotState.position.x + sin2;
-
-						if (fabsf(hitX - tempFusedData.robotState.mapCoordinate.x * JAFDSettings::Field::cellWidth) < JAFDSettings::Field::cellWidth / 2.0f + JAFDSettings::MazeMapping::distLongerThanBorder)
-						{
-							leftBorderDetected++; borderDetected.lf = true;
-
-							float hitY = headingCos * tempFusedData.distances.leftFront / 10.0f + tempFusedData.robotState.position.y + cosf(tempFusedData.robotState.globalHeading + JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
-
-							if (fabsf(hitY - tempFusedData.robotState.mapCoordinate.y * JAFDSettings::Field::cellWidth) < JAFDSettings::MazeMapping::widthSecureDetectFactor * JAFDSettings::Field::cellWidth / 2.0f)
-							{
-								// Wall is directly left of us
-								leftWallsDetected++;
-
-								tempXOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(sin1) - sin1 - sin2;
-								tempXOffTrust += 1.0;
-							}
-						}
-					}
-				}
-				else if (tempFusedData.distSensorState.leftFront == DistSensorStatus::underflow)
-				{
-					leftWallsDetected++;
+			if (fabsf(tempFusedData.robotState.pitch) < JAFDSettings::SensorFusion::maxPitchForDistSensor)
+			{
+				float headingSin, headingCos;
+				fastSinCos(tempFusedData.robotState.globalHeading, headingSin, headingCos);
 
-					switch (tempFusedData.robotState.heading)
-					{
-					case AbsoluteDir::north:
-						tempYOffset += 15.0f - JAFDSettings::Mechanics::robotWidth / 2.0f;
-						tempYOffTrust += 1.0f;
-						break;
-					case AbsoluteDir::east:
-						tempXOffset += JAFDSettings::Mechanics::robotWidth / 2.0f - 15.0f;
-						tempXOffTrust += 1.0f;
-						break;
-					case AbsoluteDir::south:
-						tempYOffset += JAFDSettings::Mechanics::robotWidth / 2.0f - 15.0f;
-						tempYOffTrust += 1.0f;
-						break;
-					case AbsoluteDir::west:
-						tempXOffset += 15.0f - JAFDSettings::Mechanics::robotWidth / 2.0f;
-						tempXOffTrust += 1.0f;
-						break;
-					default:
-						break;
-					}
-				}
+				const bool northSouth = tempFusedData.robotState.heading == AbsoluteDir::north || tempFusedData.robotState.heading == AbsoluteDir::south;
 
-				if (tempFusedData.distSensorState.leftBack == DistSensorStatus::ok)
+				for (uint8_t i = 0; i < numDistSensors; i++)
 				{
-					// Measurement is ok
-					// Check if resulting hit point is a 90 wall left of us
-					if (tempFusedData.robotState.heading == AbsoluteDir::north || tempFusedData.robotState.heading == AbsoluteDir::south)
-					{
-						float cos1 = headingCos * tempFusedData.distances.leftBack / 10.0f;
-						float cos2 = cosf(tempFusedData.robotState.globalHeading + JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
+					const DistSensorPose& pose = distSensorPoses[i];
+					const bool isFront = pose.dir == RelativeDir::forward;
+					const bool alongX = isFront == northSouth;		// Is the measurement (perpendicular to the wall) along the x-axis?
+					const DistSensorStatus status = tempFusedData.distSensorState.*pose.status;
 
-						float hitY = cos1 + tempFusedData.robotState.position.y + cos2;
+					uint8_t& wallsDetected = isFront ? frontWallsDetected : (pose.dir == RelativeDir::left ? leftWallsDetected : rightWallsDetected);
+					float& tempOffset = alongX ? tempXOffset : tempYOffset;
+					float& tempOffTrust = alongX ? tempXOffTrust : tempYOffTrust;
 
-						if (fabsf(hitY - tempFusedData.robotState.mapCoordinate.y * JAFDSettings::Field::cellWidth) < JAFDSettings::Field::cellWidth / 2.0f + JAFDSettings::MazeMapping::distLongerThanBorder)
-						{
-							leftBorderDetected++; borderDetected.lb = true;
-
-							float hitX = -headingSin * tempFusedData.distances.leftBack / 10.0f + tempFusedData.robotState.position.x - sinf(tempFusedData.robotState.globalHeading + JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
-
-							if (fabsf(hitX - tempFusedData.robotState.mapCoordinate.x * JAFDSettings::Field::cellWidth) < JAFDSettings::MazeMapping::widthSecureDetectFactor * JAFDSettings::Field::cellWidth / 2.0f)
-							{
-								// Wall is directly left of us
-								leftWallsDetected++;
-
-								tempYOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(cos1) - cos1 - cos2;
-								tempYOffTrust += 1.0f;
-							}
-						}
-					}
-					else
-					{
-						float sin1 = -headingSin * tempFusedData.distances.leftBack / 10.0f;
-						float sin2 = -sinf(tempFusedData.robotState.globalHeading + JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
-
-						float hitX = sin1 + tempFusedData.robotState.position.x + sin2;
-
-						if (fabsf(hitX - tempFusedData.robotState.mapCoordinate.x * JAFDSettings::Field::cellWidth) < JAFDSettings::Field::cellWidth / 2.0f + JAFDSettings::MazeMapping::distLongerThanBorder)
-						{
-							leftBorderDetected++; borderDetected.lb = true;
-
-							float hitY = headingCos * tempFusedData.distances.leftBack / 10.0f + tempFusedData.robotState.position.y + cosf(tempFusedData.robotState.globalHeading + JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
-
-							if (fabsf(hitY - tempFusedData.robotState.mapCoordinate.y * JAFDSettings::Field::cellWidth) < JAFDSettings::MazeMapping::widthSecureDetectFactor * JAFDSettings::Field::cellWidth / 2.0f)
-							{
-								// Wall is directly left of us
-								leftWallsDetected++;
-
-								tempXOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(sin1) - sin1 - sin2;
-								tempXOffTrust += 1.0f;
-							}
-						}
-					}
-				}
-				else if (tempFusedData.distSensorState.leftBack == DistSensorStatus::underflow)
-				{
-					leftWallsDetected++;
+					// Direction of measurement and position of the sensor relative to the middle of the robot - rotated to the global frame
+					const float dirX = pose.dirX * headingCos - pose.dirY * headingSin;
+					const float dirY = pose.dirX * headingSin + pose.dirY * headingCos;
+					const float offsetX = pose.x * headingCos - pose.y * headingSin;
+					const float offsetY = pose.x * headingSin + pose.y * headingCos;
 
-					switch (tempFusedData.robotState.heading)
+					if (status == DistSensorStatus::ok)
 					{
-					case AbsoluteDir::north:
-						tempYOffset += 15.0f - JAFDSettings::Mechanics::robotWidth / 2.0f;
-						tempYOffTrust += 1.0f;
-						break;
-					case AbsoluteDir::east:
-						tempXOffset += JAFDSettings::Mechanics::robotWidth / 2.0f - 15.0f;
-						tempXOffTrust += 1.0f;
-						break;
-					case AbsoluteDir::south:
-						tempYOffset += JAFDSettings::Mechanics::robotWidth / 2.0f - 15.0f;
-						tempYOffTrust += 1.0f;
-						break;
-					case AbsoluteDir::west:
-						tempXOffset += 15.0f - JAFDSettings::Mechanics::robotWidth / 2.0f;
-						tempXOffTrust += 1.0f;
-						break;
-					default:
-						break;
-					}
-				}
+						const float dist = tempFusedData.distances.*pose.distance / 10.0f;
 
-				if (tempFusedData.distSensorState.rightFront == DistSensorStatus::ok)
-				{
-					// Measurement is ok
-					// Check if resulting hit point is a 90 wall right of us
-					if (tempFusedData.robotState.heading == AbsoluteDir::north || tempFusedData.robotState.heading == AbsoluteDir::south)
-					{
-						float cos1 = -headingCos * tempFusedData.distances.rightFront / 10.0f;
-						float cos2 = -cosf(tempFusedData.robotState.globalHeading + JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
+						// Measurement and hit point perpendicular to the wall (a) and along the wall (b)
+						const float measA = dist * (alongX ? dirX : dirY);
+						const float offsetA = alongX ? offsetX : offsetY;
+						const float hitA = measA + offsetA + (alongX ? tempFusedData.robotState.position.x : tempFusedData.robotState.position.y);
+						const float hitB = dist * (alongX ? dirY : dirX) + (alongX ? offsetY : offsetX) + (alongX ? tempFusedData.robotState.position.y : tempFusedData.robotState.position.x);
+						const float cellA = (alongX ? tempFusedData.robotState.mapCoordinate.x : tempFusedData.robotState.mapCoordinate.y) * JAFDSettings::Field::cellWidth;
+						const float cellB = (alongX ? tempFusedData.robotState.mapCoordinate.y : tempFusedData.robotState.mapCoordinate.x) * JAFDSettings::Field::cellWidth;
 
-						float hitY = cos1 + tempFusedData.robotState.position.y + cos2;
+						const bool onWall = fabsf(hitB - cellB) < JAFDSettings::MazeMapping::widthSecureDetectFactor * JAFDSettings::Field::cellWidth / 2.0f;		// Hit point is on the wall of the current cell
+						const bool atBorder = fabsf(hitA - cellA) < JAFDSettings::Field::cellWidth / 2.0f + JAFDSettings::MazeMapping::distLongerThanBorder;	// Hit point is at the border of the current cell
 
-						if (fabsf(hitY - tempFusedData.robotState.mapCoordinate.y * JAFDSettings::Field::cellWidth) < JAFDSettings::Field::cellWidth / 2.0f + JAFDSettings::MazeMapping::distLongerThanBorder)
+						if (isFront)
 						{
-							rightBorderDetected++; borderDetected.rf = true;
-
-							float hitX = headingSin * tempFusedData.distances.rightFront / 10.0f + tempFusedData.robotState.position.x + sinf(tempFusedData.robotState.globalHeading + JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
-
-							if (fabsf(hitX - tempFusedData.robotState.mapCoordinate.x * JAFDSettings::Field::cellWidth) < JAFDSettings::MazeMapping::widthSecureDetectFactor * JAFDSettings::Field::cellWidth / 2.0f)
+							if (onWall)
 							{
-								// Wall is directly right of us
-								rightWallsDetected++;
-
-								tempYOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(cos1) - cos1 - cos2;
-								tempYOffTrust += 1.0f;
+								if (atBorder)
+								{
+									// Wall is directly in front of us
+									wallsDetected++;
+
+									// Cell-Midpoint offset calculation
+									tempOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(measA) - measA - offsetA;
+									tempOffTrust += 1.0f;
+								}
+
+								if (lastDists[i] != 0 && lastTime != 0)
+								{
+									tempDistSensSpeed += (tempFusedData.distances.*pose.distance - lastDists[i]) / 10.0f * 1000.0f / (now - lastTime);
+									validDistSpeedSamples++;
+								}
+
+								lastDists[i] = tempFusedData.distances.*pose.distance;
 							}
-						}
-					}
-					else
-					{
-						float sin1 = headingSin * tempFusedData.distances.rightFront / 10.0f;
-						float sin2 = sinf(tempFusedData.robotState.globalHeading + JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
-
-						float hitX = sin1 + tempFusedData.robotState.position.x + sin2;
-
-						if (fabsf(hitX - tempFusedData.robotState.mapCoordinate.x * JAFDSettings::Field::cellWidth) < JAFDSettings::Field::cellWidth / 2.0f + JAFDSettings::MazeMapping::distLongerThanBorder)
-						{
-							rightBorderDetected++; borderDetected.rf = true;
-
-							float hitY = -headingCos * tempFusedData.distances.rightFront / 10.0f + tempFusedData.robotState.position.y - cosf(tempFusedData.robotState.globalHeading + JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
-
-							if (fabsf(hitY - tempFusedData.robotState.mapCoordinate.y * JAFDSettings::Field::cellWidth) < JAFDSettings::MazeMapping::widthSecureDetectFactor * JAFDSettings::Field::cellWidth / 2.0f)
+							else
 							{
-								// Wall is directly right of us
-								rightWallsDetected++;
-
-								tempXOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(sin1) - sin1 - sin2;
-								tempXOffTrust += 1.0f;
+								lastDists[i] = 0;
 							}
 						}
-					}
-				}
-				else if (tempFusedData.distSensorState.rightFront == DistSensorStatus::underflow)
-				{
-					rightWallsDetected++;
-
-					switch (tempFusedData.robotState.heading)
-					{
-					case AbsoluteDir::south:
-						tempYOffset += 15.0f - JAFDSettings::Mechanics::robotWidth / 2.0f;
-						tempYOffTrust += 1.0f;
-						break;
-					case AbsoluteDir::west:
-						tempXOffset += JAFDSettings::Mechanics::robotWidth / 2.0f - 15.0f;
-						tempXOffTrust += 1.0f;
-						break;
-					case AbsoluteDir::north:
-						tempYOffset += JAFDSettings::Mechanics::robotWidth / 2.0f - 15.0f;
-						tempYOffTrust += 1.0f;
-						break;
-					case AbsoluteDir::east:
-						tempXOffset += 15.0f - JAFDSettings::Mechanics::robotWidth / 2.0f;
-						tempXOffTrust += 1.0f;
-						break;
-					default:
-						break;
-					}
-				}
-
-				if (tempFusedData.distSensorState.rightBack == DistSensorStatus::ok)
-				{
-					// Measurement is ok
-					// Check if resulting hit point is a 90 wall right of us
-					if (tempFusedData.robotState.heading == AbsoluteDir::north || tempFusedData.robotState.heading == AbsoluteDir::south)
-					{
-						float cos1 = -headingCos * tempFusedData.distances.rightBack / 10.0f;
-						float cos2 = -cosf(tempFusedData.robotState.globalHeading - JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
-
-						float hitY = cos1 + tempFusedData.robotState.position.y + cos2;
-
-						if (fabsf(hitY - tempFusedData.robotState.mapCoordinate.y * JAFDSettings::Field::cellWidth) < JAFDSettings::Field::cellWidth / 2.0f + JAFDSettings::MazeMapping::distLongerThanBorder)
+						else if (atBorder)
 						{
-							rightBorderDetected++; borderDetected.rb = true;
+							if (pose.dir == RelativeDir::left) leftBorderDetected++;
+							else rightBorderDetected++;
 
-							float hitX = headingSin * tempFusedData.distances.rightBack / 10.0f + tempFusedData.robotState.position.x + sinf(tempFusedData.robotState.globalHeading - JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
-
-							if (fabsf(hitX - tempFusedData.robotState.mapCoordinate.x * JAFDSettings::Field::cellWidth) < JAFDSettings::MazeMapping::widthSecureDetectFactor * JAFDSettings::Field::cellWidth / 2.0f)
+							if (onWall)
 							{
-								// Wall is directly right of us
-								rightWallsDetected++;
+								// Wall is directly left / right of us
+								wallsDetected++;
 
-								tempYOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(cos1) - cos1 - cos2;
-								tempYOffTrust += 1.0f;
+								tempOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(measA) - measA - offsetA;
+								tempOffTrust += 1.0f;
 							}
 						}
 					}
 					else
 					{
-						float sin1 = headingSin * tempFusedData.distances.rightBack / 10.0f;
-						float sin2 = sinf(tempFusedData.robotState.globalHeading - JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
+						lastDists[i] = 0;
 
-						float hitX = sin1 + tempFusedData.robotState.position.x + sin2;
-						if (fabsf(hitX - tempFusedData.robotState.mapCoordinate.x * JAFDSettings::Field::cellWidth) < JAFDSettings::Field::cellWidth / 2.0f + JAFDSettings::MazeMapping::distLongerThanBorder)
+						if (status == DistSensorStatus::underflow)
 						{
-							rightBorderDetected++; borderDetected.rb = true;
-
-							float hitY = -headingCos * tempFusedData.distances.rightBack / 10.0f + tempFusedData.robotState.position.y - cosf(tempFusedData.robotState.globalHeading - JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
-
-							if (fabsf(hitY - tempFusedData.robotState.mapCoordinate.y * JAFDSettings::Field::cellWidth) < JAFDSettings::MazeMapping::widthSecureDetectFactor * JAFDSettings::Field::cellWidth / 2.0f)
-							{
-								// Wall is directly right of us
-								rightWallsDetected++;
+							// Robot touches the wall
+							wallsDetected++;
 
-								tempXOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(sin1) - sin1 - sin2;
-								tempXOffTrust += 1.0f;
-							}
+							tempOffset += sgn(alongX ? dirX : dirY) * (JAFDSettings::Field::cellWidth / 2.0f - pose.halfExtent);
+							tempOffTrust += 1.0f;
 						}
 					}
 				}
-				else if (tempFusedData.distSensorState.rightBack == DistSensorStatus::underflow)
-				{
-					rightWallsDetected++;
-
-					switch (tempFusedData.robotState.heading)
-					{
-					case AbsoluteDir::south:
-						tempYOffset += 15.0f - JAFDSettings::Mechanics::robotWidth / 2.0f;
-						tempYOffTrust += 1.0f;
-						break;
-					case AbsoluteDir::west:
-						tempXOffset += JAFDSettings::Mechanics::robotWidth / 2.0f - 15.0f;
-						tempXOffTrust += 1.0f;
-						break;
-					case AbsoluteDir::north:
-						tempYOffset += JAFDSettings::Mechanics::robotWidth / 2.0f - 15.0f;
-						tempYOffTrust += 1.0f;
-						break;
-					case AbsoluteDir::east:
-						tempXOffset += 15.0f - JAFDSettings::Mechanics::robotWidth / 2.0f;
-						tempXOffTrust += 1.0f;
-						break;
-					default:
-						break;
-					}
-				}
 
 				// Calculate angle
 				if (frontWallsDetected == 2 && tempFusedData.distSensorState.frontLeft == DistSensorStatus::ok && tempFusedData.distSensorState.frontRight == DistSensorStatus::ok)
 				{
 					// Calculate angle if both front distance sensors detected a wall directly in front of the robot.
-					tempDistSensAngle += asinf((tempFusedData.distances.frontLeft - tempFusedData.distances.frontRight) / sqrtf(JAFDSettings::Mechanics::distSensFrontSpacing * JAFDSettings::Mechanics::distSensFrontSpacing * 100.0f + (tempFusedData.distances.frontLeft - tempFusedData.distances.frontRight) * (tempFusedData.distances.frontLeft - tempFusedData.distances.frontRight)));
+					tempDistSensAngle += fastAsin((tempFusedData.distances.frontLeft - tempFusedData.distances.frontRight) * fastInvSqrt(JAFDSettings::Mechanics::distSensFrontSpacing * JAFDSettings::Mechanics::distSensFrontSpacing * 100.0f + (tempFusedData.distances.frontLeft - tempFusedData.distances.frontRight) * (tempFusedData.distances.frontLeft - tempFusedData.distances.frontRight)));
 					tempDistSensAngleTrust += 1.0f / 3.0f;
 				}
 
 				if (leftBorderDetected == 2 && tempFusedData.distSensorState.leftFront == DistSensorStatus::ok && tempFusedData.distSensorState.leftBack == DistSensorStatus::ok)
 				{
 					// Calculate angle if both left distance sensors detected a border directly left of the robot.
-					tempDistSensAngle += asinf((tempFusedData.distances.leftBack - tempFusedData.distances.leftFront) / sqrtf(JAFDSettings::Mechanics::distSensLRSpacing * JAFDSettings::Mechanics::distSensLRSpacing * 100.0f + (tempFusedData.distances.leftBack - tempFusedData.distances.leftFront) * (tempFusedData.distances.leftBack - tempFusedData.distances.leftFront)));
+					tempDistSensAngle += fastAsin((tempFusedData.distances.leftBack - tempFusedData.distances.leftFront) * fastInvSqrt(JAFDSettings::Mechanics::distSensLRSpacing * JAFDSettings::Mechanics::distSensLRSpacing * 100.0f + (tempFusedData.distances.leftBack - tempFusedData.distances.leftFront) * (tempFusedData.distances.leftBack - tempFusedData.distances.leftFront)));
 					tempDistSensAngleTrust += 1.0f / 3.0f;
 				}
 
@@ -737,7 +432,7 @@ namespace JAFD
 
 				{
 					// Calculate angle if both right distance sensors detected a wall directly right of the robot.
-					tempDistSensAngle += asinf((tempFusedData.distances.rightFront - tempFusedData.distances.rightBack) / sqrtf(JAFDSettings::Mechanics::distSensLRSpacing * JAFDSettings::Mechanics::distSensLRSpacing * 100.0f + (tempFusedData.distances.rightFront - tempFusedData.distances.rightBack) * (tempFusedData.distances.rightFront - tempFusedData.distances.rightBack)));
+					tempDistSensAngle += fastAsin((tempFusedData.distances.rightFront - tempFusedData.distances.rightBack) * fastInvSqrt(JAFDSettings::Mechanics::distSensLRSpacing * JAFDSettings::Mechanics::distSensLRSpacing * 100.0f + (tempFusedData.distances.rightFront - tempFusedData.distances.rightBack) * (tempFusedData.distances.rightFront - tempFusedData.distances.rightBack)));
 					tempDistSensAngleTrust += 1.0f / 3.0f;
 				}
 
@@ -758,25 +453,24 @@ namespace JAFD
 				{
 
 				case AbsoluteDir::north:
-					distSensAngle = tempDistSensAngle;
 					tempXOffTrust /= 2.0f;		// If facing north, two sensors (front) could give an X-Offset
 					tempYOffTrust /= 4.0f;		// If facing north, four sensors (left & right) could give an Y-Offset
 					break;
 
 				case AbsoluteDir::east:
-					distSensAngle = tempDistSensAngle - DEG_TO_RAD * 90.0f;
+					tempDistSensAngle -= DEG_TO_RAD * 90.0f;
 					tempXOffTrust /= 4.0f;
 					tempYOffTrust /= 2.0f;
 					break;
 
 				case AbsoluteDir::south:
-					distSensAngle = tempDistSensAngle + DEG_TO_RAD * 180.0f;
+					tempDistSensAngle += DEG_TO_RAD * 180.0f;
 					tempXOffTrust /= 2.0f;
 					tempYOffTrust /= 4.0f;
 					break;
 
 				case AbsoluteDir::west:
-					distSensAngle = tempDistSensAngle + DEG_TO_RAD * 90.0f;
+					tempDistSensAngle += DEG_TO_RAD * 90.0f;
 					tempXOffTrust /= 4.0f;
 					tempYOffTrust /= 2.0f;
 					break;
@@ -785,12 +479,28 @@ namespace JAFD
 					break;
 				}
 
-				distSensX = tempXOffset + tempFusedData.robotState.mapCoordinate.x * JAFDSettings::Field::cellWidth;
-				distSensY = tempYOffset + tempFusedData.robotState.mapCoordinate.y * JAFDSettings::Field::cellWidth;
-				distSensXTrust = tempXOffTrust;
-				distSensYTrust = tempYOffTrust;
+				// Update pose - the trust scales the variance of the measurement
+				if (distSensPoseUpdates)
+				{
+					__disable_irq();
+
+					if (tempXOffTrust > JAFDSettings::PoseEKF::minTrust)
+					{
+						PoseEKF::updateX(tempXOffset + tempFusedData.robotState.mapCoordinate.x * JAFDSettings::Field::cellWidth, JAFDSettings::PoseEKF::distSensOffsetNoise * JAFDSettings::PoseEKF::distSensOffsetNoise / tempXOffTrust);
+					}
 
-				distSensAngleTrust = tempDistSensAngleTrust;
+					if (tempYOffTrust > JAFDSettings::PoseEKF::minTrust)
+					{
+						PoseEKF::updateY(tempYOffset + tempFusedData.robotState.mapCoordinate.y * JAFDSettings::Field::cellWidth, JAFDSettings::PoseEKF::distSensOffsetNoise * JAFDSettings::PoseEKF::distSensOffsetNoise / tempYOffTrust);
+					}
+
+					if (tempDistSensAngleTrust > JAFDSettings::PoseEKF::minTrust)
+					{
+						PoseEKF::updateHeading(tempDistSensAngle, JAFDSettings::PoseEKF::distSensAngleNoise * JAFDSettings::PoseEKF::distSensAngleNoise / tempDistSensAngleTrust);
+					}
+
+					__enable_irq();
+				}
 
 				if (tempFusedData.distSensorState.frontLong == DistSensorStatus::ok)
 				{
@@ -835,8 +545,7 @@ namespace JAFD
 			}
 			else
 			{
-				lastLeftDist = 0;
-				lastRightDist = 0;
+				for (auto& lastDist : lastDists) lastDist = 0;
 				lastMiddleFrontDist = 0;
 			}
 
@@ -1186,51 +895,77 @@ namespace JAFD
 
 			if (updateCertainty < 0.0f) updateCertainty = 0.0f;
 
-			tempCell.cellConnections = (~walls) & CellConnections::directionMask;
+			// Ramps are only known from driving over them
+			tempCell.cellConnections = ((~walls) & CellConnections::directionMask) | (tempFusedData.gridCell.cellConnections & CellConnections::rampMask);
+
+			if (!onRamp) MazeMapping::setCurrentCell(tempCell, tempFusedData.gridCellCertainty, updateCertainty, tempFusedData.robotState.mapCoordinate);
 
-			MazeMapping::setCurrentCell(tempCell, tempFusedData.gridCellCertainty, updateCertainty, tempFusedData.robotState.mapCoordinate);
+			// The maze is flushed at every checkpoint - the snapshot of the rest is written once per visit
+			static bool onCheckpoint = false;
 
-			if (validDistSpeedSamples > 0)
+			if (!onRamp && tempCell.cellState & CellState::checkpoint)
 			{
-				distSensSpeedTrust = validDistSpeedSamples / 4.0f;
-				distSensSpeed = (-tempDistSensSpeed / (float)(validDistSpeedSamples)) * JAFDSettings::SensorFusion::distSensSpeedIIRFactor + distSensSpeed * (1.0f - JAFDSettings::SensorFusion::distSensSpeedIIRFactor);	// Negative, because increasing distance means driving away; 
+				if (!onCheckpoint) Checkpoint::store(tempFusedData.robotState.mapCoordinate, tempFusedData.robotState.heading);
+
+				onCheckpoint = true;
 			}
 			else
 			{
-				distSensSpeedTrust = 0.0f;
+				onCheckpoint = false;
+			}
+
+			if (validDistSpeedSamples > 0 && distSensPoseUpdates)
+			{
+				const float distSensSpeedTrust = validDistSpeedSamples / 4.0f;
+
+				__disable_irq();
+				PoseEKF::updateVel(-tempDistSensSpeed / (float)(validDistSpeedSamples), JAFDSettings::PoseEKF::distSensSpeedNoise * JAFDSettings::PoseEKF::distSensSpeedNoise / distSensSpeedTrust);	// Negative, because increasing distance means driving away
+				__enable_irq();
 			}
 
 			lastPosition = tempFusedData.robotState.mapCoordinate;
 			fusedData.gridCell = tempCell;
 			fusedData.gridCellCertainty = tempFusedData.gridCellCertainty;
+			publishedFusedData.publish(fusedData);
 			lastTime = now;
 		}
 
 		// "heading" in rad
 		void setCertainRobotPosition(Vec3f pos, float heading)
 		{
-			auto tempRobotState = fusedData.robotState;
+			// sensorFiltering() must not publish in between
+			__disable_irq();
+
+			auto tempRobotState = publishedRobotState.read();
 
 			tempRobotState.position = pos;
 			tempRobotState.globalHeading = makeRotationCoherent(tempRobotState.globalHeading, heading);
 
-			float currentRotEncAngle = (MotorControl::getDistance(Motor::right) - MotorControl::getDistance(Motor::left)) / (JAFDSettings::Mechanics::wheelDistToMiddle * 2.0f * 1.173f);
+			PoseEKF::reset(tempRobotState.position.x, tempRobotState.position.y, tempRobotState.globalHeading);
+			publishedRobotState.publish(tempRobotState);
 
-			totalHeadingOff = fitAngleToInterval(heading - currentRotEncAngle);
+			__enable_irq();
 
 			Bno055::tare(heading);
+		}
+
+		FusedData getFusedData()
+		{
+			FusedData result = publishedFusedData.read();
+			result.robotState = publishedRobotState.read();
 
-			fusedData.robotState = tempRobotState;
+			return result;
 		}
 
-		const volatile FusedData& getFusedData()
+		RobotState getRobotState()
 		{
-			return fusedData;
+			return publishedRobotState.read();
 		}
 
 		void updateSensors()
 		{
-			DistanceSensors::forceNewMeasurement();
+			// The Bno055 is read on Wire1 in the background while the other sensors use Wire
+			const bool bnoUpdateRunning = Bno055::startUpdate() == ReturnCode::ok;
 
 			if (ColorSensor::dataIsReady())
 			{
@@ -1242,21 +977,114 @@ namespace JAFD
 				fusedData.colorSensData.lux = lux;
 			}
 
-			Bno055::updateValues();
-
 			RobotLogic::timeBetweenUpdate();
 
+			// Heat sensor readings go into the batch of the distance sensors
+			HeatSensor::queueUpdate();
+
+			// Collect finished distance measurements and fuse all buffered samples
 			DistanceSensors::updateDistSensors();
+
+			DistanceSensors::DistSample sample;
+
+			while (DistanceSensors::getSample(&sample) == ReturnCode::ok)
+			{
+				fuseDistSample(sample);
+			}
+
+			if (bnoUpdateRunning) Bno055::finishUpdate();
+
+			HeatSensor::finishUpdate(fusedData.heatSensData);
+
+			publishedFusedData.publish(fusedData);
+
+			Telemetry::logDistances(fusedData.distances, fusedData.distSensorState);
+		}
+
+		uint32_t getDistSampleTime(const DistanceSensors::SensorID sensor)
+		{
+			return distSampleTimes[static_cast<uint8_t>(sensor)];
 		}
 
 		void setDistances(Distances distances)
 		{
 			fusedData.distances = distances;
+			publishedFusedData.publish(fusedData);
 		}
 
 		void setDistSensStates(DistSensorStates distSensorStates)
 		{
 			fusedData.distSensorState = distSensorStates;
+			publishedFusedData.publish(fusedData);
+		}
+
+		void setDistSensPoseUpdates(const bool enabled)
+		{
+			distSensPoseUpdates = enabled;
+		}
+
+		ReturnCode getDistSensMounting(const DistanceSensors::SensorID sensor, Vec2f& position, Vec2f& direction)
+		{
+			const uint8_t i = static_cast<uint8_t>(sensor);
+
+			if (i >= numDistSensors) return ReturnCode::error;
+
+			position = Vec2f(distSensorPoses[i].x, distSensorPoses[i].y);
+			direction = Vec2f(distSensorPoses[i].dirX, distSensorPoses[i].dirY);
+
+			return ReturnCode::ok;
+		}
+
+		ReturnCode getPoseAt(const uint32_t time, TimedPose& pose)
+		{
+			TimedPose history[JAFDSettings::SensorFusion::poseHistorySize];
+			uint32_t count;
+
+			// Copy again if sensorFiltering() wrote in between
+			do
+			{
+				count = poseHistoryCount;
+
+				__DMB();
+
+				for (uint8_t i = 0; i < JAFDSettings::SensorFusion::poseHistorySize; i++) history[i] = poseHistory[i];
+
+				__DMB();
+			} while (count != poseHistoryCount);
+
+			if (count == 0) return ReturnCode::error;
+
+			const uint8_t numPoses = (count < JAFDSettings::SensorFusion::poseHistorySize) ? count : JAFDSettings::SensorFusion::poseHistorySize;
+
+			// From the newest to the oldest pose
+			const TimedPose* newer = &history[(count - 1) % JAFDSettings::SensorFusion::poseHistorySize];
+
+			if (static_cast<int32_t>(time - newer->time) >= 0)
+			{
+				pose = *newer;
+				pose.time = time;
+				return ReturnCode::ok;
+			}
+
+			for (uint8_t i = 2; i <= numPoses; i++)
+			{
+				const TimedPose* older = &history[(count - i) % JAFDSettings::SensorFusion::poseHistorySize];
+
+				if (static_cast<int32_t>(time - older->time) >= 0)
+				{
+					const float factor = (newer->time != older->time) ? static_cast<float>(time - older->time) / (newer->time - older->time) : 0.0f;
+
+					pose.time = time;
+					pose.position = older->position + (newer->position - older->position) * factor;
+					pose.heading = older->heading + (newer->heading - older->heading) * factor;
+
+					return ReturnCode::ok;
+				}
+
+				newer = older;
+			}
+
+			return ReturnCode::error;
 		}
 	}
 }
\ No newline at end of file
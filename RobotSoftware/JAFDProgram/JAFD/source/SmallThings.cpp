@@ -15,6 +15,7 @@
 #include "../header/TCA9548A.h"
 #include "../header/TCS34725.h"
 #include "../header/Bno055.h"
+#include "../header/Telemetry.h"
 
 #include <Wire.h>
 
@@ -264,8 +265,26 @@ namespace JAFD
 		namespace
 		{
 			extern "C" char* sbrk(int i);
+			extern "C" char _ezero;		// End of .bss (linker script)
 			char* ramstart = (char*)0x20070000;
 			char* ramend = (char*)0x20088000;
+
+			constexpr uint32_t paintPattern = 0xC5C5C5C5;
+
+			// Static buffer of a subsystem
+			struct Buffer
+			{
+				const char* name;
+				uint32_t size;
+			};
+
+			Buffer _buffers[JAFDSettings::MemWatcher::maxBuffers];
+			uint8_t _numBuffers = 0;
+
+			uint32_t* _paintEnd = nullptr;				// First word above the painted RAM
+			uint32_t* _lowestUsed = nullptr;			// Lowest overwritten word found so far
+			char* volatile _deepestInterruptSP = ramend;
+			uint32_t _lastReport = 0;
 		}	
 
 		uint32_t getDynamicRam()
@@ -287,6 +306,102 @@ namespace JAFD
 			register char* stack_ptr asm("sp");
 			return stack_ptr - heapend + mi.fordblks;
 		}
+
+		void paintStack()
+		{
+			uint32_t* start = reinterpret_cast<uint32_t*>((reinterpret_cast<uint32_t>(sbrk(0)) + 3) & ~3);
+			register char* stack_ptr asm("sp");
+
+			_paintEnd = reinterpret_cast<uint32_t*>(reinterpret_cast<uint32_t>(stack_ptr - JAFDSettings::MemWatcher::paintMargin) & ~3);
+			_lowestUsed = _paintEnd;
+
+			for (uint32_t* word = start; word < _paintEnd; word++) *word = paintPattern;
+		}
+
+		uint32_t getStackHighWater()
+		{
+			if (_paintEnd == nullptr) return getStackRam();
+
+			// The heap can have grown into the painted RAM - the search starts above it
+			uint32_t* word = reinterpret_cast<uint32_t*>((reinterpret_cast<uint32_t>(sbrk(0)) + 3) & ~3);
+
+			// The mark only moves down - nothing above the last one has to be searched
+			while (word < _lowestUsed && *word == paintPattern) word++;
+
+			_lowestUsed = word;
+
+			return ramend - reinterpret_cast<char*>(_lowestUsed);
+		}
+
+		void sampleInterruptStack()
+		{
+			register char* stack_ptr asm("sp");
+
+			// A nested interrupt between compare and store can only lose its own sample
+			if (stack_ptr < _deepestInterruptSP) _deepestInterruptSP = stack_ptr;
+		}
+
+		uint32_t getInterruptStackDepth()
+		{
+			return ramend - _deepestInterruptSP;
+		}
+
+		uint32_t getStaticRam()
+		{
+			return &_ezero - ramstart;
+		}
+
+		ReturnCode addBuffer(const char* name, const uint32_t size)
+		{
+			if (_numBuffers >= JAFDSettings::MemWatcher::maxBuffers) return ReturnCode::error;
+
+			_buffers[_numBuffers].name = name;
+			_buffers[_numBuffers].size = size;
+			_numBuffers++;
+
+			return ReturnCode::ok;
+		}
+
+		uint32_t getBufferRam()
+		{
+			uint32_t sum = 0;
+
+			for (uint8_t i = 0; i < _numBuffers; i++) sum += _buffers[i].size;
+
+			return sum;
+		}
+
+		void update()
+		{
+			if (millis() - _lastReport < JAFDSettings::MemWatcher::reportInterval) return;
+
+			_lastReport = millis();
+
+			Telemetry::logMemory(getFreeRam(), getDynamicRam(), getStaticRam(), getBufferRam(), getStackHighWater(), getInterruptStackDepth());
+		}
+
+		void dump()
+		{
+			Serial.println("Memory (bytes)");
+
+			Serial.print("free: ");
+			Serial.println(getFreeRam());
+			Serial.print("dynamic: ");
+			Serial.println(getDynamicRam());
+			Serial.print("static: ");
+			Serial.println(getStaticRam());
+			Serial.print("stack high-water: ");
+			Serial.println(getStackHighWater());
+			Serial.print("interrupt stack depth: ");
+			Serial.println(getInterruptStackDepth());
+
+			for (uint8_t i = 0; i < _numBuffers; i++)
+			{
+				Serial.print(_buffers[i].name);
+				Serial.print(": ");
+				Serial.println(_buffers[i].size);
+			}
+		}
 	}
 
 	namespace Wait
@@ -316,7 +431,6 @@ namespace JAFD
 		}
 	}
 
-	// TODO
 	namespace Switch
 	{
 		namespace
@@ -326,12 +440,15 @@ namespace JAFD
 
 		void setup()
 		{
-
+			pin.port->PIO_PER = pin.pin;
+			pin.port->PIO_ODR = pin.pin;
+			pin.port->PIO_PUER = pin.pin;
 		}
 
+		// Pressed switch pulls the pin to ground
 		bool getState()
 		{
-
+			return !(pin.port->PIO_PDSR & pin.pin);
 		}
 	}
 
@@ -18,6 +18,7 @@ This part of the Library is responsible for driving smoothly.
 #include "../header/PIDController.h"
 #include "../header/DistanceSensors.h"
 #include "../header/SensorFusion.h"
+#include "../header/Telemetry.h"
 
 namespace JAFD
 {
@@ -37,6 +38,7 @@ namespace JAFD
 				ForceSpeed forceSpeed;
 				TaskArray taskArray;
 				AlignFront alignFront;
+				FollowPath followPath;
 
 				_TaskCopies() : stop() {};
 				~_TaskCopies() {}
@@ -48,6 +50,100 @@ namespace JAFD
 			PIDController _angularVelPID(JAFDSettings::Controller::SmoothDriving::angularVelPidSettings);	// PID controller for angular velocity
 		
 			volatile bool _stopped = false;		// Is current task stopped?
+
+			Telemetry::TaskType _currentTaskType = Telemetry::TaskType::stop;	// Type of current task
+			bool _finishLogged = true;			// Has the end of the current task been logged?
+			volatile uint32_t _taskNumber = 0;	// Number of started tasks (detects a task change while planning ahead)
+
+			// Log start of a new task
+			void taskStarted(const Telemetry::TaskType type)
+			{
+				_currentTaskType = type;
+				_finishLogged = false;
+				_taskNumber++;
+
+				Telemetry::logTask(Telemetry::TaskEvent::started, type, 0);
+			}
+
+			// Read the start state of a new task with masked interrupts - false if the current task must not be replaced
+			// taskNumber lets replaceTask() detect a task started in the meantime
+			bool readStartState(const NewStateType stateType, const RobotState* specifiedState, const bool forceOverride, RobotState& startState, uint32_t& taskNumber)
+			{
+				bool replace;
+
+				__disable_irq();
+
+				replace = _currentTask->isFinished() || forceOverride;
+				taskNumber = _taskNumber;
+
+				if (replace)
+				{
+					if (specifiedState) startState = *specifiedState;
+					else if (stateType == NewStateType::lastEndState) startState = static_cast<RobotState>(_currentTask->getEndState());
+					else startState = SensorFusion::getRobotState();
+				}
+
+				__enable_irq();
+
+				return replace;
+			}
+
+			// Replace the current task by an already started one - only the swap is done with masked interrupts
+			// Aborts if another task was started since readStartState()
+			template<typename T>
+			ReturnCode replaceTask(const T& task, T& slot, const Telemetry::TaskType type, const uint32_t taskNumber)
+			{
+				__disable_irq();
+
+				if (_taskNumber != taskNumber)
+				{
+					__enable_irq();
+					return ReturnCode::aborted;
+				}
+
+				_currentTask->~ITask();
+				_currentTask = new (&slot) T(task);
+				taskStarted(type);
+				_stopped = false;
+
+				__enable_irq();
+				return ReturnCode::ok;
+			}
+
+			// Start a new task - planning runs with enabled interrupts
+			template<typename T>
+			ReturnCode startNewTask(const T& newTask, T& slot, const Telemetry::TaskType type, const NewStateType stateType, const RobotState* specifiedState, const bool forceOverride)
+			{
+				static T temp;
+				RobotState startState;
+				uint32_t taskNumber;
+
+				if (!readStartState(stateType, specifiedState, forceOverride, startState, taskNumber)) return ReturnCode::ok;
+
+				temp = newTask;
+
+				const ReturnCode code = temp.startTask(startState);
+
+				if (code != ReturnCode::ok) return code;
+
+				return replaceTask(temp, slot, type, taskNumber);
+			}
+
+			// Global heading of an EntranceDirection (north = 0, west = pi/2)
+			float directionToHeading(const uint8_t direction)
+			{
+				switch (direction)
+				{
+				case EntranceDirections::east:
+					return -M_PI_2;
+				case EntranceDirections::south:
+					return M_PI;
+				case EntranceDirections::west:
+					return M_PI_2;
+				default:
+					return 0.0f;
+				}
+			}
 		}
 
 		ITask::ITask() : _finished(false), _endState() {}
@@ -64,7 +160,7 @@ namespace JAFD
 
 		// Accelerate class - begin 
 
-		Accelerate::Accelerate(int16_t endSpeeds, float distance) : ITask(), _endSpeeds(endSpeeds), _distance(distance), _targetDir(1.0f, 0.0f){}
+		Accelerate::Accelerate(int16_t endSpeeds, float distance, int16_t maxSpeeds) : ITask(), _endSpeeds(endSpeeds), _distance(distance), _targetDir(1.0f, 0.0f), _maxSpeeds(maxSpeeds) {}
 
 		ReturnCode Accelerate::startTask(RobotState startState)
 		{
@@ -73,11 +169,12 @@ namespace JAFD
 			_startPos = (Vec2f)(startState.position);
 			_startSpeeds = startState.forwardVel;
 
-			if (!((_startSpeeds >= 0 && _endSpeeds >= 0 && _distance >= 0) || (_startSpeeds <= 0 && _endSpeeds <= 0 && _distance <= 0)) || _endSpeeds == _startSpeeds) return ReturnCode::error;
+			if (!((_startSpeeds >= 0 && _endSpeeds >= 0 && _distance >= 0 && _maxSpeeds >= 0) || (_startSpeeds <= 0 && _endSpeeds <= 0 && _distance <= 0 && _maxSpeeds <= 0))) return ReturnCode::error;
 
-			_totalTime = 2 * _distance / static_cast<float>(_endSpeeds + _startSpeeds);
+			// Plan speed over distance
+			if (_profile.plan(fabsf(_distance), fabsf(_startSpeeds), fabsf(_endSpeeds), fabsf(_maxSpeeds), JAFDSettings::SmoothDriving::maxAcc, JAFDSettings::SmoothDriving::maxJerk) != ReturnCode::ok) return ReturnCode::error;
 
-			_endState.wheelSpeeds = FloatWheelSpeeds{ _endSpeeds, _endSpeeds };
+			_endState.wheelSpeeds = FloatWheelSpeeds{ static_cast<float>(_endSpeeds), static_cast<float>(_endSpeeds) };
 			_endState.forwardVel = static_cast<float>(_endSpeeds);
 			_endState.position = startState.position + (Vec3f)(_targetDir * _distance);
 			_endState.angularVel = Vec3f(0.0f, 0.0f, 0.0f);
@@ -93,22 +190,20 @@ namespace JAFD
 			float currentHeading;			// Current heading of robot;
 			Vec2f posRelToStart;			// Position relative to start
 			float drivenDistance;			// Distance to startpoint (with correct sign for direction)
-			float radiant;					// Needed as temporary value for acceleration/decceleration
-			float calculatedTime;			// Calculated time based on driven distance
 			float desiredSpeed;				// Desired linear velocity
 			float desAngularVel;			// Desired angular velocity
 			float correctedForwardVel;		// Corrected forward velocity
 			float correctedAngularVel;		// Corrected angular velocity
 			WheelSpeeds output;				// Speed output for both wheels
 
-			const auto tempRobotState = SensorFusion::getFusedData().robotState;
+			const auto tempRobotState = SensorFusion::getRobotState();
 
 			currentPosition = (Vec2f)(tempRobotState.position);
 			currentHeading = tempRobotState.globalHeading;
 
 			// Calculate driven distance
 			posRelToStart = currentPosition - _startPos;
-			drivenDistance = std::max(posRelToStart.x * _targetDir.x + posRelToStart.y * _targetDir.y, 0.0f);
+			drivenDistance = std::max((posRelToStart.x * _targetDir.x + posRelToStart.y * _targetDir.y) * sgn(_distance), 0.0f);
 
 			// Check if I am there
 			if (drivenDistance >= fabsf(_distance))
@@ -129,12 +224,8 @@ namespace JAFD
 			// If finished, drive with end speeds
 			if (!_finished)
 			{
-				// Accelerate / deccelerate - v = v_1 + (t / t_ges) * (v_2 - v_1); s = _errorIntegral(v * dt) = ((v_2 - v_1) * t^2) / (2 * t_ges) + v_1 * t => radiant = t_ges * v_1^2 - 2 * s * (v_1 + v_2); t = t_ges * (v_1 - sqrt(radiant)) / (v_2 - v_1); t_ges = s * 2 / (v_2 - v_1)
-				radiant = static_cast<float>(_startSpeeds) * static_cast<float>(_startSpeeds) + 2.0f * drivenDistance * static_cast<float>(_endSpeeds - _startSpeeds) / _totalTime;
-				if (radiant < 0.0f) radiant = 0.0f;
-				calculatedTime = _totalTime * (static_cast<float>(_startSpeeds) - sqrtf(radiant) * sgn(_startSpeeds + _endSpeeds)) / static_cast<float>(_startSpeeds - _endSpeeds);
-				if (calculatedTime < 0.0f) calculatedTime = 0.0f;
-				desiredSpeed = static_cast<float>(_startSpeeds) + (calculatedTime / _totalTime) * static_cast<float>(_endSpeeds - _startSpeeds);
+				// Accelerate / deccelerate - lookup in precomputed profile
+				desiredSpeed = _profile.getSpeed(fabsf(drivenDistance)) * sgn(_distance);
 			}
 			else
 			{
@@ -146,11 +237,15 @@ namespace JAFD
 
 			float angleDamping = std::max(GoToAngle::angleDampingBegin - fabsf(fabsf(drivenDistance) - fabsf(_distance)), 0.0f) / GoToAngle::angleDampingBegin;
 
-			float errorAngle = fitAngleToInterval(getGlobalHeading(goToVec) - tempRobotState.globalHeading);
+			// Backwards the error is measured from the back of the robot, otherwise errorCos would flip the direction
+			float errorAngle = fitAngleToInterval(getGlobalHeading(goToVec) - tempRobotState.globalHeading - ((_distance < 0.0f) ? static_cast<float>(M_PI) : 0.0f));
 			errorAngle *= 1.0f - angleDamping;
 
-			desAngularVel = desiredSpeed / GoToAngle::aheadDistL * sinf(errorAngle);
-			desiredSpeed = desiredSpeed * cosf(errorAngle);
+			float errorSin, errorCos;
+			fastSinCos(errorAngle, errorSin, errorCos);
+
+			desAngularVel = fabsf(desiredSpeed) / GoToAngle::aheadDistL * errorSin;
+			desiredSpeed = desiredSpeed * errorCos;
 
 			//// A variation of pure pursuits controller where the goal point is a lookahead distance on the path away (not a lookahead distance from the robot).
 			//// Furthermore, the lookahead distance is dynamically adapted to the speed
@@ -178,7 +273,7 @@ namespace JAFD
 			correctedAngularVel = desAngularVel * PID::nonePIDPart + _angularVelPID.process(desAngularVel, tempRobotState.angularVel.x, 1.0f / freq);
 
 			// Compute wheel speeds - v = (v_r + v_l) / 2; w = (v_r - v_l) / wheelDistance => v_l = v - w * wheelDistance / 2; v_r = v + w * wheelDistance / 2
-			output = WheelSpeeds{ correctedForwardVel - JAFDSettings::Mechanics::wheelDistance * correctedAngularVel / 2.0f, correctedForwardVel + JAFDSettings::Mechanics::wheelDistance * correctedAngularVel / 2.0f };
+			output = WheelSpeeds{ static_cast<int16_t>(roundf(correctedForwardVel - JAFDSettings::Mechanics::wheelDistance * correctedAngularVel / 2.0f)), static_cast<int16_t>(roundf(correctedForwardVel + JAFDSettings::Mechanics::wheelDistance * correctedAngularVel / 2.0f)) };
 
 			// Correct speed if it is too low 
 			if (output.left < JAFDSettings::MotorControl::minSpeed && output.left > -JAFDSettings::MotorControl::minSpeed)
@@ -220,7 +315,7 @@ namespace JAFD
 				_targetDir *= -1;
 			}
 
-			_endState.wheelSpeeds = FloatWheelSpeeds{ _speeds, _speeds };
+			_endState.wheelSpeeds = FloatWheelSpeeds{ static_cast<float>(_speeds), static_cast<float>(_speeds) };
 			_endState.forwardVel = static_cast<float>(_speeds);
 			_endState.position = startState.position + (Vec3f)(_targetDir * fabsf(_distance));
 			_endState.angularVel = Vec3f(0.0f, 0.0f, 0.0f);
@@ -244,7 +339,7 @@ namespace JAFD
 			float correctedForwardVel;		// Corrected forward velocity
 			float correctedAngularVel;		// Corrected angular velocity
 
-			const auto tempRobotState = SensorFusion::getFusedData().robotState;
+			const auto tempRobotState = SensorFusion::getRobotState();
 
 			currentPosition = (Vec2f)(tempRobotState.position);
 			currentHeading = tempRobotState.globalHeading;
@@ -264,11 +359,15 @@ namespace JAFD
 
 			float angleDamping = std::max(GoToAngle::angleDampingBegin - fabsf(absDrivenDist - fabsf(_distance)), 0.0f) / GoToAngle::angleDampingBegin;
 
-			float errorAngle = fitAngleToInterval(getGlobalHeading(goToVec) - tempRobotState.globalHeading);
+			// Backwards the error is measured from the back of the robot (see Accelerate)
+			float errorAngle = fitAngleToInterval(getGlobalHeading(goToVec) - tempRobotState.globalHeading - ((_distance < 0.0f) ? static_cast<float>(M_PI) : 0.0f));
 			errorAngle *= 1.0f - angleDamping;
 
-			desAngularVel = _speeds / GoToAngle::aheadDistL * sinf(errorAngle);
-			desiredSpeed = _speeds * cosf(errorAngle);
+			float errorSin, errorCos;
+			fastSinCos(errorAngle, errorSin, errorCos);
+
+			desAngularVel = fabsf(_speeds) / GoToAngle::aheadDistL * errorSin;
+			desiredSpeed = _speeds * errorCos;
 
 			//// A variation of pure pursuits controller where the goal point is a lookahead distance on the path away (not a lookahead distance from the robot).
 			//// Furthermore, the lookahead distance is dynamically adapted to the speed
@@ -297,7 +396,7 @@ namespace JAFD
 			correctedAngularVel = desAngularVel * PID::nonePIDPart + _angularVelPID.process(desAngularVel, tempRobotState.angularVel.x, 1.0f / freq);
 
 			// Compute wheel speeds - v = (v_r + v_l) / 2; w = (v_r - v_l) / wheelDistance => v_l = v - w * wheelDistance / 2; v_r = v + w * wheelDistance / 2
-			output = WheelSpeeds{ correctedForwardVel - JAFDSettings::Mechanics::wheelDistance * correctedAngularVel / 2.0f, correctedForwardVel + JAFDSettings::Mechanics::wheelDistance * correctedAngularVel / 2.0f };
+			output = WheelSpeeds{ static_cast<int16_t>(roundf(correctedForwardVel - JAFDSettings::Mechanics::wheelDistance * correctedAngularVel / 2.0f)), static_cast<int16_t>(roundf(correctedForwardVel + JAFDSettings::Mechanics::wheelDistance * correctedAngularVel / 2.0f)) };
 
 			// Correct speed if it is too low 
 			if (output.left < JAFDSettings::MotorControl::minSpeed && output.left > -JAFDSettings::MotorControl::minSpeed)
@@ -348,19 +447,19 @@ namespace JAFD
 
 		// Rotate class - begin
 
-		Rotate::Rotate(float maxAngularVel, float angle) : ITask(), _maxAngularVel(maxAngularVel), _angle(angle / 180.0f * M_PI), _accelerate(true) {}
+		Rotate::Rotate(float maxAngularVel, float angle) : ITask(), _maxAngularVel(maxAngularVel), _angle(angle / 180.0f * M_PI) {}
 
 		ReturnCode Rotate::startTask(RobotState startState)
 		{
 			_finished = false;
 			_startAngle = startState.globalHeading;
-			_accelerate = true;
 
 			if (abs(startState.wheelSpeeds.left) > JAFDSettings::MotorControl::minSpeed || abs(startState.wheelSpeeds.right) > JAFDSettings::MotorControl::minSpeed) return ReturnCode::error;
 
-			_totalTime = _angle / _maxAngularVel * 2.0f;
+			if (_angle * _maxAngularVel < 0.0f || _maxAngularVel == 0.0f) return ReturnCode::error;
 
-			if (_totalTime < 0.0f) return ReturnCode::error;
+			// Plan angular velocity over rotated angle
+			if (_angle != 0.0f && _profile.plan(fabsf(_angle), 0.0f, 0.0f, fabsf(_maxAngularVel), JAFDSettings::SmoothDriving::maxAngularAcc, JAFDSettings::SmoothDriving::maxAngularJerk) != ReturnCode::ok) return ReturnCode::error;
 
 			_endState.wheelSpeeds = FloatWheelSpeeds{ 0.0f, 0.0f };
 			_endState.forwardVel = static_cast<float>(0.0f);
@@ -382,7 +481,7 @@ namespace JAFD
 			float correctedAngularVel;	// By PID Controller corrected angular velocity
 			WheelSpeeds output;			// Output
 
-			const auto tempRobotState = SensorFusion::getFusedData().robotState;
+			const auto tempRobotState = SensorFusion::getRobotState();
 
 			// Calculate rotated angle
 			rotatedAngle = tempRobotState.globalHeading - _startAngle;
@@ -398,27 +497,14 @@ namespace JAFD
 				return WheelSpeeds{ 0, 0 };
 			}
 
-			// Accelerate / deccelerate
-			if (_accelerate)
-			{
-				// w(t) = w_max * 2 * t / t_ges => a(t) = w_max * t^2 / t_ges => t(a) = sqrt(a * t_ges / w_max); w(a) = w_max * 2 * sqrt(a * t_ges / w_max) / t_ges = sqrt(4 * a * w_max / t_ges)
-				desAngularVel = sqrtf(4.0f * fabsf(rotatedAngle * _maxAngularVel) / _totalTime) * sgn(_maxAngularVel);
-
-				if (fabsf(rotatedAngle) >= fabsf(_angle) / 2.0f)
-				{
-					_accelerate = false;
-				}
-			}
-			else
-			{
-				desAngularVel = _maxAngularVel - sqrtf(4.0f * fabsf((rotatedAngle - _angle / 2.0f) * _maxAngularVel) / _totalTime) * sgn(_maxAngularVel);
-			}
+			// Accelerate / deccelerate - lookup in precomputed profile
+			desAngularVel = _profile.getSpeed(fabsf(rotatedAngle)) * sgn(_angle);
 
 			// Kind of PID - controller
 			correctedAngularVel = desAngularVel * 0.8f + _angularVelPID.process(desAngularVel, tempRobotState.angularVel.x, 1.0f / freq);
 	
 			// Compute wheel speeds -- w = (v_r - v_l) / wheelDistance; v_l = -v_r; => v_l = -w * wheelDistance / 2; v_r = w * wheelDistance / 2
-			output = WheelSpeeds{ -JAFDSettings::Mechanics::wheelDistance * correctedAngularVel / 2.0f, JAFDSettings::Mechanics::wheelDistance * correctedAngularVel / 2.0f };
+			output = WheelSpeeds{ static_cast<int16_t>(roundf(-JAFDSettings::Mechanics::wheelDistance * correctedAngularVel / 2.0f)), static_cast<int16_t>(roundf(JAFDSettings::Mechanics::wheelDistance * correctedAngularVel / 2.0f)) };
 
 			// Correct speed if it is too low
 			if (output.right < JAFDSettings::MotorControl::minSpeed && output.right > -JAFDSettings::MotorControl::minSpeed)
@@ -450,7 +536,7 @@ namespace JAFD
 				_targetDir *= -1;
 			}
 
-			_endState.wheelSpeeds = FloatWheelSpeeds{ _speeds, _speeds };
+			_endState.wheelSpeeds = FloatWheelSpeeds{ static_cast<float>(_speeds), static_cast<float>(_speeds) };
 			_endState.forwardVel = static_cast<float>(_speeds);
 			_endState.position = startState.position + (Vec3f)(_targetDir * fabsf(_distance));
 			_endState.angularVel = Vec3f(0.0f, 0.0f, 0.0f);
@@ -474,7 +560,7 @@ namespace JAFD
 			float correctedForwardVel;		// Corrected forward velocity
 			float correctedAngularVel;		// Corrected angular velocity
 
-			const auto tempRobotState = SensorFusion::getFusedData().robotState;
+			const auto tempRobotState = SensorFusion::getRobotState();
 
 			currentPosition = (Vec2f)(tempRobotState.position);
 			currentHeading = tempRobotState.globalHeading;
@@ -494,11 +580,15 @@ namespace JAFD
 
 			float angleDamping = std::max(GoToAngle::angleDampingBegin - fabsf(absDrivenDist - fabsf(_distance)), 0.0f) / GoToAngle::angleDampingBegin;
 
-			float errorAngle = fitAngleToInterval(getGlobalHeading(goToVec) - tempRobotState.globalHeading);
+			// Backwards the error is measured from the back of the robot (see Accelerate)
+			float errorAngle = fitAngleToInterval(getGlobalHeading(goToVec) - tempRobotState.globalHeading - ((_distance < 0.0f) ? static_cast<float>(M_PI) : 0.0f));
 			errorAngle *= 1.0f - angleDamping;
 
-			desAngularVel = _speeds / GoToAngle::aheadDistL * sinf(errorAngle);
-			desiredSpeed = _speeds * cosf(errorAngle);
+			float errorSin, errorCos;
+			fastSinCos(errorAngle, errorSin, errorCos);
+
+			desAngularVel = fabsf(_speeds) / GoToAngle::aheadDistL * errorSin;
+			desiredSpeed = _speeds * errorCos;
 
 			//// A variation of pure pursuits controller where the goal point is a lookahead distance on the path away (not a lookahead distance from the robot).
 			//// Furthermore, the lookahead distance is dynamically adapted to the speed
@@ -527,7 +617,7 @@ namespace JAFD
 			correctedAngularVel = desAngularVel * PID::nonePIDPart + _angularVelPID.process(desAngularVel, tempRobotState.angularVel.x, 1.0f / freq);
 
 			// Compute wheel speeds - v = (v_r + v_l) / 2; w = (v_r - v_l) / wheelDistance => v_l = v - w * wheelDistance / 2; v_r = v + w * wheelDistance / 2
-			output = WheelSpeeds{ correctedForwardVel - JAFDSettings::Mechanics::wheelDistance * correctedAngularVel / 2.0f, correctedForwardVel + JAFDSettings::Mechanics::wheelDistance * correctedAngularVel / 2.0f };
+			output = WheelSpeeds{ static_cast<int16_t>(roundf(correctedForwardVel - JAFDSettings::Mechanics::wheelDistance * correctedAngularVel / 2.0f)), static_cast<int16_t>(roundf(correctedForwardVel + JAFDSettings::Mechanics::wheelDistance * correctedAngularVel / 2.0f)) };
 
 			// Correct speed if it is too low 
 			if (output.left < JAFDSettings::MotorControl::minSpeed && output.left > -JAFDSettings::MotorControl::minSpeed)
@@ -611,8 +701,9 @@ namespace JAFD
 		WheelSpeeds AlignFront::updateSpeeds(const uint8_t freq)
 		{
 			static WheelSpeeds output;
-			const auto tempDistances = SensorFusion::getFusedData().distances;
-			const auto tempDistSensStates = SensorFusion::getFusedData().distSensorState;
+			const auto tempFusedData = SensorFusion::getFusedData();
+			const auto tempDistances = tempFusedData.distances;
+			const auto tempDistSensStates = tempFusedData.distSensorState;
 
 			if (_finished)
 			{
@@ -672,721 +763,896 @@ namespace JAFD
 
 		// AlignFront class - end
 
-		// TaskArray class - begin
+		// FollowPath class - begin
 
-		TaskArray::TaskArray(const TaskArray& taskArray) : ITask(), _numTasks(taskArray._numTasks), _currentTaskNum(taskArray._numTasks - 1)
+		FollowPath::FollowPath(const uint8_t* directions, const uint8_t pathLength) : ITask(), _directions(), _pathLength(0), _segments(), _numSegments(0), _currentSegment(0), _nextPlanned(false)
 		{
-			_endState = taskArray._endState;
+			if (directions == nullptr) return;
 
-			for (uint8_t i = 0; i < _numTasks; i++)
+			while (_pathLength < pathLength && _pathLength < JAFDSettings::SmoothDriving::maxPathLength && directions[_pathLength] != EntranceDirections::nowhere)
 			{
-				_taskTypes[i] = taskArray._taskTypes[i];
-
-				switch (_taskTypes[i])
-				{
-				case _TaskType::accelerate:
-					_taskArray[i] = new (&(_taskCopies[i].accelerate)) Accelerate(taskArray._taskCopies[i].accelerate);
-					break;
-				case _TaskType::straight:
-					_taskArray[i] = new (&(_taskCopies[i].straight)) DriveStraight(taskArray._taskCopies[i].straight);
-					break;
-				case _TaskType::stop:
-					_taskArray[i] = new (&(_taskCopies[i].stop)) Stop(taskArray._taskCopies[i].stop);
-					break;
-				case _TaskType::rotate:
-					_taskArray[i] = new (&(_taskCopies[i].rotate)) Rotate(taskArray._taskCopies[i].rotate);
-					break;
-				case _TaskType::forceSpeed:
-					_taskArray[i] = new (&(_taskCopies[i].forceSpeed)) ForceSpeed(taskArray._taskCopies[i].forceSpeed);
-				default:
-					break;
-				}
+				_directions[_pathLength] = directions[_pathLength];
+				_pathLength++;
 			}
 		}
 
-		TaskArray::TaskArray(const Accelerate& task) : ITask()
-		{
-			_taskTypes[_numTasks] = _TaskType::accelerate;
-			_taskArray[_numTasks] = new(&(_taskCopies[_numTasks].accelerate)) Accelerate(task);
-			_currentTaskNum = _numTasks;
-			_numTasks++;
-		}
-
-		TaskArray::TaskArray(const DriveStraight& task) : ITask()
+		ReturnCode FollowPath::addSegment(const _SegmentType type, const Vec2f start, const float heading, const float length, const float curvature, const float maxSpeed)
 		{
-			_taskTypes[_numTasks] = _TaskType::straight;
-			_taskArray[_numTasks] = new(&(_taskCopies[_numTasks].straight)) DriveStraight(task);
-			_currentTaskNum = _numTasks;
-			_numTasks++;
-		}
+			if (_numSegments >= sizeof(_segments) / sizeof(*_segments)) return ReturnCode::error;
 
-		TaskArray::TaskArray(const Stop& task) : ITask()
-		{
-			_taskTypes[_numTasks] = _TaskType::stop;
-			_taskArray[_numTasks] = new(&(_taskCopies[_numTasks].stop)) Stop(task);
-			_currentTaskNum = _numTasks;
-			_numTasks++;
-		}
+			_segments[_numSegments++] = _Segment{ type, start, heading, length, curvature, maxSpeed, 0.0f };
 
-		TaskArray::TaskArray(const Rotate& task) : ITask()
-		{
-			_taskTypes[_numTasks] = _TaskType::rotate;
-			_taskArray[_numTasks] = new(&(_taskCopies[_numTasks].rotate)) Rotate(task);
-			_currentTaskNum = _numTasks;
-			_numTasks++;
+			return ReturnCode::ok;
 		}
 
-		TaskArray::TaskArray(const ForceSpeed& task) : ITask()
+		ReturnCode FollowPath::planSegment(const uint8_t segment, const float startSpeed, MotionProfile& profile) const
 		{
-			_taskTypes[_numTasks] = _TaskType::forceSpeed;
-			_taskArray[_numTasks] = new(&(_taskCopies[_numTasks].forceSpeed)) ForceSpeed(task);
-			_currentTaskNum = _numTasks;
-			_numTasks++;
-		}
+			const _Segment& newSegment = _segments[segment];
 
-		TaskArray::TaskArray(const AlignFront& task) : ITask()
-		{
-			_taskTypes[_numTasks] = _TaskType::alignFront;
-			_taskArray[_numTasks] = new(&(_taskCopies[_numTasks].alignFront)) AlignFront(task);
-			_currentTaskNum = _numTasks;
-			_numTasks++;
+			if (newSegment.type == _SegmentType::turn) return profile.plan(newSegment.length, 0.0f, 0.0f, newSegment.maxSpeed, JAFDSettings::SmoothDriving::maxAngularAcc, JAFDSettings::SmoothDriving::maxAngularJerk);
+			else return profile.plan(newSegment.length, startSpeed, newSegment.endSpeed, newSegment.maxSpeed, JAFDSettings::SmoothDriving::maxAcc, JAFDSettings::SmoothDriving::maxJerk);
 		}
 
-		ReturnCode TaskArray::startTask(RobotState startState)
+		ReturnCode FollowPath::nextSegment()
 		{
-			ReturnCode code = ReturnCode::ok;
-			RobotState state = startState;
+			const uint8_t segment = _currentSegment + 1;
 
-			for (int16_t i = _numTasks - 1; i >= 0; i--)
+			if (_nextPlanned)
 			{
-				if (_taskArray[i]->startTask(state) != ReturnCode::ok)
-				{
-					code = ReturnCode::error;
-				}
-				else
-				{
-				}
+				_profile = _nextProfile;
+			}
+			else
+			{
+				Telemetry::logEvent(Telemetry::Event::segmentPlannedLate, segment);
 
-				state = _taskArray[i]->getEndState();
+				if (planSegment(segment, _segments[_currentSegment].endSpeed, _profile) != ReturnCode::ok) return ReturnCode::error;
 			}
 
-			_endState = state;
-			
-			return code;
+			_currentSegment = segment;
+			_nextPlanned = false;
+
+			return ReturnCode::ok;
 		}
 
-		WheelSpeeds TaskArray::updateSpeeds(const uint8_t freq)
+		ReturnCode FollowPath::startTask(RobotState startState)
 		{
-			WheelSpeeds speeds = _taskArray[_currentTaskNum]->updateSpeeds(freq);
+			constexpr float arcRadius = JAFDSettings::Field::cellWidth / 2.0f;
 
-			if (_taskArray[_currentTaskNum]->isFinished())
-			{
-				if (_currentTaskNum <= 0)
-				{
-					_finished = true;
-					return speeds;
-				}
+			const float arcSpeed = std::min(JAFDSettings::SmoothDriving::pathSpeed, sqrtf(JAFDSettings::SmoothDriving::maxLateralAcc * arcRadius));
 
-				_currentTaskNum--;
+			_finished = false;
+			_numSegments = 0;
+			_currentSegment = 0;
+			_nextPlanned = false;
 
-				_taskArray[_currentTaskNum]->startTask(_taskArray[_currentTaskNum + 1]->getEndState());
-			}
+			if (_pathLength == 0) return ReturnCode::error;
 
-			return speeds;
-		}
+			// Start in the center of the current cell, aligned to the grid
+			Vec2f point = Vec2f(roundf(startState.position.x / JAFDSettings::Field::cellWidth), roundf(startState.position.y / JAFDSettings::Field::cellWidth)) * JAFDSettings::Field::cellWidth;
+			float heading = roundf(startState.globalHeading / M_PI_2) * M_PI_2;
+			float startSpeed = fabsf(startState.forwardVel);
 
-		// TaskArray class - end
+			// Turn on the spot to the first direction
+			const float firstTurn = fitAngleToInterval(directionToHeading(_directions[0]) - heading);
 
-		// Update speeds for both wheels
-		void updateSpeeds(const uint8_t freq)
-		{
-			if (!_stopped)
-			{
-				MotorControl::setSpeeds(_currentTask->updateSpeeds(freq));
-			}
-			else
+			if (fabsf(firstTurn) > 0.1f)
 			{
-				_angularVelPID.reset();
-				_forwardVelPID.reset();
-			}
-		}
+				if (startSpeed > JAFDSettings::MotorControl::minSpeed) return ReturnCode::error;
 
-		// Set new Accelerate task (use last end state to start)
-		template<>
-		ReturnCode setNewTask<NewStateType::lastEndState>(const Accelerate& newTask, const bool forceOverride)
-		{
-			static RobotState endState;
-			static ReturnCode returnCode;
-			static Accelerate temp;
+				addSegment(_SegmentType::turn, point, heading, fabsf(firstTurn), sgn(firstTurn), JAFDSettings::SmoothDriving::pathTurnSpeed);
 
-			returnCode = ReturnCode::ok;
+				heading += firstTurn;
+				startSpeed = 0.0f;
+			}
 
-			__disable_irq();
+			// Straight runs with arcs in between
+			bool arcBefore = false;
 
-			if (_currentTask->isFinished() || forceOverride)
+			for (uint8_t i = 0; i < _pathLength;)
 			{
-				endState = static_cast<RobotState>(_currentTask->getEndState());
+				uint8_t runLength = 1;
 
-				temp = newTask;
-				returnCode = temp.startTask(endState);
+				while (i + runLength < _pathLength && _directions[i + runLength] == _directions[i]) runLength++;
 
-				if (returnCode == ReturnCode::ok)
-				{
-					_currentTask = new (&(_taskCopies.accelerate)) Accelerate(temp);
-					_stopped = false;
-				}
-			}
+				const float turn = (i + runLength < _pathLength) ? fitAngleToInterval(directionToHeading(_directions[i + runLength]) - directionToHeading(_directions[i])) : 0.0f;
+				const bool arcAfter = fabsf(fabsf(turn) - M_PI_2) < 0.1f;
+				const Vec2f dir = Vec2f(cosf(heading), sinf(heading));
 
-			__enable_irq();
-			return returnCode;
-		}
+				const float lineStart = arcBefore ? arcRadius : 0.0f;
+				const float lineLength = runLength * JAFDSettings::Field::cellWidth - lineStart - (arcAfter ? arcRadius : 0.0f);
 
-		// Set new Accelerate task (use current state to start)
-		template<>
-		ReturnCode setNewTask<NewStateType::currentState>(const Accelerate& newTask, const bool forceOverride)
-		{
-			static ReturnCode returnCode;
-			static Accelerate temp;
+				if (lineLength > 0.5f && addSegment(_SegmentType::line, point + dir * lineStart, heading, lineLength, 0.0f, JAFDSettings::SmoothDriving::pathSpeed) != ReturnCode::ok) return ReturnCode::error;
 
-			returnCode = ReturnCode::ok;
+				// Center of the last cell of this run
+				point += dir * (runLength * JAFDSettings::Field::cellWidth);
+				i += runLength;
 
-			__disable_irq();
+				// End of path or reversal
+				if (!arcAfter) break;
+
+				if (addSegment(_SegmentType::arc, point - dir * arcRadius, heading, arcRadius * M_PI_2, sgn(turn) / arcRadius, arcSpeed) != ReturnCode::ok) return ReturnCode::error;
 
-			if (_currentTask->isFinished() || forceOverride)
+				heading += turn;
+				arcBefore = true;
+			}
+
+			// Speed at the end of every segment - stop before and after turning on the spot
+			for (uint8_t i = 0; i < _numSegments; i++)
 			{
-				temp = newTask;
-				returnCode = temp.startTask(SensorFusion::getFusedData().robotState);
+				_Segment& segment = _segments[i];
 
-				if (returnCode == ReturnCode::ok)
-				{
-					_currentTask = new (&(_taskCopies.accelerate)) Accelerate(temp);
-					_stopped = false;
-				}
+				if (i + 1 < _numSegments && segment.type != _SegmentType::turn && _segments[i + 1].type != _SegmentType::turn) segment.endSpeed = std::min(segment.maxSpeed, _segments[i + 1].maxSpeed);
+				else segment.endSpeed = 0.0f;
 			}
 
-			__enable_irq();
-			return returnCode;
+			_endState.wheelSpeeds = FloatWheelSpeeds{ 0.0f, 0.0f };
+			_endState.forwardVel = 0.0f;
+			_endState.position = Vec3f(point.x, point.y, startState.position.z);
+			_endState.angularVel = Vec3f(0.0f, 0.0f, 0.0f);
+			_endState.globalHeading = heading;
+
+			_forwardVelPID.reset();
+			_angularVelPID.reset();
+
+			return planSegment(0, startSpeed, _profile);
 		}
 
-		// Set new Accelerate task (use specified state to start)
-		ReturnCode setNewTask(const Accelerate& newTask, RobotState startState, const bool forceOverride)
+		// Update speeds for both wheels
+		WheelSpeeds FollowPath::updateSpeeds(const uint8_t freq)
 		{
-			static ReturnCode returnCode;
-			static Accelerate temp;
-
-			returnCode = ReturnCode::ok;
+			float progress;					// Driven length of current segment
+			float crossTrackError;			// Distance to the path (positive = left of path)
+			float desiredSpeed;				// Desired linear velocity
+			float desAngularVel;			// Desired angular velocity
+			float correctedForwardVel;		// Corrected forward velocity
+			float correctedAngularVel;		// Corrected angular velocity
+			WheelSpeeds output;				// Speed output for both wheels
 
-			__disable_irq();
+			const auto tempRobotState = SensorFusion::getRobotState();
+			const Vec2f currentPosition = (Vec2f)(tempRobotState.position);
 
-			if (_currentTask->isFinished() || forceOverride)
+			// Progress in current segment - switch to the next one when it is done
+			while (true)
 			{
-				temp = newTask;
-				returnCode = temp.startTask(startState);
+				const _Segment& segment = _segments[_currentSegment];
+				Vec2f dir;
+				fastSinCos(segment.heading, dir.y, dir.x);
+
+				const Vec2f relPos = currentPosition - segment.start;
 
-				if (returnCode == ReturnCode::ok)
+				switch (segment.type)
+				{
+				case _SegmentType::turn:
+					progress = (tempRobotState.globalHeading - segment.heading) * segment.curvature;
+					crossTrackError = 0.0f;
+					break;
+				case _SegmentType::line:
+					progress = dir.x * relPos.x + dir.y * relPos.y;
+					crossTrackError = dir.x * relPos.y - dir.y * relPos.x;
+					break;
+				default:
 				{
-					_currentTask = new (&(_taskCopies.accelerate)) Accelerate(temp);
-					_stopped = false;
+					// Center is on the inner side of the arc
+					const float radius = 1.0f / fabsf(segment.curvature);
+					const Vec2f center = segment.start + Vec2f(-dir.y, dir.x) * (1.0f / segment.curvature);
+					const Vec2f startRel = segment.start - center;
+					const Vec2f currentRel = currentPosition - center;
+
+					progress = fastAtan2(startRel.x * currentRel.y - startRel.y * currentRel.x, startRel.x * currentRel.x + startRel.y * currentRel.y) * sgn(segment.curvature) * radius;
+					crossTrackError = (radius - currentRel.length()) * sgn(segment.curvature);
+					break;
+				}
 				}
-			}
 
-			__enable_irq();
-			return returnCode;
-		}
+				if (progress < segment.length) break;
 
-		// Set new DriveStraight task (use last end state to start)
-		template<>
-		ReturnCode setNewTask<NewStateType::lastEndState>(const DriveStraight& newTask, const bool forceOverride)
-		{
-			static RobotState endState;
-			static ReturnCode returnCode;
-			static DriveStraight temp;
+				if (_currentSegment + 1 >= _numSegments)
+				{
+					_forwardVelPID.reset();
+					_angularVelPID.reset();
 
-			returnCode = ReturnCode::ok;
+					_finished = true;
 
-			__disable_irq();
+					return WheelSpeeds{ 0, 0 };
+				}
 
-			if (_currentTask->isFinished() || forceOverride)
-			{
-				endState = static_cast<RobotState>(_currentTask->getEndState());
+				// Stop where the robot is if the next segment can't be driven
+				if (nextSegment() != ReturnCode::ok)
+				{
+					_forwardVelPID.reset();
+					_angularVelPID.reset();
 
-				temp = newTask;
-				returnCode = temp.startTask(endState);
+					_endState.wheelSpeeds = FloatWheelSpeeds{ 0.0f, 0.0f };
+					_endState.forwardVel = 0.0f;
+					_endState.position = tempRobotState.position;
+					_endState.angularVel = Vec3f(0.0f, 0.0f, 0.0f);
+					_endState.globalHeading = tempRobotState.globalHeading;
 
-				if (returnCode == ReturnCode::ok)
-				{
-					_currentTask = new (&(_taskCopies.straight)) DriveStraight(temp);
-					_stopped = false;
+					_finished = true;
+
+					return WheelSpeeds{ 0, 0 };
 				}
 			}
 
-			__enable_irq();
-			return returnCode;
-		}
-
-		// Set new DriveStraight task (use current state to start)
-		template<>
-		ReturnCode setNewTask<NewStateType::currentState>(const DriveStraight& newTask, const bool forceOverride)
-		{
-			static ReturnCode returnCode;
-			static DriveStraight temp;
+			const _Segment& segment = _segments[_currentSegment];
 
-			returnCode = ReturnCode::ok;
+			if (segment.type == _SegmentType::turn)
+			{
+				desAngularVel = _profile.getSpeed(progress) * sgn(segment.curvature);
 
-			__disable_irq();
+				// Kind of PID - controller
+				correctedAngularVel = desAngularVel * 0.8f + _angularVelPID.process(desAngularVel, tempRobotState.angularVel.x, 1.0f / freq);
 
-			if (_currentTask->isFinished() || forceOverride)
-			{
-				temp = newTask;
-				returnCode = temp.startTask(SensorFusion::getFusedData().robotState);
+				// Compute wheel speeds -- w = (v_r - v_l) / wheelDistance; v_l = -v_r; => v_l = -w * wheelDistance / 2; v_r = w * wheelDistance / 2
+				output = WheelSpeeds{ static_cast<int16_t>(roundf(-JAFDSettings::Mechanics::wheelDistance * correctedAngularVel / 2.0f)), static_cast<int16_t>(roundf(JAFDSettings::Mechanics::wheelDistance * correctedAngularVel / 2.0f)) };
 
-				if (returnCode == ReturnCode::ok)
+				// Correct speed if it is too low
+				if (output.right < JAFDSettings::MotorControl::minSpeed && output.right > -JAFDSettings::MotorControl::minSpeed)
 				{
-					_currentTask = new (&(_taskCopies.straight)) DriveStraight(temp);
-					_stopped = false;
+					_angularVelPID.reset();
+					output.right = JAFDSettings::MotorControl::minSpeed * sgn(segment.curvature);
+					output.left = -output.right;
 				}
+
+				return output;
 			}
 
-			__enable_irq();
-			return returnCode;
-		}
+			// Lookup in precomputed profile; steer along the path and back to it if the pose got corrected
+			const float pathHeading = segment.heading + segment.curvature * std::max(std::min(progress, segment.length), 0.0f);
+			const float headingError = fitAngleToInterval(pathHeading - tempRobotState.globalHeading);
 
-		// Set new DriveStraight task (use specified state to start)
-		ReturnCode setNewTask(const DriveStraight& newTask, RobotState startState, const bool forceOverride)
-		{
-			static ReturnCode returnCode;
-			static DriveStraight temp;
+			desiredSpeed = _profile.getSpeed(progress);
+			desAngularVel = desiredSpeed * segment.curvature + JAFDSettings::SmoothDriving::headingGain * headingError - JAFDSettings::SmoothDriving::crossTrackGain * crossTrackError * desiredSpeed;
 
-			returnCode = ReturnCode::ok;
+			// Kind of PID - controller
+			correctedForwardVel = desiredSpeed * PID::nonePIDPart + _forwardVelPID.process(desiredSpeed, tempRobotState.forwardVel, 1.0f / freq);
+			correctedAngularVel = desAngularVel * PID::nonePIDPart + _angularVelPID.process(desAngularVel, tempRobotState.angularVel.x, 1.0f / freq);
 
-			__disable_irq();
+			// Compute wheel speeds - v = (v_r + v_l) / 2; w = (v_r - v_l) / wheelDistance => v_l = v - w * wheelDistance / 2; v_r = v + w * wheelDistance / 2
+			output = WheelSpeeds{ static_cast<int16_t>(roundf(correctedForwardVel - JAFDSettings::Mechanics::wheelDistance * correctedAngularVel / 2.0f)), static_cast<int16_t>(roundf(correctedForwardVel + JAFDSettings::Mechanics::wheelDistance * correctedAngularVel / 2.0f)) };
 
-			if (_currentTask->isFinished() || forceOverride)
+			// Correct speed if it is too low
+			if (output.left < JAFDSettings::MotorControl::minSpeed && output.left > -JAFDSettings::MotorControl::minSpeed)
 			{
-				temp = newTask;
-				returnCode = temp.startTask(startState);
+				_forwardVelPID.reset();
+				_angularVelPID.reset();
 
-				if (returnCode == ReturnCode::ok)
-				{
-					_currentTask = new (&(_taskCopies.straight)) DriveStraight(temp);
-					_stopped = false;
-				}
+				output.left = JAFDSettings::MotorControl::minSpeed;
 			}
 
-			__enable_irq();
-			return returnCode;
+			if (output.right < JAFDSettings::MotorControl::minSpeed && output.right > -JAFDSettings::MotorControl::minSpeed)
+			{
+				_forwardVelPID.reset();
+				_angularVelPID.reset();
+
+				output.right = JAFDSettings::MotorControl::minSpeed;
+			}
+
+			return output;
 		}
 
-		// Set new Stop task (use last end state to start)
-		template<>
-		ReturnCode setNewTask<NewStateType::lastEndState>(const Stop& newTask, const bool forceOverride)
+		// FollowPath class - end
+
+		// TaskPool - begin
+
+		namespace TaskPool
 		{
-			static RobotState endState;
-			static ReturnCode returnCode;
-			static Stop temp;
+			namespace
+			{
+				// Slots of one task type
+				template<typename T, uint8_t size>
+				struct Pool
+				{
+					T tasks[size];
+					uint8_t refCounts[size];
+				};
+
+				Pool<Accelerate, JAFDSettings::SmoothDriving::TaskPool::accelerateSlots> _accelerates;
+				Pool<DriveStraight, JAFDSettings::SmoothDriving::TaskPool::straightSlots> _straights;
+				Pool<Stop, JAFDSettings::SmoothDriving::TaskPool::stopSlots> _stops;
+				Pool<Rotate, JAFDSettings::SmoothDriving::TaskPool::rotateSlots> _rotates;
+				Pool<ForceSpeed, JAFDSettings::SmoothDriving::TaskPool::forceSpeedSlots> _forceSpeeds;
+				Pool<AlignFront, JAFDSettings::SmoothDriving::TaskPool::alignFrontSlots> _alignFronts;
+
+				template<typename T, uint8_t size>
+				ReturnCode addToPool(Pool<T, size>& pool, const T& task, const TaskType type, Handle& handle)
+				{
+					for (uint8_t i = 0; i < size; i++)
+					{
+						if (pool.refCounts[i] == 0)
+						{
+							pool.tasks[i] = task;
+							pool.refCounts[i] = 1;
 
-			returnCode = ReturnCode::ok;
+							handle.type = type;
+							handle.index = i;
 
-			__disable_irq();
+							return ReturnCode::ok;
+						}
+					}
 
-			if (_currentTask->isFinished() || forceOverride)
-			{
-				endState = static_cast<RobotState>(_currentTask->getEndState());
+					return ReturnCode::error;
+				}
 
-				temp = newTask;
-				returnCode = temp.startTask(endState);
+				template<typename T, uint8_t size>
+				uint8_t countFree(const Pool<T, size>& pool)
+				{
+					uint8_t free = 0;
+
+					for (uint8_t i = 0; i < size; i++)
+					{
+						if (pool.refCounts[i] == 0) free++;
+					}
+
+					return free;
+				}
 
-				if (returnCode == ReturnCode::ok)
+				// Reference count of a handle
+				uint8_t* refCount(const Handle handle)
 				{
-					_currentTask = new (&(_taskCopies.stop)) Stop(temp);
-					_stopped = false;
+					switch (handle.type)
+					{
+					case TaskType::accelerate:
+						return &_accelerates.refCounts[handle.index];
+					case TaskType::straight:
+						return &_straights.refCounts[handle.index];
+					case TaskType::stop:
+						return &_stops.refCounts[handle.index];
+					case TaskType::rotate:
+						return &_rotates.refCounts[handle.index];
+					case TaskType::forceSpeed:
+						return &_forceSpeeds.refCounts[handle.index];
+					case TaskType::alignFront:
+						return &_alignFronts.refCounts[handle.index];
+					default:
+						return nullptr;
+					}
 				}
 			}
 
-			__enable_irq();
-			return returnCode;
-		}
+			ReturnCode add(const Accelerate& task, Handle& handle)
+			{
+				return addToPool(_accelerates, task, TaskType::accelerate, handle);
+			}
 
-		// Set new Stop task (use current state to start)
-		template<>
-		ReturnCode setNewTask<NewStateType::currentState>(const Stop& newTask, const bool forceOverride)
-		{
-			static ReturnCode returnCode;
-			static Stop temp;
+			ReturnCode add(const DriveStraight& task, Handle& handle)
+			{
+				return addToPool(_straights, task, TaskType::straight, handle);
+			}
 
-			returnCode = ReturnCode::ok;
+			ReturnCode add(const Stop& task, Handle& handle)
+			{
+				return addToPool(_stops, task, TaskType::stop, handle);
+			}
 
-			__disable_irq();
+			ReturnCode add(const Rotate& task, Handle& handle)
+			{
+				return addToPool(_rotates, task, TaskType::rotate, handle);
+			}
 
-			if (_currentTask->isFinished() || forceOverride)
+			ReturnCode add(const ForceSpeed& task, Handle& handle)
 			{
-				temp = newTask;
-				returnCode = temp.startTask(SensorFusion::getFusedData().robotState);
+				return addToPool(_forceSpeeds, task, TaskType::forceSpeed, handle);
+			}
 
-				if (returnCode == ReturnCode::ok)
-				{
-					_currentTask = new (&(_taskCopies.stop)) Stop(temp);
-					_stopped = false;
-				}
+			ReturnCode add(const AlignFront& task, Handle& handle)
+			{
+				return addToPool(_alignFronts, task, TaskType::alignFront, handle);
 			}
 
-			__enable_irq();
-			return returnCode;
-		}
+			void retain(const Handle handle)
+			{
+				uint8_t* count = refCount(handle);
 
-		// Set new Stop task (use specified state to start)
-		ReturnCode setNewTask(const Stop& newTask, RobotState startState, const bool forceOverride)
-		{
-			static ReturnCode returnCode;
-			static Stop temp;
+				if (count != nullptr && *count < 0xff) (*count)++;
+			}
 
-			returnCode = ReturnCode::ok;
+			void release(const Handle handle)
+			{
+				uint8_t* count = refCount(handle);
 
-			__disable_irq();
+				if (count != nullptr && *count > 0) (*count)--;
+			}
 
-			if (_currentTask->isFinished() || forceOverride)
+			ITask* get(const Handle handle)
 			{
-				temp = newTask;
-				returnCode = temp.startTask(startState);
-
-				if (returnCode == ReturnCode::ok)
+				switch (handle.type)
 				{
-					_currentTask = new (&(_taskCopies.stop)) Stop(temp);
-					_stopped = false;
+				case TaskType::accelerate:
+					return &_accelerates.tasks[handle.index];
+				case TaskType::straight:
+					return &_straights.tasks[handle.index];
+				case TaskType::stop:
+					return &_stops.tasks[handle.index];
+				case TaskType::rotate:
+					return &_rotates.tasks[handle.index];
+				case TaskType::forceSpeed:
+					return &_forceSpeeds.tasks[handle.index];
+				case TaskType::alignFront:
+					return &_alignFronts.tasks[handle.index];
+				default:
+					return nullptr;
 				}
 			}
 
-			__enable_irq();
-			return returnCode;
-		}
+			ReturnCode unshare(Handle& handle)
+			{
+				uint8_t* count = refCount(handle);
+				Handle copy;
+				ReturnCode code;
 
-		// Set new Rotate task (use last end state to start)
-		template<>
-		ReturnCode setNewTask<NewStateType::lastEndState>(const Rotate& newTask, const bool forceOverride)
-		{
-			static RobotState endState;
-			static ReturnCode returnCode;
-			static Rotate temp;
+				if (count == nullptr) return ReturnCode::error;
+				if (*count <= 1) return ReturnCode::ok;
 
-			returnCode = ReturnCode::ok;
+				switch (handle.type)
+				{
+				case TaskType::accelerate:
+					code = add(_accelerates.tasks[handle.index], copy);
+					break;
+				case TaskType::straight:
+					code = add(_straights.tasks[handle.index], copy);
+					break;
+				case TaskType::stop:
+					code = add(_stops.tasks[handle.index], copy);
+					break;
+				case TaskType::rotate:
+					code = add(_rotates.tasks[handle.index], copy);
+					break;
+				case TaskType::forceSpeed:
+					code = add(_forceSpeeds.tasks[handle.index], copy);
+					break;
+				case TaskType::alignFront:
+					code = add(_alignFronts.tasks[handle.index], copy);
+					break;
+				default:
+					return ReturnCode::error;
+				}
 
-			__disable_irq();
+				if (code != ReturnCode::ok) return code;
 
-			if (_currentTask->isFinished() || forceOverride)
-			{
-				endState = static_cast<RobotState>(_currentTask->getEndState());
+				release(handle);
+				handle = copy;
 
-				temp = newTask;
-				returnCode = temp.startTask(endState);
+				return ReturnCode::ok;
+			}
 
-				if (returnCode == ReturnCode::ok)
+			uint8_t getFreeSlots(const TaskType type)
+			{
+				switch (type)
 				{
-					_currentTask = new (&(_taskCopies.rotate)) Rotate(temp);
-					_stopped = false;
+				case TaskType::accelerate:
+					return countFree(_accelerates);
+				case TaskType::straight:
+					return countFree(_straights);
+				case TaskType::stop:
+					return countFree(_stops);
+				case TaskType::rotate:
+					return countFree(_rotates);
+				case TaskType::forceSpeed:
+					return countFree(_forceSpeeds);
+				case TaskType::alignFront:
+					return countFree(_alignFronts);
+				default:
+					return 0;
 				}
 			}
-
-			__enable_irq();
-			return returnCode;
 		}
 
-		// Set new Rotate task (use current state to start)
-		template<>
-		ReturnCode setNewTask<NewStateType::currentState>(const Rotate& newTask, const bool forceOverride)
-		{
-			static ReturnCode returnCode;
-			static Rotate temp;
+		// TaskPool - end
 
-			returnCode = ReturnCode::ok;
+		// TaskArray class - begin
 
-			__disable_irq();
+		TaskArray::TaskArray(const TaskArray& taskArray) : ITask(), _numTasks(taskArray._numTasks), _currentTaskNum(taskArray._numTasks - 1), _valid(taskArray._valid)
+		{
+			_endState = taskArray._endState;
 
-			if (_currentTask->isFinished() || forceOverride)
+			for (uint8_t i = 0; i < _numTasks; i++)
 			{
-				temp = newTask;
-				returnCode = temp.startTask(SensorFusion::getFusedData().robotState);
-
-				if (returnCode == ReturnCode::ok)
-				{
-					_currentTask = new (&(_taskCopies.rotate)) Rotate(temp);
-					_stopped = false;
-				}
+				_tasks[i] = taskArray._tasks[i];
+				TaskPool::retain(_tasks[i]);
 			}
+		}
 
-			__enable_irq();
-			return returnCode;
+		TaskArray& TaskArray::operator=(const TaskArray& taskArray)
+		{
+			if (this == &taskArray) return *this;
+
+			for (uint8_t i = 0; i < taskArray._numTasks; i++) TaskPool::retain(taskArray._tasks[i]);
+			for (uint8_t i = 0; i < _numTasks; i++) TaskPool::release(_tasks[i]);
+
+			for (uint8_t i = 0; i < taskArray._numTasks; i++) _tasks[i] = taskArray._tasks[i];
+
+			_numTasks = taskArray._numTasks;
+			_currentTaskNum = _numTasks - 1;
+			_valid = taskArray._valid;
+			_finished = false;
+			_endState = taskArray._endState;
+
+			return *this;
 		}
 
-		// Set new Rotate task (use specified state to start)
-		ReturnCode setNewTask(const Rotate& newTask, RobotState startState, const bool forceOverride)
+		TaskArray::~TaskArray()
 		{
-			static ReturnCode returnCode;
-			static Rotate temp;
+			for (uint8_t i = 0; i < _numTasks; i++) TaskPool::release(_tasks[i]);
+		}
 
-			returnCode = ReturnCode::ok;
+		void TaskArray::mergeLinearTasks()
+		{
+			uint8_t numMerged = 0;		// Number of tasks after merging
+			uint8_t i = 0;
 
-			__disable_irq();
+			auto distanceOf = [this](const uint8_t index) -> float
+			{
+				if (_tasks[index].type == TaskPool::TaskType::accelerate) return static_cast<Accelerate*>(TaskPool::get(_tasks[index]))->_distance;
+				else return static_cast<DriveStraight*>(TaskPool::get(_tasks[index]))->_distance;
+			};
 
-			if (_currentTask->isFinished() || forceOverride)
+			// Tasks are stored in reverse order (index 0 is the last task) - merged tasks only move to lower indices
+			while (i < _numTasks)
 			{
-				temp = newTask;
-				returnCode = temp.startTask(startState);
+				const bool isLinear = _tasks[i].type == TaskPool::TaskType::accelerate || _tasks[i].type == TaskPool::TaskType::straight;
+				uint8_t end = i;		// Highest index of the run
 
-				if (returnCode == ReturnCode::ok)
+				if (isLinear)
 				{
-					_currentTask = new (&(_taskCopies.rotate)) Rotate(temp);
-					_stopped = false;
+					const float direction = sgn(distanceOf(i));
+
+					while (end + 1 < _numTasks)
+					{
+						const bool nextLinear = _tasks[end + 1].type == TaskPool::TaskType::accelerate || _tasks[end + 1].type == TaskPool::TaskType::straight;
+
+						if (nextLinear && sgn(distanceOf(end + 1)) == direction) end++;
+						else break;
+					}
 				}
+
+				TaskPool::Handle merged = _tasks[i];
+
+				if (end != i)
+				{
+					float distance = 0.0f;		// Total distance of the run
+					int16_t endSpeeds = 0;		// End speed of the last Accelerate
+					int16_t maxSpeeds = 0;		// Highest speed of all Accelerate
+					bool onlyStraight = true;
+
+					for (uint8_t j = i; j <= end; j++)
+					{
+						if (_tasks[j].type == TaskPool::TaskType::accelerate)
+						{
+							const Accelerate& task = *static_cast<Accelerate*>(TaskPool::get(_tasks[j]));
+
+							if (onlyStraight) endSpeeds = task._endSpeeds;
+							if (abs(task._endSpeeds) > abs(maxSpeeds)) maxSpeeds = task._endSpeeds;
+							if (abs(task._maxSpeeds) > abs(maxSpeeds)) maxSpeeds = task._maxSpeeds;
+
+							onlyStraight = false;
+						}
+
+						distance += distanceOf(j);
+					}
+
+					// DriveStraight keeps the speed - the run ends with the speed of its last Accelerate
+					const ReturnCode code = onlyStraight ? TaskPool::add(DriveStraight(distance), merged) : TaskPool::add(Accelerate(endSpeeds, distance, maxSpeeds), merged);
+
+					// Pool full - keep the tasks of the run one by one
+					if (code != ReturnCode::ok) end = i;
+					else for (uint8_t j = i; j <= end; j++) TaskPool::release(_tasks[j]);
+				}
+
+				_tasks[numMerged] = merged;
+
+				numMerged++;
+				i = end + 1;
 			}
 
-			__enable_irq();
-			return returnCode;
+			_numTasks = numMerged;
+			_currentTaskNum = _numTasks - 1;
 		}
 
-		// Set new ForceSpeed task (use last end state to start)
-		template<>
-		ReturnCode setNewTask<NewStateType::lastEndState>(const ForceSpeed& newTask, const bool forceOverride)
+		TaskArray::TaskArray(const Accelerate& task) : ITask()
 		{
-			static RobotState endState;
-			static ReturnCode returnCode;
-			static ForceSpeed temp;
+			addFirst(task);
+		}
 
-			returnCode = ReturnCode::ok;
+		TaskArray::TaskArray(const DriveStraight& task) : ITask()
+		{
+			addFirst(task);
+		}
 
-			__disable_irq();
+		TaskArray::TaskArray(const Stop& task) : ITask()
+		{
+			addFirst(task);
+		}
 
-			if (_currentTask->isFinished() || forceOverride)
-			{
-				endState = static_cast<RobotState>(_currentTask->getEndState());
+		TaskArray::TaskArray(const Rotate& task) : ITask()
+		{
+			addFirst(task);
+		}
 
-				temp = newTask;
-				returnCode = temp.startTask(endState);
+		TaskArray::TaskArray(const ForceSpeed& task) : ITask()
+		{
+			addFirst(task);
+		}
 
-				if (returnCode == ReturnCode::ok)
-				{
-					_currentTask = new (&(_taskCopies.forceSpeed)) ForceSpeed(temp);
-					_stopped = false;
-				}
-			}
+		TaskArray::TaskArray(const AlignFront& task) : ITask()
+		{
+			addFirst(task);
+		}
 
-			__enable_irq();
-			return returnCode;
+		uint8_t TaskArray::getNumTasks() const
+		{
+			return _numTasks;
 		}
 
-		// Set new ForceSpeed task (use current state to start)
-		template<>
-		ReturnCode setNewTask<NewStateType::currentState>(const ForceSpeed& newTask, const bool forceOverride)
+		ReturnCode TaskArray::startTask(RobotState startState)
 		{
-			static ReturnCode returnCode;
-			static ForceSpeed temp;
+			if (!_valid || _numTasks == 0) return ReturnCode::error;
 
-			returnCode = ReturnCode::ok;
+			ReturnCode code = ReturnCode::ok;
+			RobotState state = startState;
 
-			__disable_irq();
+			// One profile for consecutive straight tasks - no slowing down at their borders
+			mergeLinearTasks();
 
-			if (_currentTask->isFinished() || forceOverride)
+			// Copies share their tasks - starting them would reset a running copy, so shared tasks get their own slots
+			for (uint8_t i = 0; i < _numTasks; i++)
 			{
-				temp = newTask;
-				returnCode = temp.startTask(SensorFusion::getFusedData().robotState);
+				if (TaskPool::unshare(_tasks[i]) != ReturnCode::ok) return ReturnCode::error;
+			}
+
+			for (int16_t i = _numTasks - 1; i >= 0; i--)
+			{
+				ITask* task = TaskPool::get(_tasks[i]);
 
-				if (returnCode == ReturnCode::ok)
+				if (task->startTask(state) != ReturnCode::ok)
 				{
-					_currentTask = new (&(_taskCopies.forceSpeed)) ForceSpeed(temp);
-					_stopped = false;
+					code = ReturnCode::error;
 				}
+
+				state = task->getEndState();
 			}
 
-			__enable_irq();
-			return returnCode;
+			_endState = state;
+			
+			return code;
 		}
 
-		// Set new ForceSpeed task (use specified state to start)
-		ReturnCode setNewTask(const ForceSpeed& newTask, RobotState startState, const bool forceOverride)
+		WheelSpeeds TaskArray::updateSpeeds(const uint8_t freq)
 		{
-			static ReturnCode returnCode;
-			static ForceSpeed temp;
+			ITask* task = TaskPool::get(_tasks[_currentTaskNum]);
+			WheelSpeeds speeds = task->updateSpeeds(freq);
 
-			returnCode = ReturnCode::ok;
+			if (task->isFinished())
+			{
+				if (_currentTaskNum <= 0)
+				{
+					_finished = true;
+					return speeds;
+				}
 
-			__disable_irq();
+				_currentTaskNum--;
+
+				TaskPool::get(_tasks[_currentTaskNum])->startTask(task->getEndState());
+
+				Telemetry::logTask(Telemetry::TaskEvent::subTaskStarted, static_cast<Telemetry::TaskType>(_tasks[_currentTaskNum].type), _currentTaskNum);
+			}
+
+			return speeds;
+		}
+
+		// TaskArray class - end
 
-			if (_currentTask->isFinished() || forceOverride)
+		// Update speeds for both wheels
+		void updateSpeeds(const uint8_t freq)
+		{
+			if (!_stopped)
 			{
-				temp = newTask;
-				returnCode = temp.startTask(startState);
+				MotorControl::setSpeeds(_currentTask->updateSpeeds(freq));
 
-				if (returnCode == ReturnCode::ok)
+				if (!_finishLogged && _currentTask->isFinished())
 				{
-					_currentTask = new (&(_taskCopies.forceSpeed)) ForceSpeed(temp);
-					_stopped = false;
+					_finishLogged = true;
+					Telemetry::logTask(Telemetry::TaskEvent::finished, _currentTaskType, 0);
 				}
 			}
+			else
+			{
+				_angularVelPID.reset();
+				_forwardVelPID.reset();
+			}
+		}
 
-			__enable_irq();
-			return returnCode;
+		// Set new Accelerate task (use last end state to start)
+		template<>
+		ReturnCode setNewTask<NewStateType::lastEndState>(const Accelerate& newTask, const bool forceOverride)
+		{
+			return startNewTask(newTask, _taskCopies.accelerate, Telemetry::TaskType::accelerate, NewStateType::lastEndState, nullptr, forceOverride);
 		}
 
-		// Set new AlignFront task (use last end state to start)
+		// Set new Accelerate task (use current state to start)
 		template<>
-		ReturnCode setNewTask<NewStateType::lastEndState>(const AlignFront& newTask, const bool forceOverride)
+		ReturnCode setNewTask<NewStateType::currentState>(const Accelerate& newTask, const bool forceOverride)
 		{
-			static RobotState endState;
-			static ReturnCode returnCode;
-			static AlignFront temp;
+			return startNewTask(newTask, _taskCopies.accelerate, Telemetry::TaskType::accelerate, NewStateType::currentState, nullptr, forceOverride);
+		}
 
-			returnCode = ReturnCode::ok;
+		// Set new Accelerate task (use specified state to start)
+		ReturnCode setNewTask(const Accelerate& newTask, RobotState startState, const bool forceOverride)
+		{
+			return startNewTask(newTask, _taskCopies.accelerate, Telemetry::TaskType::accelerate, NewStateType::currentState, &startState, forceOverride);
+		}
 
-			__disable_irq();
+		// Set new DriveStraight task (use last end state to start)
+		template<>
+		ReturnCode setNewTask<NewStateType::lastEndState>(const DriveStraight& newTask, const bool forceOverride)
+		{
+			return startNewTask(newTask, _taskCopies.straight, Telemetry::TaskType::straight, NewStateType::lastEndState, nullptr, forceOverride);
+		}
 
-			if (_currentTask->isFinished() || forceOverride)
-			{
-				endState = static_cast<RobotState>(_currentTask->getEndState());
+		// Set new DriveStraight task (use current state to start)
+		template<>
+		ReturnCode setNewTask<NewStateType::currentState>(const DriveStraight& newTask, const bool forceOverride)
+		{
+			return startNewTask(newTask, _taskCopies.straight, Telemetry::TaskType::straight, NewStateType::currentState, nullptr, forceOverride);
+		}
 
-				temp = newTask;
-				returnCode = temp.startTask(endState);
+		// Set new DriveStraight task (use specified state to start)
+		ReturnCode setNewTask(const DriveStraight& newTask, RobotState startState, const bool forceOverride)
+		{
+			return startNewTask(newTask, _taskCopies.straight, Telemetry::TaskType::straight, NewStateType::currentState, &startState, forceOverride);
+		}
 
-				if (returnCode == ReturnCode::ok)
-				{
-					_currentTask = new (&(_taskCopies.alignFront)) AlignFront(temp);
-					_stopped = false;
-				}
-			}
+		// Set new Stop task (use last end state to start)
+		template<>
+		ReturnCode setNewTask<NewStateType::lastEndState>(const Stop& newTask, const bool forceOverride)
+		{
+			return startNewTask(newTask, _taskCopies.stop, Telemetry::TaskType::stop, NewStateType::lastEndState, nullptr, forceOverride);
+		}
 
-			__enable_irq();
-			return returnCode;
+		// Set new Stop task (use current state to start)
+		template<>
+		ReturnCode setNewTask<NewStateType::currentState>(const Stop& newTask, const bool forceOverride)
+		{
+			return startNewTask(newTask, _taskCopies.stop, Telemetry::TaskType::stop, NewStateType::currentState, nullptr, forceOverride);
 		}
 
-		// Set new AlignFront task (use current state to start)
+		// Set new Stop task (use specified state to start)
+		ReturnCode setNewTask(const Stop& newTask, RobotState startState, const bool forceOverride)
+		{
+			return startNewTask(newTask, _taskCopies.stop, Telemetry::TaskType::stop, NewStateType::currentState, &startState, forceOverride);
+		}
+
+		// Set new Rotate task (use last end state to start)
 		template<>
-		ReturnCode setNewTask<NewStateType::currentState>(const AlignFront& newTask, const bool forceOverride)
+		ReturnCode setNewTask<NewStateType::lastEndState>(const Rotate& newTask, const bool forceOverride)
 		{
-			static ReturnCode returnCode;
-			static AlignFront temp;
+			return startNewTask(newTask, _taskCopies.rotate, Telemetry::TaskType::rotate, NewStateType::lastEndState, nullptr, forceOverride);
+		}
 
-			returnCode = ReturnCode::ok;
+		// Set new Rotate task (use current state to start)
+		template<>
+		ReturnCode setNewTask<NewStateType::currentState>(const Rotate& newTask, const bool forceOverride)
+		{
+			return startNewTask(newTask, _taskCopies.rotate, Telemetry::TaskType::rotate, NewStateType::currentState, nullptr, forceOverride);
+		}
 
-			__disable_irq();
+		// Set new Rotate task (use specified state to start)
+		ReturnCode setNewTask(const Rotate& newTask, RobotState startState, const bool forceOverride)
+		{
+			return startNewTask(newTask, _taskCopies.rotate, Telemetry::TaskType::rotate, NewStateType::currentState, &startState, forceOverride);
+		}
 
-			if (_currentTask->isFinished() || forceOverride)
-			{
-				temp = newTask;
-				returnCode = temp.startTask(SensorFusion::getFusedData().robotState);
+		// Set new ForceSpeed task (use last end state to start)
+		template<>
+		ReturnCode setNewTask<NewStateType::lastEndState>(const ForceSpeed& newTask, const bool forceOverride)
+		{
+			return startNewTask(newTask, _taskCopies.forceSpeed, Telemetry::TaskType::forceSpeed, NewStateType::lastEndState, nullptr, forceOverride);
+		}
 
-				if (returnCode == ReturnCode::ok)
-				{
-					_currentTask = new (&(_taskCopies.alignFront)) AlignFront(temp);
-					_stopped = false;
-				}
-			}
+		// Set new ForceSpeed task (use current state to start)
+		template<>
+		ReturnCode setNewTask<NewStateType::currentState>(const ForceSpeed& newTask, const bool forceOverride)
+		{
+			return startNewTask(newTask, _taskCopies.forceSpeed, Telemetry::TaskType::forceSpeed, NewStateType::currentState, nullptr, forceOverride);
+		}
 
-			__enable_irq();
-			return returnCode;
+		// Set new ForceSpeed task (use specified state to start)
+		ReturnCode setNewTask(const ForceSpeed& newTask, RobotState startState, const bool forceOverride)
+		{
+			return startNewTask(newTask, _taskCopies.forceSpeed, Telemetry::TaskType::forceSpeed, NewStateType::currentState, &startState, forceOverride);
 		}
 
-		// Set new AlignFront task (use specified state to start)
-		ReturnCode setNewTask(const AlignFront& newTask, RobotState startState, const bool forceOverride)
+		// Set new AlignFront task (use last end state to start)
+		template<>
+		ReturnCode setNewTask<NewStateType::lastEndState>(const AlignFront& newTask, const bool forceOverride)
 		{
-			static ReturnCode returnCode;
-			static AlignFront temp;
+			return startNewTask(newTask, _taskCopies.alignFront, Telemetry::TaskType::alignFront, NewStateType::lastEndState, nullptr, forceOverride);
+		}
 
-			returnCode = ReturnCode::ok;
+		// Set new AlignFront task (use current state to start)
+		template<>
+		ReturnCode setNewTask<NewStateType::currentState>(const AlignFront& newTask, const bool forceOverride)
+		{
+			return startNewTask(newTask, _taskCopies.alignFront, Telemetry::TaskType::alignFront, NewStateType::currentState, nullptr, forceOverride);
+		}
 
-			__disable_irq();
+		// Set new AlignFront task (use specified state to start)
+		ReturnCode setNewTask(const AlignFront& newTask, RobotState startState, const bool forceOverride)
+		{
+			return startNewTask(newTask, _taskCopies.alignFront, Telemetry::TaskType::alignFront, NewStateType::currentState, &startState, forceOverride);
+		}
 
-			if (_currentTask->isFinished() || forceOverride)
-			{
-				temp = newTask;
-				returnCode = temp.startTask(startState);
+		// Set new FollowPath task (use last end state to start)
+		template<>
+		ReturnCode setNewTask<NewStateType::lastEndState>(const FollowPath& newTask, const bool forceOverride)
+		{
+			return startNewTask(newTask, _taskCopies.followPath, Telemetry::TaskType::followPath, NewStateType::lastEndState, nullptr, forceOverride);
+		}
 
-				if (returnCode == ReturnCode::ok)
-				{
-					_currentTask = new (&(_taskCopies.alignFront)) AlignFront(temp);
-					_stopped = false;
-				}
-			}
+		// Set new FollowPath task (use current state to start)
+		template<>
+		ReturnCode setNewTask<NewStateType::currentState>(const FollowPath& newTask, const bool forceOverride)
+		{
+			return startNewTask(newTask, _taskCopies.followPath, Telemetry::TaskType::followPath, NewStateType::currentState, nullptr, forceOverride);
+		}
 
-			__enable_irq();
-			return returnCode;
+		// Set new FollowPath task (use specified state to start)
+		ReturnCode setNewTask(const FollowPath& newTask, RobotState startState, const bool forceOverride)
+		{
+			return startNewTask(newTask, _taskCopies.followPath, Telemetry::TaskType::followPath, NewStateType::currentState, &startState, forceOverride);
 		}
 
 		// Set new TaskArray task (use last end state to start)
 		template<>
 		ReturnCode setNewTask<NewStateType::lastEndState>(const TaskArray& newTask, const bool forceOverride)
 		{
-			static RobotState endState;
-			static ReturnCode returnCode;
-
-			returnCode = ReturnCode::ok;
+			RobotState state;
+			uint32_t taskNumber;
 
-			__disable_irq();
-
-			if (_currentTask->isFinished() || forceOverride)
-			{
-				endState = static_cast<RobotState>(_currentTask->getEndState());
+			if (!readStartState(NewStateType::lastEndState, nullptr, forceOverride, state, taskNumber)) return ReturnCode::ok;
 
-				TaskArray temp = newTask;
-				returnCode = temp.startTask(endState);
+			// Plan with enabled interrupts - only the handles are copied while they are masked
+			TaskArray temp = newTask;
+			const ReturnCode code = temp.startTask(state);
 
-				if (returnCode == ReturnCode::ok)
-				{
-					_currentTask = new (&(_taskCopies.taskArray)) TaskArray(temp);
-					_stopped = false;
-				}
-			}
+			if (code != ReturnCode::ok) return code;
 
-			__enable_irq();
-			return returnCode;
+			return replaceTask(temp, _taskCopies.taskArray, Telemetry::TaskType::taskArray, taskNumber);
 		}
 
 		// Set new TaskArray task (use current state to start)
 		template<>
 		ReturnCode setNewTask<NewStateType::currentState>(const TaskArray& newTask, const bool forceOverride)
 		{
-			static ReturnCode returnCode;
+			RobotState state;
+			uint32_t taskNumber;
 
-			returnCode = ReturnCode::ok;
+			if (!readStartState(NewStateType::currentState, nullptr, forceOverride, state, taskNumber)) return ReturnCode::ok;
 
-			__disable_irq();
+			// Plan with enabled interrupts - only the handles are copied while they are masked
+			TaskArray temp = newTask;
+			const ReturnCode code = temp.startTask(state);
 
-			if (_currentTask->isFinished() || forceOverride)
-			{
-				TaskArray temp = newTask;
-				returnCode = temp.startTask(SensorFusion::getFusedData().robotState);
+			if (code != ReturnCode::ok) return code;
 
-				if (returnCode == ReturnCode::ok)
-				{
-					_currentTask = new (&(_taskCopies.taskArray)) TaskArray(temp);
-					_stopped = false;
-				}
-			}
-
-			__enable_irq();
-			return returnCode;
+			return replaceTask(temp, _taskCopies.taskArray, Telemetry::TaskType::taskArray, taskNumber);
 		}
 
 		// Set new TaskArray task (use specified state to start)
 		ReturnCode setNewTask(const TaskArray& newTask, RobotState startState, const bool forceOverride)
 		{
-			static ReturnCode returnCode;
+			RobotState state;
+			uint32_t taskNumber;
 
-			returnCode = ReturnCode::ok;
-
-			__disable_irq();
+			if (!readStartState(NewStateType::currentState, &startState, forceOverride, state, taskNumber)) return ReturnCode::ok;
 
-			if (_currentTask->isFinished() || forceOverride)
-			{
-				TaskArray temp = newTask;
-				returnCode = temp.startTask(startState);
+			// Plan with enabled interrupts - only the handles are copied while they are masked
+			TaskArray temp = newTask;
+			const ReturnCode code = temp.startTask(state);
 
-				if (returnCode == ReturnCode::ok)
-				{
-					_currentTask = new (&(_taskCopies.taskArray)) TaskArray(temp);
-					_stopped = false;
-				}
-			}
+			if (code != ReturnCode::ok) return code;
 
-			__enable_irq();
-			return returnCode;
+			return replaceTask(temp, _taskCopies.taskArray, Telemetry::TaskType::taskArray, taskNumber);
 		}
 
 		// Is the current task finished?
@@ -1400,5 +1666,44 @@ namespace JAFD
 			_stopped = true;
 			setNewTask<NewStateType::currentState>(Stop(), true);
 		}
+
+		void planAhead()
+		{
+			uint32_t taskNumber;
+			uint8_t segment;
+			float startSpeed;
+			bool needed;
+
+			// Only FollowPath plans ahead - the segment after the current one
+			__disable_irq();
+
+			taskNumber = _taskNumber;
+			needed = _currentTaskType == Telemetry::TaskType::followPath && !_currentTask->isFinished() && !_taskCopies.followPath._nextPlanned && _taskCopies.followPath._currentSegment + 1 < _taskCopies.followPath._numSegments;
+
+			if (needed)
+			{
+				segment = _taskCopies.followPath._currentSegment + 1;
+				startSpeed = _taskCopies.followPath._segments[segment - 1].endSpeed;
+			}
+
+			__enable_irq();
+
+			if (!needed) return;
+
+			// A task change while planning makes the profile useless - it is dropped then
+			MotionProfile profile;
+
+			if (_taskCopies.followPath.planSegment(segment, startSpeed, profile) != ReturnCode::ok) return;
+
+			__disable_irq();
+
+			if (_taskNumber == taskNumber && _taskCopies.followPath._currentSegment + 1 == segment)
+			{
+				_taskCopies.followPath._nextProfile = profile;
+				_taskCopies.followPath._nextPlanned = true;
+			}
+
+			__enable_irq();
+		}
 	}
 }
\ No newline at end of file
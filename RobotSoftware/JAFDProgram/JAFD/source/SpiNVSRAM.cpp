@@ -6,6 +6,8 @@ This private file of the library is responsible for the access to the SPI NVSRAM
 #include "../header/SpiNVSRAM.h"
 #include "../header/DuePinMapping.h"
 
+#include <string.h>
+
 namespace JAFD
 {
 	namespace SpiNVSRAM
@@ -23,6 +25,129 @@ namespace JAFD
 			};
 
 			constexpr auto _ssPin = PinMapping::MappedPins[JAFDSettings::SpiNVSRAM::ssPin];		// Slave-Select Pin
+
+			constexpr uint8_t _spiChipSelCh = 3;		// Chip select channel of SPI0 the Arduino library uses when no pin is given (BOARD_SPI_DEFAULT_SS)
+			constexpr uint8_t _spiTxPerID = 1;			// DMA hardware handshaking interface of SPI0 TX
+			constexpr uint8_t _spiRxPerID = 2;			// DMA hardware handshaking interface of SPI0 RX
+			constexpr uint16_t _maxDMABlockSize = 0xfff;	// Maximum size of one DMA buffer transfer
+
+			Mode _currentMode = Mode::sequential;		// Current value of the mode register
+
+			volatile bool _busy = false;						// Is a DMA transfer running?
+			volatile bool _isRead = false;						// Is the running DMA transfer a read?
+			uint8_t* volatile _dmaBuffer = nullptr;				// Position in the buffer of the next DMA block (nullptr = fill)
+			volatile uint32_t _dmaRemaining = 0;				// Bytes that still have to be transferred after the current DMA block
+			void(* volatile _finishedCallback)() = nullptr;		// Called when DMA transfer is finished
+			uint32_t _savedSpiMode = 0;							// SPI mode register before the DMA transfer
+			uint8_t _dummyByte = 0x00;							// Sent while reading via DMA
+			uint8_t _fillValue = 0x00;							// Sent while filling via DMA
+
+			// Write the mode register, if it changes
+			void setMode(const Mode mode)
+			{
+				if (mode == _currentMode) return;
+
+				enable();
+
+				SPI.transfer((uint8_t)Instruction::wrr);
+				SPI.transfer((uint8_t)mode);
+
+				disable();
+
+				_currentMode = mode;
+			}
+
+			// Send instruction and address
+			void sendHeader(const Instruction instruction, const uint32_t address)
+			{
+				SPI.transfer((uint8_t)instruction);
+
+				SPI.transfer((uint8_t)(address >> 16));
+				SPI.transfer((uint8_t)(address >> 8));
+				SPI.transfer((uint8_t)(address));
+			}
+
+			// Start transfer of the next DMA block
+			void startDMABlock()
+			{
+				const uint32_t blockSize = _dmaRemaining > _maxDMABlockSize ? _maxDMABlockSize : _dmaRemaining;
+
+				auto& txCh = DMAC->DMAC_CH_NUM[JAFDSettings::SpiNVSRAM::dmaTxChannel];
+
+				if (_isRead)
+				{
+					// Throw away old received data
+					{
+						volatile auto dummy = SPI0->SPI_RDR;
+					}
+
+					auto& rxCh = DMAC->DMAC_CH_NUM[JAFDSettings::SpiNVSRAM::dmaRxChannel];
+
+					rxCh.DMAC_SADDR = (uint32_t)&SPI0->SPI_RDR;
+					rxCh.DMAC_DADDR = (uint32_t)_dmaBuffer;
+					rxCh.DMAC_DSCR = 0;
+					rxCh.DMAC_CTRLA = blockSize | DMAC_CTRLA_SRC_WIDTH_BYTE | DMAC_CTRLA_DST_WIDTH_BYTE;
+					rxCh.DMAC_CTRLB = DMAC_CTRLB_SRC_DSCR | DMAC_CTRLB_DST_DSCR | DMAC_CTRLB_FC_PER2MEM_DMA_FC | DMAC_CTRLB_SRC_INCR_FIXED | DMAC_CTRLB_DST_INCR_INCREMENTING;
+					rxCh.DMAC_CFG = DMAC_CFG_SRC_PER(_spiRxPerID) | DMAC_CFG_SRC_H2SEL | DMAC_CFG_SOD | DMAC_CFG_FIFOCFG_ASAP_CFG;
+
+					// Send dummy bytes
+					txCh.DMAC_SADDR = (uint32_t)&_dummyByte;
+					txCh.DMAC_CTRLB = DMAC_CTRLB_SRC_DSCR | DMAC_CTRLB_DST_DSCR | DMAC_CTRLB_FC_MEM2PER_DMA_FC | DMAC_CTRLB_SRC_INCR_FIXED | DMAC_CTRLB_DST_INCR_FIXED;
+
+					DMAC->DMAC_CHER = DMAC_CHER_ENA0 << JAFDSettings::SpiNVSRAM::dmaRxChannel;
+				}
+				else if (_dmaBuffer)
+				{
+					txCh.DMAC_SADDR = (uint32_t)_dmaBuffer;
+					txCh.DMAC_CTRLB = DMAC_CTRLB_SRC_DSCR | DMAC_CTRLB_DST_DSCR | DMAC_CTRLB_FC_MEM2PER_DMA_FC | DMAC_CTRLB_SRC_INCR_INCREMENTING | DMAC_CTRLB_DST_INCR_FIXED;
+				}
+				else
+				{
+					// Send the same byte over and over again
+					txCh.DMAC_SADDR = (uint32_t)&_fillValue;
+					txCh.DMAC_CTRLB = DMAC_CTRLB_SRC_DSCR | DMAC_CTRLB_DST_DSCR | DMAC_CTRLB_FC_MEM2PER_DMA_FC | DMAC_CTRLB_SRC_INCR_FIXED | DMAC_CTRLB_DST_INCR_FIXED;
+				}
+
+				txCh.DMAC_DADDR = (uint32_t)&SPI0->SPI_TDR;
+				txCh.DMAC_DSCR = 0;
+				txCh.DMAC_CTRLA = blockSize | DMAC_CTRLA_SRC_WIDTH_BYTE | DMAC_CTRLA_DST_WIDTH_BYTE;
+				txCh.DMAC_CFG = DMAC_CFG_DST_PER(_spiTxPerID) | DMAC_CFG_DST_H2SEL | DMAC_CFG_SOD | DMAC_CFG_FIFOCFG_ALAP_CFG;
+
+				if (_dmaBuffer) _dmaBuffer += blockSize;
+				_dmaRemaining -= blockSize;
+
+				DMAC->DMAC_CHER = DMAC_CHER_ENA0 << JAFDSettings::SpiNVSRAM::dmaTxChannel;
+			}
+
+			// Start an asynchronous transfer
+			ReturnCode startTransfer(const Instruction instruction, const Mode mode, const uint32_t address, uint8_t* buffer, const uint32_t length, void(*finishedCallback)())
+			{
+				if (_busy) return ReturnCode::aborted;
+				if (length == 0) return ReturnCode::error;
+
+				setMode(mode);
+
+				_busy = true;
+				_isRead = instruction == Instruction::read;
+				_dmaBuffer = buffer;
+				_dmaRemaining = length;
+				_finishedCallback = finishedCallback;
+
+				enable();
+
+				sendHeader(instruction, address);
+
+				// DMA writes only bytes to the transmit register, so the SPI has to use a fixed chip select channel
+				_savedSpiMode = SPI0->SPI_MR;
+				SPI0->SPI_MR = (_savedSpiMode & ~(SPI_MR_PS | SPI_MR_PCS_Msk)) | SPI_MR_PCS(~(1 << _spiChipSelCh) & 0xf);
+
+				// Interrupt when the last byte is transferred
+				DMAC->DMAC_EBCIER = DMAC_EBCIER_BTC0 << (_isRead ? JAFDSettings::SpiNVSRAM::dmaRxChannel : JAFDSettings::SpiNVSRAM::dmaTxChannel);
+
+				startDMABlock();
+
+				return ReturnCode::ok;
+			}
 		}
 
 		ReturnCode setup()
@@ -30,6 +155,29 @@ namespace JAFD
 			_ssPin.port->PIO_PER = _ssPin.pin;
 			_ssPin.port->PIO_OER = _ssPin.pin;
 
+			disable();
+
+			// Setup DMA controller
+			PMC->PMC_PCER1 = PMC_PCER1_PID39;
+
+			DMAC->DMAC_EN = 0;
+			DMAC->DMAC_GCFG = DMAC_GCFG_ARB_CFG_FIXED;
+			DMAC->DMAC_EN = DMAC_EN_ENABLE;
+
+			NVIC_ClearPendingIRQ(DMAC_IRQn);
+			NVIC_EnableIRQ(DMAC_IRQn);
+			NVIC_SetPriority(DMAC_IRQn, 1);
+
+			// Mode register is unknown after a reset of the MCU
+			enable();
+
+			SPI.transfer((uint8_t)Instruction::wrr);
+			SPI.transfer((uint8_t)Mode::sequential);
+
+			disable();
+
+			_currentMode = Mode::sequential;
+
 			return ReturnCode::ok;
 		}
 
@@ -43,24 +191,14 @@ namespace JAFD
 			_ssPin.port->PIO_SODR = _ssPin.pin;
 		}
 
+		// Single bytes can be accessed in every mode, so the mode register doesn't have to be changed
 		uint8_t readByte(const uint32_t address)
 		{
-			// Set Byte Mode
-			enable();
-
-			SPI.transfer((uint8_t)Instruction::wrr);
-			SPI.transfer(0b00000000);
-
-			disable();
+			waitForTransfer();
 
-			// Read Data
 			enable();
 
-			SPI.transfer((uint8_t)Instruction::read);
-
-			SPI.transfer((uint8_t)(address >> 16));
-			SPI.transfer((uint8_t)(address >> 8));
-			SPI.transfer((uint8_t)(address));
+			sendHeader(Instruction::read, address);
 
 			auto val = SPI.transfer(0x00);
 
@@ -71,22 +209,11 @@ namespace JAFD
 
 		void writeByte(const uint32_t address, const uint8_t byte)
 		{
-			// Set Byte Mode
-			enable();
+			waitForTransfer();
 
-			SPI.transfer((uint8_t)Instruction::wrr);
-			SPI.transfer(0b00000000);
-
-			disable();
-
-			// Write Data
 			enable();
 
-			SPI.transfer((uint8_t)Instruction::write);
-
-			SPI.transfer((uint8_t)(address >> 16));
-			SPI.transfer((uint8_t)(address >> 8));
-			SPI.transfer((uint8_t)(address));
+			sendHeader(Instruction::write, address);
 
 			SPI.transfer(byte);
 
@@ -95,22 +222,13 @@ namespace JAFD
 
 		void readStream(const uint32_t address, uint8_t* buffer, const uint32_t length)
 		{
-			// Set Stream Mode
-			enable();
+			waitForTransfer();
 
-			SPI.transfer((uint8_t)Instruction::wrr);
-			SPI.transfer(0b01000000);
+			setMode(Mode::sequential);
 
-			disable();
-
-			// Read Data
 			enable();
 
-			SPI.transfer((uint8_t)Instruction::read);
-
-			SPI.transfer((uint8_t)(address >> 16));
-			SPI.transfer((uint8_t)(address >> 8));
-			SPI.transfer((uint8_t)(address));
+			sendHeader(Instruction::read, address);
 
 			for (uint32_t i = 0; i < length; i++)
 			{
@@ -121,48 +239,188 @@ namespace JAFD
 			disable();
 		}
 
+		// In sequential mode the address counter crosses page boundaries on its own
 		void writeStream(uint32_t address, uint8_t* buffer, const uint32_t length)
 		{
-			// Set Stream Mode
+			waitForTransfer();
+
+			setMode(Mode::sequential);
+
 			enable();
 
-			SPI.transfer((uint8_t)Instruction::wrr);
-			SPI.transfer(0b01000000);
+			sendHeader(Instruction::write, address);
+
+			for (uint32_t i = 0; i < length; i++)
+			{
+				SPI.transfer(*(buffer++));
+			}
 
 			disable();
+		}
+
+		// Write the same value to a whole area
+		void fill(const uint32_t address, const uint8_t value, const uint32_t length)
+		{
+			waitForTransfer();
+
+			setMode(Mode::sequential);
 
-			// Write Data
 			enable();
 
-			SPI.transfer((uint8_t)Instruction::write);
+			sendHeader(Instruction::write, address);
+
+			for (uint32_t i = 0; i < length; i++)
+			{
+				SPI.transfer(value);
+			}
+
+			disable();
+		}
+
+		ReturnCode readStreamAsync(const uint32_t address, uint8_t* buffer, const uint32_t length, void(*finishedCallback)())
+		{
+			return startTransfer(Instruction::read, Mode::sequential, address, buffer, length, finishedCallback);
+		}
+
+		ReturnCode writeStreamAsync(const uint32_t address, uint8_t* buffer, const uint32_t length, void(*finishedCallback)())
+		{
+			return startTransfer(Instruction::write, Mode::sequential, address, buffer, length, finishedCallback);
+		}
+
+		ReturnCode fillAsync(const uint32_t address, const uint8_t value, const uint32_t length, void(*finishedCallback)())
+		{
+			if (_busy) return ReturnCode::aborted;
+
+			_fillValue = value;
+
+			return startTransfer(Instruction::write, Mode::sequential, address, nullptr, length, finishedCallback);
+		}
+
+		bool isBusy()
+		{
+			return _busy;
+		}
+
+		void waitForTransfer()
+		{
+			// Thread mode with enabled interrupts - the DMA interrupt finishes the transfer
+			if (__get_IPSR() == 0 && __get_PRIMASK() == 0)
+			{
+				while (_busy);
+				return;
+			}
+
+			// In an interrupt (priority >= the one of the DMA) or with masked interrupts the flag would never be cleared - poll the channel status instead
+			NVIC_DisableIRQ(DMAC_IRQn);
+
+			while (_busy) dmaInterrupt();
+
+			NVIC_EnableIRQ(DMAC_IRQn);
+		}
+
+		void dmaInterrupt()
+		{
+			const uint32_t status = DMAC->DMAC_EBCISR;
 
-			SPI.transfer((uint8_t)(address >> 16));
-			SPI.transfer((uint8_t)(address >> 8));
-			SPI.transfer((uint8_t)(address));
+			if (!_busy) return;
+
+			const uint8_t channel = _isRead ? JAFDSettings::SpiNVSRAM::dmaRxChannel : JAFDSettings::SpiNVSRAM::dmaTxChannel;
+
+			if (!(status & (DMAC_EBCISR_BTC0 << channel))) return;
+
+			// Continue with next block
+			if (_dmaRemaining > 0)
+			{
+				startDMABlock();
+				return;
+			}
+
+			// Wait until the last byte is shifted out
+			while (!(SPI0->SPI_SR & SPI_SR_TXEMPTY));
+
+			disable();
+
+			// Clear received data and overrun flag
+			{
+				volatile auto dummy = SPI0->SPI_RDR;
+				dummy = SPI0->SPI_SR;
+			}
+
+			SPI0->SPI_MR = _savedSpiMode;
+
+			DMAC->DMAC_EBCIDR = DMAC_EBCIDR_BTC0 << channel;
+
+			_busy = false;
+
+			if (_finishedCallback) _finishedCallback();
+		}
+
+		uint16_t crc16(const uint8_t* bytes, const uint32_t length)
+		{
+			uint16_t crc = 0xffff;
 
 			for (uint32_t i = 0; i < length; i++)
 			{
-				SPI.transfer(*(buffer++));
+				crc ^= static_cast<uint16_t>(bytes[i]) << 8;
 
-				// If Page-Overflow initiate new write cycle
-				if (++address % pageSize == 0)
+				for (uint8_t j = 0; j < 8; j++)
 				{
-					disable();
+					crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+				}
+			}
+
+			return crc;
+		}
+
+		ReturnCode loadNewestSlot(const uint32_t address, const uint16_t version, void* data, const uint16_t dataSize, uint8_t* buffer, uint32_t& sequence, uint8_t& nextSlot)
+		{
+			const uint32_t size = slotSize(dataSize);
+			int8_t newest = -1;
+			uint32_t newestSequence = 0;
+
+			// Both slots at once, then choose from the buffer
+			readStream(address, buffer, 2 * size);
 
-					delay(1);
+			for (uint8_t i = 0; i < 2; i++)
+			{
+				const uint8_t* slot = buffer + i * size;
+				SlotHeader header;
+				uint16_t crc;
 
-					enable();
+				memcpy(&header, slot, sizeof(SlotHeader));
+				memcpy(&crc, slot + sizeof(SlotHeader) + dataSize, sizeof(uint16_t));
 
-					// Write address
-					SPI.transfer((uint8_t)Instruction::write);
+				if (header.version != version || header.size != dataSize || crc != crc16(slot, sizeof(SlotHeader) + dataSize)) continue;
 
-					SPI.transfer((uint8_t)(address >> 16));
-					SPI.transfer((uint8_t)(address >> 8));
-					SPI.transfer((uint8_t)(address));
+				if (newest < 0 || static_cast<int32_t>(header.sequence - newestSequence) > 0)
+				{
+					newest = i;
+					newestSequence = header.sequence;
 				}
 			}
 
-			disable();
+			if (newest < 0) return ReturnCode::error;
+
+			memcpy(data, buffer + newest * size + sizeof(SlotHeader), dataSize);
+
+			sequence = newestSequence;
+			nextSlot = newest ^ 1;
+
+			return ReturnCode::ok;
+		}
+
+		void buildSlot(uint8_t* buffer, const uint16_t version, const uint32_t sequence, const void* data, const uint16_t dataSize)
+		{
+			SlotHeader header;
+			header.version = version;
+			header.size = dataSize;
+			header.sequence = sequence;
+
+			memcpy(buffer, &header, sizeof(SlotHeader));
+			memcpy(buffer + sizeof(SlotHeader), data, dataSize);
+
+			const uint16_t crc = crc16(buffer, sizeof(SlotHeader) + dataSize);
+			memcpy(buffer + sizeof(SlotHeader) + dataSize, &crc, sizeof(uint16_t));
 		}
 	}
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include <Wire.h>
 
 #include "../header/TCA9548A.h"
+#include "../header/AsyncI2C.h"
 #include "../../JAFDSettings.h"
 
 namespace JAFD
@@ -39,5 +40,190 @@ namespace JAFD
 
 			return 4;
 		}
+
+		namespace Batch
+		{
+			namespace
+			{
+				// One queued register operation
+				struct Operation
+				{
+					uint8_t channel;		// Multiplexer channel
+					uint8_t i2cAddr;		// I2C address of device
+					uint16_t regAddr;		// Register address
+					uint8_t regAddrSize;	// Size of register address (1 or 2 bytes)
+					bool write;				// Write or read?
+					uint8_t length;			// Number of bytes to read
+					uint8_t value;			// Value to write
+					uint8_t* buffer;		// Buffer for read data
+				};
+
+				// Every operation and every channel switch of a batch fits into the queue of the bus
+				static_assert(JAFDSettings::AsyncI2C::queueSize >= 2 * JAFDSettings::I2CMultiplexer::maxBatchSize, "Queue of AsyncI2C is too small for a batch");
+
+				Operation _operations[JAFDSettings::I2CMultiplexer::maxBatchSize];
+				uint8_t _numOperations = 0;
+
+				uint8_t _channelMasks[maxCh] = { 1 << 0, 1 << 1, 1 << 2, 1 << 3, 1 << 4, 1 << 5, 1 << 6, 1 << 7 };	// Values written to the multiplexer
+				uint8_t _readData[JAFDSettings::I2CMultiplexer::maxBatchData];										// Data of all combined reads
+
+				// Can the second operation be done in the same read transaction as the first ones?
+				inline bool canMerge(const Operation& first, const uint16_t endAddr, const Operation& next)
+				{
+					if (next.write || next.channel != first.channel || next.i2cAddr != first.i2cAddr || next.regAddrSize != first.regAddrSize) return false;
+					if (next.regAddr < first.regAddr || next.regAddr > endAddr + JAFDSettings::I2CMultiplexer::maxMergeGap) return false;
+
+					return next.regAddr + next.length - first.regAddr <= JAFDSettings::I2CMultiplexer::maxMergeLength;
+				}
+			}
+
+			ReturnCode queueRead(const uint8_t channel, const uint8_t i2cAddr, const uint16_t regAddr, const uint8_t regAddrSize, uint8_t* buffer, const uint8_t length)
+			{
+				if (_numOperations >= JAFDSettings::I2CMultiplexer::maxBatchSize || channel >= maxCh || length == 0 || length > JAFDSettings::I2CMultiplexer::maxMergeLength) return ReturnCode::error;
+
+				Operation& operation = _operations[_numOperations++];
+
+				operation.channel = channel;
+				operation.i2cAddr = i2cAddr;
+				operation.regAddr = regAddr;
+				operation.regAddrSize = regAddrSize;
+				operation.write = false;
+				operation.length = length;
+				operation.value = 0;
+				operation.buffer = buffer;
+
+				return ReturnCode::ok;
+			}
+
+			ReturnCode queueWrite(const uint8_t channel, const uint8_t i2cAddr, const uint16_t regAddr, const uint8_t regAddrSize, const uint8_t value)
+			{
+				if (_numOperations >= JAFDSettings::I2CMultiplexer::maxBatchSize || channel >= maxCh) return ReturnCode::error;
+
+				Operation& operation = _operations[_numOperations++];
+
+				operation.channel = channel;
+				operation.i2cAddr = i2cAddr;
+				operation.regAddr = regAddr;
+				operation.regAddrSize = regAddrSize;
+				operation.write = true;
+				operation.length = 1;
+				operation.value = value;
+				operation.buffer = nullptr;
+
+				return ReturnCode::ok;
+			}
+
+			uint8_t numQueued()
+			{
+				return _numOperations;
+			}
+
+			ReturnCode execute()
+			{
+				ReturnCode code = ReturnCode::ok;
+				uint8_t order[JAFDSettings::I2CMultiplexer::maxBatchSize];
+
+				// Stable sort by channel - start with the current channel to save one switch
+				for (uint8_t i = 0; i < _numOperations; i++)
+				{
+					const uint8_t key = (_operations[i].channel + maxCh - _currentChannel) % maxCh;
+					uint8_t j = i;
+
+					for (; j > 0 && (_operations[order[j - 1]].channel + maxCh - _currentChannel) % maxCh > key; j--)
+					{
+						order[j] = order[j - 1];
+					}
+
+					order[j] = i;
+				}
+
+				// Queue all transactions on the bus - they run in the background
+				uint8_t groupStarts[JAFDSettings::I2CMultiplexer::maxBatchSize + 1];	// First operation of every combined read
+				uint16_t groupOffsets[JAFDSettings::I2CMultiplexer::maxBatchSize];		// Position of data of every combined read
+				uint8_t numGroups = 0;
+				uint16_t dataLength = 0;
+				uint8_t i = 0;
+
+				while (i < _numOperations)
+				{
+					Operation& first = _operations[order[i]];
+
+					if (first.channel != _currentChannel)
+					{
+						if (AsyncI2C::queueWrite(AsyncI2C::Bus::wire, JAFDSettings::DistanceSensors::multiplexerAddr, 0, 0, &_channelMasks[first.channel], 1) != ReturnCode::ok) code = ReturnCode::error;
+
+						_currentChannel = first.channel;
+					}
+
+					if (first.write)
+					{
+						if (AsyncI2C::queueWrite(AsyncI2C::Bus::wire, first.i2cAddr, first.regAddr, first.regAddrSize, &first.value, 1) != ReturnCode::ok) code = ReturnCode::error;
+
+						i++;
+						continue;
+					}
+
+					// Combine following reads of neighbouring registers
+					uint16_t endAddr = first.regAddr + first.length;
+					uint8_t j = i + 1;
+
+					for (; j < _numOperations && canMerge(first, endAddr, _operations[order[j]]); j++)
+					{
+						const Operation& next = _operations[order[j]];
+
+						if (next.regAddr + next.length > endAddr) endAddr = next.regAddr + next.length;
+					}
+
+					const uint8_t length = endAddr - first.regAddr;
+
+					if (dataLength + length > JAFDSettings::I2CMultiplexer::maxBatchData)
+					{
+						code = ReturnCode::error;
+					}
+					else if (AsyncI2C::queueRead(AsyncI2C::Bus::wire, first.i2cAddr, first.regAddr, first.regAddrSize, _readData + dataLength, length) == ReturnCode::ok)
+					{
+						groupStarts[numGroups] = i;
+						groupOffsets[numGroups] = dataLength;
+						numGroups++;
+
+						dataLength += length;
+					}
+					else
+					{
+						code = ReturnCode::error;
+					}
+
+					i = j;
+				}
+
+				groupStarts[numGroups] = _numOperations;
+
+				// Wait for the end of the batch
+				if (AsyncI2C::waitForBus(AsyncI2C::Bus::wire) != ReturnCode::ok)
+				{
+					code = ReturnCode::error;
+				}
+
+				// Distribute data to all combined operations
+				if (code == ReturnCode::ok)
+				{
+					for (uint8_t group = 0; group < numGroups; group++)
+					{
+						const Operation& first = _operations[order[groupStarts[group]]];
+
+						for (uint8_t k = groupStarts[group]; k < groupStarts[group + 1]; k++)
+						{
+							const Operation& operation = _operations[order[k]];
+
+							memcpy(operation.buffer, _readData + groupOffsets[group] + (operation.regAddr - first.regAddr), operation.length);
+						}
+					}
+				}
+
+				_numOperations = 0;
+
+				return code;
+			}
+		}
 	}
 }
\ No newline at end of file
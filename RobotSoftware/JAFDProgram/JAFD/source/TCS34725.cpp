@@ -1,6 +1,7 @@
 #include <Wire.h>
 
 #include "../header/TCS34725.h"
+#include "../header/DuePinMapping.h"
 #include "../../JAFDSettings.h"
 
 namespace JAFD
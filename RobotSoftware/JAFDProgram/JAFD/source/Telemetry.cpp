@@ -0,0 +1,298 @@
+/*
+This private file of the library is responsible for streaming binary telemetry records over SerialUSB
+*/
+
+#include "../../JAFDSettings.h"
+#include "../header/Telemetry.h"
+#include "../header/SmallThings.h"
+
+namespace JAFD
+{
+	namespace Telemetry
+	{
+		namespace
+		{
+			constexpr uint8_t headerSize = 8;											// Sync, version, type, length, timestamp
+			constexpr uint32_t bufferMask = JAFDSettings::Telemetry::bufferSize - 1;	// Index in buffer = position & bufferMask
+
+			static_assert((JAFDSettings::Telemetry::bufferSize & bufferMask) == 0, "Size of telemetry buffer has to be a power of two");
+			static_assert(JAFDSettings::Telemetry::maxDrainBytes >= headerSize + 0xff + 1 && JAFDSettings::Telemetry::maxDrainBytes <= JAFDSettings::Telemetry::bufferSize, "Maximum drained bytes must fit every record and the buffer");
+
+			// Payloads
+			struct __attribute__((packed)) StatusPayload
+			{
+				uint32_t dropped;
+				uint16_t used;
+			};
+
+			struct __attribute__((packed)) RobotStatePayload
+			{
+				float leftWheel;
+				float rightWheel;
+				float forwardVel;
+				float x;
+				float y;
+				float z;
+				float angularVel;
+				float globalHeading;
+				float pitch;
+			};
+
+			struct __attribute__((packed)) DistancesPayload
+			{
+				uint16_t distances[7];
+				uint8_t states[7];
+			};
+
+			struct __attribute__((packed)) PIDPayload
+			{
+				uint8_t id;
+				float setPoint;
+				float value;
+				float p;
+				float i;
+				float d;
+				float output;
+			};
+
+			struct __attribute__((packed)) TaskPayload
+			{
+				uint8_t event;
+				uint8_t type;
+				uint8_t index;
+			};
+
+			struct __attribute__((packed)) EventPayload
+			{
+				uint8_t event;
+				int32_t value;
+			};
+
+			struct __attribute__((packed)) FilterInputsPayload
+			{
+				uint32_t time;
+				float leftWheel;
+				float rightWheel;
+				float forwardX;
+				float forwardY;
+				float forwardZ;
+				float rotSpeed;
+				uint8_t freq;
+			};
+
+			struct __attribute__((packed)) MemoryPayload
+			{
+				uint32_t free;
+				uint32_t dynamic;
+				uint32_t staticRam;
+				uint32_t buffers;
+				uint32_t stackHighWater;
+				uint32_t interruptStack;
+			};
+
+			struct __attribute__((packed)) DistCalibPayload
+			{
+				uint8_t sensor;
+				uint8_t valid;
+				uint8_t points;
+				float k;
+				float d;
+				float rms;
+			};
+
+			// Ring buffer - bytes that don't belong to a committed record are 0, so a record is committed as soon as its sync byte is set
+			uint8_t _buffer[JAFDSettings::Telemetry::bufferSize];
+			volatile uint32_t _head = 0;		// Reserved bytes (by all producers)
+			volatile uint32_t _tail = 0;		// Sent bytes (by the main loop)
+			volatile uint32_t _dropped = 0;		// Records dropped because the buffer was full
+			uint32_t _reportedDropped = 0;		// Last value of _dropped sent in a status record
+
+			void atomicIncrement(volatile uint32_t& value)
+			{
+				uint32_t temp;
+
+				do
+				{
+					temp = __LDREXW(&value) + 1;
+				} while (__STREXW(temp, &value) != 0);
+			}
+
+			// Reserve space, fill it and commit the record
+			void write(const RecordType type, const void* payload, const uint8_t length)
+			{
+				const uint32_t size = headerSize + length + 1;
+				uint32_t start;
+
+				// Reserve - an interrupt between LDREX and STREX makes the STREX fail
+				do
+				{
+					start = __LDREXW(&_head);
+
+					if (start + size - _tail > JAFDSettings::Telemetry::bufferSize)
+					{
+						__CLREX();
+						atomicIncrement(_dropped);
+						return;
+					}
+				} while (__STREXW(start + size, &_head) != 0);
+
+				const uint32_t timestamp = millis();
+				const uint8_t header[headerSize] = { syncByte, version, static_cast<uint8_t>(type), length, static_cast<uint8_t>(timestamp), static_cast<uint8_t>(timestamp >> 8), static_cast<uint8_t>(timestamp >> 16), static_cast<uint8_t>(timestamp >> 24) };
+				const uint8_t* bytes = static_cast<const uint8_t*>(payload);
+				uint8_t checksum = 0;
+
+				for (uint8_t i = 1; i < headerSize; i++)
+				{
+					_buffer[(start + i) & bufferMask] = header[i];
+					checksum ^= header[i];
+				}
+
+				for (uint8_t i = 0; i < length; i++)
+				{
+					_buffer[(start + headerSize + i) & bufferMask] = bytes[i];
+					checksum ^= bytes[i];
+				}
+
+				_buffer[(start + headerSize + length) & bufferMask] = checksum;
+
+				// Commit - the sync byte has to be written last
+				__DMB();
+
+				_buffer[start & bufferMask] = syncByte;
+			}
+		}
+
+		ReturnCode setup()
+		{
+			SerialUSB.begin(0);
+
+			MemWatcher::addBuffer("telemetry", sizeof(_buffer));
+
+			return ReturnCode::ok;
+		}
+
+		void drain()
+		{
+			if (!SerialUSB) return;
+
+			// Find committed records - stop at the first record that is still written
+			const uint32_t start = _tail;
+			uint32_t end = start;
+
+			while (end != _head && _buffer[end & bufferMask] == syncByte)
+			{
+				__DMB();
+
+				const uint32_t size = headerSize + _buffer[(end + 3) & bufferMask] + 1;
+
+				if (end + size - start > JAFDSettings::Telemetry::maxDrainBytes) break;
+
+				end += size;
+			}
+
+			if (end != start)
+			{
+				// Send contiguous parts
+				const uint32_t first = start & bufferMask;
+				const uint32_t length = end - start;
+
+				if (first + length > JAFDSettings::Telemetry::bufferSize)
+				{
+					SerialUSB.write(&_buffer[first], JAFDSettings::Telemetry::bufferSize - first);
+					SerialUSB.write(_buffer, first + length - JAFDSettings::Telemetry::bufferSize);
+				}
+				else
+				{
+					SerialUSB.write(&_buffer[first], length);
+				}
+
+				// Clear sent bytes before releasing them
+				for (uint32_t i = start; i != end; i++) _buffer[i & bufferMask] = 0;
+
+				__DMB();
+
+				_tail = end;
+			}
+
+			// Report dropped records (after freeing space for the status record)
+			const uint32_t dropped = _dropped;
+
+			if (dropped != _reportedDropped)
+			{
+				_reportedDropped = dropped;
+
+				const StatusPayload status = { dropped, static_cast<uint16_t>(_head - _tail) };
+				write(RecordType::status, &status, sizeof(status));
+			}
+		}
+
+		void logRobotState(const RobotState& state)
+		{
+			const RobotStatePayload payload = { state.wheelSpeeds.left, state.wheelSpeeds.right, state.forwardVel, state.position.x, state.position.y, state.position.z, state.angularVel.x, state.globalHeading, state.pitch };
+
+			write(RecordType::robotState, &payload, sizeof(payload));
+		}
+
+		void logDistances(const Distances& distances, const DistSensorStates& states)
+		{
+			const DistancesPayload payload = {
+				{ distances.frontLeft, distances.frontRight, distances.frontLong, distances.leftFront, distances.leftBack, distances.rightFront, distances.rightBack },
+				{ static_cast<uint8_t>(states.frontLeft), static_cast<uint8_t>(states.frontRight), static_cast<uint8_t>(states.frontLong), static_cast<uint8_t>(states.leftFront), static_cast<uint8_t>(states.leftBack), static_cast<uint8_t>(states.rightFront), static_cast<uint8_t>(states.rightBack) }
+			};
+
+			write(RecordType::distances, &payload, sizeof(payload));
+		}
+
+		void logPID(const PIDID id, const float setPoint, const float value, const PIDTerms& terms, const float output)
+		{
+			const PIDPayload payload = { static_cast<uint8_t>(id), setPoint, value, terms.p, terms.i, terms.d, output };
+
+			write(RecordType::pid, &payload, sizeof(payload));
+		}
+
+		void logTask(const TaskEvent event, const TaskType type, const uint8_t index)
+		{
+			const TaskPayload payload = { static_cast<uint8_t>(event), static_cast<uint8_t>(type), index };
+
+			write(RecordType::task, &payload, sizeof(payload));
+		}
+
+		void logEvent(const Event event, const int32_t value)
+		{
+			const EventPayload payload = { static_cast<uint8_t>(event), value };
+
+			write(RecordType::event, &payload, sizeof(payload));
+		}
+
+		void logFilterInputs(const uint32_t time, const FloatWheelSpeeds& wheelSpeeds, const Vec3f& bnoForwardVec, const float bnoRotSpeed, const uint8_t freq)
+		{
+			const FilterInputsPayload payload = { time, wheelSpeeds.left, wheelSpeeds.right, bnoForwardVec.x, bnoForwardVec.y, bnoForwardVec.z, bnoRotSpeed, freq };
+
+			write(RecordType::filterInputs, &payload, sizeof(payload));
+		}
+
+		void logFusionTime(const uint32_t time)
+		{
+			write(RecordType::fusionTime, &time, sizeof(time));
+		}
+
+		void logMemory(const uint32_t free, const uint32_t dynamic, const uint32_t staticRam, const uint32_t buffers, const uint32_t stackHighWater, const uint32_t interruptStack)
+		{
+			const MemoryPayload payload = { free, dynamic, staticRam, buffers, stackHighWater, interruptStack };
+
+			write(RecordType::memory, &payload, sizeof(payload));
+		}
+
+		void logDistCalib(const uint8_t sensor, const bool valid, const uint8_t points, const float k, const float d, const float rms)
+		{
+			const DistCalibPayload payload = { sensor, static_cast<uint8_t>(valid), points, k, d, rms };
+
+			write(RecordType::distCalib, &payload, sizeof(payload));
+		}
+
+		uint32_t getDropped()
+		{
+			return _dropped;
+		}
+	}
+}
\ No newline at end of file
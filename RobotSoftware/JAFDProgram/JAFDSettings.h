@@ -53,8 +53,11 @@ namespace JAFDSettings
 	{
 		constexpr uint8_t ssPin = 39;
 		constexpr uint32_t mazeMappingStartAddr = 0;
-		constexpr uint32_t bno055StartAddr = mazeMappingStartAddr + 64 * 1024;
-		constexpr uint32_t distSensStartAddr = bno055StartAddr + 32;
+		constexpr uint32_t calibrationStartAddr = mazeMappingStartAddr + 64 * 1024;	// Two slots of the calibration block (see Calibration.h)
+		constexpr uint32_t checkpointStartAddr = calibrationStartAddr + 1024;		// Two slots of the checkpoint snapshot (see Checkpoint.h)
+
+		constexpr uint8_t dmaTxChannel = 0;		// DMA channel for sending
+		constexpr uint8_t dmaRxChannel = 1;		// DMA channel for receiving
 	}
 
 	namespace ColorSensor
@@ -66,6 +69,15 @@ namespace JAFDSettings
 
 	namespace CamRec
 	{
+		constexpr uint32_t baudRate = 1050000;			// 84 MHz / 16 / 5 - exact on the Due, the PL011 of the RasPI uses a fractional divider
+		constexpr uint16_t rxHalfBufferSize = 128;		// Size of each half of the PDC receive buffer
+		constexpr uint16_t handshakeTimeout = 1000;		// Time to wait for the ready frame after setup (ms)
+	}
+
+	namespace Bno055
+	{
+		constexpr uint16_t bootTimeout = 1000;			// Maximum boot time after power on or reset (ms)
+		constexpr uint16_t fusionTimeout = 500;			// Maximum time until the fusion delivers the first orientation (ms)
 	}
 
 	namespace MotorControl
@@ -77,15 +89,34 @@ namespace JAFDSettings
 		constexpr float maxRotSpeed = 2.0f * maxSpeed / Mechanics::wheelDistance;	// Calculated maximum rotation speed
 
 		constexpr float pulsePerRev = 4741.44f / 4.0f;	// Rotary-Encoder pulses per revolution
+		constexpr uint8_t qdecFilter = 20;				// Glitch filter of the quadrature decoders (pulses shorter than qdecFilter + 1 MCK cycles are ignored)
 
-		constexpr uint8_t currentADCSampleCount = 2;		// How often to sample and average the ADC measurement for the current
+		constexpr uint8_t adcPrescaler = 20;				// ADC clock = MCK / ((adcPrescaler + 1) * 2) = 2 MHz - one half of the DMA buffer every ~2 ms
+		constexpr uint8_t adcAveragedSequences = 32;		// Conversions of every feedback channel in one half of the DMA buffer (averaged)
+		constexpr uint16_t adcTimeout = 20;				// Maximum time until the first half is averaged (ms)
 		constexpr float currentSensFactor = 1.0f / 0.14f;	// 140mv/A
 		
 		constexpr float voltageSensFactor = 2.585f;			// "Real Voltage" / "Measured Voltage" for voltage feedback
+		constexpr float motorVoltage = 6.0f;				// Nominal voltage of the motors - reference of the PWM reduction and the feedforward (V)
 
 		constexpr float initPWMReduction = 0.71f;			// Starting with this reduction of the pwm to prevent overvoltage
 		constexpr float pwmRedIIRFactor = 0.5f;				// IIR factor for PWM reduction value
 
+		constexpr bool fixedPointControl = true;			// Speed calculation and PID-Loop in Q16.16 instead of float (see Fixed.h)
+
+		// Identification of the feedforward tables (characterize())
+		namespace Characterization
+		{
+			constexpr uint8_t numSteps = 8;				// Number of PWM steps
+			constexpr float minDuty = 0.15f;			// PWM duty cycle of the first step
+			constexpr float maxDuty = 0.8f;				// PWM duty cycle of the last step
+			constexpr uint16_t settleTime = 300;		// Time until the speed is steady (ms)
+			constexpr uint16_t sampleTime = 200;		// Sampling time in each direction (ms)
+			constexpr uint16_t sampleInterval = 10;		// Time between two samples - one speed update (ms)
+			constexpr uint16_t pauseTime = 300;			// Stop between the directions (ms)
+			constexpr float minSpeed = 2.0f;			// Steps with a lower speed are ignored, the motor didn't turn (cm/s)
+		}
+
 		namespace Left
 		{
 			constexpr uint8_t pwmPin = 43;			// PWM pin left motor
@@ -96,6 +127,7 @@ namespace JAFDSettings
 			constexpr uint8_t voltFbPinB = A3;		// Voltage feedback output left motor / B
 			constexpr uint8_t encA = 4;				// Encoder Pin A
 			constexpr uint8_t encB = 5;				// Encoder Pin B
+			constexpr bool useQDEC = true;			// Count with the quadrature decoder of the timer counter? (Encoder pins have to be TIOA / TIOB of TC0 or TC6)
 		}
 
 		namespace Right
@@ -108,6 +140,7 @@ namespace JAFDSettings
 			constexpr uint8_t voltFbPinB = A5;		// Voltage feedback output left motor / b
 			constexpr uint8_t encA = 6;				// Encoder Pin A
 			constexpr uint8_t encB = 9;				// Encoder Pin B
+			constexpr bool useQDEC = false;			// Count with the quadrature decoder of the timer counter? (Encoder pins have to be TIOA / TIOB of TC0 or TC6)
 		}
 	}
 
@@ -116,29 +149,57 @@ namespace JAFDSettings
 		// Maze
 		constexpr float maxPitchForDistSensor = DEG_TO_RAD * 10.0f;		// Maximum pitch of robot for correct front distance measurements
 		constexpr uint16_t minDeltaDistForEdge = 30;					// Minimum change in distance that corresponds to an edge (in mm)
+		constexpr float minRampPitch = DEG_TO_RAD * 15.0f;				// Minimum pitch of robot on a ramp
+		constexpr float maxLevelPitch = DEG_TO_RAD * 5.0f;				// Maximum pitch of robot at the end of a ramp
 
-		// Distance & Speed
-		constexpr float distSensSpeedIIRFactor = 0.8f;					// Factor used for IIR-Filter for speed measured by distance sensors
+		// Distance
 		constexpr float longDistSensIIRFactor = 0.8f;					// Factor used for IIR-Filter for high range distance measurements
 		constexpr float shortDistSensIIRFactor = 0.8f;					// Factor used for IIR-Filter for short range distance measurements
-		constexpr float distSpeedPortion = 0.2f;						// How much is a perfect distance sensor measured speed worth?
-
-		// Position
-		constexpr float distSensOffsetPortion = 1.0f;					// How much does the center-offset measured by all distance sensors count?
 
 		// Rotation
-		constexpr float bno055RotPortion = 0.1f;						// How much is a Bno055 rotation measurement worth?
-		constexpr float angularVelIIRFactor = 0.9f;						// Factor used for IIR-Filter for angular velocity
-		constexpr float angularVelDiffPortion = 0.5f;					// How much of the angular yaw velocity is based on differentiation?
 		constexpr float pitchIIRFactor = 0.5f;							// Factor used for IIR-Filter for pitch angle
-		constexpr float distAngularPortion = 1.0f;						// How much is a perfect distance sensor measured angle worth?
+
+		// Pose history
+		constexpr uint8_t poseHistorySize = 16;							// Number of stored poses (one per call of sensorFiltering() - 800 ms at 20 Hz)
+	}
+
+	namespace PoseEKF
+	{
+		// Process noise (standard deviation per sqrt(s))
+		constexpr float posNoise = 0.5f;								// Position (cm) - e.g. wheels slipping sideways
+		constexpr float headingNoise = DEG_TO_RAD * 0.5f;				// Heading (rad)
+		constexpr float velNoise = 40.0f;								// Forward velocity (cm/s) - acceleration unknown to the model
+		constexpr float angularVelNoise = 4.0f;							// Angular velocity (rad/s) - angular acceleration unknown to the model
+
+		// Measurement noise (standard deviation)
+		constexpr float wheelVelNoise = 2.0f;							// Forward velocity measured by the encoders (cm/s)
+		constexpr float wheelAngularVelNoise = 0.15f;					// Angular velocity measured by the encoders (rad/s)
+		constexpr float bnoHeadingNoise = DEG_TO_RAD * 3.0f;			// Heading measured by the Bno055 (rad)
+		constexpr float distSensAngleNoise = DEG_TO_RAD * 2.0f;		// Heading measured by distance sensors with full trust (rad)
+		constexpr float distSensSpeedNoise = 8.0f;						// Speed measured by distance sensors with full trust (cm/s)
+		constexpr float distSensOffsetNoise = 1.0f;					// Position measured by distance sensors with full trust (cm)
+
+		// Uncertainty (standard deviation) of a certain robot position
+		constexpr float initialPosNoise = 0.5f;							// Position (cm)
+		constexpr float initialHeadingNoise = DEG_TO_RAD * 1.0f;		// Heading (rad)
+		constexpr float initialVelNoise = 5.0f;							// Forward velocity (cm/s)
+		constexpr float initialAngularVelNoise = 0.2f;					// Angular velocity (rad/s)
+
+		constexpr float outlierGate = 16.0f;							// Reject measurements with a squared normalized innovation above this (4 sigma)
+		constexpr float minTrust = 0.01f;								// Measurements by distance sensors with less trust are ignored
 	}
 
 	namespace Controller
 	{
 		namespace Motor
 		{
-			constexpr JAFD::PIDSettings pidSettings(0.85f, 5.2f, 0.01f, 1.0f / MotorControl::cmPSToPerc, 0.5f / MotorControl::cmPSToPerc, -1.0f / MotorControl::cmPSToPerc, 1.0f / MotorControl::cmPSToPerc);
+			constexpr JAFD::PIDSettings pidSettings(0.85f, 5.2f, 0.01f, 1.0f / MotorControl::cmPSToPerc, 0.5f / MotorControl::cmPSToPerc, -1.0f / MotorControl::cmPSToPerc, 1.0f / MotorControl::cmPSToPerc);	// Without feedforward tables
+
+			// With feedforward tables the PID only corrects the rest - the gains are scheduled by the desired speed (linear between the two speeds, limits of ffPidSettingsLow)
+			constexpr float scheduleLowSpeed = 15.0f;		// Gains of ffPidSettingsLow up to this speed (cm/s)
+			constexpr float scheduleHighSpeed = 30.0f;		// Gains of ffPidSettingsHigh from this speed (cm/s)
+			constexpr JAFD::PIDSettings ffPidSettingsLow(0.6f, 4.0f, 0.01f, 0.3f / MotorControl::cmPSToPerc, 0.5f / MotorControl::cmPSToPerc, -0.5f / MotorControl::cmPSToPerc, 0.5f / MotorControl::cmPSToPerc);
+			constexpr JAFD::PIDSettings ffPidSettingsHigh(0.35f, 2.0f, 0.01f, 0.3f / MotorControl::cmPSToPerc, 0.5f / MotorControl::cmPSToPerc, -0.5f / MotorControl::cmPSToPerc, 0.5f / MotorControl::cmPSToPerc);
 		}
 
 		namespace GoToAngle
@@ -162,17 +223,53 @@ namespace JAFDSettings
 
 	namespace SmoothDriving
 	{
-		constexpr uint8_t maxArrrayedTasks = 5;						// Maximum number of tasks in TaskArray
+		constexpr uint8_t maxArrrayedTasks = 16;					// Maximum number of tasks in TaskArray
 		constexpr uint16_t maxAlignDistError = 10;					// Maximum deviation from perfect aligned distance (mm)
 		constexpr uint16_t maxAlignStartDist = 50;					// Maximum deviation from aligned distance at beginning to start (mm)
 		constexpr uint16_t alignSpeed = MotorControl::minSpeed;		// Minimum speed to align to wall
 		constexpr uint16_t minAlignDist = 70;						// Minimum align distance, is default
+		constexpr float maxAcc = 30.0f;								// Maximum linear acceleration (cm/s^2)
+		constexpr float maxJerk = 150.0f;							// Maximum linear jerk (cm/s^3)
+		constexpr float maxAngularAcc = 5.0f;						// Maximum angular acceleration (rad/s^2)
+		constexpr float maxAngularJerk = 30.0f;						// Maximum angular jerk (rad/s^3)
+		constexpr uint8_t maxPathLength = 16;						// Maximum number of cells in FollowPath
+		constexpr float pathSpeed = 30.0f;							// Cruise speed of FollowPath (cm/s)
+		constexpr float pathTurnSpeed = 2.0f;						// Angular velocity of turns on the spot in FollowPath (rad/s)
+		constexpr float maxLateralAcc = 40.0f;						// Maximum lateral acceleration in arcs (cm/s^2)
+		constexpr float headingGain = 2.0f;							// Angular velocity per heading error in FollowPath (1/s)
+		constexpr float crossTrackGain = 0.01f;					// Angular velocity per cross track error and speed in FollowPath (rad/cm^2)
+
+		// Slots of the static task pool shared by all TaskArrays
+		namespace TaskPool
+		{
+			constexpr uint8_t accelerateSlots = 8;
+			constexpr uint8_t straightSlots = 4;
+			constexpr uint8_t stopSlots = 8;
+			constexpr uint8_t rotateSlots = 4;
+			constexpr uint8_t forceSpeedSlots = 2;
+			constexpr uint8_t alignFrontSlots = 2;
+		}
+	}
+
+	namespace MotionProfile
+	{
+		constexpr uint8_t tableSize = 32;			// Number of speeds stored per profile
+		constexpr uint16_t integrationSteps = 256;	// Time steps to sample a profile while planning (setNewTask plans in the main loop; the 20 Hz interrupt replans the next TaskArray task and late FollowPath segments)
 	}
 
 	namespace Dispenser
 	{
 		constexpr uint32_t pause = 700;		// How long is the piston extended in ms?
 
+		// Rescue kits per victim
+		constexpr uint8_t harmedKits = 2;
+		constexpr uint8_t stableKits = 1;
+		constexpr uint8_t unharmedKits = 0;
+		constexpr uint8_t redKits = 1;
+		constexpr uint8_t yellowKits = 1;
+		constexpr uint8_t greenKits = 0;
+		constexpr uint8_t heatKits = 1;
+
 		namespace Left
 		{
 			constexpr float startDty = 0.03f;	// duty cylce for start
@@ -194,16 +291,72 @@ namespace JAFDSettings
 	{
 		constexpr float distLongerThanBorder = 7.0f;		// Distance longer than border from which next field is empty (cm)
 		constexpr float widthSecureDetectFactor = 0.85f;	// Factor of cell width in which border the distance measurement safely hits the front wall	
+
+		// Costs are roughly the needed time in 0.1s
+		namespace PathPlanner
+		{
+			constexpr uint16_t straightCost = 20;		// Driving one cell straight
+			constexpr uint16_t turn90Cost = 15;			// Additional cost for a 90 degree turn
+			constexpr uint16_t turn180Cost = 25;		// Additional cost for a 180 degree turn
+			constexpr uint16_t rampCost = 30;			// Additional cost for a ramp
+			constexpr uint16_t bumpCost = 10;			// Additional cost for a speed bump
+			constexpr uint16_t openListSize = 256;		// Maximum size of the open list
+		}
+
+		namespace VictimEvidence
+		{
+			constexpr uint8_t tableSize = 64;						// Number of walls with victim evidence
+			constexpr float maxAngleError = DEG_TO_RAD * 25.0f;		// Maximum angle between sensor and wall normal
+			constexpr float maxWallDist = Field::cellWidth;			// Maximum distance from the robot middle to the wall (cm)
+			constexpr uint8_t minVisualFrames = 3;					// Minimum number of camera frames for a decision
+			constexpr float minVisualProb = 0.6f;					// Minimum average camera weight of a victim class
+			constexpr uint8_t minHeatReadings = 3;					// Minimum number of heat readings for a decision
+			constexpr float minHeatProb = 0.5f;						// Minimum share of heat readings above the threshold
+		}
+
+		namespace IncrementalPlanner
+		{
+			constexpr uint8_t costUnit = 10;			// PathPlanner costs are stored in multiples of this (one byte per cell)
+			constexpr uint16_t openListSize = 256;		// Maximum size of the open list
+		}
+
+		namespace Exploration
+		{
+			constexpr uint8_t maxFrontiers = 128;		// Maximum number of frontier cells in the list (dropped ones are found again when there is space)
+			constexpr uint8_t maxPathLength = 64;		// Maximum length of the path planned ahead
+		}
 	}
 
 	namespace DistanceSensors
 	{
 		constexpr uint16_t minCalibDataDiff = 20;		// Minimum difference in calibration data
-		constexpr uint8_t bytesPerCalibData = 8;
 
 		constexpr uint8_t multiplexerAddr = 0x70;
 
-		constexpr uint16_t timeout = 200;
+		constexpr uint16_t timeout = 200;				// Timeout for distance measurements (ms)
+		constexpr uint16_t restartDelay = 100;			// Break between stopping and starting a hanging sensor (ms)
+		constexpr uint16_t readyTimeout = 100;			// Maximum wait for a VL6180 to be ready after stopping the ranging (ms)
+		constexpr uint16_t sampleBufferSize = 32;		// Number of timestamped samples which can be buffered (power of two)
+
+		// Automated calibration of the short sensors - the robot starts in the middle of a dead end, facing the front wall
+		namespace AutoCalibration
+		{
+			constexpr float firstOffset = 4.0f;			// First position forward from the middle of the cell (cm)
+			constexpr float offsetStep = 4.0f;			// Steps backward to the next position (cm)
+			constexpr uint8_t numOffsets = 8;			// Number of positions
+			constexpr float angleStep = 12.0f;			// Steps of the rotations in the middle of the cell (deg)
+			constexpr uint8_t numAngles = 2;			// Number of rotations to each side
+			constexpr int16_t speed = 10;				// Speed between the positions (cm/s)
+			constexpr float angularVel = 1.0f;			// Angular velocity of the rotations (rad/s)
+			constexpr uint16_t settleTime = 300;		// Time to wait after a movement (ms)
+			constexpr uint16_t sampleTime = 500;		// Sampling time at every pose (ms)
+			constexpr uint8_t minSamples = 5;			// Minimum number of valid samples of a sensor at one pose
+			constexpr uint8_t minPoints = 4;			// Minimum number of poses for the fit of a sensor
+			constexpr float maxIncidence = 30.0f;		// Maximum angle between measurement and normal of the wall (deg)
+			constexpr float wallMargin = 3.0f;			// Minimum distance of the hit point to the end of a wall (cm)
+			constexpr float minK = 0.5f;				// Range of the fitted scale - outside the sensor keeps its old calibration
+			constexpr float maxK = 1.5f;
+		}
 
 		namespace LeftFront
 		{
@@ -241,6 +394,77 @@ namespace JAFDSettings
 		}
 	}
 
+	namespace I2CMultiplexer
+	{
+		constexpr uint8_t maxBatchSize = 32;		// Maximum number of queued register operations
+		constexpr uint8_t maxMergeGap = 24;			// Maximum number of unused bytes between two registers that are read in one transaction
+		constexpr uint8_t maxMergeLength = 32;		// Maximum number of bytes in one read transaction
+		constexpr uint16_t maxBatchData = 256;		// Maximum number of bytes read in one batch
+	}
+
+	namespace AsyncI2C
+	{
+		constexpr uint16_t queueSize = 64;			// Maximum number of queued transactions per bus (power of two)
+		constexpr uint32_t clock = 100000;			// Clock of both buses (Hz) - the default of Wire
+		constexpr uint16_t timeoutMargin = 10;		// Time a transaction may take longer than its transfer time until the bus gets reset (ms) - clock stretching of the Bno055
+
+		// The timeout runs per transaction: the longest one (3 byte register address, 255 bytes read) needs 260 bytes * 9 clocks / 100 kHz = 24 ms + margin
+	}
+
+	namespace Scheduler
+	{
+		constexpr uint8_t maxJobsPerPriority = 8;	// Maximum number of jobs per priority
+		constexpr uint16_t highFreq = 1000;			// Base frequency of high priority jobs (Hz)
+		constexpr uint16_t mediumFreq = 100;		// Base frequency of medium priority jobs (Hz)
+		constexpr uint16_t lowFreq = 20;			// Base frequency of low priority jobs (Hz)
+	}
+
+	namespace Profiler
+	{
+		constexpr uint8_t maxSections = 24;			// Maximum number of measured sections
+	}
+
+	namespace MemWatcher
+	{
+		constexpr uint8_t maxBuffers = 16;			// Maximum number of accounted static buffers
+		constexpr uint32_t reportInterval = 1000;	// Time between two memory records of the telemetry (ms)
+		constexpr uint16_t paintMargin = 256;		// Unpainted bytes below the stack pointer of paintStack()
+	}
+
+	namespace MazeSim
+	{
+		constexpr uint8_t maxSize = 16;				// Maximum width and height of a simulated maze (cells)
+		constexpr uint8_t minSize = 6;				// Minimum width and height in the corpus (cells)
+		constexpr uint8_t corpusSize = 12;			// Number of mazes in the benchmark
+		constexpr uint32_t corpusSeed = 69420;		// Seed of the first maze - the others follow
+		constexpr uint8_t loopShare = 15;			// Share of removed extra walls, so the maze has loops (%)
+		constexpr uint8_t blackTileShare = 4;		// Share of black tiles (%)
+		constexpr uint8_t bumpShare = 6;			// Share of speed bumps (%)
+	}
+
+	namespace RobotSim
+	{
+		constexpr uint8_t jobFreq = 20;				// Frequency of sensorFiltering() and updateSpeeds() like on the robot (Hz)
+		constexpr uint32_t maxTaskTime = 30000;		// Simulated time until a task has to be finished (ms)
+		constexpr float maxPosError = 3.0f;			// Maximum distance of the fused end position to the planned one (cm)
+		constexpr float maxHeadingError = 10.0f * DEG_TO_RAD;	// Maximum error of the fused end heading (rad) - FollowPath stops without turning onto the exact grid heading
+		constexpr float maxFusionError = 5.0f;		// Maximum distance of the fused position to the simulated one while driving through the corridor (cm)
+		constexpr uint8_t corridorCells = 4;		// Length of the corridor of the fusion benchmark (cells)
+		constexpr uint16_t maxSensorRange = 1200;	// Longer distances are reported as overflow (mm)
+	}
+
+	namespace Replay
+	{
+		constexpr float maxStateDifference = 1e-4f;	// Maximum difference of a replayed robot state value to the recorded one (JAFDBench replay)
+	}
+
+	namespace Telemetry
+	{
+		constexpr uint16_t bufferSize = 4096;		// Size of the record ring buffer (power of two)
+		constexpr uint16_t maxDrainBytes = 512;		// Maximum bytes sent per call of Telemetry::drain()
+		constexpr uint8_t pidLogDivider = 10;		// Only every n-th tick of the 100 Hz speed PID logs its terms (0 = off)
+	}
+
 	namespace I2CBus
 	{
 		constexpr uint8_t powerResetPin = 38;
@@ -265,7 +489,16 @@ namespace JAFDSettings
 	{
 		constexpr uint8_t averagingNumber = 5;
 
-		constexpr float threshold = 10.0f;
+		constexpr float threshold = 10.0f;			// Difference to the ambient temperature for a victim (confidence 0.5)
+		constexpr float confidenceBand = 4.0f;		// Difference to the threshold for a confidence of 0 or 1
+		constexpr uint16_t sampleInterval = 100;	// Time between two readings (ms)
+		constexpr float ambientAlpha = 0.05f;		// Weight of a new reading in the rolling ambient estimate
+		constexpr uint8_t topPixels = 2;			// Number of hottest pixels that are averaged (TPA81)
+		constexpr uint8_t minBlobSize = 2;			// Minimum number of connected hot pixels (AMG8833)
+
+#ifndef USE_AMG8833
+		constexpr uint8_t i2cAddr = 0x68;			// Same address for both TPA81 - they are separated by the multiplexer
+#endif
 
 		namespace Left
 		{
@@ -0,0 +1,137 @@
+import struct
+import sys
+
+import serial
+
+# Must match Telemetry.h
+SYNC_BYTE = 0xA5
+VERSION = 1
+HEADER_SIZE = 8
+
+RECORD_TYPES = {
+    0: ("status", "<IH", ("dropped", "used")),
+    1: ("robotState", "<9f", ("left_wheel", "right_wheel", "forward_vel", "x", "y", "z", "angular_vel", "global_heading", "pitch")),
+    2: ("distances", "<7H7B", ("front_left", "front_right", "front_long", "left_front", "left_back", "right_front", "right_back",
+                               "front_left_state", "front_right_state", "front_long_state", "left_front_state", "left_back_state", "right_front_state", "right_back_state")),
+    3: ("pid", "<B6f", ("id", "set_point", "value", "p", "i", "d", "output")),
+    4: ("task", "<3B", ("event", "type", "index")),
+    5: ("event", "<Bi", ("event", "value")),
+    6: ("filterInputs", "<I6fB", ("time", "left_wheel", "right_wheel", "forward_x", "forward_y", "forward_z", "rot_speed", "freq")),
+    7: ("fusionTime", "<I", ("time",)),
+    8: ("memory", "<6I", ("free", "dynamic", "static", "buffers", "stack_high_water", "interrupt_stack")),
+    9: ("distCalib", "<3B3f", ("sensor", "valid", "points", "k", "d", "rms")),
+}
+
+PID_IDS = ("leftMotor", "rightMotor")
+TASK_TYPES = ("accelerate", "straight", "stop", "rotate", "forceSpeed", "alignFront", "taskArray", "followPath")
+TASK_EVENTS = ("started", "finished", "subTaskStarted")
+EVENTS = ("distSensorTimeout", "distSensorI2CError", "i2cTimeout", "distSensorStalled",
+          "distSensorSetupError", "distCalibAborted", "floorChanged", "rampNotStored",
+          "dispenserTurnFailed", "segmentPlannedLate")
+DIST_SENSOR_STATES = ("ok", "overflow", "underflow", "error")
+
+def name_of(names, value):
+    return names[value] if value < len(names) else str(value)
+
+def decode_payload(record_type, payload):
+    if record_type not in RECORD_TYPES:
+        return "unknown" + str(record_type), {"raw": payload.hex()}
+
+    name, fmt, fields = RECORD_TYPES[record_type]
+
+    if struct.calcsize(fmt) != len(payload):
+        return name, {"raw": payload.hex()}
+
+    values = dict(zip(fields, struct.unpack(fmt, payload)))
+
+    if name == "pid":
+        values["id"] = name_of(PID_IDS, values["id"])
+    elif name == "task":
+        values["event"] = name_of(TASK_EVENTS, values["event"])
+        values["type"] = name_of(TASK_TYPES, values["type"])
+    elif name == "event":
+        values["event"] = name_of(EVENTS, values["event"])
+    elif name == "distances":
+        for field in fields[7:]:
+            values[field] = name_of(DIST_SENSOR_STATES, values[field])
+
+    return name, values
+
+class Decoder:
+    def __init__(self):
+        self.buffer = bytearray()
+        self.bad_records = 0
+
+    # Feed received bytes, returns list of (timestamp, name, values)
+    def feed(self, data):
+        return [(timestamp, *decode_payload(record_type, payload)) for record_type, timestamp, payload, _ in self.feed_raw(data)]
+
+    # Feed received bytes, returns list of (record type, timestamp, payload, whole record) - for forwarding records unchanged
+    def feed_raw(self, data):
+        self.buffer += data
+        records = []
+
+        while True:
+            start = self.buffer.find(SYNC_BYTE)
+
+            if start < 0:
+                self.buffer.clear()
+                break
+
+            del self.buffer[:start]
+
+            if len(self.buffer) < HEADER_SIZE:
+                break
+
+            version, record_type, length, timestamp = struct.unpack_from("<BBBI", self.buffer, 1)
+            size = HEADER_SIZE + length + 1
+
+            if len(self.buffer) < size:
+                break
+
+            checksum = 0
+
+            for byte in self.buffer[1:size - 1]:
+                checksum ^= byte
+
+            # Resynchronize at the next sync byte
+            if version != VERSION or checksum != self.buffer[size - 1]:
+                self.bad_records += 1
+                del self.buffer[:1]
+                continue
+
+            records.append((record_type, timestamp, bytes(self.buffer[HEADER_SIZE:size - 1]), bytes(self.buffer[:size])))
+
+            del self.buffer[:size]
+
+        return records
+
+def format_record(timestamp, name, values):
+    return "{:10d} {:12s} ".format(timestamp, name) + " ".join("{}={:.3f}".format(k, v) if isinstance(v, float) else "{}={}".format(k, v) for k, v in values.items())
+
+# Usage: decode.py <serial port | recorded file> [filter record name]
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        print("Usage: decode.py <port or file> [record name]")
+        sys.exit(1)
+
+    filter_name = sys.argv[2] if len(sys.argv) > 2 else None
+    decoder = Decoder()
+
+    if sys.argv[1].startswith("/dev/") or sys.argv[1].startswith("COM"):
+        source = serial.Serial(sys.argv[1], 115200, timeout=0.1)
+    else:
+        source = open(sys.argv[1], "rb")
+
+    while True:
+        data = source.read(4096)
+
+        if not data and not isinstance(source, serial.Serial):
+            break
+
+        for record in decoder.feed(data):
+            if filter_name is None or record[1] == filter_name:
+                print(format_record(*record))
+
+    if decoder.bad_records > 0:
+        print("Bad records:", decoder.bad_records)